@@ -0,0 +1,107 @@
+// moves a share of 10,000 instances (or however many are asked for) a little every frame, for a run of frames, and
+// compares fitting the tree over them by refitting it against building it again, in the time each frame's update
+// takes and the rays a second traced through the scene after the last frame, since a refit tree is never as good as
+// a freshly built one - scene::apply chooses between the two, and how that does is shown alongside
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "helper.h"
+
+#include "scene.h"
+
+#include "bench_common.h"
+
+static scene cube_field(int count, double half_size){
+    scene world{};
+    sampler s(3);
+    const int mat = world.add_material<lambertian>(colour(0.5, 0.5, 0.5));
+    triangle_mesh cube{};
+    for(int v = 0; v < 8; v++) cube.add_vertex(point3(v & 1 ? 0.5 : -0.5, v & 2 ? 0.5 : -0.5, v & 4 ? 0.5 : -0.5));
+    const int faces[6][4] = { {0, 4, 6, 2}, {1, 3, 7, 5}, {0, 1, 5, 4}, {2, 6, 7, 3}, {0, 2, 3, 1}, {4, 5, 7, 6} };
+    for(const auto &f : faces){
+        cube.add_triangle(f[0], f[1], f[2]);
+        cube.add_triangle(f[0], f[2], f[3]);
+    }
+    const int mesh = world.add_mesh(std::move(cube));
+    for(int i = 0; i < count; i++)
+        world.add_instance(mesh, transform::translate(vec3::random(s, -half_size, half_size)), mat);
+    world.build();
+    return world;
+}
+
+// frame's update, moving every instance in moving a step along its own direction
+static frame_update step(const scene &world, const std::vector<int> &moving, const std::vector<vec3> &velocity,
+                         int frame){
+    frame_update update{};
+    update.frame = frame;
+    for(size_t k = 0; k < moving.size(); k++){
+        const transform to_world = transform::translate(velocity[k]) * world.instances[moving[k]].to_world();
+        transform to_object{};
+        to_world.inverse(to_object);
+        update.instances.push_back(moving[k]);
+        update.to_world.push_back(to_world);
+        update.to_object.push_back(to_object);
+    }
+    return update;
+}
+
+static double trace(const scene &world, const std::vector<ray> &rays){
+    auto start = bench_clock::now();
+    int hits = 0;
+    for(const ray &r : rays){
+        hit_record rec{};
+        if(world.hit(r, 0.001, infinity, rec)) hits++;
+    }
+    return rays.size() / seconds_since(start) / 1e6;
+}
+
+int main(int argc, char **argv){
+    const int count = argc > 1 ? std::atoi(argv[1]) : 10000;
+    const int frames = argc > 2 ? std::atoi(argv[2]) : 60;
+    const double half_size = 2 * std::cbrt(static_cast<double>(count));
+
+    sampler s(4);
+    const std::vector<ray> rays = random_rays(200000, half_size, s);
+
+    std::printf("%d instances, %d frames\n%-10s %14s %14s %14s %14s %14s   %s\n", count, frames, "moving",
+                "refit ms", "rebuild ms", "refit Mrays/s", "built Mrays/s", "apply Mrays/s",
+                "apply chose (none/refit/rebuild)");
+    for(double share : { 0.001, 0.01, 0.1, 0.5 }){
+        scene refit_world = cube_field(count, half_size);
+        scene rebuild_world = cube_field(count, half_size);
+        scene chosen_world = cube_field(count, half_size);
+
+        std::vector<int> moving{};
+        std::vector<vec3> velocity{};
+        for(int i = 0; i < count; i++){
+            if(random_double(s) >= share) continue;
+            moving.push_back(i);
+            velocity.push_back(vec3::random(s, -0.2, 0.2));
+        }
+
+        double refit_seconds = 0, rebuild_seconds = 0;
+        int choices[3] = {};
+        for(int frame = 0; frame < frames; frame++){
+            const frame_update update = step(refit_world, moving, velocity, frame);
+
+            // the first two are made to refit or rebuild every frame
+            auto start = bench_clock::now();
+            refit_world.apply(update, tree_update::refit);
+            refit_seconds += seconds_since(start);
+
+            start = bench_clock::now();
+            rebuild_world.apply(update, tree_update::rebuild);
+            rebuild_seconds += seconds_since(start);
+
+            choices[static_cast<int>(chosen_world.apply(update))]++;
+        }
+
+        char label[32];
+        std::snprintf(label, sizeof(label), "%zu", moving.size());
+        std::printf("%-10s %14.4f %14.4f %14.3f %14.3f %14.3f   %d/%d/%d\n", label, 1000 * refit_seconds / frames,
+                    1000 * rebuild_seconds / frames, trace(refit_world, rays), trace(rebuild_world, rays),
+                    trace(chosen_world, rays), choices[0], choices[1], choices[2]);
+    }
+}
@@ -0,0 +1,126 @@
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include "helper.h"
+
+#include "camera.h"
+#include "framebuffer.h"
+#include "integrator.h"
+#include "material.h"
+#include "render.h"
+#include "scene.h"
+
+using bench_clock = std::chrono::steady_clock;
+
+inline double seconds_since(bench_clock::time_point start){
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+// the most memory the process has had resident so far
+inline double peak_rss_mb(){
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0; // reported in kilobytes on linux
+}
+
+inline double file_size_mb(const std::string &path){
+    struct stat info{};
+    return stat(path.c_str(), &info) == 0 ? info.st_size / (1024.0 * 1024.0) : 0;
+}
+
+struct bench_sphere {
+    point3 center{};
+    double radius{};
+};
+
+// spheres scattered through a cube which grows with the count, so the density (and so the number of spheres near
+// any one ray) stays about the same at every size, half_size is set to half the cube's side
+inline std::vector<bench_sphere> random_spheres(int count, sampler &s, double &half_size){
+    half_size = std::cbrt(static_cast<double>(count));
+
+    std::vector<bench_sphere> spheres(count);
+    for(auto &sph : spheres){
+        sph.center = vec3::random(s, -half_size, half_size);
+        sph.radius = random_double(s, 0.05, 0.25);
+    }
+    return spheres;
+}
+
+// rays from random points on a shell around the cube, aimed at random points inside it
+inline std::vector<ray> random_rays(int count, double half_size, sampler &s){
+    std::vector<ray> rays{};
+    rays.reserve(count);
+    for(int i = 0; i < count; i++){
+        point3 origin = 3 * half_size * random_unit_vector(s);
+        point3 target = vec3::random(s, -half_size, half_size);
+        rays.emplace_back(origin, target - origin);
+    }
+    return rays;
+}
+
+// the demo scene's layout, a field of count small spheres of every material on a big ground sphere, spread over a
+// square patch of ground which grows with the count, so the density stays about the same, and a camera looking
+// across it
+inline scene random_scene(int count){
+    scene world{};
+    sampler s(static_cast<uint64_t>(count));
+    const int ground = world.add_material<lambertian>(colour(0.5, 0.5, 0.5));
+    world.spheres.add(point3(0, -1000, 0), 1000, ground);
+
+    const double half_size = std::sqrt(static_cast<double>(count)) * 0.5;
+    for(int i = 0; i < count; i++){
+        int mat;
+        const double choice = random_double(s);
+        if(choice < 0.6){
+            mat = world.add_material<lambertian>(vec3::random(s));
+        }else if(choice < 0.9){
+            const colour albedo = vec3::random(s, 0.5, 1);
+            mat = world.add_material<metal>(albedo, random_double(s, 0, 0.3));
+        }else{
+            mat = world.add_material<dielectric>(1.5);
+        }
+
+        const double radius = random_double(s, 0.1, 0.3);
+        const double x = random_double(s, -half_size, half_size);
+        world.spheres.add(point3(x, radius, random_double(s, -half_size, half_size)), radius, mat);
+    }
+    world.build();
+
+    world.view.look_from = point3(0, 3, half_size + 3);
+    world.view.look_at = point3(0, 0, 0);
+    world.view.vertical_fov = 40;
+    return world;
+}
+
+// renders the scene's frame as settings has it into fb, as the renderer does but sampling the lights only if asked,
+// returning how long it took
+inline double render_frame(const scene &world, const render_settings &settings, framebuffer &fb,
+                           bool sample_lights = false){
+    camera cam(world.view, static_cast<double>(settings.width) / settings.height);
+    path_integrator integrator(world.frame.max_depth, 3, sample_lights ? &world.lights : nullptr, &world.media);
+    auto start = bench_clock::now();
+    render(cam, world.geometry(), integrator, settings, fb);
+    return seconds_since(start);
+}
+
+// root mean squared error of the displayed (clamped, gamma corrected) values
+inline double rmse(const image &a, const image &b){
+    double squared_error = 0;
+    for(size_t i = 0; i < a.rgb.size(); i++){
+        const double x = std::sqrt(clamp(a.rgb[i], 0, 1));
+        const double y = std::sqrt(clamp(b.rgb[i], 0, 1));
+        squared_error += (x - y) * (x - y);
+    }
+    return std::sqrt(squared_error / a.rgb.size());
+}
+
+#endif // BENCH_COMMON_H
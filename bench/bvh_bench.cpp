@@ -0,0 +1,74 @@
+// compares the bvh_node against the plain hittable_list, for build time and for closest hit traversal speed, over
+// scenes of random spheres with increasing object counts
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "helper.h"
+
+#include "material.h"
+
+#include "sphere.h"
+#include "hittable_list.h"
+#include "bvh.h"
+
+#include "bench_common.h"
+
+static double trace_all(const hittable &world, const std::vector<ray> &rays, size_t count, double &t_sum, int &hits){
+    auto start = bench_clock::now();
+    t_sum = 0;
+    hits = 0;
+    for(size_t i = 0; i < count; i++){
+        hit_record rec;
+        if(world.hit(rays[i], 0.001, infinity, rec)){
+            t_sum += rec.t;
+            hits++;
+        }
+    }
+    return seconds_since(start);
+}
+
+int main(int argc, char **argv){
+    const int max_count = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    const int ray_count = 200000;
+    const double list_tests_budget = 2e8; // caps rays * objects for the linear list, which is far too slow otherwise
+
+    std::printf("%10s %12s %12s %14s %14s %10s %s\n",
+                "objects", "list build", "bvh build", "list rays/s", "bvh rays/s", "speedup", "hits agree");
+
+    for(int count = 100; count <= max_count; count *= 10){
+        sampler s(static_cast<uint64_t>(count));
+        double half_size = 0;
+
+        std::vector<bench_sphere> spheres = random_spheres(count, s, half_size);
+        auto mat = make_shared<lambertian>(colour(0.5, 0.5, 0.5));
+
+        auto start = bench_clock::now();
+        hittable_list list{};
+        for(const auto &sph : spheres)
+            list.add(make_shared<sphere>(sph.center, sph.radius, mat));
+        double list_build = seconds_since(start);
+
+        start = bench_clock::now();
+        bvh_node bvh(list);
+        double bvh_build = seconds_since(start);
+
+        std::vector<ray> rays = random_rays(ray_count, half_size, s);
+        size_t list_rays = std::max<size_t>(100, std::min<size_t>(rays.size(), list_tests_budget / count));
+
+        double list_t_sum = 0, bvh_t_sum = 0;
+        int list_hits = 0, bvh_hits = 0;
+        double list_time = trace_all(list, rays, list_rays, list_t_sum, list_hits);
+        trace_all(bvh, rays, list_rays, bvh_t_sum, bvh_hits); // the same rays through the bvh, to compare hits
+        bool agree = list_hits == bvh_hits && list_t_sum == bvh_t_sum;
+
+        double bvh_time = trace_all(bvh, rays, rays.size(), bvh_t_sum, bvh_hits);
+
+        double list_rate = list_rays / list_time;
+        double bvh_rate = rays.size() / bvh_time;
+        std::printf("%10d %10.2fms %10.2fms %14.0f %14.0f %9.1fx %s\n",
+                    count, list_build * 1e3, bvh_build * 1e3, list_rate, bvh_rate, bvh_rate / list_rate,
+                    agree ? "yes" : "NO");
+    }
+}
@@ -0,0 +1,171 @@
+// renders a scene (the demo scene by default) at 320x180 without a checkpoint, then checkpointing only at the end,
+// every second, and after every tile, printing what checkpointing costs (the fastest of two renders each way) and
+// that the image is the same every way, then stops a render halfway through and carries it on from its checkpoint,
+// checking that comes out the same too, and lastly times checkpointing a whole 1920x1080 frame (with features)
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "helper.h"
+
+#include "camera.h"
+#include "checkpoint.h"
+#include "framebuffer.h"
+#include "integrator.h"
+#include "render.h"
+#include "scene.h"
+#include "scene_file.h"
+
+#include "bench_common.h"
+
+static bool same_image(const framebuffer &a, const framebuffer &b){
+    for(size_t p = 0; p < a.pixels.size(); p++)
+        for(int c = 0; c < 3; c++)
+            if(a.pixels[p].rgb[c] != b.pixels[p].rgb[c]) return false;
+    return true;
+}
+
+// renders the frame into fb, checkpointing to path every interval seconds if it's given one
+static double render_once(const scene &world, render_settings settings, const std::string &path, double interval,
+                          framebuffer &fb, double &file_mb){
+    if(path.empty()) return render_frame(world, settings, fb, true);
+
+    camera cam(world.view, static_cast<double>(settings.width) / settings.height);
+    path_integrator integrator(world.frame.max_depth, 3, &world.lights);
+    auto start = bench_clock::now();
+    std::remove(path.c_str());
+    render_checkpoint checkpoint{};
+    std::string error{};
+    if(!checkpoint.open(path, settings, 1, fb, error)){
+        std::fprintf(stderr, "Couldn't open the checkpoint, %s\n", error.c_str());
+        std::exit(-1);
+    }
+    checkpoint.interval = interval;
+    settings.resume = true;
+    render(cam, world.geometry(), integrator, settings, fb, nullptr, [&](const framebuffer &tile_fb, const tile &t){
+        checkpoint.save_tile(tile_fb, t);
+    });
+    checkpoint.checkpoint(error);
+    const double seconds = seconds_since(start);
+    file_mb = (sizeof(checkpoint_header) + 2 * fb.pixels.size() * sizeof(partial_pixel)) / 1048576.0;
+    return seconds;
+}
+
+static double fastest_render(const scene &world, const render_settings &settings, const std::string &path,
+                             double interval, framebuffer &fb, double &file_mb){
+    const double first = render_once(world, settings, path, interval, fb, file_mb);
+    return std::min(first, render_once(world, settings, path, interval, fb, file_mb));
+}
+
+int main(int argc, char **argv){
+    const std::string scene_path = argc > 1 ? argv[1] : "scenes/demo.scene";
+    const std::string directory = argc > 2 ? argv[2] : "/tmp";
+    const std::string path = directory + "/checkpoint_bench.rtcheck";
+
+    scene world{};
+    std::string error{};
+    if(!load_scene(scene_path, world, error)){
+        std::fprintf(stderr, "Couldn't load the scene, %s\n", error.c_str());
+        return -1;
+    }
+
+    render_settings settings{};
+    settings.width = 320;
+    settings.height = 180;
+    settings.samples_per_pixel = 16;
+    settings.tile_size = 16;
+    settings.num_threads = std::max(1u, std::thread::hardware_concurrency());
+    settings.report_progress = false;
+
+    std::printf("%dx%d at %d samples per pixel, %d threads, %d tiles\n", settings.width, settings.height,
+                settings.samples_per_pixel, settings.num_threads,
+                static_cast<int>(make_tiles(settings.width, settings.height, settings.tile_size).size()));
+    std::printf("%-22s %10s %10s %10s %6s\n", "checkpointing", "seconds", "overhead", "file MB", "same");
+
+    framebuffer reference{};
+    double file_mb = 0;
+    const double base = fastest_render(world, settings, "", 0, reference, file_mb);
+    std::printf("%-22s %10.3f %10s %10s %6s\n", "none", base, "-", "-", "-");
+    const char *names[] = { "at the end", "every second", "after every tile" };
+    const double intervals[] = { 1e9, 1, 0 };
+    for(int run = 0; run < 3; run++){
+        framebuffer fb{};
+        const double seconds = fastest_render(world, settings, path, intervals[run], fb, file_mb);
+        std::printf("%-22s %10.3f %9.1f%% %10.1f %6s\n", names[run], seconds, 100 * (seconds / base - 1), file_mb,
+                    same_image(fb, reference) ? "yes" : "NO");
+        std::fflush(stdout);
+    }
+
+    // stopped halfway through (by time), as a killed render would be at its last checkpoint, then carried on
+    {
+        std::remove(path.c_str());
+        camera cam(world.view, static_cast<double>(settings.width) / settings.height);
+        path_integrator integrator(world.frame.max_depth, 3, &world.lights);
+        render_settings stopping = settings;
+        std::atomic<bool> stop{false};
+        stopping.stop = &stop;
+        stopping.resume = true;
+        framebuffer fb{};
+        long long stopped_samples;
+        {
+            render_checkpoint checkpoint{};
+            checkpoint.open(path, stopping, 1, fb, error);
+            checkpoint.interval = 0;
+            std::thread stopper([&](){
+                std::this_thread::sleep_for(std::chrono::duration<double>(base / 2));
+                stop = true;
+            });
+            render(cam, world.geometry(), integrator, stopping, fb, nullptr, [&](const framebuffer &tile_fb,
+                                                                                  const tile &t){
+                checkpoint.save_tile(tile_fb, t);
+            });
+            stopper.join();
+            checkpoint.checkpoint(error);
+            stopped_samples = fb.total_samples();
+        }
+
+        stopping.stop = nullptr;
+        render_checkpoint checkpoint{};
+        framebuffer resumed{};
+        auto start = bench_clock::now();
+        checkpoint.open(path, stopping, 1, resumed, error);
+        const double open_ms = 1000 * seconds_since(start);
+        render(cam, world.geometry(), integrator, stopping, resumed);
+        std::printf("\nstopped at %lld of %lld samples, carried on from the checkpoint (opened in %.2f ms): same %s\n",
+                    stopped_samples, reference.total_samples(), open_ms, same_image(resumed, reference) ? "yes" : "NO");
+    }
+
+    // the most a checkpoint can have to write, every pixel of a big frame at once
+    render_settings big = settings;
+    big.width = 1920;
+    big.height = 1080;
+    big.features = true;
+    std::remove(path.c_str());
+    {
+        render_checkpoint checkpoint{};
+        framebuffer fb{};
+        auto start = bench_clock::now();
+        if(!checkpoint.open(path, big, 1, fb, error)){
+            std::fprintf(stderr, "Couldn't open the checkpoint, %s\n", error.c_str());
+            return -1;
+        }
+        const double open_seconds = seconds_since(start);
+        checkpoint.interval = 1e9;
+        for(size_t p = 0; p < fb.pixels.size(); p++) fb.add_sample(p, colour(0.5, 0.5, 0.5), surface_features{});
+        start = bench_clock::now();
+        for(const tile &t : make_tiles(big.width, big.height, big.tile_size)) checkpoint.save_tile(fb, t);
+        const double save_seconds = seconds_since(start);
+        start = bench_clock::now();
+        checkpoint.checkpoint(error);
+        std::printf("a %dx%d frame with features, %.0f MB: making the file %.3f s, copying every tile in %.3f s, "
+                    "flushing it %.3f s\n", big.width, big.height,
+                    2.0 * fb.pixels.size() * (sizeof(partial_pixel) + sizeof(partial_features)) / 1048576,
+                    open_seconds, save_seconds, seconds_since(start));
+    }
+    std::remove(path.c_str());
+}
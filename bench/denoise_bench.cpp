@@ -0,0 +1,88 @@
+// renders a scene (the demo scene by default) at a few samples per pixel, with features, and denoises each render,
+// printing how close the image is to a reference of many more samples (as PSNR) before and after, how long the
+// denoiser takes on one thread and on every core, and how long the render itself took - set against the PSNR of
+// renders with more samples and no denoising, that shows what sample count denoising a few samples is worth
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "helper.h"
+
+#include "camera.h"
+#include "denoise.h"
+#include "framebuffer.h"
+#include "integrator.h"
+#include "render.h"
+#include "scene.h"
+#include "scene_file.h"
+
+#include "bench_common.h"
+
+// the fastest of a few runs, in milliseconds
+static double time_denoise(const framebuffer &fb, denoise_settings denoising, int threads, image &out){
+    denoising.num_threads = threads;
+    double best = infinity;
+    for(int run = 0; run < 3; run++){
+        auto start = bench_clock::now();
+        out = denoise(fb, denoising);
+        best = std::min(best, 1000 * seconds_since(start));
+    }
+    return best;
+}
+
+int main(int argc, char **argv){
+    const std::string scene_path = argc > 1 ? argv[1] : "scenes/demo.scene";
+    const int reference_samples = argc > 2 ? std::atoi(argv[2]) : 1024;
+
+    scene world{};
+    std::string error{};
+    if(!load_scene(scene_path, world, error)){
+        std::fprintf(stderr, "Couldn't load the scene, %s\n", error.c_str());
+        return -1;
+    }
+
+    const int cores = std::max(1u, std::thread::hardware_concurrency());
+    render_settings settings{};
+    settings.width = 160;
+    settings.height = 90;
+    settings.num_threads = cores;
+    settings.report_progress = false;
+    settings.samples_per_pixel = reference_samples;
+    settings.seed = 12345; // so the reference's noise is unrelated to the renders compared against it
+    framebuffer fb{};
+    render_frame(world, settings, fb);
+    const image reference = resolve(fb);
+
+    std::printf("%dx%d, PSNR in dB against %d samples per pixel, denoising with %d passes, %d wide SIMD\n",
+                settings.width, settings.height, reference_samples, denoise_settings{}.iterations, simd_real::width);
+    std::printf("%-6s %10s %10s %10s %14s %14s\n", "spp", "render s", "noisy", "denoised", "1 thread ms",
+                (std::to_string(cores) + " threads ms").c_str());
+
+    settings.seed = 0;
+    settings.features = true;
+    for(int spp : { 1, 2, 4, 8, 16, 32, 64 }){
+        settings.samples_per_pixel = spp;
+        const double render_seconds = render_frame(world, settings, fb);
+        image denoised{};
+        const double one_thread = time_denoise(fb, denoise_settings{}, 1, denoised);
+        const double all_threads = time_denoise(fb, denoise_settings{}, cores, denoised);
+        std::printf("%-6d %10.3f %10.2f %10.2f %14.2f %14.2f\n", spp, render_seconds, psnr(resolve(fb), reference),
+                    psnr(denoised, reference), one_thread, all_threads);
+        std::fflush(stdout);
+    }
+
+    // the denoiser's time doesn't depend on the scene or the sample count, only the resolution, so a frame a few
+    // times bigger shows how it scales
+    settings.width = 640;
+    settings.height = 360;
+    settings.samples_per_pixel = 2;
+    render_frame(world, settings, fb);
+    image denoised{};
+    const double one_thread = time_denoise(fb, denoise_settings{}, 1, denoised);
+    const double all_threads = time_denoise(fb, denoise_settings{}, cores, denoised);
+    const double megapixels = settings.width * settings.height / 1e6;
+    std::printf("\n%dx%d, denoised in %.2f ms on 1 thread (%.1f ms a megapixel), %.2f ms on %d\n", settings.width,
+                settings.height, one_thread, one_thread / megapixels, all_threads, cores);
+}
@@ -0,0 +1,202 @@
+// checks that rendering samples allocates nothing, and measures what the reference counted material pointer the hit
+// record used to carry cost on the hit path, against the plain pointer it carries now, on one thread and on many
+// threads hitting spheres that share a material (where every refcount change fights over the same cache line)
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "helper.h"
+
+#include "camera.h"
+#include "framebuffer.h"
+#include "integrator.h"
+#include "render.h"
+#include "scene.h"
+#include "sphere.h"
+
+#include "bench_common.h"
+
+static std::atomic<long long> allocation_count{0};
+
+// every overload of the global new and delete is replaced, all going through these two, so whichever form a
+// container or the library uses is counted, and each block is freed the way it was allocated - they're kept out of
+// line, so the compiler never sees a malloc'd block handed to operator delete (or the other way round) once inlined
+__attribute__((noinline)) static void *counted_allocate(size_t size){
+    allocation_count++;
+    return std::malloc(size ? size : 1);
+}
+
+__attribute__((noinline)) static void counted_release(void *p){
+    std::free(p);
+}
+
+void *operator new(size_t size){
+    if(void *p = counted_allocate(size)) return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size){
+    if(void *p = counted_allocate(size)) return p;
+    throw std::bad_alloc();
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept { return counted_allocate(size); }
+void *operator new[](size_t size, const std::nothrow_t &) noexcept { return counted_allocate(size); }
+
+void operator delete(void *p) noexcept { counted_release(p); }
+void operator delete[](void *p) noexcept { counted_release(p); }
+void operator delete(void *p, size_t) noexcept { counted_release(p); }
+void operator delete[](void *p, size_t) noexcept { counted_release(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { counted_release(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { counted_release(p); }
+
+// the hit path with the material pointer type as the only thing that changes, a shared_ptr (as the hit record used
+// to hold) is assigned on every successful intersection, which is an atomic increment and an atomic decrement of
+// whatever it replaced, where the plain pointer is a single store
+template<typename pointer_type>
+struct bench_hit_record {
+    point3 p{};
+    real t{};
+    pointer_type mat_ptr{};
+    bool front_face{};
+    vec3 normal{};
+};
+
+template<typename pointer_type>
+struct bench_hit_sphere {
+    point3 center{};
+    real radius{};
+    pointer_type mat_ptr{};
+
+    bool hit(const ray &r, real t_min, real t_max, bench_hit_record<pointer_type> &rec) const {
+        real root;
+        if(!hit_sphere_root(center, radius, r, t_min, t_max, root)) return false;
+
+        rec.t = root;
+        rec.p = r.at(root);
+        vec3 outward_normal = (rec.p - center) / radius;
+        rec.front_face = dot(r.direction(), outward_normal) < 0.0;
+        rec.normal = rec.front_face ? outward_normal : -outward_normal;
+        rec.mat_ptr = mat_ptr;
+        return true;
+    }
+};
+
+typedef bench_hit_sphere<shared_ptr<material>> shared_sphere;
+typedef bench_hit_sphere<const material *> plain_sphere;
+
+// a few spheres in a row along the ray, so each ray has several successful intersections, as a linear scan of a
+// small scene would
+static std::vector<bench_sphere> spheres_in_a_row(){
+    std::vector<bench_sphere> spheres{};
+    for(int i = 0; i < 8; i++){
+        bench_sphere sph{};
+        sph.center = point3(0, 0, -2.0 - i);
+        sph.radius = 0.5;
+        spheres.push_back(sph);
+    }
+    return spheres;
+}
+
+template<typename pointer_type>
+static double hits_per_second(const std::vector<bench_hit_sphere<pointer_type>> &spheres, int num_threads, long long rays_per_thread){
+    std::vector<std::thread> threads{};
+    std::atomic<int> sink{0};
+
+    auto start = bench_clock::now();
+    for(int t = 0; t < num_threads; t++){
+        threads.emplace_back([&, t](){
+            sampler s(static_cast<uint64_t>(t));
+            int hits = 0;
+            bench_hit_record<pointer_type> rec;
+            for(long long n = 0; n < rays_per_thread; n++){
+                // aimed from behind the row, so the spheres are tested far to near and every one of them hits
+                ray r(point3(0, 0, -20), vec3(random_double(s, -0.01, 0.01), random_double(s, -0.01, 0.01), 1));
+                double closest = infinity;
+                for(const auto &sph : spheres){
+                    if(sph.hit(r, 0.001, closest, rec)){
+                        closest = rec.t;
+                        hits++;
+                    }
+                }
+            }
+            sink += hits;
+        });
+    }
+    for(auto &thread : threads)
+        thread.join();
+
+    return static_cast<double>(sink.load()) / seconds_since(start);
+}
+
+int main(){
+    // allocations while rendering samples of the demo scene, with everything built beforehand
+    scene world{};
+    sampler scene_sampler(1);
+    int ground = world.add_material<lambertian>(colour(0.5, 0.5, 0.5));
+    int glass = world.add_material<dielectric>(1.5);
+    world.spheres.add(point3(0, -100.5, -1), 100, ground);
+    world.spheres.add(point3(0, 1, -1), 1.5, glass);
+    world.spheres.add(point3(0, 1, -1), -1.4, glass);
+    for(int i = 0; i < 100; i++){
+        int mat = world.add_material<metal>(vec3::random(scene_sampler), 0.2 * random_double(scene_sampler));
+        world.spheres.add(vec3::random(scene_sampler, -5, 5) + point3(0, 5, 0), 0.3, mat);
+    }
+    world.build();
+
+    render_settings settings{};
+    settings.width = 160;
+    settings.height = 90;
+    settings.samples_per_pixel = 8;
+
+    camera cam(point3(5, 10, 10), point3(0, 0, -1), vec3(0, 1, 0), 16.0 / 9.0, 20, 0.7, 15);
+    path_integrator integrator(50, 3);
+    framebuffer fb(settings.width, settings.height);
+    tile whole_frame{};
+    whole_frame.x1 = settings.width;
+    whole_frame.y1 = settings.height;
+
+    long long before = allocation_count.load();
+    render_scratch scratch{};
+    render_tile(whole_frame, cam, world.geometry(), integrator, settings, settings.samples_per_pixel, fb, scratch);
+    long long allocations = allocation_count.load() - before;
+
+    std::printf("heap allocations while rendering %lld samples: %lld\n", fb.total_samples(), allocations);
+
+    // the cost of the refcounted pointer in the hit record, against the plain one
+    std::vector<shared_sphere> shared_spheres{};
+    std::vector<plain_sphere> plain_spheres{};
+    auto mat = make_shared<lambertian>(colour(0.5, 0.5, 0.5));
+    for(const auto &sph : spheres_in_a_row()){
+        shared_sphere shared{};
+        shared.center = sph.center;
+        shared.radius = sph.radius;
+        shared.mat_ptr = mat;
+        shared_spheres.push_back(shared);
+
+        plain_sphere plain{};
+        plain.center = sph.center;
+        plain.radius = sph.radius;
+        plain.mat_ptr = mat.get();
+        plain_spheres.push_back(plain);
+    }
+
+    const long long rays_per_thread = 2000000;
+    const int max_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> thread_counts{};
+    for(int threads = 1; threads < max_threads; threads *= 2)
+        thread_counts.push_back(threads);
+    thread_counts.push_back(max_threads); // always ends on every core
+
+    std::printf("%8s %22s %22s %8s\n", "threads", "shared_ptr hits/s", "plain pointer hits/s", "speedup");
+    for(int threads : thread_counts){
+        double shared_rate = hits_per_second(shared_spheres, threads, rays_per_thread);
+        double plain_rate = hits_per_second(plain_spheres, threads, rays_per_thread);
+        std::printf("%8d %22.0f %22.0f %7.2fx\n", threads, shared_rate, plain_rate, plain_rate / shared_rate);
+    }
+}
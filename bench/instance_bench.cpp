@@ -0,0 +1,167 @@
+// scatters more and more instances of one mesh (a bumpy sphere of about a thousand triangles) through a scene, each
+// turned and scaled differently, then prints the memory the instances take against copying the mesh into world space
+// for each (as one big mesh), and the rays a second traced through each - then, for the biggest scene, how many
+// instances a ray reaches, and what taking a ray into an instance's space costs next to the whole of testing it
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+#include "helper.h"
+
+#include "scene.h"
+
+#include "bench_common.h"
+
+// a unit sphere of rings by segments quads, pushed in and out a little, as mesh_bench's
+static triangle_mesh bumpy_sphere(int rings, int segments){
+    triangle_mesh mesh{};
+    for(int r = 0; r <= rings; r++){
+        const double theta = pi * r / rings;
+        for(int s = 0; s < segments; s++){
+            const double phi = 2 * pi * s / segments;
+            const double bump = 1 + 0.02 * std::sin(13 * theta) * std::sin(17 * phi);
+            mesh.add_vertex(point3(bump * std::sin(theta) * std::cos(phi), bump * std::cos(theta),
+                                   bump * std::sin(theta) * std::sin(phi)));
+        }
+    }
+    for(int r = 0; r < rings; r++){
+        for(int s = 0; s < segments; s++){
+            const int a = r * segments + s, b = r * segments + (s + 1) % segments;
+            mesh.add_triangle(a, b, b + segments);
+            mesh.add_triangle(a, b + segments, a + segments);
+        }
+    }
+    return mesh;
+}
+
+// count placements through a cube which grows with the count, so instances are about as far apart at every size
+static std::vector<transform> placements(int count, sampler &s, double &half_size){
+    half_size = 2 * std::cbrt(static_cast<double>(count));
+    std::vector<transform> out{};
+    for(int i = 0; i < count; i++){
+        const double size = random_double(s, 0.3, 0.8);
+        out.push_back(transform::translate(vec3::random(s, -half_size, half_size))
+                      * transform::rotate(random_unit_vector(s), random_double(s, 0, 360))
+                      * transform::scale(vec3(size, size * random_double(s, 0.5, 1.5), size)));
+    }
+    return out;
+}
+
+template<typename hit_fn>
+static double rays_per_second(const std::vector<ray> &rays, int &hits, hit_fn &&hit){
+    hits = 0;
+    auto start = bench_clock::now();
+    for(const ray &r : rays){
+        hit_record rec{};
+        if(hit(r, rec)) hits++;
+    }
+    return rays.size() / seconds_since(start) / 1e6;
+}
+
+int main(int argc, char **argv){
+    const int max_count = argc > 1 ? std::atoi(argv[1]) : 10000;
+    const size_t flat_triangle_budget = 2000000; // past this, copying the mesh for each instance is left out
+
+    const triangle_mesh shape = bumpy_sphere(24, 24);
+    std::printf("a mesh of %zu triangles, %zu bytes an instance (a transform of %zu, and the rest), rays per "
+                "second in millions\n", shape.size(), sizeof(mesh_instance), sizeof(transform));
+    std::printf("%10s %14s %14s %14s %14s %14s %14s\n", "instances", "instance KB", "B/instance", "copied MB",
+                "instanced", "copied", "hits (i/c)");
+
+    scene world{};
+    std::vector<ray> last_rays{};
+    for(int count = 100; count <= max_count; count *= 10){
+        sampler s(static_cast<uint64_t>(count));
+        double half_size;
+        const std::vector<transform> to_world = placements(count, s, half_size);
+        const std::vector<ray> rays = random_rays(200000, half_size, s);
+
+        world = scene{};
+        const int mat = world.add_material<lambertian>(colour(0.5, 0.5, 0.5));
+        triangle_mesh mesh = shape;
+        const int mesh_idx = world.add_mesh(std::move(mesh));
+        for(const transform &placement : to_world) world.add_instance(mesh_idx, placement, mat);
+        world.build();
+
+        // the instances themselves, and the tree over them, the mesh is the same size whatever the count
+        const double instance_bytes = world.instances.capacity() * sizeof(mesh_instance)
+                                      + world.instance_tree.nodes.capacity() * sizeof(bvh_flat_node)
+                                      + world.instance_tree.indices.capacity() * sizeof(int);
+        int instanced_hits;
+        const double instanced = rays_per_second(rays, instanced_hits, [&](const ray &r, hit_record &rec){
+            return world.hit(r, 0.001, infinity, rec);
+        });
+
+        char copied_mb[32] = "-", copied_rate[32] = "-", hits[48];
+        std::snprintf(hits, sizeof(hits), "%d/-", instanced_hits);
+        if(static_cast<size_t>(count) * shape.size() <= flat_triangle_budget){
+            triangle_mesh flat{};
+            for(const transform &placement : to_world){
+                const int first = static_cast<int>(flat.vertices.size());
+                for(const point3 &v : shape.vertices) flat.add_vertex(placement.apply_point(v));
+                for(size_t t = 0; t < shape.size(); t++)
+                    flat.add_triangle(first + shape.indices[3 * t], first + shape.indices[3 * t + 1],
+                                      first + shape.indices[3 * t + 2]);
+            }
+            flat.build();
+            int flat_hits;
+            const double flat_rate = rays_per_second(rays, flat_hits, [&](const ray &r, hit_record &rec){
+                return flat.hit(r, 0.001, infinity, rec);
+            });
+            std::snprintf(copied_mb, sizeof(copied_mb), "%.1f", flat.memory_bytes() / 1048576.0);
+            std::snprintf(copied_rate, sizeof(copied_rate), "%.3f", flat_rate);
+            std::snprintf(hits, sizeof(hits), "%d/%d", instanced_hits, flat_hits);
+        }
+
+        std::printf("%10d %14.1f %14.1f %14s %14.3f %14s %14s\n", count, instance_bytes / 1024, instance_bytes / count,
+                    copied_mb, instanced, copied_rate, hits);
+        std::fflush(stdout);
+        last_rays = rays;
+    }
+
+    // every instance the rays reach in the last scene, in the order traversal reaches them
+    std::vector<std::pair<int, int>> visits{}; // ray, instance
+    for(size_t r = 0; r < last_rays.size(); r++){
+        world.instance_tree.traverse(last_rays[r], 0.001, infinity, [&](int first, int count, real &closest_so_far){
+            bool hit_leaf = false;
+            for(int i = first; i < first + count; i++){
+                const int idx = world.instance_tree.indices[i];
+                visits.emplace_back(static_cast<int>(r), idx);
+                hit_record rec{};
+                if(world.instances[idx].hit(last_rays[r], 0.001, closest_so_far, rec)){
+                    hit_leaf = true;
+                    closest_so_far = rec.t;
+                }
+            }
+            return hit_leaf;
+        });
+    }
+
+    // taking each ray into each instance's space, by itself
+    auto start = bench_clock::now();
+    real checksum = 0;
+    for(const auto &visit : visits){
+        const transform &to_object = world.instances[visit.second].to_object;
+        const ray &r = last_rays[visit.first];
+        const ray object_ray(to_object.apply_point(r.origin()), to_object.apply_vector(r.direction()));
+        checksum += object_ray.origin()[0] + object_ray.direction()[1];
+    }
+    const double transform_ns = 1e9 * seconds_since(start) / visits.size();
+
+    // and the whole of testing each instance, which is that, then the mesh's tree
+    start = bench_clock::now();
+    int instance_hits = 0;
+    for(const auto &visit : visits){
+        hit_record rec{};
+        instance_hits += world.instances[visit.second].hit(last_rays[visit.first], 0.001, infinity, rec);
+    }
+    const double test_ns = 1e9 * seconds_since(start) / visits.size();
+
+    std::printf("\n%.2f instances reached a ray, taking a ray into an instance's space %.2f ns, testing it %.2f ns "
+                "(%.1f%% of which is the transform), checksum %g, %d hit\n",
+                static_cast<double>(visits.size()) / last_rays.size(), transform_ns, test_ns,
+                100 * transform_ns / test_ns, static_cast<double>(checksum), instance_hits);
+}
@@ -0,0 +1,136 @@
+// renders a scene lit by emissive objects (scenes/indoor.scene by default) at a few sample counts with and without
+// light sampling (next event estimation, weighted by multiple importance sampling), printing each render's time and
+// RMSE against a reference of many more samples with it, and roughly how many samples without light sampling it takes
+// to get down to the error each count gets with it - then times the shadow rays light sampling sends, with the any
+// hit occluded query against finding the closest hit, checking the two agree on every ray
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "helper.h"
+
+#include "camera.h"
+#include "framebuffer.h"
+#include "integrator.h"
+#include "render.h"
+#include "scene.h"
+#include "scene_file.h"
+
+#include "bench_common.h"
+
+// the shadow rays from where camera rays first hit a diffuse surface to a point picked on a light, as the integrator
+// sends them
+static std::vector<ray> shadow_rays(const scene &world, int count, std::vector<real> &lengths){
+    camera cam(world.view, 4.0 / 3);
+    sampler s(5);
+    std::vector<ray> rays{};
+    while(static_cast<int>(rays.size()) < count){
+        const ray r = cam.get_ray(random_double(s), random_double(s), s);
+        hit_record rec{};
+        if(!world.geometry().hit(r, path_t_min, infinity, rec) || !rec.mat_ptr->samples_lights()) continue;
+
+        light_sample sample{};
+        if(!world.lights.sample(rec.p, s, sample) || sample.distance <= 2 * path_t_min) continue;
+        rays.emplace_back(rec.p, sample.direction);
+        lengths.push_back(sample.distance - path_t_min);
+    }
+    return rays;
+}
+
+int main(int argc, char **argv){
+    const std::string scene_path = argc > 1 ? argv[1] : "scenes/indoor.scene";
+    const int reference_samples = argc > 2 ? std::atoi(argv[2]) : 1024;
+
+    scene world{};
+    std::string error{};
+    if(!load_scene(scene_path, world, error)){
+        std::fprintf(stderr, "Couldn't load the scene, %s\n", error.c_str());
+        return -1;
+    }
+    if(world.lights.empty()){
+        std::fprintf(stderr, "%s has no emissive spheres or instances to sample\n", scene_path.c_str());
+        return -1;
+    }
+
+    render_settings settings{};
+    settings.width = 160;
+    settings.height = 120;
+    settings.num_threads = std::max(1u, std::thread::hardware_concurrency());
+    settings.report_progress = false;
+    settings.samples_per_pixel = reference_samples;
+    settings.seed = 12345; // so the reference's noise is unrelated to the renders compared against it
+    framebuffer fb{};
+    render_frame(world, settings, fb, true);
+    const image reference = resolve(fb);
+
+    std::printf("%dx%d, %zu lights, RMSE against %d samples per pixel with light sampling\n", settings.width,
+                settings.height, world.lights.size(), reference_samples);
+    std::printf("%-6s %12s %12s %12s %12s %20s\n", "spp", "without s", "RMSE", "with s", "RMSE",
+                "spp without for it");
+
+    // without light sampling, the error is mostly the odd bright pixel where a path happened to find a light, so it
+    // doesn't fall as 1 over the square root of the sample count until there are a lot of samples, and how many it
+    // takes to match light sampling is found by rendering that many, interpolating between the counts rendered
+    const int counts[] = { 1, 4, 16, 64, 256, 1024 };
+    const int count_total = sizeof(counts) / sizeof(counts[0]);
+    double without[count_total], without_seconds[count_total];
+    settings.seed = 0;
+    for(int c = 0; c < count_total; c++){
+        settings.samples_per_pixel = counts[c];
+        without_seconds[c] = render_frame(world, settings, fb);
+        without[c] = rmse(resolve(fb), reference);
+    }
+
+    for(int c = 0; c < 4; c++){
+        settings.samples_per_pixel = counts[c];
+        const double with_seconds = render_frame(world, settings, fb, true);
+        const double with = rmse(resolve(fb), reference);
+
+        char matching[32];
+        std::snprintf(matching, sizeof(matching), "> %d", counts[count_total - 1]);
+        for(int k = 0; k < count_total; k++){
+            if(without[k] > with) continue;
+            double spp = counts[k];
+            if(k > 0){ // between the two counts, in log of the count against log of the error
+                const double f = std::log(without[k - 1] / with) / std::log(without[k - 1] / without[k]);
+                spp = counts[k - 1] * std::pow(static_cast<double>(counts[k]) / counts[k - 1], f);
+            }
+            std::snprintf(matching, sizeof(matching), "%.0f", spp);
+            break;
+        }
+        std::printf("%-6d %12.3f %12.5f %12.3f %12.5f %20s\n", counts[c], without_seconds[c], without[c], with_seconds,
+                    with, matching);
+        std::fflush(stdout);
+    }
+    for(int c = 4; c < count_total; c++)
+        std::printf("%-6d %12.3f %12.5f\n", counts[c], without_seconds[c], without[c]);
+
+    std::vector<real> lengths{};
+    const std::vector<ray> rays = shadow_rays(world, 200000, lengths);
+    const hittable &geometry = world.geometry();
+
+    auto start = bench_clock::now();
+    std::vector<char> blocked(rays.size());
+    for(size_t i = 0; i < rays.size(); i++)
+        blocked[i] = geometry.occluded(rays[i], path_t_min, lengths[i]);
+    const double occluded_seconds = seconds_since(start);
+
+    start = bench_clock::now();
+    size_t blocked_count = 0, disagreements = 0;
+    for(size_t i = 0; i < rays.size(); i++){
+        hit_record rec{};
+        const bool hit = geometry.hit(rays[i], path_t_min, lengths[i], rec);
+        blocked_count += hit;
+        disagreements += hit != static_cast<bool>(blocked[i]);
+    }
+    const double hit_seconds = seconds_since(start);
+
+    std::printf("\n%zu shadow rays, %.1f%% blocked, Mrays/s: occluded %.3f, closest hit %.3f, %zu disagree\n",
+                rays.size(), 100.0 * blocked_count / rays.size(), rays.size() / occluded_seconds / 1e6,
+                rays.size() / hit_seconds / 1e6, disagreements);
+    return disagreements == 0 ? 0 : 1;
+}
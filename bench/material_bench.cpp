@@ -0,0 +1,258 @@
+// compares the tagged materials, dispatched with a switch, against the virtual material classes they replaced, both
+// for a single scattering event (one bounce) with the hits in a random order, and binned by type first, then whole
+// paths traced one at a time against a batch at a time, and checks that every version gives exactly the same result
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "helper.h"
+
+#include "camera.h"
+#include "integrator.h"
+#include "material.h"
+#include "scene.h"
+
+#include "bench_common.h"
+
+// the material system as it was, a class per type overriding a virtual scatter, each allocated on its own - the
+// scattering itself is the same code as the tagged version's, so only the dispatch (and the layout) differs
+class virtual_material {
+public:
+    virtual bool scatter(const ray &r_incident, const hit_record &rec, colour &attenuation, ray &scattered,
+                         sampler &s) const = 0;
+    virtual ~virtual_material() = default;
+};
+
+template<material_type type>
+class virtual_material_of : public virtual_material {
+public:
+    explicit virtual_material_of(const material &m) : m(m) {}
+
+    bool scatter(const ray &r_incident, const hit_record &rec, colour &attenuation, ray &scattered,
+                 sampler &s) const override {
+        return scatter_as<type>(m, r_incident, rec, attenuation, scattered, s);
+    }
+private:
+    material m{};
+};
+
+static std::unique_ptr<virtual_material> make_virtual(const material &m){
+    switch(m.type){
+        case material_type::lambertian:
+            return std::unique_ptr<virtual_material>(new virtual_material_of<material_type::lambertian>(m));
+        case material_type::metal:
+            return std::unique_ptr<virtual_material>(new virtual_material_of<material_type::metal>(m));
+        case material_type::dielectric:
+            return std::unique_ptr<virtual_material>(new virtual_material_of<material_type::dielectric>(m));
+        case material_type::emissive:
+            return std::unique_ptr<virtual_material>(new virtual_material_of<material_type::emissive>(m));
+        case material_type::isotropic:
+            return std::unique_ptr<virtual_material>(new virtual_material_of<material_type::isotropic>(m));
+    }
+    return nullptr;
+}
+
+static material random_material(sampler &s){
+    double choice = random_double(s);
+    if(choice < 0.4) return lambertian(vec3::random(s));
+    if(choice < 0.8) return metal(vec3::random(s), random_double(s, 0, 0.5));
+    return dielectric(random_double(s, 1.3, 1.8));
+}
+
+// one scattering event, a ray arriving at a hit on a surface
+struct bounce {
+    ray r_incident{};
+    hit_record rec{};
+    int material_idx{};
+};
+
+struct bounce_result {
+    ray scattered{};
+    colour attenuation{};
+    bool scattered_any{};
+};
+
+// each bounce draws its random numbers from its own sampler, so the order bounces are shaded in doesn't matter
+static sampler bounce_sampler(size_t i){
+    return sampler(12345, i);
+}
+
+static void record(bounce_result &out, bool scattered_any, const ray &scattered, const colour &attenuation){
+    out.scattered_any = scattered_any;
+    out.scattered = scattered;
+    out.attenuation = attenuation;
+}
+
+static bool same_results(const std::vector<bounce_result> &a, const std::vector<bounce_result> &b){
+    for(size_t i = 0; i < a.size(); i++){
+        for(int c = 0; c < 3; c++){
+            if(a[i].scattered.direction()[c] != b[i].scattered.direction()[c]) return false;
+            if(a[i].attenuation[c] != b[i].attenuation[c]) return false;
+        }
+        if(a[i].scattered_any != b[i].scattered_any) return false;
+    }
+    return true;
+}
+
+template<material_type type>
+static void shade_bucket(const std::vector<bounce> &bounces, const std::vector<material> &table, const int *first,
+                         const int *last, std::vector<bounce_result> &results){
+    for(const int *it = first; it != last; it++){
+        const bounce &b = bounces[*it];
+        sampler s = bounce_sampler(*it);
+        ray scattered{};
+        colour attenuation{};
+        bool scattered_any = scatter_as<type>(table[b.material_idx], b.r_incident, b.rec, attenuation, scattered, s);
+        record(results[*it], scattered_any, scattered, attenuation);
+    }
+}
+
+// paths through a scene with every material type in it, traced from a small frame's worth of camera rays
+static void trace_paths(int batch_size){
+    scene world{};
+    sampler scene_sampler(2);
+    int ground = world.add_material<lambertian>(colour(0.5, 0.5, 0.5));
+    int glass = world.add_material<dielectric>(1.5);
+    world.spheres.add(point3(0, -100.5, -1), 100, ground);
+    world.spheres.add(point3(0, 1, -1), 1.5, glass);
+    world.spheres.add(point3(0, 1, -1), -1.4, glass);
+    for(int i = 0; i < 200; i++){
+        int mat = world.add_material<material>(random_material(scene_sampler));
+        world.spheres.add(vec3::random(scene_sampler, -5, 5) + point3(0, 5, 0), 0.3, mat);
+    }
+    world.build();
+
+    const int width = 320;
+    const int height = 180;
+    const int samples = 4;
+    camera cam(point3(5, 10, 10), point3(0, 0, -1), vec3(0, 1, 0), 16.0 / 9.0, 20, 0.7, 15);
+    path_integrator integrator(50, 3);
+
+    // the camera rays, and the samplers as they are after generating them, which the paths carry on drawing from
+    std::vector<ray> rays{};
+    std::vector<sampler> samplers{};
+    for(int j = 0; j < height; j++){
+        for(int i = 0; i < width; i++){
+            for(int sample = 0; sample < samples; sample++){
+                const size_t pixel = static_cast<size_t>(j) * width + i;
+                sampler s = pixel_sampler(1, pixel, sample);
+                double u = (i + random_double(s)) / (width - 1);
+                double v = (j + random_double(s)) / (height - 1);
+                rays.push_back(cam.get_ray(u, v, s));
+                samplers.push_back(s);
+            }
+        }
+    }
+
+    std::vector<colour> one_at_a_time(rays.size());
+    std::vector<sampler> path_samplers = samplers;
+    auto start = bench_clock::now();
+    for(size_t p = 0; p < rays.size(); p++)
+        one_at_a_time[p] = integrator.radiance(rays[p], world.geometry(), path_samplers[p]);
+    double scalar_seconds = seconds_since(start);
+
+    std::vector<colour> batched(rays.size());
+    path_samplers = samplers;
+    path_batch batch{};
+    start = bench_clock::now();
+    for(size_t first = 0; first < rays.size(); first += batch_size){
+        size_t count = std::min<size_t>(batch_size, rays.size() - first);
+        integrator.radiance_batch(&rays[first], &path_samplers[first], count, world.geometry(), &batched[first], batch);
+    }
+    double batch_seconds = seconds_since(start);
+
+    bool agree = true;
+    for(size_t p = 0; p < rays.size(); p++)
+        for(int c = 0; c < 3; c++)
+            agree = agree && one_at_a_time[p][c] == batched[p][c];
+
+    std::printf("\n%10s %18s %18s %s\n", "paths", "one at a time/s", "batches of N/s", "radiance agrees");
+    std::printf("%10zu %18.0f %18.0f %s   (N = %d)\n", rays.size(), rays.size() / scalar_seconds,
+                rays.size() / batch_seconds, agree ? "yes" : "NO", batch_size);
+}
+
+int main(int argc, char **argv){
+    // a batch's worth of bounces, shaded over and over, the size radiance_batch would work on at once
+    const int bounce_count = argc > 1 ? std::atoi(argv[1]) : 4096;
+    const int material_count = 64;
+    const int repeats = std::max(1, 10000000 / bounce_count);
+
+    sampler s(1);
+    std::vector<material> table{};
+    std::vector<std::unique_ptr<virtual_material>> virtual_table{};
+    for(int m = 0; m < material_count; m++){
+        table.push_back(random_material(s));
+        virtual_table.push_back(make_virtual(table.back()));
+    }
+
+    std::vector<bounce> bounces(bounce_count);
+    for(auto &b : bounces){
+        b.material_idx = static_cast<int>(random_double(s) * material_count);
+        b.r_incident = ray(vec3::random(s, -1, 1), random_unit_vector(s));
+        b.rec.p = b.r_incident.at(random_double(s, 0.1, 10));
+        b.rec.t = 1;
+        b.rec.mat_ptr = &table[b.material_idx];
+        b.rec.set_face_normal(b.r_incident, random_unit_vector(s));
+    }
+
+    std::vector<bounce_result> virtual_results(bounce_count);
+    std::vector<bounce_result> switch_results(bounce_count);
+    std::vector<bounce_result> binned_results(bounce_count);
+    double virtual_seconds = 0, switch_seconds = 0, binned_seconds = 0;
+    std::vector<int> binned(bounce_count);
+
+    for(int rep = 0; rep < repeats; rep++){
+        auto start = bench_clock::now();
+        for(size_t i = 0; i < bounces.size(); i++){
+            const bounce &b = bounces[i];
+            sampler bs = bounce_sampler(i);
+            ray scattered{};
+            colour attenuation{};
+            bool scattered_any = virtual_table[b.material_idx]->scatter(b.r_incident, b.rec, attenuation, scattered, bs);
+            record(virtual_results[i], scattered_any, scattered, attenuation);
+        }
+        virtual_seconds += seconds_since(start);
+
+        start = bench_clock::now();
+        for(size_t i = 0; i < bounces.size(); i++){
+            const bounce &b = bounces[i];
+            sampler bs = bounce_sampler(i);
+            ray scattered{};
+            colour attenuation{};
+            bool scattered_any = b.rec.mat_ptr->scatter(b.r_incident, b.rec, attenuation, scattered, bs);
+            record(switch_results[i], scattered_any, scattered, attenuation);
+        }
+        switch_seconds += seconds_since(start);
+
+        // the binning is timed along with the shading, it's part of what the batched path pays for
+        start = bench_clock::now();
+        int starts[material_type_count + 1] = {};
+        for(const auto &b : bounces)
+            starts[static_cast<int>(b.rec.mat_ptr->type) + 1]++;
+        for(int t = 0; t < material_type_count; t++)
+            starts[t + 1] += starts[t];
+        int fill[material_type_count];
+        std::copy(starts, starts + material_type_count, fill);
+        for(size_t i = 0; i < bounces.size(); i++)
+            binned[fill[static_cast<int>(bounces[i].rec.mat_ptr->type)]++] = static_cast<int>(i);
+
+        const int *first = binned.data();
+        shade_bucket<material_type::lambertian>(bounces, table, first + starts[0], first + starts[1], binned_results);
+        shade_bucket<material_type::metal>(bounces, table, first + starts[1], first + starts[2], binned_results);
+        shade_bucket<material_type::dielectric>(bounces, table, first + starts[2], first + starts[3], binned_results);
+        shade_bucket<material_type::emissive>(bounces, table, first + starts[3], first + starts[4], binned_results);
+        binned_seconds += seconds_since(start);
+    }
+
+    const double total = static_cast<double>(bounce_count) * repeats;
+    bool agree = same_results(virtual_results, switch_results) && same_results(virtual_results, binned_results);
+
+    std::printf("%10s %16s %16s %16s %s\n", "bounces", "virtual ns", "switch ns", "binned ns", "results agree");
+    std::printf("%10d %16.2f %16.2f %16.2f %s\n", bounce_count, 1e9 * virtual_seconds / total,
+                1e9 * switch_seconds / total, 1e9 * binned_seconds / total, agree ? "yes" : "NO");
+
+    trace_paths(4096);
+}
@@ -0,0 +1,169 @@
+// fires rays through a ball of procedural smoke (a density grid of 128 voxels across, or however many are asked for),
+// sampling where each first scatters and how much light gets through it, by brute force ray marching (half a voxel a
+// step, the usual way, which is biased by its step) and by delta and ratio tracking, with one majorant for the whole
+// grid and with majorant grids of finer and finer blocks, printing the rays a second, the density lookups a ray, and
+// the fraction of rays that scatter and the mean transmittance (which all should agree, within the noise and the
+// marching's bias), then the same for a homogeneous medium, sampled in closed form against marched
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "helper.h"
+
+#include "material.h"
+#include "medium.h"
+
+#include "bench_common.h"
+
+struct medium_result {
+    double seconds{};
+    double lookups{}; // a ray, on average
+    double scattered{}; // the fraction of rays that did
+    double transmittance{}; // the mean
+};
+
+// where r is inside the sphere at the origin, as medium_list works it out
+static bool inside_ball(const ray &r, real radius, real &t0, real &t1){
+    const real a = r.direction().length_squared();
+    const real b_half = dot(r.direction(), r.origin());
+    const real discriminant = b_half * b_half - a * (r.origin().length_squared() - radius * radius);
+    if(discriminant <= 0) return false;
+    t0 = std::max(real(0), (-b_half - std::sqrt(discriminant)) / a);
+    t1 = (-b_half + std::sqrt(discriminant)) / a;
+    return t0 < t1;
+}
+
+// steps along each ray adding up the optical depth (density times step), it scatters once that passes a free path
+// drawn at the start, and the light getting through is e to the minus all of it
+template<typename density_function>
+static medium_result march(const std::vector<ray> &rays, real radius, real scale, real step,
+                           density_function density){
+    medium_result result{};
+    auto start = bench_clock::now();
+    long long lookups = 0, scattered = 0;
+    double transmittance = 0;
+    for(size_t i = 0; i < rays.size(); i++){
+        sampler s(i);
+        const ray &r = rays[i];
+        real t0, t1;
+        if(!inside_ball(r, radius, t0, t1)){
+            transmittance += 1;
+            continue;
+        }
+        const real length = r.direction().length();
+        const real dt = step / length;
+        const real path = free_path(s.next_double());
+        real depth = 0;
+        bool hit = false;
+        for(real t = t0 + dt / 2; t < t1; t += dt){
+            depth += density(r.at(t)) * scale * step;
+            lookups++;
+            if(!hit && depth >= path){
+                hit = true;
+                scattered++;
+            }
+        }
+        transmittance += std::exp(-depth);
+    }
+    result.seconds = seconds_since(start);
+    result.lookups = static_cast<double>(lookups) / rays.size();
+    result.scattered = static_cast<double>(scattered) / rays.size();
+    result.transmittance = transmittance / rays.size();
+    return result;
+}
+
+// what the renderer does, delta tracking where each ray scatters, then ratio tracking how much gets through, the
+// lookups are counted in a pass of their own, so counting them doesn't slow the timed one
+static medium_result track(const std::vector<ray> &rays, const medium_list &media){
+    medium_result result{};
+    auto start = bench_clock::now();
+    long long scattered = 0;
+    double transmittance = 0;
+    for(size_t i = 0; i < rays.size(); i++){
+        sampler s(i);
+        hit_record rec;
+        if(media.sample_scatter(rays[i], 0, infinity, s, rec)) scattered++;
+        transmittance += media.transmittance(rays[i], 0, infinity, s);
+    }
+    result.seconds = seconds_since(start);
+    result.scattered = static_cast<double>(scattered) / rays.size();
+    result.transmittance = transmittance / rays.size();
+
+    if(media.grids.empty()) return result;
+    long long lookups = 0;
+    const medium &m = media.media[0];
+    for(size_t i = 0; i < rays.size(); i++){
+        sampler s(i);
+        medium_random next(s);
+        real t0, t1;
+        if(!inside_ball(rays[i], m.radius, t0, t1)) continue;
+        media.grids[0].track(rays[i], t0, t1, m.density, next, [&](real, real ratio){
+            lookups++;
+            return next() >= ratio;
+        });
+        media.grids[0].track(rays[i], t0, t1, m.density, next, [&](real, real){
+            lookups++;
+            return true;
+        });
+    }
+    result.lookups = static_cast<double>(lookups) / rays.size();
+    return result;
+}
+
+int main(int argc, char **argv){
+    const int resolution = argc > 1 ? std::atoi(argv[1]) : 128;
+    const int ray_count = argc > 2 ? std::atoi(argv[2]) : 200000;
+    const real radius = 1;
+    const real scale = 20; // the smoke's densities go up to about 1, so up to 20 collisions a unit
+
+    // rays from a shell around the smoke at points inside it, about half of them missing the ball
+    std::vector<ray> rays{};
+    sampler s(1);
+    for(int i = 0; i < ray_count; i++){
+        const point3 origin = 3 * radius * random_unit_vector(s);
+        const point3 target = radius * 1.4 * vec3::random(s, -1, 1);
+        rays.emplace_back(origin, target - origin);
+    }
+
+    const material table[1] = { isotropic(colour(1, 1, 1)) };
+    medium_list smoke{};
+    smoke.materials = table;
+    auto start = bench_clock::now();
+    smoke.add(point3(0, 0, 0), radius, scale, 0, smoke_grid(resolution, 7));
+    const density_grid &grid = smoke.grids[0];
+    std::printf("smoke of %d^3 voxels (made in %.3f s), %d rays, up to %g collisions a unit\n", resolution,
+                seconds_since(start), ray_count, scale);
+    std::printf("%-28s %12s %14s %12s %14s\n", "sampling", "Mrays/s", "lookups/ray", "scattered", "transmittance");
+
+    auto print = [&](const char *name, const medium_result &r){
+        std::printf("%-28s %12.3f %14.1f %12.4f %14.4f\n", name, ray_count / r.seconds / 1e6, r.lookups, r.scattered,
+                    r.transmittance);
+        std::fflush(stdout);
+    };
+
+    print("marching, half voxel steps", march(rays, radius, scale, grid.voxel[0] / 2, [&](const point3 &p){
+        return grid.density(p);
+    }));
+    const int blocks[] = { resolution, 32, 16, 8, 4, 2 };
+    for(int block : blocks){
+        if(block > resolution) continue;
+        smoke.grids[0].build_majorants(block);
+        char name[64];
+        if(block == resolution) std::snprintf(name, sizeof(name), "tracking, one majorant");
+        else std::snprintf(name, sizeof(name), "tracking, %d voxel blocks", block);
+        print(name, track(rays, smoke));
+    }
+
+    // a homogeneous medium, where a free path is exact, and so is what gets through
+    const real fog_density = 2;
+    medium_list fog{};
+    fog.materials = table;
+    fog.add(point3(0, 0, 0), radius, fog_density, 0);
+    std::printf("\nhomogeneous fog, %g collisions a unit\n", fog_density);
+    print("marching, 1/64 unit steps", march(rays, radius, 1, radius / 64, [&](const point3 &){
+        return fog_density;
+    }));
+    print("exponential, closed form", track(rays, fog));
+}
@@ -0,0 +1,133 @@
+// writes a mesh of about a million triangles (or however many are asked for) to an OBJ file, a bumpy sphere of quads,
+// then measures loading it, building its tree, and tracing rays at it, on its own and through instances - which is
+// what taking each ray into the mesh's space costs - and at the end, how little a grid of many instances of it takes
+// next to copying the mesh for each
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "helper.h"
+
+#include "obj_loader.h"
+#include "scene.h"
+
+#include "bench_common.h"
+
+// a unit sphere of rings by segments quads, pushed in and out a little so it isn't too regular for the tree, with
+// each vertex written once and shared by the four quads around it
+static bool write_sphere_obj(const std::string &path, int rings, int segments){
+    FILE *file = std::fopen(path.c_str(), "w");
+    if(!file) return false;
+
+    std::fprintf(file, "# mesh_bench, %d rings of %d quads\n", rings, segments);
+    for(int r = 0; r <= rings; r++){
+        const double theta = pi * r / rings;
+        for(int s = 0; s < segments; s++){
+            const double phi = 2 * pi * s / segments;
+            const double bump = 1 + 0.02 * std::sin(13 * theta) * std::sin(17 * phi);
+            std::fprintf(file, "v %.7f %.7f %.7f\n", bump * std::sin(theta) * std::cos(phi), bump * std::cos(theta),
+                         bump * std::sin(theta) * std::sin(phi));
+        }
+    }
+    for(int r = 0; r < rings; r++){
+        for(int s = 0; s < segments; s++){
+            const int a = r * segments + s + 1, b = r * segments + (s + 1) % segments + 1;
+            std::fprintf(file, "f %d %d %d %d\n", a, b, b + segments, a + segments);
+        }
+    }
+    return std::fclose(file) == 0;
+}
+
+template<typename hit_fn>
+static void time_rays(const char *label, const std::vector<ray> &rays, hit_fn &&hit){
+    int hits = 0;
+    auto start = bench_clock::now();
+    for(const ray &r : rays){
+        hit_record rec{};
+        if(hit(r, rec)) hits++;
+    }
+    const double seconds = seconds_since(start);
+    std::printf("%-32s %10.2f Mrays/s  (%.1f%% hit)\n", label, rays.size() / seconds / 1e6, 100.0 * hits / rays.size());
+}
+
+int main(int argc, char **argv){
+    const int triangles = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    const std::string directory = argc > 2 ? argv[2] : "/tmp";
+    const std::string path = directory + "/mesh_bench.obj";
+
+    const int rings = std::max(2, static_cast<int>(std::sqrt(triangles / 4.0)));
+    if(!write_sphere_obj(path, rings, 2 * rings)){
+        std::fprintf(stderr, "couldn't write %s\n", path.c_str());
+        return -1;
+    }
+
+    const double rss_before = peak_rss_mb();
+    triangle_mesh mesh{};
+    std::string error{};
+    auto start = bench_clock::now();
+    if(!load_obj(path, mesh, error)){
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return -1;
+    }
+    const double load_seconds = seconds_since(start);
+    const double load_rss = peak_rss_mb() - rss_before;
+    const double file_mb = file_size_mb(path);
+    std::remove(path.c_str());
+
+    start = bench_clock::now();
+    mesh.build();
+    const double build_seconds = seconds_since(start);
+
+    std::printf("%zu triangles, %zu vertices, %.1f MB of OBJ\n", mesh.size(), mesh.vertices.size(), file_mb);
+    std::printf("load   %8.3f s  (%.1f MB/s, %.2f Mtriangles/s, peak RSS grew %.1f MB)\n", load_seconds,
+                file_mb / load_seconds, mesh.size() / load_seconds / 1e6, load_rss);
+    std::printf("build  %8.3f s\n", build_seconds);
+    std::printf("memory %8.1f MB  (%.1f bytes a triangle, buffers and tree)\n\n", mesh.memory_bytes() / 1048576.0,
+                static_cast<double>(mesh.memory_bytes()) / mesh.size());
+
+    sampler s(1);
+    const std::vector<ray> rays = random_rays(1000000, 1, s);
+    time_rays("mesh", rays, [&](const ray &r, hit_record &rec){ return mesh.hit(r, 0.001, infinity, rec); });
+
+    const mesh_instance identity(&mesh, transform{}, 0);
+    time_rays("instance, identity", rays, [&](const ray &r, hit_record &rec){
+        return identity.hit(r, 0.001, infinity, rec);
+    });
+
+    // the same placement as the mesh itself, reached through a rotation, a scale and a translation and their inverse
+    const transform there = transform::translate(vec3(3, -1, 2)) * transform::scale(vec3(2, 0.5, 1.5))
+                            * transform::rotate(vec3(1, 2, 3), 40);
+    std::vector<ray> moved_rays{};
+    moved_rays.reserve(rays.size());
+    for(const ray &r : rays) moved_rays.emplace_back(there.apply_point(r.origin()), there.apply_vector(r.direction()));
+    const mesh_instance moved(&mesh, there, 0);
+    time_rays("instance, rotated and scaled", moved_rays, [&](const ray &r, hit_record &rec){
+        return moved.hit(r, 0.001, infinity, rec);
+    });
+
+    // a grid of instances through the scene's top level tree, each one sharing the mesh
+    const int grid = 10;
+    scene world{};
+    const int mat = world.add_material<lambertian>(colour(0.5, 0.5, 0.5));
+    const int mesh_idx = world.add_mesh(std::move(mesh));
+    for(int x = 0; x < grid; x++)
+        for(int z = 0; z < grid; z++)
+            world.add_instance(mesh_idx, transform::translate(vec3(3 * (x - grid / 2), 0, 3 * (z - grid / 2))), mat);
+    start = bench_clock::now();
+    world.build();
+    const double instance_build = seconds_since(start);
+
+    const std::vector<ray> grid_rays = random_rays(1000000, 1.5 * grid, s);
+    char label[64];
+    std::snprintf(label, sizeof(label), "scene of %d instances", grid * grid);
+    time_rays(label, grid_rays, [&](const ray &r, hit_record &rec){ return world.hit(r, 0.001, infinity, rec); });
+
+    const double instance_bytes = world.instances.capacity() * sizeof(mesh_instance)
+                                  + world.instance_tree.nodes.capacity() * sizeof(bvh_flat_node);
+    std::printf("\n%d instances built in %.4f s, %.1f KB for all of them (%zu bytes each) against %.1f MB to copy "
+                "the mesh for each\n", grid * grid, instance_build, instance_bytes / 1024, sizeof(mesh_instance),
+                grid * grid * world.meshes[0]->memory_bytes() / 1048576.0);
+}
@@ -0,0 +1,76 @@
+// compares the two ways a tree over moving spheres can bound them, by the boxes at the ray's time, interpolated
+// between each node's boxes at either end of the shutter interval, against boxes swept over the whole interval, for
+// closest hit traversal speed with rays at random times, over random spheres moving further and further - either all
+// the same way (as the parts of something moving as a whole do), or each its own way, and which of the two
+// moving_sphere_store picks by itself
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "helper.h"
+
+#include "moving_sphere_store.h"
+
+#include "bench_common.h"
+
+static double trace_all(const hittable &world, const std::vector<ray> &rays, double &t_sum, int &hits){
+    auto start = bench_clock::now();
+    t_sum = 0;
+    hits = 0;
+    for(const ray &r : rays){
+        hit_record rec;
+        if(world.hit(r, 0.001, infinity, rec)){
+            t_sum += rec.t;
+            hits++;
+        }
+    }
+    return seconds_since(start);
+}
+
+int main(int argc, char **argv){
+    const int count = argc > 1 ? std::atoi(argv[1]) : 10000;
+    const int ray_count = 200000;
+    const material mat = lambertian(colour(0.5, 0.5, 0.5));
+
+    sampler s(21);
+    double half_size;
+    const std::vector<bench_sphere> spheres = random_spheres(count, s, half_size);
+    std::vector<ray> rays = random_rays(ray_count, half_size, s);
+    for(ray &r : rays) r.tm = random_double(s);
+
+    std::printf("%d spheres, %d rays at random times, Mrays/s\n", count, ray_count);
+    std::printf("%-12s %8s %14s %14s %10s %14s %s\n", "directions", "travel", "swept", "interpolated", "speedup",
+                "automatic", "hits agree");
+
+    // how far each sphere goes over the interval, against spheres of radius 0.05 to 0.25, about two units apart
+    for(bool same_way : { true, false })
+    for(double travel : { 0.0, 0.25, 1.0, 4.0, 16.0 }){
+        moving_sphere_store swept{}, interpolated{}, automatic{};
+        sampler direction(7);
+        const vec3 shared_direction = unit_vector(vec3(1, 0.5, 0.25));
+        for(const bench_sphere &sphere : spheres){
+            const vec3 way = same_way ? shared_direction : random_unit_vector(direction);
+            const point3 end = sphere.center + travel * way;
+            swept.add(sphere.center, end, sphere.radius, 0);
+            interpolated.add(sphere.center, end, sphere.radius, 0);
+            automatic.add(sphere.center, end, sphere.radius, 0);
+        }
+        swept.materials = interpolated.materials = automatic.materials = &mat;
+        swept.build(motion_bounds::swept);
+        interpolated.build(motion_bounds::interpolated);
+        automatic.build(motion_bounds::automatic);
+
+        double swept_t_sum, interpolated_t_sum;
+        int swept_hits, interpolated_hits;
+        const double swept_seconds = trace_all(swept, rays, swept_t_sum, swept_hits);
+        const double interpolated_seconds = trace_all(interpolated, rays, interpolated_t_sum, interpolated_hits);
+        const bool agree = swept_hits == interpolated_hits && swept_t_sum == interpolated_t_sum;
+
+        std::printf("%-12s %8.2f %14.3f %14.3f %9.2fx %14s %s\n", same_way ? "same" : "random", travel,
+                    ray_count / swept_seconds / 1e6, ray_count / interpolated_seconds / 1e6,
+                    swept_seconds / interpolated_seconds, automatic.tree.moving() ? "interpolated" : "swept",
+                    agree ? "yes" : "NO");
+        std::fflush(stdout);
+    }
+}
@@ -0,0 +1,148 @@
+// measures ray throughput, in millions of rays a second, for camera rays alone (traced one at a time, and in packets)
+// and for whole paths (in each of the render modes), over a scene of random spheres on a ground sphere, and checks
+// that every way of tracing finds the same hits and renders the same image
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "helper.h"
+
+#include "camera.h"
+#include "framebuffer.h"
+#include "integrator.h"
+#include "render.h"
+#include "scene.h"
+#include "tile_scheduler.h"
+
+#include "bench_common.h"
+
+// passes rays through to the scene, counting them, to find out how many rays a render traces
+class counting_hittable : public hittable {
+public:
+    explicit counting_hittable(const hittable &inner) : inner(inner) {}
+
+    bool hit(const ray &r, real t_min, real t_max, hit_record &rec) const override {
+        rays++;
+        return inner.hit(r, t_min, t_max, rec);
+    }
+
+    int hit_packet(const ray *rays_in, int count, real t_min, real t_max, hit_record *recs) const override {
+        rays += count;
+        return inner.hit_packet(rays_in, count, t_min, t_max, recs);
+    }
+
+    bool bounding_box(aabb &output_box) const override { return inner.bounding_box(output_box); }
+public:
+    mutable long long rays{};
+private:
+    const hittable &inner;
+};
+
+// the camera rays render_tile makes for a frame, tile by tile, pixel by pixel, sample by sample
+static std::vector<ray> camera_rays(const camera &cam, const render_settings &settings){
+    std::vector<ray> rays{};
+    for(const tile &t : make_tiles(settings.width, settings.height, settings.tile_size)){
+        for(int j = t.y0; j < t.y1; j++){
+            for(int i = t.x0; i < t.x1; i++){
+                for(int sample = 0; sample < settings.samples_per_pixel; sample++){
+                    sampler s = pixel_sampler(settings.seed, static_cast<size_t>(j) * settings.width + i, sample,
+                                                  settings.sequence);
+                    rays.push_back(camera_ray(cam, settings, i, j, s));
+                }
+            }
+        }
+    }
+    return rays;
+}
+
+static void primary_rays(const scene &world, const camera &cam, const render_settings &settings){
+    const std::vector<ray> rays = camera_rays(cam, settings);
+    const hittable &geometry = world.geometry();
+
+    double single_t_sum = 0;
+    auto start = bench_clock::now();
+    for(const ray &r : rays){
+        hit_record rec;
+        if(geometry.hit(r, path_t_min, infinity, rec)) single_t_sum += rec.t;
+    }
+    double single_seconds = seconds_since(start);
+
+    double packet_t_sum = 0;
+    hit_record recs[packet_size];
+    start = bench_clock::now();
+    for(size_t first = 0; first < rays.size(); first += packet_size){
+        const int count = static_cast<int>(std::min<size_t>(packet_size, rays.size() - first));
+        const int hits = geometry.hit_packet(&rays[first], count, path_t_min, infinity, recs);
+        for(int l = 0; l < count; l++)
+            if(hits & (1 << l)) packet_t_sum += recs[l].t;
+    }
+    double packet_seconds = seconds_since(start);
+
+    std::printf("%-24s %12.2f %12.2f %12s %s\n", "camera rays only", rays.size() / single_seconds / 1e6,
+                rays.size() / packet_seconds / 1e6, "", single_t_sum == packet_t_sum ? "yes" : "NO");
+}
+
+static double render_frame(const scene &world, const hittable &geometry, const camera &cam,
+                           const render_settings &settings, framebuffer &fb){
+    path_integrator integrator(world.frame.max_depth, 3);
+    render_scratch scratch{};
+    fb = framebuffer(settings.width, settings.height);
+
+    auto start = bench_clock::now();
+    for(const tile &t : make_tiles(settings.width, settings.height, settings.tile_size))
+        render_tile(t, cam, geometry, integrator, settings, settings.samples_per_pixel, fb, scratch);
+    return seconds_since(start);
+}
+
+static void full_paths(const scene &world, const camera &cam, render_settings settings){
+    // every mode traces exactly the same rays, so counting them once does for all of them
+    counting_hittable counter(world.geometry());
+    framebuffer fb{};
+    render_frame(world, counter, cam, settings, fb);
+    const double rays = static_cast<double>(counter.rays);
+
+    double seconds[3];
+    framebuffer images[3];
+    const render_mode modes[3] = { render_mode::path, render_mode::packet, render_mode::wavefront };
+    for(int m = 0; m < 3; m++){
+        settings.mode = modes[m];
+        seconds[m] = render_frame(world, world.geometry(), cam, settings, images[m]);
+    }
+
+    bool agree = true;
+    for(int m = 1; m < 3; m++)
+        for(size_t p = 0; p < images[0].pixels.size(); p++)
+            for(int c = 0; c < 3; c++)
+                agree = agree && images[0].pixels[p][c] == images[m].pixels[p][c];
+
+    std::printf("%-24s %12.2f %12.2f %12.2f %s   (%.2f rays per path)\n", "whole paths", rays / seconds[0] / 1e6,
+                rays / seconds[1] / 1e6, rays / seconds[2] / 1e6, agree ? "yes" : "NO",
+                rays / (static_cast<double>(settings.width) * settings.height * settings.samples_per_pixel));
+}
+
+int main(int argc, char **argv){
+    const int sphere_count = argc > 1 ? std::atoi(argv[1]) : 10000;
+
+    scene world = random_scene(sphere_count);
+    render_settings settings{};
+    settings.width = 320;
+    settings.height = 180;
+    settings.samples_per_pixel = 8;
+
+    std::printf("%d spheres, %dx%d at %d samples per pixel, Mrays/s\n", sphere_count, settings.width,
+                settings.height, settings.samples_per_pixel);
+
+    // a pinhole camera first, where the rays of a pixel all start at the same point, then one with a lens, where
+    // they start spread over it
+    const double apertures[2] = { 0.0, 0.2 };
+    for(double aperture : apertures){
+        world.view.aperture = aperture;
+        camera cam(world.view, static_cast<double>(settings.width) / settings.height);
+
+        std::printf("\naperture %.1f\n%-24s %12s %12s %12s %s\n", aperture, "", "one at a time", "packets",
+                    "wavefront", "agree");
+        primary_rays(world, cam, settings);
+        full_paths(world, cam, settings);
+    }
+}
@@ -0,0 +1,100 @@
+// renders the same scene in whichever precision and vec3 layout this copy was built with (meson builds a copy for
+// each, precision_bench_double, _float, _double_simd and _float_simd), timing it, and writes the image out as a PFM
+// named after the variant, given another variant's image as well, it reports how far this one's image is from it,
+// next to how far apart two renders of this variant with different seeds are, which is the noise the error has to be
+// compared against
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "helper.h"
+
+#include "camera.h"
+#include "framebuffer.h"
+#include "image_writer.h"
+#include "integrator.h"
+#include "render.h"
+#include "scene.h"
+
+#include "bench_common.h"
+
+static std::string variant_name(){
+    std::string name = sizeof(real) == sizeof(float) ? "float" : "double";
+#if defined(RT_VEC3_SIMD)
+    name += "_simd";
+#endif
+    return name;
+}
+
+// the error in what's displayed, after clamping and gamma correction, as PSNR in dB (higher is closer), along with
+// the fraction of pixels an 8 bit image would show differently by more than 2 levels
+static void compare(const image &a, const image &b, double &psnr, double &differing){
+    size_t differing_pixels = 0;
+    for(size_t p = 0; p < a.rgb.size() / 3; p++){
+        bool differs = false;
+        for(int c = 0; c < 3; c++){
+            const double x = std::sqrt(clamp(a.rgb[3 * p + c], 0, 1));
+            const double y = std::sqrt(clamp(b.rgb[3 * p + c], 0, 1));
+            differs = differs || std::fabs(x - y) * 255 > 2;
+        }
+        if(differs) differing_pixels++;
+    }
+    const double error = rmse(a, b);
+    psnr = error > 0 ? 20 * std::log10(1 / error) : infinity;
+    differing = static_cast<double>(differing_pixels) / (a.rgb.size() / 3);
+}
+
+int main(int argc, char **argv){
+    const std::string reference_path = argc > 1 ? argv[1] : "";
+    const int sphere_count = argc > 2 ? std::atoi(argv[2]) : 500;
+
+    scene world = random_scene(sphere_count);
+    world.view.aperture = 0.1;
+    render_settings settings{};
+    settings.width = 320;
+    settings.height = 180;
+    settings.samples_per_pixel = 32;
+    settings.report_progress = false;
+
+    framebuffer fb{};
+    const double seconds = render_frame(world, settings, fb);
+    const image img = resolve(fb);
+    const std::string image_path = "precision_bench_" + variant_name() + ".pfm";
+    if(!write_image(img, pfm_encoder{}, image_path)){
+        std::fprintf(stderr, "couldn't write %s\n", image_path.c_str());
+        return -1;
+    }
+
+    std::printf("%-12s %10s %10s %12s %10s %12s %12s\n", "variant", "vec3 B", "ray B", "sphere B", "node B",
+                "render s", "Msamples/s");
+    std::printf("%-12s %10zu %10zu %12zu %10zu %12.3f %12.3f\n", variant_name().c_str(), sizeof(vec3), sizeof(ray),
+                4 * sizeof(real) + sizeof(int), sizeof(bvh_flat_node), seconds,
+                static_cast<double>(settings.width) * settings.height * settings.samples_per_pixel / seconds / 1e6);
+    std::printf("wrote %s\n", image_path.c_str());
+
+    if(reference_path.empty()) return 0;
+
+    image reference{};
+    std::string error{};
+    if(!load_pfm(reference_path, reference, error)){
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return -1;
+    }
+    if(reference.width != img.width || reference.height != img.height){
+        std::fprintf(stderr, "%s is a different size\n", reference_path.c_str());
+        return -1;
+    }
+
+    settings.seed += 1;
+    render_frame(world, settings, fb);
+    double error_psnr, error_differing, noise_psnr, noise_differing;
+    compare(img, reference, error_psnr, error_differing);
+    compare(img, resolve(fb), noise_psnr, noise_differing);
+
+    std::printf("\n%-40s %10s %18s\n", "", "PSNR dB", "pixels off > 2/255");
+    std::printf("%-40s %10.2f %17.2f%%\n", ("against " + reference_path).c_str(), error_psnr, 100 * error_differing);
+    std::printf("%-40s %10.2f %17.2f%%\n", "against another seed", noise_psnr, 100 * noise_differing);
+}
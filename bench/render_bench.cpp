@@ -0,0 +1,221 @@
+// renders a fixed set of scenes at fixed seeds, so runs can be compared from one change to the next, and reports for
+// each the rays traced a second, where the time went (generating camera rays, traversing the scene, scattering off
+// materials, writing the image out) and how deep paths went on average, it's always built with the profiling counters
+// compiled in (RT_PROFILE), so it's a little slower than the renderer is without them
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "helper.h"
+
+#include "camera.h"
+#include "framebuffer.h"
+#include "image_writer.h"
+#include "integrator.h"
+#include "profile.h"
+#include "render.h"
+#include "scene.h"
+#include "scene_file.h"
+
+#include "bench_common.h"
+
+// the scenes are all small enough to render in a few seconds at the default settings
+static const int bench_width = 320;
+static const int bench_height = 180;
+
+static void set_view(scene &world, const point3 &from, const point3 &at, double fov){
+    world.view.look_from = from;
+    world.view.look_at = at;
+    world.view.vertical_fov = fov;
+    world.frame.width = bench_width;
+    world.frame.height = bench_height;
+}
+
+// thousands of small spheres of every material on a ground sphere, where traversal dominates
+static scene many_spheres(){
+    scene world{};
+    sampler s(1);
+    int ground = world.add_material<lambertian>(colour(0.5, 0.5, 0.5));
+    world.spheres.add(point3(0, -1000, 0), 1000, ground);
+
+    const int count = 10000;
+    const double half_size = std::sqrt(static_cast<double>(count)) * 0.5;
+    for(int i = 0; i < count; i++){
+        material mat{};
+        double choice = random_double(s);
+        if(choice < 0.6) mat = lambertian(vec3::random(s));
+        else if(choice < 0.9) mat = metal(vec3::random(s, 0.5, 1), random_double(s, 0, 0.3));
+        else mat = dielectric(1.5);
+
+        const double radius = random_double(s, 0.1, 0.3);
+        point3 center(random_double(s, -half_size, half_size), radius, random_double(s, -half_size, half_size));
+        world.spheres.add(center, radius, world.spheres.add_material(mat));
+    }
+    world.build();
+    set_view(world, point3(0, 3, half_size + 3), point3(0, 0, 0), 40);
+    return world;
+}
+
+// a cluster of glass spheres, some hollow, in front of a few coloured ones, where paths refract many times over
+static scene glass_heavy(){
+    scene world{};
+    sampler s(2);
+    int ground = world.add_material<lambertian>(colour(0.4, 0.4, 0.4));
+    int glass = world.add_material<dielectric>(1.5);
+    world.spheres.add(point3(0, -1000, 0), 1000, ground);
+
+    for(int i = 0; i < 60; i++){
+        const double radius = random_double(s, 0.3, 0.6);
+        point3 center(random_double(s, -4, 4), radius, random_double(s, -4, 2));
+        world.spheres.add(center, radius, glass);
+        if(i % 3 == 0) world.spheres.add(center, -0.9 * radius, glass); // a hollow one
+    }
+    for(int i = 0; i < 6; i++){
+        int mat = world.add_material<lambertian>(vec3::random(s, 0.2, 0.9));
+        world.spheres.add(point3(-5 + 2 * i, 1, -6), 1, mat);
+    }
+    world.build();
+    set_view(world, point3(0, 2.5, 8), point3(0, 0.5, -1), 45);
+    return world;
+}
+
+// a handful of spheres filling a small part of the view, so most camera rays go straight to the sky
+static scene sky_dominated(){
+    scene world{};
+    int diffuse = world.add_material<lambertian>(colour(0.7, 0.3, 0.3));
+    int mirror = world.add_material<metal>(colour(0.8, 0.8, 0.8), 0.0);
+    world.spheres.add(point3(-1, 0, -1), 0.5, diffuse);
+    world.spheres.add(point3(0, 0, -1), 0.5, mirror);
+    world.spheres.add(point3(1, 0, -1), 0.5, diffuse);
+    world.build();
+    set_view(world, point3(0, 1, 8), point3(0, 0, -1), 40);
+    return world;
+}
+
+struct bench_result {
+    std::string name{};
+    double seconds{};
+    profile_totals totals{};
+};
+
+static bench_result run(const std::string &name, const scene &world, const render_settings &base, int max_depth){
+    render_settings settings = base;
+    settings.width = world.frame.width;
+    settings.height = world.frame.height;
+    camera cam(world.view, static_cast<double>(settings.width) / settings.height);
+    path_integrator integrator(max_depth, 3);
+
+    framebuffer fb{};
+    profile_reset();
+    auto start = bench_clock::now();
+    render(cam, world.geometry(), integrator, settings, fb);
+    {
+        RT_PROFILE_SCOPE(output);
+        write_image(resolve(fb), ppm_encoder{}, "render_bench_" + name + ".ppm");
+    }
+
+    bench_result result{};
+    result.name = name;
+    result.seconds = seconds_since(start);
+    result.totals = profile_read();
+    return result;
+}
+
+static void print_result(const bench_result &r){
+    const profile_totals &t = r.totals;
+    double stage_total = 0;
+    for(int s = 0; s < profile_stage_count; s++) stage_total += t.stage_seconds[s];
+    auto share = [&](profile_stage s){ return stage_total > 0 ? 100 * t.seconds(s) / stage_total : 0; };
+
+    std::printf("%-14s %9.3f %10.2f %9.1f%% %9.1f%% %9.1f%% %9.1f%% %10.2f\n", r.name.c_str(), r.seconds,
+                t.count(profile_counter::rays) / r.seconds / 1e6, share(profile_stage::camera),
+                share(profile_stage::traversal), share(profile_stage::scatter), share(profile_stage::output),
+                static_cast<double>(t.count(profile_counter::bounces)) / std::max(1LL, t.count(profile_counter::paths)));
+}
+
+static bool write_json(const std::string &path, const std::vector<bench_result> &results,
+                       const render_settings &settings){
+    FILE *file = std::fopen(path.c_str(), "w");
+    if(!file) return false;
+
+    std::fprintf(file, "{\n  \"threads\": %d,\n  \"samples_per_pixel\": %d,\n  \"seed\": %llu,\n  \"scenes\": [\n",
+                 settings.num_threads, settings.samples_per_pixel, static_cast<unsigned long long>(settings.seed));
+    for(size_t i = 0; i < results.size(); i++){
+        const bench_result &r = results[i];
+        std::fprintf(file, "    {\n      \"name\": \"%s\",\n      \"seconds\": %.6f,\n      \"rays_per_second\": %.1f,\n",
+                     r.name.c_str(), r.seconds, r.totals.count(profile_counter::rays) / r.seconds);
+        write_profile_json(file, r.totals, "      ");
+        std::fprintf(file, "\n    }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(file, "  ]\n}\n");
+    return std::fclose(file) == 0;
+}
+
+int main(int argc, char **argv){
+    render_settings settings{};
+    settings.num_threads = std::max(1u, std::thread::hardware_concurrency());
+    settings.samples_per_pixel = 16;
+    settings.seed = 0;
+    std::string scene_dir = "scenes";
+    std::string json_path{};
+    std::string only{};
+
+    for(int arg = 1; arg < argc; arg++){
+        if(std::strcmp(argv[arg], "--threads") == 0 && arg + 1 < argc){
+            settings.num_threads = std::atoi(argv[++arg]);
+        }else if(std::strcmp(argv[arg], "--samples") == 0 && arg + 1 < argc){
+            settings.samples_per_pixel = std::atoi(argv[++arg]);
+        }else if(std::strcmp(argv[arg], "--scenes") == 0 && arg + 1 < argc){
+            scene_dir = argv[++arg];
+        }else if(std::strcmp(argv[arg], "--json") == 0 && arg + 1 < argc){
+            json_path = argv[++arg];
+        }else if(std::strcmp(argv[arg], "--only") == 0 && arg + 1 < argc){
+            only = argv[++arg];
+        }else{
+            std::fprintf(stderr, "Usage: %s [--threads N] [--samples N] [--scenes DIR] [--json FILE] [--only NAME]\n",
+                         argv[0]);
+            return -1;
+        }
+    }
+
+    if(settings.num_threads < 1 || settings.samples_per_pixel < 1){
+        std::fprintf(stderr, "Thread and sample counts must both be at least 1\n");
+        return -1;
+    }
+
+    // the demo scene, at a smaller size, is read from the repository so it stays the one the renderer shows
+    scene demo{};
+    std::string error{};
+    if(!load_scene(scene_dir + "/demo.scene", demo, error)){
+        std::fprintf(stderr, "Couldn't load the demo scene, %s (run it from the repository root, or pass --scenes)\n",
+                     error.c_str());
+        return -1;
+    }
+    demo.frame.width = bench_width;
+    demo.frame.height = bench_height;
+
+    std::vector<bench_result> results{};
+    auto bench = [&](const std::string &name, const scene &world){
+        if(!only.empty() && only != name) return;
+        results.push_back(run(name, world, settings, world.frame.max_depth));
+        std::fprintf(stderr, "\r%40s\r", ""); // clears the progress line render leaves
+        print_result(results.back());
+    };
+
+    std::printf("%d threads, %dx%d at %d samples per pixel\n", settings.num_threads, bench_width, bench_height,
+                settings.samples_per_pixel);
+    std::printf("%-14s %9s %10s %10s %10s %10s %10s %10s\n", "scene", "seconds", "Mrays/s", "camera", "traversal",
+                "scatter", "output", "bounces");
+    bench("demo", demo);
+    bench("many_spheres", many_spheres());
+    bench("glass_heavy", glass_heavy());
+    bench("sky_dominated", sky_dominated());
+
+    if(!json_path.empty() && !write_json(json_path, results, settings)){
+        std::fprintf(stderr, "Couldn't write %s\n", json_path.c_str());
+        return -1;
+    }
+}
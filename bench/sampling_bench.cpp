@@ -0,0 +1,103 @@
+// compares the closed form samplers in sampling.h against the rejection sampling they replaced, in samples a second,
+// then renders the demo scene at a few sample counts with each sample_sequence, reporting the error against a
+// reference render of many more samples, so the noise each sequence leaves at the same sample count can be compared
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "helper.h"
+
+#include "camera.h"
+#include "framebuffer.h"
+#include "integrator.h"
+#include "render.h"
+#include "scene.h"
+#include "scene_file.h"
+
+#include "bench_common.h"
+
+// the samplers as they were, retrying until a point lands inside
+static vec3 rejection_in_unit_sphere(sampler &s){
+    while(true){
+        auto point = vec3::random(s, -1, 1);
+        if(point.length_squared() >= 1) continue;
+        return point;
+    }
+}
+
+static vec3 rejection_in_unit_disk(sampler &s){
+    while(true){
+        auto p = vec3(random_double(s, -1, 1), random_double(s, -1, 1), 0);
+        if(p.length_squared() >= 1) continue;
+        return p;
+    }
+}
+
+template<typename sample_fn>
+static void time_sampler(const char *name, sample_fn &&sample){
+    const int count = 10000000;
+    sampler s(1);
+    vec3 sum{};
+    auto start = bench_clock::now();
+    for(int i = 0; i < count; i++) sum += sample(s);
+    const double seconds = seconds_since(start);
+    std::printf("%-32s %12.1f   (mean %+.4f %+.4f %+.4f)\n", name, count / seconds / 1e6, sum.x() / count,
+                sum.y() / count, sum.z() / count);
+}
+
+int main(int argc, char **argv){
+    const std::string scene_path = argc > 1 ? argv[1] : "scenes/demo.scene";
+    const int reference_samples = argc > 2 ? std::atoi(argv[2]) : 1024;
+
+    std::printf("%-32s %12s\n", "sampler", "Msamples/s");
+    time_sampler("unit sphere, rejection", rejection_in_unit_sphere);
+    time_sampler("unit ball, closed form", random_in_unit_sphere);
+    time_sampler("unit disk, rejection", rejection_in_unit_disk);
+    time_sampler("unit disk, concentric", random_in_unit_disk);
+    time_sampler("normal + unit vector", [](sampler &s){ return vec3(0, 0, 1) + random_unit_vector(s); });
+    time_sampler("cosine hemisphere", [](sampler &s){ return random_cosine_direction(vec3(0, 0, 1), s); });
+
+    scene world{};
+    std::string error{};
+    if(!load_scene(scene_path, world, error)){
+        std::fprintf(stderr, "Couldn't load the scene, %s\n", error.c_str());
+        return -1;
+    }
+
+    render_settings settings{};
+    settings.width = 160;
+    settings.height = 90;
+    settings.num_threads = std::max(1u, std::thread::hardware_concurrency());
+    settings.report_progress = false;
+    settings.samples_per_pixel = reference_samples;
+    settings.sequence = sample_sequence::random;
+    settings.seed = 12345; // so the reference's noise is unrelated to the renders compared against it
+    framebuffer fb{};
+    render_frame(world, settings, fb);
+    const image reference = resolve(fb);
+
+    const int sample_counts[] = { 4, 16, 64 };
+    const sample_sequence sequences[] = { sample_sequence::random, sample_sequence::halton, sample_sequence::sobol };
+    const char *names[] = { "random", "halton", "sobol" };
+
+    std::printf("\n%dx%d, RMSE against %d random samples per pixel\n%-12s", settings.width, settings.height,
+                reference_samples, "spp");
+    for(const char *name : names) std::printf(" %10s", name);
+    std::printf("\n");
+
+    settings.seed = 0;
+    for(int spp : sample_counts){
+        settings.samples_per_pixel = spp;
+        std::printf("%-12d", spp);
+        for(sample_sequence sequence : sequences){
+            settings.sequence = sequence;
+            render_frame(world, settings, fb);
+            std::printf(" %10.5f", rmse(resolve(fb), reference));
+            std::fflush(stdout);
+        }
+        std::printf("\n");
+    }
+}
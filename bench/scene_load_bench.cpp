@@ -0,0 +1,103 @@
+// measures loading a scene of a million random spheres (or however many are asked for) from the text format, and
+// from the binary format, each load is done in a child process of its own, so the peak memory use reported for it is
+// its own, and not whatever the process happened to reach before
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "helper.h"
+
+#include "scene_file.h"
+
+#include "bench_common.h"
+
+// the memory the loaded scene itself takes, the sphere arrays, the tree and the materials
+static double scene_size_mb(const scene &world){
+    const sphere_store &spheres = world.spheres;
+    double bytes = spheres.center_x.size() * sizeof(double) * 4 + spheres.material_idx.size() * sizeof(int)
+                   + spheres.tree.nodes.size() * sizeof(bvh_flat_node) + spheres.tree.indices.size() * sizeof(int)
+                   + spheres.materials.size() * sizeof(material);
+    return bytes / (1024.0 * 1024.0);
+}
+
+// writes a scene of count random spheres out as text, a line at a time, so this process stays small
+static bool write_random_scene(const std::string &path, int count){
+    FILE *file = std::fopen(path.c_str(), "w");
+    if(!file) return false;
+
+    sampler s(static_cast<uint64_t>(count));
+    const int material_count = 16;
+    double half_size = std::cbrt(static_cast<double>(count));
+    std::fprintf(file, "camera from %.17g 0 0 at 0 0 0 fov 40\nimage width 640 height 360\n", 3 * half_size);
+    for(int m = 0; m < material_count; m++){
+        colour albedo = vec3::random(s);
+        std::fprintf(file, "material m%d metal %.17g %.17g %.17g %.17g\n", m, albedo[0], albedo[1], albedo[2],
+                     random_double(s, 0, 0.5));
+    }
+    for(int i = 0; i < count; i++){
+        point3 center = vec3::random(s, -half_size, half_size);
+        std::fprintf(file, "sphere %.17g %.17g %.17g %.17g m%d\n", center[0], center[1], center[2],
+                     random_double(s, 0.05, 0.25), static_cast<int>(random_double(s) * material_count));
+    }
+    return std::fclose(file) == 0;
+}
+
+// loads the scene in a child process, timing it and printing a row for it
+static bool load_in_child(const char *label, const std::string &path, const std::string &save_path = ""){
+    std::fflush(stdout);
+    pid_t child = fork();
+    if(child < 0) return false;
+
+    if(child == 0){
+        double rss_before = peak_rss_mb();
+        scene world{};
+        std::string error{};
+        auto start = bench_clock::now();
+        bool ok = load_scene(path, world, error);
+        double seconds = seconds_since(start);
+
+        if(!ok){
+            std::fprintf(stderr, "%s\n", error.c_str());
+            std::_Exit(1);
+        }
+        std::printf("%-8s %10zu %12.3f %12.1f %12.1f %12.1f %12.1f\n", label, world.spheres.size(), seconds,
+                    file_size_mb(path), scene_size_mb(world), peak_rss_mb(), peak_rss_mb() - rss_before);
+
+        if(!save_path.empty() && !save_scene_binary(world, save_path, error)){
+            std::fprintf(stderr, "%s\n", error.c_str());
+            std::_Exit(1);
+        }
+        std::fflush(stdout);
+        std::_Exit(0);
+    }
+
+    int status = 0;
+    waitpid(child, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main(int argc, char **argv){
+    const int count = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    const std::string directory = argc > 2 ? argv[2] : "/tmp";
+    const std::string text_path = directory + "/scene_load_bench.scene";
+    const std::string binary_path = directory + "/scene_load_bench.rtscene";
+
+    if(!write_random_scene(text_path, count)){
+        std::fprintf(stderr, "couldn't write %s\n", text_path.c_str());
+        return -1;
+    }
+
+    std::printf("%-8s %10s %12s %12s %12s %12s %12s\n",
+                "format", "spheres", "load s", "file MB", "scene MB", "peak RSS MB", "load RSS MB");
+
+    // the text load parses and builds the tree, then saves the binary file the second load reads
+    bool ok = load_in_child("text", text_path, binary_path) && load_in_child("binary", binary_path);
+
+    std::remove(text_path.c_str());
+    std::remove(binary_path.c_str());
+    return ok ? 0 : -1;
+}
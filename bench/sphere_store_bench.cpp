@@ -0,0 +1,83 @@
+// compares closest hit traversal through the packed sphere_store against separately allocated spheres, both scanned
+// linearly and through a bvh, and checks that every version finds exactly the same hits
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "helper.h"
+
+#include "material.h"
+
+#include "sphere.h"
+#include "hittable_list.h"
+#include "bvh.h"
+#include "sphere_store.h"
+
+#include "bench_common.h"
+
+struct trace_result {
+    double seconds{};
+    double t_sum{};
+    int hits{};
+};
+
+static trace_result trace_all(const hittable &world, const std::vector<ray> &rays, size_t count){
+    trace_result result{};
+    auto start = bench_clock::now();
+    for(size_t i = 0; i < count; i++){
+        hit_record rec;
+        if(world.hit(rays[i], 0.001, infinity, rec)){
+            result.t_sum += rec.t;
+            result.hits++;
+        }
+    }
+    result.seconds = seconds_since(start);
+    return result;
+}
+
+int main(int argc, char **argv){
+    const int max_count = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    const int ray_count = 200000;
+    const double linear_tests_budget = 1e8; // caps rays * objects for the linear scans, which are far too slow otherwise
+
+    std::printf("sphere_store SIMD width: %d doubles\n", sphere_store::simd_width);
+    std::printf("%10s %14s %14s %14s %14s %s\n",
+                "objects", "list rays/s", "store rays/s", "bvh rays/s", "store bvh", "hits agree");
+
+    for(int count = 100; count <= max_count; count *= 10){
+        sampler s(static_cast<uint64_t>(count));
+        double half_size = 0;
+        std::vector<bench_sphere> spheres = random_spheres(count, s, half_size);
+        std::vector<ray> rays = random_rays(ray_count, half_size, s);
+        size_t linear_rays = std::max<size_t>(100, std::min<size_t>(rays.size(), linear_tests_budget / count));
+
+        auto mat = make_shared<lambertian>(colour(0.5, 0.5, 0.5));
+        hittable_list list{};
+        sphere_store linear_store{};
+        int mat_idx = linear_store.add_material(*mat);
+        for(const auto &sph : spheres){
+            list.add(make_shared<sphere>(sph.center, sph.radius, mat));
+            linear_store.add(sph.center, sph.radius, mat_idx);
+        }
+
+        bvh_node bvh(list);
+        sphere_store store = linear_store;
+        store.build();
+
+        trace_result list_result = trace_all(list, rays, linear_rays);
+        trace_result linear_store_result = trace_all(linear_store, rays, linear_rays);
+        trace_result bvh_check = trace_all(bvh, rays, linear_rays);
+        trace_result store_check = trace_all(store, rays, linear_rays);
+        bool agree = list_result.hits == linear_store_result.hits && list_result.t_sum == linear_store_result.t_sum
+                     && list_result.hits == bvh_check.hits && list_result.t_sum == bvh_check.t_sum
+                     && list_result.hits == store_check.hits && list_result.t_sum == store_check.t_sum;
+
+        trace_result bvh_result = trace_all(bvh, rays, rays.size());
+        trace_result store_result = trace_all(store, rays, rays.size());
+
+        std::printf("%10d %14.0f %14.0f %14.0f %14.0f %s\n", count,
+                    linear_rays / list_result.seconds, linear_rays / linear_store_result.seconds,
+                    rays.size() / bvh_result.seconds, rays.size() / store_result.seconds, agree ? "yes" : "NO");
+    }
+}
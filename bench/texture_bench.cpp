@@ -0,0 +1,165 @@
+// writes a texture of 2048 by 2048 texels (or however many are asked for) to a PPM file, times making its tiled file
+// (which only happens the first time it's opened), then looks it up the way a render of a plane stretching away from
+// the camera would, with footprints growing with distance, from every thread
+// at once - under a budget big enough for all of it, then smaller and smaller ones, printing the lookups a second, the
+// hit rate of the shared cache, what was loaded and evicted, and that every budget gives exactly the same colours,
+// then the same without filtering (always the finest level), against loading the whole image up front
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "helper.h"
+
+#include "texture.h"
+
+#include "bench_common.h"
+
+// coloured squares with a fine pattern over them, so neither the finest level nor any coarser one is flat
+static bool write_texture(const std::string &path, int size){
+    FILE *file = std::fopen(path.c_str(), "wb");
+    if(!file) return false;
+    std::fprintf(file, "P6\n%d %d\n255\n", size, size);
+    std::vector<unsigned char> row(3 * static_cast<size_t>(size));
+    bool ok = true;
+    for(int y = 0; y < size && ok; y++){
+        for(int x = 0; x < size; x++){
+            const int square = (x / 64) * 7 + (y / 64) * 13;
+            const int detail = ((x ^ y) & 7) * 8;
+            row[3 * x] = static_cast<unsigned char>((square * 37) % 192 + detail);
+            row[3 * x + 1] = static_cast<unsigned char>((square * 59) % 192 + detail);
+            row[3 * x + 2] = static_cast<unsigned char>((square * 83) % 192 + detail);
+        }
+        ok = std::fwrite(row.data(), 1, row.size(), file) == row.size();
+    }
+    return std::fclose(file) == 0 && ok;
+}
+
+// the lookups a view of a plane makes, pixel by pixel, a row at a time - the plane repeats the texture every 4 units,
+// and the camera's a unit above it looking at the horizon, so a row further up the image is further away, covering
+// more of the plane across the same pixels
+struct plane_view {
+    int width{512};
+    int height{256};
+
+    // where pixel x, y (jittered by jx, jy) lands in uv, and how wide the pixel is there
+    void lookup(int x, int y, double jx, double jy, real &u, real &v, real &footprint) const {
+        const double distance = height / (y + jy + 1.0); // in units, from 256 at the top row to 1 at the bottom
+        const double across = (x + jx - width / 2.0) / width * distance;
+        u = static_cast<real>(across / 4);
+        v = static_cast<real>(distance / 4);
+        footprint = static_cast<real>(distance / width / 4); // a pixel's width in uv, much the same across and along
+    }
+};
+
+// every thread takes every thread_count'th row, as render threads take tiles, returning the colours' sum
+static double run_lookups(const texture &tex, const plane_view &view, int samples, int thread_count, bool filtered,
+                          double &seconds){
+    std::vector<double> sums(thread_count, 0);
+    auto start = bench_clock::now();
+    std::vector<std::thread> threads{};
+    for(int t = 0; t < thread_count; t++){
+        threads.emplace_back([&, t](){
+            sampler s(static_cast<uint64_t>(t) + 1);
+            double sum = 0;
+            for(int y = t; y < view.height; y += thread_count){
+                for(int x = 0; x < view.width; x++){
+                    for(int k = 0; k < samples; k++){
+                        real u, v, footprint;
+                        view.lookup(x, y, random_double(s), random_double(s), u, v, footprint);
+                        const colour c = tex.sample(u, v, filtered ? footprint : 0);
+                        sum += c[0] + c[1] + c[2];
+                    }
+                }
+            }
+            sums[t] = sum;
+        });
+    }
+    for(std::thread &thread : threads) thread.join();
+    seconds = seconds_since(start);
+
+    double total = 0;
+    for(double sum : sums) total += sum;
+    return total;
+}
+
+int main(int argc, char **argv){
+    const int size = argc > 1 ? std::atoi(argv[1]) : 2048;
+    const std::string directory = argc > 2 ? argv[2] : "/tmp";
+    const int thread_count = std::max(1u, std::thread::hardware_concurrency());
+    const int samples = 4;
+
+    const std::string path = directory + "/texture_bench.ppm";
+    if(!write_texture(path, size)){
+        std::fprintf(stderr, "Couldn't write %s\n", path.c_str());
+        return -1;
+    }
+
+    const std::string tiled_path = path + ".tiles";
+    std::remove(tiled_path.c_str());
+    {
+        auto start = bench_clock::now();
+        texture_cache cache{};
+        std::string error{};
+        if(cache.open(path, error) < 0){
+            std::fprintf(stderr, "Couldn't open the texture, %s\n", error.c_str());
+            return -1;
+        }
+        const double tiling = seconds_since(start);
+        start = bench_clock::now();
+        texture_cache again{};
+        again.open(path, error);
+        std::printf("making the tiled file took %.3f s, opening it again %.6f s\n", tiling, seconds_since(start));
+    }
+
+    const plane_view view{};
+    const double lookups = static_cast<double>(view.width) * view.height * samples;
+    const double whole_mb = size * static_cast<double>(size) * 3 * 4 / 3 / 1048576;
+    std::printf("a %dx%d texture, %.1f MB with every level, %d threads, %.0f lookups a run\n", size, size,
+                whole_mb, thread_count, lookups);
+    std::printf("%-10s %12s %14s %10s %12s %12s %10s %10s\n", "budget MB", "filtering", "Mlookups/s", "hit %",
+                "loaded MB", "evicted", "held MB", "same");
+
+    double reference_sum = 0;
+    const double budgets_mb[] = { 1024, 16, 4, 1, 0.25 };
+    for(int run = 0; run < 6; run++){
+        const bool filtered = run < 5;
+        const double budget_mb = filtered ? budgets_mb[run] : 1024;
+
+        texture_cache cache(static_cast<size_t>(budget_mb * 1048576));
+        std::string error{};
+        const int idx = cache.open(path, error);
+        if(idx < 0){
+            std::fprintf(stderr, "Couldn't open the texture, %s\n", error.c_str());
+            return -1;
+        }
+
+        double seconds;
+        const double sum = run_lookups(cache.get(idx), view, samples, thread_count, filtered, seconds);
+        if(run == 0) reference_sum = sum;
+        const texture_cache_stats stats = cache.stats();
+        std::printf("%-10g %12s %14.2f %10.1f %12.1f %12llu %10.1f %10s\n", budget_mb, filtered ? "trilinear" : "none",
+                    lookups / seconds / 1e6, 100 * stats.hit_rate(), stats.bytes_loaded / 1048576.0,
+                    static_cast<unsigned long long>(stats.evictions), stats.bytes_held / 1048576.0,
+                    !filtered ? "-" : sum == reference_sum ? "yes" : "NO");
+        std::fflush(stdout);
+    }
+
+    // loading every texel of the finest level up front, as reading the whole image would
+    auto start = bench_clock::now();
+    texture_cache cache(size_t(1) << 40);
+    std::string error{};
+    const texture &tex = cache.get(cache.open(path, error));
+    double sum = 0;
+    for(int ty = 0; ty * texture_tile_size < tex.height(); ty++)
+        for(int tx = 0; tx * texture_tile_size < tex.width(); tx++)
+            sum += cache.tile(tex, 0, tx, ty).texel(0, 0)[0];
+    std::printf("\nloading all of the finest level up front: %.3f s, %.1f MB (checksum %g)\n", seconds_since(start),
+                cache.stats().bytes_held / 1048576.0, sum);
+    std::remove(path.c_str());
+    std::remove(tiled_path.c_str());
+}
@@ -0,0 +1,79 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include <algorithm>
+
+#include "helper.h"
+
+// axis aligned bounding box, by default it's empty (minimum is above maximum), so growing it by anything just gives
+// that thing's box
+class aabb {
+public:
+    aabb() = default;
+    aabb(const point3 &minimum, const point3 &maximum) : minimum(minimum), maximum(maximum) {}
+
+    point3 min() const { return minimum; }
+    point3 max() const { return maximum; }
+
+    bool empty() const { return minimum[0] > maximum[0] || minimum[1] > maximum[1] || minimum[2] > maximum[2]; }
+
+    point3 centroid() const { return 0.5 * (minimum + maximum); }
+
+    double surface_area() const {
+        if(empty()) return 0;
+        vec3 d = maximum - minimum;
+        return 2.0 * (d[0]*d[1] + d[1]*d[2] + d[2]*d[0]);
+    }
+
+    int longest_axis() const {
+        vec3 d = maximum - minimum;
+        if(d[0] > d[1] && d[0] > d[2]) return 0;
+        return d[1] > d[2] ? 1 : 2;
+    }
+
+    void expand(const point3 &p){
+        for(int a = 0; a < 3; a++){
+            minimum[a] = std::min(minimum[a], p[a]);
+            maximum[a] = std::max(maximum[a], p[a]);
+        }
+    }
+
+    void expand(const aabb &box){
+        for(int a = 0; a < 3; a++){
+            minimum[a] = std::min(minimum[a], box.minimum[a]);
+            maximum[a] = std::max(maximum[a], box.maximum[a]);
+        }
+    }
+
+    // slab test, inv_dir is 1/direction per component, worked out once per ray rather than once per box, an
+    // infinite component (ray parallel to a slab) still works since the products become +-infinity
+    bool hit(const point3 &origin, const vec3 &inv_dir, real t_min, real t_max) const {
+        for(int a = 0; a < 3; a++){
+            real t0 = (minimum[a] - origin[a]) * inv_dir[a];
+            real t1 = (maximum[a] - origin[a]) * inv_dir[a];
+            if(inv_dir[a] < 0.0) std::swap(t0, t1);
+
+            // written so that a NaN (0 * infinity, for an origin on the slab) leaves the interval as it was
+            t_min = t0 > t_min ? t0 : t_min;
+            t_max = t1 < t_max ? t1 : t_max;
+            if(t_max < t_min) return false;
+        }
+        return true;
+    }
+
+    bool hit(const ray &r, real t_min, real t_max) const {
+        vec3 d = r.direction();
+        return hit(r.origin(), vec3(1 / d[0], 1 / d[1], 1 / d[2]), t_min, t_max);
+    }
+public:
+    point3 minimum{point3(infinity, infinity, infinity)};
+    point3 maximum{point3(-infinity, -infinity, -infinity)};
+};
+
+inline aabb surrounding_box(const aabb &box0, const aabb &box1){
+    aabb box = box0;
+    box.expand(box1);
+    return box;
+}
+
+#endif // AABB_H
@@ -0,0 +1,170 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <algorithm>
+#include <vector>
+
+#include "helper.h"
+
+#include "camera.h"
+#include "transform.h"
+
+// a camera as it's keyed at one frame of an animation
+struct camera_key {
+    int frame{};
+    camera_settings view{};
+};
+
+// where a moving instance is at one frame, as a translation, a rotation (about an axis, in degrees) and a scale,
+// applied scale first, then rotation, then translation, on top of wherever the instance's own line put it
+struct motion_key {
+    int frame{};
+    vec3 translation{0, 0, 0};
+    vec3 axis{0, 1, 0};
+    double degrees{};
+    vec3 scale{1, 1, 1};
+
+    transform to_transform() const {
+        return transform::translate(translation) * transform::rotate(axis, degrees) * transform::scale(scale);
+    }
+};
+
+// the keys of one instance, by its index in scene::instances
+struct instance_track {
+    int instance{};
+    transform placement{}; // the instance's transform as its line gave it, which the keyed motion is applied after
+    std::vector<motion_key> keys{}; // in frame order
+};
+
+// what changes from one frame to the next, worked out ahead of time (it doesn't touch the scene), so it can be done
+// alongside rendering the frame before
+struct frame_update {
+    int frame{};
+    camera_settings view{};
+
+    // for each keyed instance, where it is at this frame, with the inverse already worked out
+    std::vector<int> instances{};
+    std::vector<transform> to_world{};
+    std::vector<transform> to_object{};
+};
+
+// keyframes for the camera and for instances, between keys everything's interpolated linearly - the rotation by its
+// axis and angle separately, so spinning about one axis turns at an even rate, and keeps going past 360 degrees -
+// and before the first key or after the last, it holds where that key is
+class animation {
+public:
+    bool animated() const { return frame_count > 0; }
+
+    // keys for the same frame replace each other
+    void add_camera_key(const camera_key &key);
+    void add_motion_key(int instance, const transform &placement, const motion_key &key);
+
+    camera_settings camera_at(int frame, const camera_settings &still) const;
+    transform instance_at(const instance_track &track, int frame) const;
+
+    frame_update prepare(int frame, const camera_settings &still) const;
+public:
+    int frame_count{}; // 0 for a still scene
+    std::vector<camera_key> camera_keys{}; // in frame order
+    std::vector<instance_track> tracks{};
+};
+
+// the key at or before frame, and the one after it (which are the same before the first key or past the last), and
+// how far frame is between them
+template<typename key_type>
+void surrounding_keys(const std::vector<key_type> &keys, int frame, const key_type *&before, const key_type *&after,
+                      double &fraction) {
+    auto next = std::upper_bound(keys.begin(), keys.end(), frame, [](int f, const key_type &key){
+        return f < key.frame;
+    });
+    if(next == keys.begin()) before = after = &keys.front();
+    else if(next == keys.end()) before = after = &keys.back();
+    else{
+        before = &*(next - 1);
+        after = &*next;
+    }
+    fraction = after->frame > before->frame ? static_cast<double>(frame - before->frame) / (after->frame - before->frame)
+                                            : 0;
+}
+
+template<typename key_type>
+void insert_key(std::vector<key_type> &keys, const key_type &key) {
+    auto at = std::lower_bound(keys.begin(), keys.end(), key.frame, [](const key_type &k, int f){
+        return k.frame < f;
+    });
+    if(at != keys.end() && at->frame == key.frame) *at = key;
+    else keys.insert(at, key);
+}
+
+inline vec3 lerp(const vec3 &a, const vec3 &b, double fraction){
+    return (1 - fraction) * a + fraction * b;
+}
+
+void animation::add_camera_key(const camera_key &key) {
+    insert_key(camera_keys, key);
+}
+
+void animation::add_motion_key(int instance, const transform &placement, const motion_key &key) {
+    auto track = std::find_if(tracks.begin(), tracks.end(), [&](const instance_track &t){
+        return t.instance == instance;
+    });
+    if(track == tracks.end()){
+        tracks.push_back(instance_track{});
+        track = tracks.end() - 1;
+        track->instance = instance;
+        track->placement = placement;
+    }
+    insert_key(track->keys, key);
+}
+
+camera_settings animation::camera_at(int frame, const camera_settings &still) const {
+    if(camera_keys.empty()) return still;
+
+    const camera_key *before, *after;
+    double f;
+    surrounding_keys(camera_keys, frame, before, after, f);
+    const camera_settings &a = before->view, &b = after->view;
+
+    camera_settings view{};
+    view.look_from = lerp(a.look_from, b.look_from, f);
+    view.look_at = lerp(a.look_at, b.look_at, f);
+    view.up = lerp(a.up, b.up, f);
+    view.vertical_fov = (1 - f) * a.vertical_fov + f * b.vertical_fov;
+    view.aperture = (1 - f) * a.aperture + f * b.aperture;
+    view.focus_dist = (1 - f) * a.focus_dist + f * b.focus_dist;
+    view.shutter_open = (1 - f) * a.shutter_open + f * b.shutter_open;
+    view.shutter_close = (1 - f) * a.shutter_close + f * b.shutter_close;
+    return view;
+}
+
+transform animation::instance_at(const instance_track &track, int frame) const {
+    const motion_key *before, *after;
+    double f;
+    surrounding_keys(track.keys, frame, before, after, f);
+
+    motion_key key{};
+    key.translation = lerp(before->translation, after->translation, f);
+    key.axis = lerp(before->axis, after->axis, f);
+    if(key.axis.length_squared() == 0) key.axis = before->axis; // opposite axes, halfway
+    key.degrees = (1 - f) * before->degrees + f * after->degrees;
+    key.scale = lerp(before->scale, after->scale, f);
+    return key.to_transform() * track.placement;
+}
+
+frame_update animation::prepare(int frame, const camera_settings &still) const {
+    frame_update update{};
+    update.frame = frame;
+    update.view = camera_at(frame, still);
+
+    for(const instance_track &track : tracks){
+        const transform to_world = instance_at(track, frame);
+        transform to_object{};
+        if(!to_world.inverse(to_object)) continue; // keyed down to a scale of 0, it stays where it last was
+        update.instances.push_back(track.instance);
+        update.to_world.push_back(to_world);
+        update.to_object.push_back(to_object);
+    }
+    return update;
+}
+
+#endif // ANIMATION_H
@@ -0,0 +1,522 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "aabb.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "ray_packet.h"
+
+struct bvh_flat_node {
+    aabb box{};
+    int offset{}; // leaf: first primitive in bvh_tree::indices, interior: index of the second child (first is node+1)
+    int count{}; // number of primitives in a leaf, 0 marks an interior node
+    int axis{}; // axis the children were split along, so traversal can visit the nearer child first
+};
+
+// bounding volume hierarchy over a set of primitive boxes, built with the surface area heuristic and stored as one
+// flat array of nodes in depth first order, it only deals in boxes and indices, so anything with bounding boxes
+// (objects in a hittable_list, spheres in a packed store, triangles in a mesh...) can be put in one
+//
+// a tree over primitives that move during the shutter interval (see refit_motion) keeps two boxes a node, where it is
+// at time 0 and at time 1, and a ray tests the box in between at its own time, so a node is only as big as what's in
+// it at that moment, rather than everywhere it goes over the interval
+class bvh_tree {
+public:
+    // nodes with more than max_leaf_size primitives are always split, ones with min_leaf_size or fewer never are,
+    // anything in between is left to the heuristic
+    void build(const std::vector<aabb> &boxes, int max_leaf_size = 4, int min_leaf_size = 1);
+
+    // walks the tree front to back, calling test(first, count, t_max) for every leaf the ray reaches, which should
+    // test the primitives at leaf positions first to first + count - 1 (indices maps those back to the boxes that
+    // were built from), shrink t_max to the closest hit it finds, and return true if it found one
+    template<typename leaf_test>
+    bool traverse(const ray &r, real t_min, real t_max, leaf_test &&test) const;
+
+    // the same walk for an any hit query (a shadow ray), calling test(first, count) for each leaf reached until one
+    // returns true, that it hit something in [t_min, t_max], which is returned straight away
+    template<typename leaf_test>
+    bool traverse_any(const ray &r, real t_min, real t_max, leaf_test &&test) const;
+
+    // the same, for a packet of rays at once (in a tree that doesn't move), every node that any of the rays' boxes
+    // tests pass is visited (in the order the first ray would visit them), with test(first, count, mask) called for
+    // each leaf reached, mask having a bit set for each ray that reached it, and the rays' closest hits so far in t_max
+    // (an aligned packet_size array), which test should shrink for the rays it finds closer hits for
+    template<typename leaf_test>
+    void traverse_packet(const ray_packet &packet, real t_min, real *t_max, leaf_test &&test) const;
+
+    aabb bounds() const { return nodes.empty() ? aabb{} : nodes[0].box; }
+
+    // the surface areas of every node added up, which the heuristic's cost of tracing through the tree goes with,
+    // so comparing it before and after a refit shows how much worse the refit has left the tree
+    double node_area_sum() const;
+
+    // checks the nodes are a tree traverse can walk (for trees which weren't built here, e.g. read from a file),
+    // every child comes after its parent, leaves are within the primitive_count primitives, and it's no deeper than
+    // the traversal stack allows
+    bool valid(size_t primitive_count) const;
+
+    // works out every node's box again, bottom up, from box(i) for the primitive at each leaf position i, keeping the
+    // tree's structure, for when the primitives have moved (or been rounded) since it was built
+    template<typename primitive_box>
+    void refit(primitive_box &&box);
+
+    // the same, with leaf_box(leaf) giving the box of each leaf node, which can hand back the leaf's box as it is for
+    // a leaf where nothing has moved, so a refit after a few primitives move only works out their leaves' boxes again
+    template<typename leaf_box_type>
+    void refit_leaves(leaf_box_type &&leaf_box);
+
+    // the same, for primitives moving in a straight line over the shutter interval, fitting every node's box at time
+    // 0 to start_box(i) and at time 1 to end_box(i), after which traverse and traverse_any test each node at the ray's
+    // time, between the two - which always holds what's in the node then, since each side of the box in between is
+    // no further in than the same side of every primitive's box - the tree is best built over boxes covering both
+    // ends, so its splits keep primitives apart over the whole interval
+    template<typename start_box_type, typename end_box_type>
+    void refit_motion(start_box_type &&start_box, end_box_type &&end_box);
+
+    bool moving() const { return !end_boxes.empty(); }
+
+    // the node's box at time, which is clamped to the interval [0, 1] that the boxes cover
+    aabb box_at(int node_idx, real time) const {
+        return lerp_box(node_idx, std::min(real(1), std::max(real(0), time)));
+    }
+public:
+    std::vector<bvh_flat_node> nodes{};
+    std::vector<int> indices{}; // primitive indices, in the order the leaves refer to them
+    std::vector<aabb> end_boxes{}; // each node's box at time 1 (the nodes' own are at time 0), empty unless moving
+private:
+    static constexpr int bin_count = 16;
+    static constexpr int max_depth = 64; // past this splits fall back to the median, so the traversal stack is bounded
+    static constexpr double traversal_cost = 0.125; // cost of visiting a node, relative to testing one primitive
+
+    int build_recursive(const std::vector<aabb> &boxes, const std::vector<point3> &centroids,
+                        int begin, int end, int depth, int max_leaf_size, int min_leaf_size);
+
+    // the walks traverse and traverse_any do, with the boxes at the ray's time if moving, which is a template
+    // parameter so a tree that doesn't move pays nothing for it
+    template<bool moving, typename leaf_test>
+    bool walk(const ray &r, real t_min, real t_max, leaf_test &&test) const;
+
+    template<bool moving, typename leaf_test>
+    bool walk_any(const ray &r, real t_min, real t_max, leaf_test &&test) const;
+
+    // box_at, for a time already clamped, which the walks do once a ray rather than once a node
+    aabb lerp_box(int node_idx, real time) const;
+};
+
+void bvh_tree::build(const std::vector<aabb> &boxes, int max_leaf_size, int min_leaf_size) {
+    nodes.clear();
+    end_boxes.clear();
+    indices.resize(boxes.size());
+    if(boxes.empty()) return;
+
+    std::vector<point3> centroids(boxes.size());
+    for(size_t i = 0; i < boxes.size(); i++){
+        indices[i] = static_cast<int>(i);
+        centroids[i] = boxes[i].centroid();
+    }
+
+    max_leaf_size = std::max(1, max_leaf_size);
+    min_leaf_size = std::max(1, std::min(min_leaf_size, max_leaf_size));
+    nodes.reserve(2 * boxes.size() / min_leaf_size + 1);
+    build_recursive(boxes, centroids, 0, static_cast<int>(boxes.size()), 0, max_leaf_size, min_leaf_size);
+    nodes.shrink_to_fit(); // the reserve is for the most nodes there could be, which is often several times as many
+}
+
+int bvh_tree::build_recursive(const std::vector<aabb> &boxes, const std::vector<point3> &centroids,
+                              int begin, int end, int depth, int max_leaf_size, int min_leaf_size) {
+    const int node_idx = static_cast<int>(nodes.size());
+    nodes.push_back(bvh_flat_node{}); // nodes can reallocate below, so it's only ever referred to by index
+
+    aabb bounds{};
+    aabb centroid_bounds{};
+    for(int i = begin; i < end; i++){
+        bounds.expand(boxes[indices[i]]);
+        centroid_bounds.expand(centroids[indices[i]]);
+    }
+    nodes[node_idx].box = bounds;
+
+    const int count = end - begin;
+    auto make_leaf = [&](){
+        nodes[node_idx].offset = begin;
+        nodes[node_idx].count = count;
+        return node_idx;
+    };
+
+    if(count <= min_leaf_size) return make_leaf();
+
+    // the heuristic: a split costs the traversal step, plus testing each side weighted by the chance a ray that hit
+    // this node hits that side, which is proportional to surface area - a leaf costs testing everything in it
+    int best_axis = -1;
+    int best_split = 0;
+    double best_cost = infinity;
+
+    for(int axis = 0; axis < 3 && depth < max_depth; axis++){
+        const double axis_min = centroid_bounds.minimum[axis];
+        const double extent = centroid_bounds.maximum[axis] - axis_min;
+        if(extent <= 0) continue; // every centroid on one plane, can't split along this
+
+        aabb bin_boxes[bin_count];
+        int bin_counts[bin_count] = {};
+        const double scale = bin_count / extent;
+        for(int i = begin; i < end; i++){
+            int b = std::min(bin_count - 1, static_cast<int>((centroids[indices[i]][axis] - axis_min) * scale));
+            bin_counts[b]++;
+            bin_boxes[b].expand(boxes[indices[i]]);
+        }
+
+        // sweep from the right to get the cost of everything right of each plane, then from the left to combine
+        double right_area[bin_count];
+        int right_count[bin_count];
+        aabb sweep{};
+        int sweep_count = 0;
+        for(int b = bin_count - 1; b > 0; b--){
+            sweep.expand(bin_boxes[b]);
+            sweep_count += bin_counts[b];
+            right_area[b] = sweep.surface_area();
+            right_count[b] = sweep_count;
+        }
+
+        sweep = aabb{};
+        sweep_count = 0;
+        for(int b = 0; b < bin_count - 1; b++){ // split between bin b and bin b+1
+            sweep.expand(bin_boxes[b]);
+            sweep_count += bin_counts[b];
+            if(sweep_count == 0 || right_count[b + 1] == 0) continue;
+
+            double cost = sweep.surface_area() * sweep_count + right_area[b + 1] * right_count[b + 1];
+            if(cost < best_cost){
+                best_cost = cost;
+                best_axis = axis;
+                best_split = b;
+            }
+        }
+    }
+
+    const double area = bounds.surface_area();
+    best_cost = traversal_cost + (area > 0 ? best_cost / area : infinity);
+
+    int mid = begin;
+    if(best_axis >= 0 && (best_cost < count || count > max_leaf_size)){
+        const double axis_min = centroid_bounds.minimum[best_axis];
+        const double scale = bin_count / (centroid_bounds.maximum[best_axis] - axis_min);
+        const int axis = best_axis;
+        const int split = best_split;
+        mid = static_cast<int>(std::partition(indices.begin() + begin, indices.begin() + end, [&](int idx){
+            return std::min(bin_count - 1, static_cast<int>((centroids[idx][axis] - axis_min) * scale)) <= split;
+        }) - indices.begin());
+    }else if(count > max_leaf_size){
+        // too many for a leaf but no useful split (identical centroids, or too deep), so halve it on the median
+        best_axis = centroid_bounds.empty() ? 0 : centroid_bounds.longest_axis();
+        const int axis = best_axis;
+        mid = begin + count / 2;
+        std::nth_element(indices.begin() + begin, indices.begin() + mid, indices.begin() + end, [&](int a, int b){
+            return centroids[a][axis] < centroids[b][axis];
+        });
+    }else{
+        return make_leaf();
+    }
+
+    build_recursive(boxes, centroids, begin, mid, depth + 1, max_leaf_size, min_leaf_size); // lands at node_idx + 1
+    const int second_child = build_recursive(boxes, centroids, mid, end, depth + 1, max_leaf_size, min_leaf_size);
+
+    nodes[node_idx].offset = second_child;
+    nodes[node_idx].axis = best_axis;
+    return node_idx;
+}
+
+bool bvh_tree::valid(size_t primitive_count) const {
+    std::vector<int> depths(nodes.size(), 0);
+    for(size_t n = 0; n < nodes.size(); n++){
+        const bvh_flat_node &node = nodes[n];
+        if(node.count < 0 || node.axis < 0 || node.axis > 2 || depths[n] >= 2 * max_depth) return false;
+
+        if(node.count > 0){
+            if(node.offset < 0 || static_cast<size_t>(node.offset) + node.count > primitive_count) return false;
+        }else{
+            // the first child is the next node, and the second is after the whole of the first child's subtree
+            if(n + 1 >= nodes.size() || node.offset <= static_cast<int>(n) + 1
+               || static_cast<size_t>(node.offset) >= nodes.size()) return false;
+            depths[n + 1] = std::max(depths[n + 1], depths[n] + 1); // the deepest way to a node is what counts
+            depths[node.offset] = std::max(depths[node.offset], depths[n] + 1);
+        }
+    }
+    return true;
+}
+
+double bvh_tree::node_area_sum() const {
+    double sum = 0;
+    for(const bvh_flat_node &node : nodes) sum += node.box.surface_area();
+    return sum;
+}
+
+template<typename primitive_box>
+void bvh_tree::refit(primitive_box &&box) {
+    refit_leaves([&](const bvh_flat_node &leaf){
+        aabb bounds{};
+        for(int i = leaf.offset; i < leaf.offset + leaf.count; i++)
+            bounds.expand(box(i));
+        return bounds;
+    });
+}
+
+template<typename leaf_box_type>
+void bvh_tree::refit_leaves(leaf_box_type &&leaf_box) {
+    // children always come after their parents, so going backwards reaches both of a node's children before it
+    for(size_t n = nodes.size(); n-- > 0;){
+        bvh_flat_node &node = nodes[n];
+        node.box = node.count > 0 ? leaf_box(static_cast<const bvh_flat_node &>(node))
+                                  : surrounding_box(nodes[n + 1].box, nodes[node.offset].box);
+    }
+    end_boxes.clear(); // which no longer go with the boxes at time 0
+}
+
+template<typename start_box_type, typename end_box_type>
+void bvh_tree::refit_motion(start_box_type &&start_box, end_box_type &&end_box) {
+    refit(start_box);
+    end_boxes.resize(nodes.size());
+    for(size_t n = nodes.size(); n-- > 0;){
+        const bvh_flat_node &node = nodes[n];
+        aabb bounds{};
+        if(node.count > 0){
+            for(int i = node.offset; i < node.offset + node.count; i++)
+                bounds.expand(end_box(i));
+        }else{
+            bounds = surrounding_box(end_boxes[n + 1], end_boxes[node.offset]);
+        }
+        end_boxes[n] = bounds;
+    }
+}
+
+aabb bvh_tree::lerp_box(int node_idx, real time) const {
+    const aabb &start = nodes[node_idx].box;
+    const aabb &end = end_boxes[node_idx];
+    return aabb(start.minimum + time * (end.minimum - start.minimum),
+                start.maximum + time * (end.maximum - start.maximum));
+}
+
+template<typename leaf_test>
+bool bvh_tree::traverse(const ray &r, real t_min, real t_max, leaf_test &&test) const {
+    if(nodes.empty()) return false;
+    return moving() ? walk<true>(r, t_min, t_max, test) : walk<false>(r, t_min, t_max, test);
+}
+
+template<typename leaf_test>
+bool bvh_tree::traverse_any(const ray &r, real t_min, real t_max, leaf_test &&test) const {
+    if(nodes.empty()) return false;
+    return moving() ? walk_any<true>(r, t_min, t_max, test) : walk_any<false>(r, t_min, t_max, test);
+}
+
+template<bool moving, typename leaf_test>
+bool bvh_tree::walk(const ray &r, real t_min, real t_max, leaf_test &&test) const {
+    const point3 origin = r.origin();
+    const vec3 dir = r.direction();
+    const vec3 inv_dir(1 / dir[0], 1 / dir[1], 1 / dir[2]);
+    const real time = std::min(real(1), std::max(real(0), r.time()));
+    const bool dir_negative[3] = { inv_dir[0] < 0, inv_dir[1] < 0, inv_dir[2] < 0 };
+
+    int stack[2 * max_depth]; // the median fallback adds at most ~31 levels past max_depth
+    int stack_size = 0;
+    int node_idx = 0;
+    bool hit_anything = false;
+
+    while(true){
+        const bvh_flat_node &node = nodes[node_idx];
+        const bool box_hit = moving ? lerp_box(node_idx, time).hit(origin, inv_dir, t_min, t_max)
+                                    : node.box.hit(origin, inv_dir, t_min, t_max);
+        if(box_hit){
+            if(node.count > 0){
+                if(test(node.offset, node.count, t_max))
+                    hit_anything = true;
+            }else{
+                // visit the child on the near side of the split first, since the closer hit it likely finds shrinks
+                // t_max, which lets the far child's box get rejected
+                if(dir_negative[node.axis]){
+                    stack[stack_size++] = node_idx + 1;
+                    node_idx = node.offset;
+                }else{
+                    stack[stack_size++] = node.offset;
+                    node_idx = node_idx + 1;
+                }
+                continue;
+            }
+        }
+
+        if(stack_size == 0) break;
+        node_idx = stack[--stack_size];
+    }
+
+    return hit_anything;
+}
+
+template<bool moving, typename leaf_test>
+bool bvh_tree::walk_any(const ray &r, real t_min, real t_max, leaf_test &&test) const {
+    const point3 origin = r.origin();
+    const vec3 dir = r.direction();
+    const vec3 inv_dir(1 / dir[0], 1 / dir[1], 1 / dir[2]);
+    const real time = std::min(real(1), std::max(real(0), r.time()));
+
+    int stack[2 * max_depth];
+    int stack_size = 0;
+    int node_idx = 0;
+
+    while(true){
+        const bvh_flat_node &node = nodes[node_idx];
+        const bool box_hit = moving ? lerp_box(node_idx, time).hit(origin, inv_dir, t_min, t_max)
+                                    : node.box.hit(origin, inv_dir, t_min, t_max);
+        if(box_hit){
+            if(node.count > 0){
+                if(test(node.offset, node.count)) return true;
+            }else{
+                // no hit shrinks t_max here, so which child goes first only matters in how soon a hit turns up, and
+                // the near one is as likely as any to have it
+                stack[stack_size++] = node.offset;
+                node_idx = node_idx + 1;
+                continue;
+            }
+        }
+
+        if(stack_size == 0) break;
+        node_idx = stack[--stack_size];
+    }
+
+    return false;
+}
+
+// the slab test of aabb::hit, for every ray of a packet at once
+inline int packet_box_hits(const aabb &box, const ray_packet &packet, real t_min, const real *t_max){
+    int hits = 0;
+    for(int l = 0; l < packet_size; l += simd_real::width){
+        simd_real near_t = simd_set(t_min);
+        simd_real far_t = simd_load(&t_max[l]);
+        for(int a = 0; a < 3; a++){
+            const simd_real origin = simd_load(&packet.origin[a][l]);
+            const simd_real inv_dir = simd_load(&packet.inv_direction[a][l]);
+            const simd_real t0 = (simd_set(box.minimum[a]) - origin) * inv_dir;
+            const simd_real t1 = (simd_set(box.maximum[a]) - origin) * inv_dir;
+            const simd_mask negative = simd_lt(inv_dir, simd_set(0));
+
+            // min and max take the second operand for a NaN in the first, so a NaN leaves the interval as it was
+            near_t = simd_max(simd_select(negative, t1, t0), near_t);
+            far_t = simd_min(simd_select(negative, t0, t1), far_t);
+        }
+        hits |= simd_bits(simd_ge(far_t, near_t)) << l;
+    }
+    return hits & packet.active();
+}
+
+template<typename leaf_test>
+void bvh_tree::traverse_packet(const ray_packet &packet, real t_min, real *t_max, leaf_test &&test) const {
+    if(nodes.empty()) return;
+
+    const bool dir_negative[3] = {
+        packet.inv_direction[0][0] < 0, packet.inv_direction[1][0] < 0, packet.inv_direction[2][0] < 0
+    };
+
+    int stack[2 * max_depth];
+    int stack_size = 0;
+    int node_idx = 0;
+
+    while(true){
+        const bvh_flat_node &node = nodes[node_idx];
+        const int mask = packet_box_hits(node.box, packet, t_min, t_max);
+        if(mask){
+            if(node.count > 0){
+                test(node.offset, node.count, mask);
+            }else{
+                if(dir_negative[node.axis]){
+                    stack[stack_size++] = node_idx + 1;
+                    node_idx = node.offset;
+                }else{
+                    stack[stack_size++] = node.offset;
+                    node_idx = node_idx + 1;
+                }
+                continue;
+            }
+        }
+
+        if(stack_size == 0) break;
+        node_idx = stack[--stack_size];
+    }
+}
+
+// a hittable which wraps the objects of a hittable_list in a bvh_tree, so a ray only tests the handful of objects
+// whose boxes it actually passes through, rather than every object in the list
+class bvh_node : public hittable {
+public:
+    bvh_node() = default;
+    explicit bvh_node(const hittable_list &list, int max_leaf_size = 4);
+
+    bool hit(const ray &r, real t_min, real t_max, hit_record &rec) const override;
+    bool occluded(const ray &r, real t_min, real t_max) const override;
+    bool bounding_box(aabb &output_box) const override;
+public:
+    std::vector<shared_ptr<hittable>> objects{}; // reordered into the tree's leaf order, so a leaf is a contiguous run
+    std::vector<shared_ptr<hittable>> unbounded{}; // anything without a bounding box, which is tested on every ray
+    bvh_tree tree{};
+};
+
+bvh_node::bvh_node(const hittable_list &list, int max_leaf_size) {
+    std::vector<shared_ptr<hittable>> bounded{};
+    std::vector<aabb> boxes{};
+    for(const auto &object : list.objects){
+        aabb box{};
+        if(object->bounding_box(box)){
+            bounded.push_back(object);
+            boxes.push_back(box);
+        }else{
+            unbounded.push_back(object);
+        }
+    }
+
+    tree.build(boxes, max_leaf_size);
+
+    objects.reserve(bounded.size());
+    for(int idx : tree.indices)
+        objects.push_back(bounded[idx]);
+}
+
+bool bvh_node::hit(const ray &r, real t_min, real t_max, hit_record &rec) const {
+    bool hit_anything = false;
+    for(const auto &object : unbounded){
+        if(object->hit(r, t_min, t_max, rec)){
+            hit_anything = true;
+            t_max = rec.t;
+        }
+    }
+
+    hit_anything |= tree.traverse(r, t_min, t_max, [&](int first, int count, real &closest_so_far){
+        bool hit_leaf = false;
+        for(int i = first; i < first + count; i++){
+            if(objects[i]->hit(r, t_min, closest_so_far, rec)){
+                hit_leaf = true;
+                closest_so_far = rec.t;
+            }
+        }
+        return hit_leaf;
+    });
+
+    return hit_anything;
+}
+
+bool bvh_node::occluded(const ray &r, real t_min, real t_max) const {
+    for(const auto &object : unbounded)
+        if(object->occluded(r, t_min, t_max)) return true;
+
+    return tree.traverse_any(r, t_min, t_max, [&](int first, int count){
+        for(int i = first; i < first + count; i++)
+            if(objects[i]->occluded(r, t_min, t_max)) return true;
+        return false;
+    });
+}
+
+bool bvh_node::bounding_box(aabb &output_box) const {
+    if(!unbounded.empty() || tree.nodes.empty()) return false;
+    output_box = tree.bounds();
+    return true;
+}
+
+#endif // BVH_H
@@ -3,8 +3,28 @@
 
 #include "helper.h"
 
+// where a camera is and what it's like, as a scene describes it, focus_dist 0 means focusing on look_at
+struct camera_settings {
+    point3 look_from{0, 0, 0};
+    point3 look_at{0, 0, -1};
+    vec3 up{0, 1, 0};
+    double vertical_fov{90};
+    double aperture{0};
+    double focus_dist{0};
+    double shutter_open{0}; // the interval the shutter's open for, in the time moving spheres move over (0 to 1),
+    double shutter_close{0}; // rays are spread evenly over it, an empty interval is a still frame at shutter_open
+};
+
 class camera {
 public:
+    camera(const camera_settings &settings, double aspect_ratio)
+        : camera(settings.look_from, settings.look_at, settings.up, aspect_ratio, settings.vertical_fov,
+                 settings.aperture,
+                 settings.focus_dist > 0 ? settings.focus_dist : (settings.look_from - settings.look_at).length()) {
+        time_open = settings.shutter_open;
+        time_close = settings.shutter_close;
+    }
+
     camera(const point3 &look_from, const point3 &look_at, const vec3 &vup, double aspect_ratio,
            double vertical_fov_angle, double aperture, double focus_dist) {
         if(vertical_fov_angle >= 180){
@@ -33,17 +53,24 @@ public:
         // so lens radius is half that
     }
 
-    ray get_ray(double s, double t) const {
+    ray get_ray(double s, double t, sampler &smp) const {
         // the direction isn't normalised, as it shouldn't be necessary, but basically, it's a ray going from,
         // the direction of the lower left corner, and the `- origin` bit is for the case when origin is not
         // at (0, 0, 0), so that the direction vector doesn't have any random offset, same for the `offset` vector
 
         // larger radius implies larger aperture in a real camera
-        vec3 random_origin = lens_radius * random_in_unit_disk();
+        vec3 random_origin = lens_radius * random_in_unit_disk(smp);
         vec3 offset = u * random_origin.x() + v * random_origin.y(); // random offset to simulate depth of field
 
-        return { origin + offset, lower_left_corner + s*horizontal + t*vertical - origin - offset };
+        // with the shutter open over an interval, the time is the sample's next dimension (after the lens), a still
+        // frame draws none, so its paths' dimensions are just as they were before there was a shutter
+        real time = time_open;
+        if(samples_time()) time = time_open + (time_close - time_open) * smp.next_1d();
+
+        return { origin + offset, lower_left_corner + s*horizontal + t*vertical - origin - offset, time };
     }
+
+    bool samples_time() const { return time_close > time_open; }
 private:
     point3 origin{};
     vec3 horizontal{};
@@ -51,7 +78,9 @@ private:
     point3 lower_left_corner{};
 
     vec3 u, v, w; // the orthogonal basis vectors
-    double lens_radius;
+    real lens_radius;
+    real time_open{};
+    real time_close{};
 };
 
 #endif // CAMERA_H
\ No newline at end of file
@@ -0,0 +1,340 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "helper.h"
+
+#include "distributed.h"
+#include "framebuffer.h"
+#include "render.h"
+#include "tile_scheduler.h"
+
+// a long render's framebuffer, kept in a memory mapped file as it goes, so a render that's killed can be started
+// again and carry on from where it got to, and a finished one can be given more samples later without redoing the
+// ones it has - samples are seeded by pixel and index, and summed exactly, so the image comes out exactly as if it
+// had been rendered in one go
+//
+// the file is a header, a table with an entry per tile, then two slots for every pixel, each a whole frame of
+// records (as a partial's, in tile order), a tile's entry says which of its two slots holds its pixels as of the last
+// checkpoint - as each tile's rendered its pixels are copied into its other slot, and every so often the file's
+// flushed to disk, and only then are the entries of the tiles copied since pointed at the slots they were copied
+// into (and flushed again), so the file always holds whole tiles from the last checkpoint, however the render ends -
+// the flushing is done on a thread of its own, so the workers copying tiles in never wait on the disk
+
+const char checkpoint_magic[8] = { 'R', 'T', 'C', 'H', 'E', 'C', 'K', '\0' };
+const uint32_t checkpoint_version = 1;
+
+struct checkpoint_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order; // partial_byte_order, as it's written by this machine
+    int32_t width;
+    int32_t height;
+    int32_t tile_size;
+    int32_t sequence;
+    int32_t features; // 1 if it holds the pixels' features
+    int32_t unused;
+    uint64_t seed;
+    uint64_t fingerprint; // of the scene and whatever else changes what a sample is, see checkpoint_fingerprint
+    uint64_t tile_count;
+    uint64_t pixel_count;
+};
+
+struct checkpoint_tile {
+    int32_t slot; // -1 until the tile's first checkpointed
+    int32_t samples; // the most any of its pixels had
+};
+
+// FNV-1a of size bytes at data, carrying on from hash, for the fingerprint a checkpoint is checked against
+inline uint64_t checkpoint_fingerprint(const void *data, size_t size, uint64_t hash = 0xcbf29ce484222325ull){
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for(size_t i = 0; i < size; i++){
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+class render_checkpoint {
+public:
+    render_checkpoint() = default;
+    render_checkpoint(const render_checkpoint &) = delete;
+    render_checkpoint &operator=(const render_checkpoint &) = delete;
+    ~render_checkpoint();
+
+    // opens the checkpoint at path, or makes it (at its full size, so writing to it can't run out of space) if there
+    // isn't one, for the frame the settings describe, fb is made that frame's framebuffer, holding whatever the
+    // checkpoint had, so rendering it with settings.resume carries on from there - a checkpoint of another frame (a
+    // different size, tile size, seed, sampler, features or fingerprint) is an error rather than being overwritten,
+    // though one whose header is all zeros (as a crash between making it and writing its header leaves it) is made
+    // again
+    bool open(const std::string &path, const render_settings &settings, uint64_t fingerprint, framebuffer &fb,
+              std::string &error);
+
+    // copies the tile's pixels into its other slot, for the next checkpoint, and has the checkpointing thread
+    // checkpoint if it's been interval seconds since the last one - a tile_callback, called by the worker thread
+    // which rendered the tile
+    void save_tile(const framebuffer &fb, const tile &t);
+
+    // flushes every tile saved so far to disk, and points the table at them, tiles saved while it's flushing are
+    // left for the next checkpoint
+    bool checkpoint(std::string &error);
+
+    double interval{60}; // seconds between checkpoints, 0 for one after every tile
+    int tiles_restored{}; // what open found in the checkpoint
+    long long samples_restored{};
+private:
+    std::string path{};
+    int fd{-1};
+    unsigned char *mapping{};
+    size_t mapping_size{};
+    checkpoint_header *header{};
+    checkpoint_tile *table{};
+    size_t record_bytes{};
+    std::vector<tile> tiles{};
+    std::vector<uint64_t> first_record{}; // of each tile, in either slot
+    std::vector<int> saved_samples{}; // of each tile, since the last checkpoint, -1 for tiles that weren't saved
+    std::vector<uint64_t> saves{}; // how many times each tile's been saved, to tell which were saved mid checkpoint
+
+    std::mutex lock{}; // guards everything above which save_tile changes, and what follows
+    std::chrono::steady_clock::time_point last_checkpoint{};
+    bool failed{}; // a checkpoint couldn't be written, so saving tiles has stopped
+    bool due{}; // it's been interval seconds, so the checkpointing thread should checkpoint
+    bool stopping{};
+    std::condition_variable wake{};
+
+    std::mutex flushing{}; // held for the whole of a checkpoint, so there's one at a time
+    std::thread checkpointer{};
+
+    unsigned char *record(int slot, uint64_t idx) const {
+        return mapping + sizeof(checkpoint_header) + sizeof(checkpoint_tile) * header->tile_count
+               + record_bytes * (slot * header->pixel_count + idx);
+    }
+    void checkpoint_when_due();
+};
+
+render_checkpoint::~render_checkpoint() {
+    if(checkpointer.joinable()){
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        checkpointer.join();
+    }
+    if(mapping) munmap(mapping, mapping_size);
+    if(fd >= 0) close(fd);
+}
+
+bool render_checkpoint::open(const std::string &checkpoint_path, const render_settings &settings,
+                             uint64_t fingerprint, framebuffer &fb, std::string &error) {
+    path = checkpoint_path;
+    tiles = make_tiles(settings.width, settings.height, settings.tile_size);
+    uint64_t pixel_count = 0;
+    for(const tile &t : tiles){
+        first_record.push_back(pixel_count);
+        pixel_count += static_cast<uint64_t>(t.x1 - t.x0) * (t.y1 - t.y0);
+    }
+    saved_samples.assign(tiles.size(), -1);
+    saves.assign(tiles.size(), 0);
+
+    checkpoint_header expected{};
+    std::memcpy(expected.magic, checkpoint_magic, sizeof(expected.magic));
+    expected.version = checkpoint_version;
+    expected.byte_order = partial_byte_order;
+    expected.width = settings.width;
+    expected.height = settings.height;
+    expected.tile_size = settings.tile_size;
+    expected.sequence = static_cast<int32_t>(settings.sequence);
+    expected.features = settings.features ? 1 : 0;
+    expected.seed = settings.seed;
+    expected.fingerprint = fingerprint;
+    expected.tile_count = tiles.size();
+    expected.pixel_count = pixel_count;
+    record_bytes = sizeof(partial_pixel) + (settings.features ? sizeof(partial_features) : 0);
+    mapping_size = sizeof(checkpoint_header) + sizeof(checkpoint_tile) * tiles.size() + 2 * record_bytes * pixel_count;
+
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    struct stat file_info{};
+    if(fd < 0 || fstat(fd, &file_info) != 0){
+        error = "couldn't open " + path;
+        return false;
+    }
+    bool made = file_info.st_size == 0;
+    if(made && posix_fallocate(fd, 0, static_cast<off_t>(mapping_size)) != 0){
+        error = "couldn't make " + path + " (" + std::to_string(mapping_size >> 20) + " MB)";
+        return false;
+    }
+    if(!made && static_cast<uint64_t>(file_info.st_size) != mapping_size){
+        error = path + " isn't a checkpoint of this frame";
+        return false;
+    }
+
+    void *mapped = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(mapped == MAP_FAILED){
+        error = "couldn't map " + path;
+        return false;
+    }
+    mapping = static_cast<unsigned char *>(mapped);
+    header = reinterpret_cast<checkpoint_header *>(mapping);
+    table = reinterpret_cast<checkpoint_tile *>(mapping + sizeof(checkpoint_header));
+
+    // one that was made but never had its header written is as good as a new one
+    const char no_magic[sizeof(header->magic)] = {};
+    if(!made && (std::memcmp(header->magic, no_magic, sizeof(no_magic)) == 0 || header->version == 0)) made = true;
+
+    if(made){
+        // the header goes in last, once the table's empty, so a file that was never finished isn't taken for one
+        for(size_t t = 0; t < tiles.size(); t++) table[t] = { -1, 0 };
+        std::memcpy(header, &expected, sizeof(expected));
+        if(msync(mapping, mapping_size, MS_SYNC) != 0){
+            error = "couldn't write " + path;
+            return false;
+        }
+    }else if(std::memcmp(header, &expected, sizeof(expected)) != 0){
+        error = std::memcmp(header->magic, checkpoint_magic, sizeof(header->magic)) != 0
+                || header->version != checkpoint_version || header->byte_order != partial_byte_order
+              ? path + " isn't a checkpoint (or is from an incompatible version)"
+              : path + " is a checkpoint of a different frame (its size, tile size, seed, sampler, features or scene"
+                       " differ)";
+        return false;
+    }
+
+    fb = framebuffer(settings.width, settings.height, settings.features);
+    for(size_t t = 0; t < tiles.size(); t++){
+        if(table[t].slot != 0 && table[t].slot != 1) continue;
+        tiles_restored++;
+        uint64_t idx = first_record[t];
+        for(int j = tiles[t].y0; j < tiles[t].y1; j++){
+            for(int i = tiles[t].x0; i < tiles[t].x1; i++, idx++){
+                const unsigned char *at = record(table[t].slot, idx);
+                partial_pixel p;
+                std::memcpy(&p, at, sizeof(p));
+                const size_t pixel = fb.index(i, j);
+                for(int c = 0; c < 3; c++) fb.pixels[pixel].rgb[c] = p.rgb[c];
+                fb.stats[pixel].count = p.count;
+                fb.stats[pixel].mean = p.mean;
+                fb.stats[pixel].m2 = p.m2;
+                samples_restored += p.count;
+
+                if(!settings.features) continue;
+                partial_features f;
+                std::memcpy(&f, at + sizeof(p), sizeof(f));
+                for(int c = 0; c < 3; c++){
+                    fb.features[pixel].albedo.rgb[c] = f.albedo[c];
+                    fb.features[pixel].normal.rgb[c] = f.normal[c];
+                }
+                fb.features[pixel].depth = f.depth;
+            }
+        }
+    }
+    last_checkpoint = std::chrono::steady_clock::now();
+    checkpointer = std::thread(&render_checkpoint::checkpoint_when_due, this);
+    return true;
+}
+
+void render_checkpoint::save_tile(const framebuffer &fb, const tile &t) {
+    std::lock_guard<std::mutex> guard(lock);
+    if(failed) return;
+
+    // the slot the last checkpoint didn't leave the tile in, which nothing reads until the next one
+    const int slot = table[t.index].slot == 0 ? 1 : 0;
+    uint64_t idx = first_record[t.index];
+    int samples = 0;
+    for(int j = t.y0; j < t.y1; j++){
+        for(int i = t.x0; i < t.x1; i++, idx++){
+            const size_t pixel = fb.index(i, j);
+            unsigned char *at = record(slot, idx);
+            partial_pixel p{};
+            for(int c = 0; c < 3; c++) p.rgb[c] = fb.pixels[pixel].rgb[c];
+            p.count = fb.stats[pixel].count;
+            p.mean = fb.stats[pixel].mean;
+            p.m2 = fb.stats[pixel].m2;
+            std::memcpy(at, &p, sizeof(p));
+            samples = std::max(samples, p.count);
+
+            if(!fb.has_features()) continue;
+            const feature_sum &sum = fb.features[pixel];
+            partial_features f{};
+            for(int c = 0; c < 3; c++){
+                f.albedo[c] = sum.albedo.rgb[c];
+                f.normal[c] = sum.normal.rgb[c];
+            }
+            f.depth = sum.depth;
+            std::memcpy(at + sizeof(p), &f, sizeof(f));
+        }
+    }
+    saved_samples[t.index] = samples;
+    saves[t.index]++;
+
+    const double since = std::chrono::duration<double>(std::chrono::steady_clock::now() - last_checkpoint).count();
+    if(since < interval || due) return;
+    due = true;
+    wake.notify_one();
+}
+
+bool render_checkpoint::checkpoint(std::string &error) {
+    std::lock_guard<std::mutex> one_at_a_time(flushing);
+    std::vector<uint64_t> saves_before{};
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if(failed){
+            error = "an earlier checkpoint failed";
+            return false;
+        }
+        due = false;
+        last_checkpoint = std::chrono::steady_clock::now();
+        saves_before = saves;
+    }
+
+    // the tiles' pixels have to be on disk before the table says they're there, and as the workers carry on saving
+    // tiles meanwhile, only the tiles which weren't saved again while they were flushed can be pointed at
+    bool ok = msync(mapping, mapping_size, MS_SYNC) == 0;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for(size_t t = 0; ok && t < tiles.size(); t++){
+            if(saved_samples[t] < 0 || saves[t] != saves_before[t]) continue;
+            table[t].slot = table[t].slot == 0 ? 1 : 0;
+            table[t].samples = saved_samples[t];
+            saved_samples[t] = -1;
+        }
+    }
+    // past here the workers only copy into the slots the table doesn't point at
+    ok = ok && msync(mapping, mapping_size, MS_SYNC) == 0;
+    if(!ok){
+        std::lock_guard<std::mutex> guard(lock);
+        failed = true;
+        error = "couldn't write " + path;
+    }
+    return ok;
+}
+
+void render_checkpoint::checkpoint_when_due() {
+    std::unique_lock<std::mutex> guard(lock);
+    while(true){
+        wake.wait(guard, [this](){ return due || stopping; });
+        if(stopping) return;
+        guard.unlock();
+        std::string error{};
+        if(!checkpoint(error))
+            std::fprintf(stderr, "\nCouldn't checkpoint the render, %s, carrying on without\n", error.c_str());
+        guard.lock();
+    }
+}
+
+#endif // CHECKPOINT_H
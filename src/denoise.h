@@ -0,0 +1,249 @@
+#ifndef DENOISE_H
+#define DENOISE_H
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include "helper.h"
+
+#include "framebuffer.h"
+#include "simd.h"
+
+// the denoiser, an edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) over a frame rendered with features -
+// the colour is divided by the albedo first, so it's only the light that's blurred, not the surfaces' colours, then
+// filtered a few times with a 5x5 kernel whose taps are spread twice as far apart each time (1, 2, 4... pixels), each
+// tap weighted down by how far its normal, depth and brightness are from the pixel's, and multiplied back by the
+// albedo - the brightness is compared against each pixel's estimated noise, from the variance of its samples, which
+// is filtered along with it (as SVGF, Schied et al. 2017, does), so noisy pixels are blurred more and clean edges kept
+// (which takes the variance of at least 2 samples a pixel, a pixel with fewer is filtered as if it were very noisy)
+struct denoise_settings {
+    int iterations{5}; // the last spreads its taps 2^(iterations - 1) pixels apart
+    real luminance_sigma{4}; // how many of a pixel's standard deviations a tap's brightness can be off by
+    real depth_sigma{0.05}; // how much a tap's depth can be off by, as a fraction of the pixel's, for each pixel away
+    int num_threads{1};
+};
+
+// the frame as planes of reals, a plane per channel, with a border around the image as wide as the furthest taps
+// reach, so the filter can read every tap without checking it's in the image (border pixels have a weight of 0), and
+// each row padded to a whole number of SIMD registers
+struct denoise_planes {
+    int width{};
+    int height{};
+    int border{};
+    int stride{};
+
+    // the light (colour over albedo) and the variance of its brightness, twice over, each pass reads one and writes
+    // the other
+    std::vector<real> light[2][3];
+    std::vector<real> variance[2];
+    std::vector<real> normal[3];
+    std::vector<real> depth{};
+    std::vector<real> inside{}; // 1 in the image, 0 in the border
+
+    size_t index(int i, int j) const { return static_cast<size_t>(j + border) * stride + i + border; }
+};
+
+// what the albedo's divided by, so a black channel doesn't divide by 0 (its colour is 0 too, so it stays black)
+inline real denoise_albedo(float albedo){
+    return std::max(static_cast<real>(albedo), real(1e-3));
+}
+
+inline simd_real simd_luminance(simd_real r, simd_real g, simd_real b){
+    return simd_set(0.2126) * r + simd_set(0.7152) * g + simd_set(0.0722) * b;
+}
+
+// exp(-x) for x >= 0, as (1 - x/16)^16, which is close enough for a filter weight and only takes multiplies
+inline simd_real simd_exp_neg(simd_real x){
+    simd_real t = simd_max(simd_set(0), simd_set(1) - x * simd_set(1.0 / 16));
+    t = t * t;
+    t = t * t;
+    t = t * t;
+    return t * t;
+}
+
+inline denoise_planes make_denoise_planes(const framebuffer &fb, const image &colour_image,
+                                          const feature_image &features, int iterations){
+    denoise_planes planes{};
+    planes.width = fb.width;
+    planes.height = fb.height;
+    planes.border = 2 << std::max(0, iterations - 1);
+    const int row = (fb.width + simd_real::width - 1) / simd_real::width * simd_real::width;
+    planes.stride = row + 2 * planes.border;
+
+    const size_t size = static_cast<size_t>(planes.stride) * (fb.height + 2 * planes.border);
+    for(int k = 0; k < 2; k++){
+        for(int c = 0; c < 3; c++) planes.light[k][c].assign(size, 0);
+        planes.variance[k].assign(size, 0);
+    }
+    for(int c = 0; c < 3; c++) planes.normal[c].assign(size, 0);
+    planes.depth.assign(size, 0);
+    planes.inside.assign(size, 0);
+
+    for(int j = 0; j < fb.height; j++){
+        for(int i = 0; i < fb.width; i++){
+            const size_t p = fb.index(i, j), at = planes.index(i, j);
+            colour albedo{}, light{};
+            for(int c = 0; c < 3; c++){
+                albedo[c] = denoise_albedo(features.albedo[3 * p + c]);
+                light[c] = colour_image.rgb[3 * p + c] / albedo[c];
+                planes.light[0][c][at] = light[c];
+            }
+
+            // the variance of the pixel's mean brightness, scaled as the light is, a pixel with too few samples to
+            // tell is taken to be as noisy as it is bright
+            const pixel_stats &stats = fb.stats[p];
+            const double light_scale = 1 / std::max(luminance(albedo), 1e-3);
+            double variance = stats.count >= 2 ? stats.m2 / (stats.count - 1) / stats.count
+                                               : stats.mean * stats.mean;
+            planes.variance[0][at] = static_cast<real>(variance * light_scale * light_scale);
+
+            vec3 normal(features.normal[3 * p], features.normal[3 * p + 1], features.normal[3 * p + 2]);
+            if(normal.length_squared() > 0) normal = unit_vector(normal); // averaged over the pixel, it's shorter
+            for(int c = 0; c < 3; c++) planes.normal[c][at] = normal[c];
+            planes.depth[at] = features.depth[p];
+            planes.inside[at] = 1;
+        }
+    }
+    return planes;
+}
+
+// one pass of the filter over rows [row_begin, row_end), reading from the planes of from, and writing to the other
+inline void atrous_pass(denoise_planes &planes, const denoise_settings &settings, int from, int step, int row_begin,
+                        int row_end){
+    static const real kernel[5] = { 1.0 / 16, 1.0 / 4, 3.0 / 8, 1.0 / 4, 1.0 / 16 }; // the B3 spline
+
+    // each tap's offset in the planes, kernel weight, and 1 over its distance in pixels
+    ptrdiff_t offsets[25];
+    real tap_weights[25], tap_inverse_distance[25];
+    for(int ty = 0; ty < 5; ty++){
+        for(int tx = 0; tx < 5; tx++){
+            const int t = 5 * ty + tx, dx = (tx - 2) * step, dy = (ty - 2) * step;
+            offsets[t] = static_cast<ptrdiff_t>(dy) * planes.stride + dx;
+            tap_weights[t] = kernel[tx] * kernel[ty];
+            tap_inverse_distance[t] = t == 12 ? 0 : 1 / std::sqrt(static_cast<real>(dx * dx + dy * dy));
+        }
+    }
+
+    const int to = 1 - from;
+    const real *light[3] = { planes.light[from][0].data(), planes.light[from][1].data(), planes.light[from][2].data() };
+    const real *variance = planes.variance[from].data();
+    const real *normal[3] = { planes.normal[0].data(), planes.normal[1].data(), planes.normal[2].data() };
+    const real *depth = planes.depth.data(), *inside = planes.inside.data();
+    const simd_real zero = simd_set(0), tiny = simd_set(1e-10);
+
+    for(int j = row_begin; j < row_end; j++){
+        for(int i = 0; i < planes.width; i += simd_real::width){
+            const size_t p = planes.index(i, j);
+            const simd_real light_r = simd_loadu(light[0] + p), light_g = simd_loadu(light[1] + p);
+            const simd_real light_b = simd_loadu(light[2] + p);
+            const simd_real brightness = simd_luminance(light_r, light_g, light_b);
+            const simd_real normal_x = simd_loadu(normal[0] + p), normal_y = simd_loadu(normal[1] + p);
+            const simd_real normal_z = simd_loadu(normal[2] + p);
+            const simd_real pixel_depth = simd_loadu(depth + p);
+
+            // how far off a tap's brightness and depth are, measured in the pixel's own scale of each - the
+            // variance is blurred over the 3x3 pixels around it first, since at a few samples a pixel its estimate
+            // is noisy itself
+            simd_real local_variance = zero;
+            for(int dy = -1; dy <= 1; dy++){
+                for(int dx = -1; dx <= 1; dx++){
+                    const real k = (dx == 0 ? 0.5 : 0.25) * (dy == 0 ? 0.5 : 0.25);
+                    local_variance = local_variance
+                                     + simd_set(k) * simd_loadu(variance + p + static_cast<ptrdiff_t>(dy) * planes.stride
+                                                                + dx);
+                }
+            }
+            const simd_real brightness_scale = simd_set(1) / (simd_set(settings.luminance_sigma)
+                                                              * simd_sqrt(simd_max(zero, local_variance)) + tiny);
+            const simd_real depth_scale = simd_set(1) / (simd_set(settings.depth_sigma) * pixel_depth + tiny);
+
+            // the centre tap always has its full weight
+            const simd_real centre = simd_set(tap_weights[12]);
+            simd_real total = centre, sum_r = centre * light_r, sum_g = centre * light_g, sum_b = centre * light_b;
+            simd_real sum_variance = centre * centre * simd_loadu(variance + p);
+
+            for(int t = 0; t < 25; t++){
+                if(t == 12) continue;
+                const size_t q = p + offsets[t];
+                const simd_real r = simd_loadu(light[0] + q), g = simd_loadu(light[1] + q);
+                const simd_real b = simd_loadu(light[2] + q);
+
+                // normals facing apart are weighted down as the cosine between them to the 128th
+                simd_real facing = simd_max(zero, normal_x * simd_loadu(normal[0] + q)
+                                                  + normal_y * simd_loadu(normal[1] + q)
+                                                  + normal_z * simd_loadu(normal[2] + q));
+                for(int k = 0; k < 7; k++) facing = facing * facing;
+
+                const simd_real brightness_off = brightness - simd_luminance(r, g, b);
+                const simd_real depth_off = pixel_depth - simd_loadu(depth + q);
+                const simd_real off = simd_max(brightness_off, -brightness_off) * brightness_scale
+                                      + simd_max(depth_off, -depth_off) * depth_scale
+                                        * simd_set(tap_inverse_distance[t]);
+
+                const simd_real w = simd_set(tap_weights[t]) * simd_loadu(inside + q) * facing * simd_exp_neg(off);
+                total = total + w;
+                sum_r = sum_r + w * r;
+                sum_g = sum_g + w * g;
+                sum_b = sum_b + w * b;
+                sum_variance = sum_variance + w * w * simd_loadu(variance + q);
+            }
+
+            const simd_real inverse_total = simd_set(1) / total;
+            simd_storeu(planes.light[to][0].data() + p, sum_r * inverse_total);
+            simd_storeu(planes.light[to][1].data() + p, sum_g * inverse_total);
+            simd_storeu(planes.light[to][2].data() + p, sum_b * inverse_total);
+            simd_storeu(planes.variance[to].data() + p, sum_variance * inverse_total * inverse_total);
+        }
+    }
+}
+
+// denoises a frame rendered with features (render_settings::features), the rows of each pass are split between the
+// threads, and every pixel comes out the same however many there are
+inline image denoise(const framebuffer &fb, const denoise_settings &settings){
+    const image noisy = resolve(fb);
+    if(!fb.has_features() || settings.iterations < 1) return noisy;
+    const feature_image features = resolve_features(fb);
+    denoise_planes planes = make_denoise_planes(fb, noisy, features, settings.iterations);
+
+    const int num_threads = std::max(1, std::min(settings.num_threads, fb.height));
+    int from = 0;
+    for(int pass = 0; pass < settings.iterations; pass++){
+        const int step = 1 << pass;
+        std::vector<std::thread> threads{};
+        for(int t = 1; t < num_threads; t++)
+            threads.emplace_back(atrous_pass, std::ref(planes), std::cref(settings), from, step,
+                                 fb.height * t / num_threads, fb.height * (t + 1) / num_threads);
+        atrous_pass(planes, settings, from, step, 0, fb.height / num_threads);
+        for(auto &thread : threads)
+            thread.join();
+        from = 1 - from;
+    }
+
+    image out = noisy;
+    for(int j = 0; j < fb.height; j++){
+        for(int i = 0; i < fb.width; i++){
+            const size_t p = fb.index(i, j), at = planes.index(i, j);
+            for(int c = 0; c < 3; c++)
+                out.rgb[3 * p + c] = static_cast<float>(planes.light[from][c][at]
+                                                        * denoise_albedo(features.albedo[3 * p + c]));
+        }
+    }
+    return out;
+}
+
+// the peak signal to noise ratio of an image against a reference of the same size, in dB (higher is closer),
+// comparing what's displayed, clamped to 0-1 and gamma corrected
+inline double psnr(const image &img, const image &reference){
+    double squared_error = 0;
+    for(size_t i = 0; i < img.rgb.size(); i++){
+        const double x = std::sqrt(clamp(img.rgb[i], 0, 1));
+        const double y = std::sqrt(clamp(reference.rgb[i], 0, 1));
+        squared_error += (x - y) * (x - y);
+    }
+    if(squared_error == 0) return infinity;
+    return 10 * std::log10(img.rgb.size() / squared_error);
+}
+
+#endif // DENOISE_H
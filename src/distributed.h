@@ -0,0 +1,482 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "helper.h"
+
+#include "camera.h"
+#include "framebuffer.h"
+#include "hittable.h"
+#include "integrator.h"
+#include "render.h"
+#include "tile_scheduler.h"
+
+// a frame can be split up by tile range and by sample range (render_settings::tile_begin, tile_end and sample_begin),
+// with each part rendered on its own, by another process or on another machine, into a partial, the summed samples
+// and pixel statistics of just the pixels of its tiles, and the partials merged back into the framebuffer - samples
+// are seeded by pixel and index, and summed exactly (pixel_sum), so the merged image is exactly the one a single
+// render gives, however the frame was split
+//
+// a partial file is a header, then a record per pixel, tile by tile in tile order, row by row within a tile, then if
+// it was rendered with features, a record of each pixel's features in the same order
+
+const char partial_magic[8] = { 'R', 'T', 'P', 'A', 'R', 'T', '\0', '\0' };
+const uint32_t partial_version = 2;
+const uint32_t partial_byte_order = 0x01020304;
+
+struct partial_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    int32_t width;
+    int32_t height;
+    int32_t tile_size;
+    int32_t tile_begin; // the tiles [tile_begin, tile_end) it holds
+    int32_t tile_end;
+    int32_t sample_begin; // and the samples [sample_begin, sample_end) of each of their pixels
+    int32_t sample_end;
+    int32_t sequence;
+    int32_t features; // 1 if it holds the pixels' features
+    int32_t unused;
+    uint64_t seed;
+    uint64_t pixel_count;
+};
+
+struct partial_pixel {
+    int64_t rgb[3];
+    int32_t count;
+    int32_t unused;
+    double mean;
+    double m2;
+};
+
+struct partial_features {
+    int64_t albedo[3];
+    int64_t normal[3];
+    int64_t depth;
+};
+
+struct render_partial {
+    partial_header header{};
+    std::vector<partial_pixel> pixels{};
+    std::vector<partial_features> features{}; // empty unless header.features
+};
+
+// the same pixel order the records are in
+template<typename pixel_fn>
+void for_each_partial_pixel(const std::vector<tile> &tiles, pixel_fn &&fn){
+    size_t record = 0;
+    for(const tile &t : tiles)
+        for(int j = t.y0; j < t.y1; j++)
+            for(int i = t.x0; i < t.x1; i++)
+                fn(record++, i, j);
+}
+
+// the tiles of the frame a partial covers
+inline std::vector<tile> partial_tiles(const partial_header &header){
+    std::vector<tile> tiles = make_tiles(header.width, header.height, header.tile_size);
+    return std::vector<tile>(tiles.begin() + header.tile_begin, tiles.begin() + header.tile_end);
+}
+
+// the part of fb the settings cover, as a partial
+inline render_partial make_partial(const render_settings &settings, const framebuffer &fb){
+    const int tile_count = static_cast<int>(make_tiles(settings.width, settings.height, settings.tile_size).size());
+
+    render_partial part{};
+    partial_header &header = part.header;
+    std::memcpy(header.magic, partial_magic, sizeof(header.magic));
+    header.version = partial_version;
+    header.byte_order = partial_byte_order;
+    header.width = settings.width;
+    header.height = settings.height;
+    header.tile_size = settings.tile_size;
+    header.tile_end = settings.tile_end < 0 ? tile_count : std::min(settings.tile_end, tile_count);
+    header.tile_begin = std::min(std::max(settings.tile_begin, 0), header.tile_end);
+    header.sample_begin = settings.sample_begin;
+    header.sample_end = settings.samples_per_pixel;
+    header.sequence = static_cast<int32_t>(settings.sequence);
+    header.features = fb.has_features() ? 1 : 0;
+    header.seed = settings.seed;
+
+    const std::vector<tile> tiles = partial_tiles(header);
+    for_each_partial_pixel(tiles, [&](size_t, int i, int j){
+        const size_t idx = fb.index(i, j);
+        partial_pixel p{};
+        for(int c = 0; c < 3; c++) p.rgb[c] = fb.pixels[idx].rgb[c];
+        p.count = fb.stats[idx].count;
+        p.mean = fb.stats[idx].mean;
+        p.m2 = fb.stats[idx].m2;
+        part.pixels.push_back(p);
+
+        if(!header.features) return;
+        const feature_sum &sum = fb.features[idx];
+        partial_features f{};
+        for(int c = 0; c < 3; c++){
+            f.albedo[c] = sum.albedo.rgb[c];
+            f.normal[c] = sum.normal.rgb[c];
+        }
+        f.depth = sum.depth;
+        part.features.push_back(f);
+    });
+    header.pixel_count = part.pixels.size();
+    return part;
+}
+
+inline bool write_partial(std::FILE *file, const render_partial &part){
+    return std::fwrite(&part.header, sizeof(part.header), 1, file) == 1
+           && std::fwrite(part.pixels.data(), sizeof(partial_pixel), part.pixels.size(), file) == part.pixels.size()
+           && std::fwrite(part.features.data(), sizeof(partial_features), part.features.size(), file)
+              == part.features.size();
+}
+
+// reads a partial, checking its header describes a frame it could be part of, and that it holds as many pixels as its
+// tiles have
+inline bool read_partial(std::FILE *file, render_partial &part, std::string &error){
+    partial_header &header = part.header;
+    if(std::fread(&header, sizeof(header), 1, file) != 1){
+        error = "it's too short to be a partial";
+        return false;
+    }
+    if(std::memcmp(header.magic, partial_magic, sizeof(header.magic)) != 0 || header.version != partial_version
+       || header.byte_order != partial_byte_order){
+        error = "it isn't a partial (or is from an incompatible version)";
+        return false;
+    }
+    if(header.width < 1 || header.height < 1 || header.tile_size < 1 || header.sample_begin < 0
+       || header.sample_end < header.sample_begin || (header.features != 0 && header.features != 1)){
+        error = "its header is corrupt";
+        return false;
+    }
+    const int tile_count = static_cast<int>(make_tiles(header.width, header.height, header.tile_size).size());
+    if(header.tile_begin < 0 || header.tile_end < header.tile_begin || header.tile_end > tile_count){
+        error = "its tile range is outside the frame";
+        return false;
+    }
+
+    uint64_t expected = 0;
+    for(const tile &t : partial_tiles(header))
+        expected += static_cast<uint64_t>(t.x1 - t.x0) * (t.y1 - t.y0);
+    if(header.pixel_count != expected){
+        error = "it holds the wrong number of pixels for its tiles";
+        return false;
+    }
+
+    part.pixels.resize(header.pixel_count);
+    part.features.resize(header.features ? header.pixel_count : 0);
+    if(std::fread(part.pixels.data(), sizeof(partial_pixel), part.pixels.size(), file) != part.pixels.size()
+       || std::fread(part.features.data(), sizeof(partial_features), part.features.size(), file)
+          != part.features.size()){
+        error = "it's truncated";
+        return false;
+    }
+    return true;
+}
+
+inline bool save_partial(const render_partial &part, const std::string &path, std::string &error){
+    FILE *file = std::fopen(path.c_str(), "wb");
+    if(!file){
+        error = "couldn't open " + path + " for writing";
+        return false;
+    }
+    bool ok = write_partial(file, part);
+    ok = std::fclose(file) == 0 && ok;
+    if(!ok) error = "couldn't write " + path;
+    return ok;
+}
+
+inline bool load_partial(const std::string &path, render_partial &part, std::string &error){
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if(!file){
+        error = "couldn't open " + path;
+        return false;
+    }
+    bool ok = read_partial(file, part, error);
+    std::fclose(file);
+    if(!ok) error = path + ": " + error;
+    return ok;
+}
+
+// merges partials into fb, which have to cover the whole frame once they're put together, every tile's samples from
+// the same first to the same last, each exactly once - they're merged in order of tile then sample range, so the
+// pixel statistics come out the same for the same set of partials, whichever order they're given in (and the image
+// always does, being summed exactly)
+inline bool merge_partials(std::vector<render_partial> parts, framebuffer &fb, std::string &error){
+    if(parts.empty()){
+        error = "there are no partials to merge";
+        return false;
+    }
+
+    const partial_header &first = parts[0].header;
+    for(const render_partial &part : parts){
+        const partial_header &h = part.header;
+        if(h.width != first.width || h.height != first.height || h.tile_size != first.tile_size
+           || h.seed != first.seed || h.sequence != first.sequence){
+            error = "the partials are of different frames (their size, tile size, seed or sampler differ)";
+            return false;
+        }
+        if(h.features != first.features){
+            error = "some of the partials were rendered with features and some without";
+            return false;
+        }
+    }
+
+    std::sort(parts.begin(), parts.end(), [](const render_partial &a, const render_partial &b){
+        return std::make_pair(a.header.tile_begin, a.header.sample_begin)
+               < std::make_pair(b.header.tile_begin, b.header.sample_begin);
+    });
+
+    // each tile's sample ranges have to run on from each other, from the same start to the same end for every tile
+    const std::vector<tile> tiles = make_tiles(first.width, first.height, first.tile_size);
+    std::vector<std::vector<std::pair<int, int>>> ranges(tiles.size());
+    for(const render_partial &part : parts)
+        for(int t = part.header.tile_begin; t < part.header.tile_end; t++)
+            ranges[t].emplace_back(part.header.sample_begin, part.header.sample_end);
+
+    int sample_begin = 0, sample_end = 0;
+    for(size_t t = 0; t < tiles.size(); t++){
+        std::sort(ranges[t].begin(), ranges[t].end());
+        if(ranges[t].empty()){
+            error = "tile " + std::to_string(t) + " isn't in any of the partials";
+            return false;
+        }
+        if(t == 0){
+            sample_begin = ranges[t].front().first;
+            sample_end = std::max_element(ranges[t].begin(), ranges[t].end(), [](const std::pair<int, int> &a,
+                                          const std::pair<int, int> &b){ return a.second < b.second; })->second;
+        }
+        int covered = sample_begin;
+        for(const auto &range : ranges[t]){
+            if(range.first != covered){
+                error = "tile " + std::to_string(t) + (range.first < covered ? " has overlapping sample ranges"
+                                                                            : " is missing samples");
+                return false;
+            }
+            covered = range.second;
+        }
+        if(covered != sample_end){
+            error = "tile " + std::to_string(t) + " has samples up to " + std::to_string(covered) + " rather than "
+                    + std::to_string(sample_end);
+            return false;
+        }
+    }
+
+    fb = framebuffer(first.width, first.height, first.features != 0);
+    for(const render_partial &part : parts){
+        for_each_partial_pixel(partial_tiles(part.header), [&](size_t record, int i, int j){
+            const partial_pixel &p = part.pixels[record];
+            const size_t idx = fb.index(i, j);
+            pixel_sum sum{};
+            for(int c = 0; c < 3; c++) sum.rgb[c] = p.rgb[c];
+            fb.pixels[idx].add(sum);
+
+            pixel_stats stats{};
+            stats.count = p.count;
+            stats.mean = p.mean;
+            stats.m2 = p.m2;
+            fb.stats[idx].merge(stats);
+
+            if(!fb.has_features()) return;
+            const partial_features &f = part.features[record];
+            feature_sum features{};
+            for(int c = 0; c < 3; c++){
+                features.albedo.rgb[c] = f.albedo[c];
+                features.normal.rgb[c] = f.normal[c];
+            }
+            features.depth = f.depth;
+            fb.features[idx].add(features);
+        });
+    }
+    return true;
+}
+
+// a job for a worker process, tile_begin -1 tells it to exit
+struct distributed_job {
+    int32_t tile_begin;
+    int32_t tile_end;
+    int32_t sample_begin;
+    int32_t sample_end;
+};
+
+inline bool write_all(int fd, const void *data, size_t bytes){
+    const char *at = static_cast<const char *>(data);
+    while(bytes > 0){
+        ssize_t written = write(fd, at, bytes);
+        if(written <= 0) return false;
+        at += written;
+        bytes -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+inline bool read_all(int fd, void *data, size_t bytes){
+    char *at = static_cast<char *>(data);
+    while(bytes > 0){
+        ssize_t got = read(fd, at, bytes);
+        if(got <= 0) return false;
+        at += got;
+        bytes -= static_cast<size_t>(got);
+    }
+    return true;
+}
+
+// a worker process, renders the jobs it's sent down jobs_fd, each with its threads, and sends each back as a partial
+inline void distributed_worker(const camera &cam, const hittable &world, const path_integrator &integrator,
+                               render_settings settings, int jobs_fd, int results_fd){
+    FILE *results = fdopen(results_fd, "wb");
+    if(!results) _exit(1);
+
+    settings.report_progress = false;
+    framebuffer fb{};
+    distributed_job job{};
+    while(read_all(jobs_fd, &job, sizeof(job)) && job.tile_begin >= 0){
+        settings.tile_begin = job.tile_begin;
+        settings.tile_end = job.tile_end;
+        settings.sample_begin = job.sample_begin;
+        settings.samples_per_pixel = job.sample_end;
+        render(cam, world, integrator, settings, fb);
+        if(!write_partial(results, make_partial(settings, fb)) || std::fflush(results) != 0) _exit(1);
+    }
+    _exit(0); // skips the parent's atexit handlers and buffers, which were copied by fork
+}
+
+// renders the frame the settings describe across processes worker processes, forked from this one (so they start
+// with the scene already loaded), each with settings.num_threads threads - the frame's tiles are split into a few
+// ranges per process, and each range's samples into sample_splits ranges, the coordinator hands the jobs out over
+// pipes as workers become free, and merges the partials they send back into fb
+//
+// it has to be called before this process starts any threads of its own, since only the forking thread carries on in
+// a child
+inline bool render_distributed(const camera &cam, const hittable &world, const path_integrator &integrator,
+                               const render_settings &settings, int processes, int sample_splits, framebuffer &fb,
+                               std::string &error){
+    const int tile_count = static_cast<int>(render_tiles(settings).size());
+    const int tile_offset = std::max(settings.tile_begin, 0);
+    const int sample_count = settings.samples_per_pixel - settings.sample_begin;
+    processes = std::max(1, processes);
+    sample_splits = std::max(1, std::min(sample_splits, sample_count));
+
+    std::vector<distributed_job> jobs{};
+    const int tile_ranges = std::max(1, std::min(tile_count, 4 * processes));
+    for(int r = 0; r < tile_ranges; r++){
+        for(int s = 0; s < sample_splits; s++){
+            distributed_job job{};
+            job.tile_begin = tile_offset + tile_count * r / tile_ranges;
+            job.tile_end = tile_offset + tile_count * (r + 1) / tile_ranges;
+            job.sample_begin = settings.sample_begin + sample_count * s / sample_splits;
+            job.sample_end = settings.sample_begin + sample_count * (s + 1) / sample_splits;
+            jobs.push_back(job);
+        }
+    }
+    processes = std::min(processes, static_cast<int>(jobs.size()));
+
+    struct worker_process {
+        pid_t pid{-1};
+        int jobs_fd{-1}; // the coordinator's ends
+        FILE *results{};
+        int job{-1}; // the job it's on, -1 once it's been told to exit
+    };
+    std::vector<worker_process> workers(processes);
+
+    bool ok = true;
+    std::fflush(nullptr); // so nothing buffered gets written twice, by a child as well
+    for(int w = 0; w < processes && ok; w++){
+        int job_pipe[2], result_pipe[2];
+        if(pipe(job_pipe) != 0) { ok = false; break; }
+        if(pipe(result_pipe) != 0) { close(job_pipe[0]); close(job_pipe[1]); ok = false; break; }
+
+        pid_t pid = fork();
+        if(pid == 0){
+            // the child only keeps its own ends of its own pipes
+            for(int other = 0; other < w; other++){
+                close(workers[other].jobs_fd);
+                std::fclose(workers[other].results);
+            }
+            close(job_pipe[1]);
+            close(result_pipe[0]);
+            distributed_worker(cam, world, integrator, settings, job_pipe[0], result_pipe[1]);
+        }
+
+        close(job_pipe[0]);
+        close(result_pipe[1]);
+        workers[w].pid = pid;
+        workers[w].jobs_fd = job_pipe[1];
+        workers[w].results = fdopen(result_pipe[0], "rb");
+        if(pid < 0 || !workers[w].results){
+            close(job_pipe[1]);
+            if(workers[w].results) std::fclose(workers[w].results);
+            else close(result_pipe[0]);
+            workers[w].jobs_fd = -1;
+            workers[w].results = nullptr;
+            ok = false;
+        }
+    }
+    if(!ok) error = "couldn't start the worker processes";
+
+    std::vector<render_partial> parts(jobs.size());
+    size_t next_job = 0, jobs_done = 0;
+    auto hand_out = [&](worker_process &worker){
+        if(next_job < jobs.size() && ok){
+            worker.job = static_cast<int>(next_job);
+            if(write_all(worker.jobs_fd, &jobs[next_job++], sizeof(distributed_job))) return;
+            error = "couldn't send a worker process its job";
+            ok = false;
+        }
+        distributed_job stop{ -1, -1, 0, 0 };
+        write_all(worker.jobs_fd, &stop, sizeof(stop));
+        worker.job = -1;
+    };
+    for(worker_process &worker : workers)
+        if(worker.results) hand_out(worker);
+
+    while(ok && jobs_done < jobs.size()){
+        std::vector<pollfd> waiting{};
+        std::vector<worker_process *> waiting_workers{};
+        for(worker_process &worker : workers){
+            if(worker.job < 0) continue;
+            waiting.push_back({ fileno(worker.results), POLLIN, 0 });
+            waiting_workers.push_back(&worker);
+        }
+        if(poll(waiting.data(), waiting.size(), -1) < 0) continue; // interrupted by a signal
+
+        for(size_t w = 0; w < waiting.size() && ok; w++){
+            if(!(waiting[w].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            worker_process &worker = *waiting_workers[w];
+            std::string part_error{};
+            if(!read_partial(worker.results, parts[worker.job], part_error)){
+                error = "a worker process failed (" + part_error + ")";
+                ok = false;
+                break;
+            }
+            jobs_done++;
+            if(settings.report_progress)
+                std::fprintf(stderr, "\rJobs: %*zu/%zu", 5, jobs_done, jobs.size());
+            hand_out(worker);
+        }
+    }
+
+    for(worker_process &worker : workers){
+        if(worker.jobs_fd >= 0) close(worker.jobs_fd); // a worker still waiting for a job reads the end of the pipe
+        if(worker.results) std::fclose(worker.results);
+        int status = 0;
+        if(worker.pid > 0 && (waitpid(worker.pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+           && ok){
+            error = "a worker process exited with an error";
+            ok = false;
+        }
+    }
+
+    return ok && merge_partials(std::move(parts), fb, error);
+}
+
+#endif // DISTRIBUTED_H
@@ -0,0 +1,192 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "helper.h"
+
+// running statistics of a pixel's samples, kept with Welford's method (a running mean and sum of squared differences
+// from it), which unlike summing squares doesn't lose precision when the variance is small next to the mean
+struct pixel_stats {
+    int count{};
+    double mean{}; // of the samples' luminance
+    double m2{};
+
+    void add(double value){
+        count++;
+        double delta = value - mean;
+        mean += delta / count;
+        m2 += delta * (value - mean);
+    }
+
+    // combines the statistics of two disjoint sets of samples (Chan et al.'s parallel form of Welford's method)
+    void merge(const pixel_stats &other){
+        if(other.count == 0) return;
+        const int total = count + other.count;
+        const double delta = other.mean - mean;
+        mean += delta * other.count / total;
+        m2 += other.m2 + delta * delta * (static_cast<double>(count) * other.count / total);
+        count = total;
+    }
+
+    // estimated standard error of the pixel's displayed brightness, the standard error of the mean luminance, scaled
+    // by the slope of the gamma 2 curve at the mean (d/dx sqrt(x) = 1/(2 sqrt(x))), since that's what a viewer sees
+    double display_error() const {
+        if(count < 2) return infinity;
+        double standard_error = sqrt(m2 / (count - 1) / count);
+        return standard_error / (2.0 * sqrt(std::max(mean, 1e-4)));
+    }
+};
+
+inline double luminance(const colour &c){
+    return 0.2126 * c[0] + 0.7152 * c[1] + 0.0722 * c[2];
+}
+
+// a pixel's samples summed in fixed point, 32 bits after the point, since integer addition is exact the sum comes out
+// the same whatever order the samples are added in, so a frame split by sample range (across passes, processes or
+// machines) and merged is exactly the frame rendered in one go - a sum overflows past 2^31 (say 20,000 samples
+// averaging 100,000), which is far beyond anything a scene here reaches
+struct pixel_sum {
+    int64_t rgb[3]{};
+
+    void add(const colour &sample){
+        for(int c = 0; c < 3; c++) rgb[c] += to_fixed(sample[c]);
+    }
+
+    void add(const pixel_sum &other){
+        for(int c = 0; c < 3; c++) rgb[c] += other.rgb[c];
+    }
+
+    double operator[](int c) const { return static_cast<double>(rgb[c]) * (1.0 / 4294967296.0); }
+
+    static int64_t to_fixed(double value){
+        // clamped well inside the range, a NaN from a degenerate sample counts as nothing rather than corrupting the sum
+        if(!(value == value)) return 0;
+        return std::llround(std::max(-1e6, std::min(value, 1e6)) * 4294967296.0);
+    }
+};
+
+// what a sample's camera ray first hit, which the denoiser uses to tell edges apart from noise - the colour of the
+// surface (its material's base colour, or the sky's colour for a ray that hits nothing), the normal there (facing the
+// ray, or back along it for the sky), and the distance to it (0 for the sky)
+struct surface_features {
+    colour albedo{};
+    vec3 normal{};
+    real depth{};
+};
+
+// a pixel's features summed over its samples, in fixed point as the colour is, so they merge exactly too
+struct feature_sum {
+    pixel_sum albedo{};
+    pixel_sum normal{};
+    int64_t depth{};
+
+    void add(const surface_features &f){
+        albedo.add(f.albedo);
+        normal.add(f.normal);
+        depth += pixel_sum::to_fixed(f.depth);
+    }
+
+    void add(const feature_sum &other){
+        albedo.add(other.albedo);
+        normal.add(other.normal);
+        depth += other.depth;
+    }
+};
+
+// what the renderer writes into, the sum of every sample taken for each pixel, in linear colour, and statistics about
+// those samples, with row 0 at the bottom of the image (the same way round as the camera's v coordinate), and if it's
+// asked for, the features of the surfaces they first hit
+class framebuffer {
+public:
+    framebuffer() = default;
+    framebuffer(int width, int height, bool with_features = false) : width(width), height(height),
+        pixels(static_cast<size_t>(width) * height), stats(pixels.size()), features(with_features ? pixels.size() : 0) {}
+
+    size_t index(int i, int j) const { return static_cast<size_t>(j) * width + i; }
+
+    void add_sample(size_t idx, const colour &sample){
+        pixels[idx].add(sample);
+        stats[idx].add(luminance(sample));
+    }
+
+    void add_sample(size_t idx, const colour &sample, const surface_features &first_hit){
+        add_sample(idx, sample);
+        features[idx].add(first_hit);
+    }
+
+    bool has_features() const { return !features.empty(); }
+
+    int samples(size_t idx) const { return stats[idx].count; }
+    long long total_samples() const {
+        long long total = 0;
+        for(const auto &s : stats) total += s.count;
+        return total;
+    }
+public:
+    int width{};
+    int height{};
+    std::vector<pixel_sum> pixels{};
+    std::vector<pixel_stats> stats{};
+    std::vector<feature_sum> features{}; // empty unless it was made with them
+};
+
+// a finished image, linear colour averaged over the samples, stored as packed float rgb triples (row 0 at the bottom
+// again) - which is the layout both the float encoders and the tone mapping pass want
+struct image {
+    int width{};
+    int height{};
+    std::vector<float> rgb{};
+};
+
+// averages each pixel over however many samples it got
+inline image resolve(const framebuffer &fb){
+    image img{};
+    img.width = fb.width;
+    img.height = fb.height;
+    img.rgb.resize(fb.pixels.size() * 3);
+
+    for(size_t p = 0; p < fb.pixels.size(); p++){
+        const double scale = fb.samples(p) > 0 ? 1.0 / fb.samples(p) : 0.0;
+        for(int c = 0; c < 3; c++)
+            img.rgb[3 * p + c] = static_cast<float>(fb.pixels[p][c] * scale);
+    }
+
+    return img;
+}
+
+// a framebuffer's features averaged over each pixel's samples, packed as image is (depth has one value a pixel)
+struct feature_image {
+    int width{};
+    int height{};
+    std::vector<float> albedo{};
+    std::vector<float> normal{};
+    std::vector<float> depth{};
+};
+
+inline feature_image resolve_features(const framebuffer &fb){
+    feature_image img{};
+    img.width = fb.width;
+    img.height = fb.height;
+    if(!fb.has_features()) return img;
+    img.albedo.resize(fb.pixels.size() * 3);
+    img.normal.resize(fb.pixels.size() * 3);
+    img.depth.resize(fb.pixels.size());
+
+    for(size_t p = 0; p < fb.pixels.size(); p++){
+        const double scale = fb.samples(p) > 0 ? 1.0 / fb.samples(p) : 0.0;
+        const feature_sum &f = fb.features[p];
+        for(int c = 0; c < 3; c++){
+            img.albedo[3 * p + c] = static_cast<float>(f.albedo[c] * scale);
+            img.normal[3 * p + c] = static_cast<float>(f.normal[c] * scale);
+        }
+        img.depth[p] = static_cast<float>(static_cast<double>(f.depth) * (1.0 / 4294967296.0) * scale);
+    }
+
+    return img;
+}
+
+#endif // FRAMEBUFFER_H
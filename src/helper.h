@@ -4,7 +4,8 @@
 #include <cmath>
 #include <limits>
 #include <memory>
-#include <random>
+
+#include "sampler.h"
 
 // usings
 
@@ -23,14 +24,13 @@ inline double deg_to_rads(double degs) {
     return (degs * pi) / 180.0;
 }
 
-inline double random_double(){
-    static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    static std::mt19937 generator{};
-    return distribution(generator);
+// the sampler's next dimension, which is just the next random number unless it's drawing from a sequence
+inline double random_double(sampler &s){
+    return s.next_1d();
 }
 
-inline double random_double(double min, double max){
-    return min + (max - min) * random_double();
+inline double random_double(sampler &s, double min, double max){
+    return min + (max - min) * random_double(s);
 }
 
 inline double clamp(double val, double min, double max){
@@ -43,5 +43,6 @@ inline double clamp(double val, double min, double max){
 
 #include "ray.h"
 #include "vector.h"
+#include "sampling.h"
 
 #endif // HELPER_H
\ No newline at end of file
@@ -1,17 +1,29 @@
 #ifndef HITTABLE_H
 #define HITTABLE_H
 
+#include "aabb.h"
 #include "ray.h"
 
 class material;
 
 struct hit_record {
     point3 p{}; // point at which hit happened
-    double t{}; // value on dir vector line at which hit occurred
-    shared_ptr<material> mat_ptr{};
+    real t{}; // value on dir vector line at which hit occurred
+    const material *mat_ptr{}; // owned by the scene (or the object hit), a plain pointer so copying it is free
+    int light{-1}; // the light hit, in the scene's light_list, -1 if it isn't one (a mesh gives the triangle hit here,
+                   // which its instance turns into the light's index)
 
     bool front_face{};
     vec3 normal{}; // normal at hit
+
+    // texture coordinates, which spheres only work out when the material they hit has a texture (it's the only thing
+    // reading them), uv_scale is how far they go across a unit of distance on the surface, and footprint is how wide
+    // the cone of rays through a pixel has spread by the time it's got here, which the integrator fills in, so a
+    // texture lookup covers uv_scale * footprint (0 for the finest detail it has)
+    real u{};
+    real v{};
+    real uv_scale{};
+    real footprint{};
     inline void set_face_normal(const ray &r, const vec3 &outward_normal){
         front_face = dot(r.direction(), outward_normal) < 0.0; // used to determine the refraction ratio
         // if ray coming from outside, then the normal and ray point in different directions
@@ -21,7 +33,26 @@ struct hit_record {
 
 class hittable {
 public:
-    virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const = 0;
+    virtual bool hit(const ray &r, real t_min, real t_max, hit_record &rec) const = 0;
+
+    // finds the closest hit for each of count rays (at most a packet's worth, 8), filling in recs[i] for each ray i
+    // that hits something, and returning a bit per ray that did - hittables which can trace rays together override
+    // this, otherwise each ray is traced on its own
+    virtual int hit_packet(const ray *rays, int count, real t_min, real t_max, hit_record *recs) const {
+        int hits = 0;
+        for(int i = 0; i < count; i++)
+            if(hit(rays[i], t_min, t_max, recs[i])) hits |= 1 << i;
+        return hits;
+    }
+
+    // whether r hits anything at all in [t_min, t_max], which is all a shadow ray needs to know, so it can stop at the
+    // first hit found rather than going on for the closest - hittables which can stop early override this
+    virtual bool occluded(const ray &r, real t_min, real t_max) const {
+        hit_record rec;
+        return hit(r, t_min, t_max, rec);
+    }
+
+    virtual bool bounding_box(aabb &output_box) const = 0; // false if it has no finite box
     virtual ~hittable() {}
 };
 
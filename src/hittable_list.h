@@ -17,14 +17,16 @@ public:
     void clear() { objects.clear(); }
     void add(shared_ptr<hittable> obj) { objects.push_back(obj); }
 
-    bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override;
+    bool hit(const ray &r, real t_min, real t_max, hit_record &rec) const override;
+    bool occluded(const ray &r, real t_min, real t_max) const override;
+    bool bounding_box(aabb &output_box) const override;
 public:
     std::vector<shared_ptr<hittable>> objects{};
 };
 
-bool hittable_list::hit(const ray &r, double t_min, double t_max, hit_record &rec) const {
+bool hittable_list::hit(const ray &r, real t_min, real t_max, hit_record &rec) const {
     bool hit_anything = false;
-    double closest_so_far = t_max; // we modify the t_max, this allows us to get only the closest intersection
+    real closest_so_far = t_max; // we modify the t_max, this allows us to get only the closest intersection
 
     for(const auto &object : objects){
         if(object->hit(r, t_min, closest_so_far, rec)){
@@ -36,5 +38,24 @@ bool hittable_list::hit(const ray &r, double t_min, double t_max, hit_record &re
     return hit_anything;
 }
 
+bool hittable_list::occluded(const ray &r, real t_min, real t_max) const {
+    for(const auto &object : objects)
+        if(object->occluded(r, t_min, t_max)) return true;
+    return false;
+}
+
+bool hittable_list::bounding_box(aabb &output_box) const {
+    if(objects.empty()) return false;
+
+    aabb box{};
+    for(const auto &object : objects){
+        aabb object_box{};
+        if(!object->bounding_box(object_box)) return false; // one unbounded object makes the whole list unbounded
+        box.expand(object_box);
+    }
+
+    output_box = box;
+    return true;
+}
 
 #endif // HITTABLE_LIST_H
\ No newline at end of file
@@ -0,0 +1,117 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "helper.h"
+
+#include "colour.h"
+#include "framebuffer.h"
+
+// turns a finished image into the bytes of a file, the whole file is built in memory so it can go out in one write
+class image_encoder {
+public:
+    virtual void encode(const image &img, std::vector<unsigned char> &out) const = 0;
+    virtual ~image_encoder() = default;
+};
+
+// binary PPM (P6), gamma corrected 8 bit rgb with the top row first
+class ppm_encoder : public image_encoder {
+public:
+    void encode(const image &img, std::vector<unsigned char> &out) const override {
+        char header[64];
+        int header_size = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", img.width, img.height);
+
+        const size_t row_bytes = static_cast<size_t>(img.width) * 3;
+        std::vector<uint8_t> pixels(img.rgb.size());
+        tonemap_gamma2(img.rgb.data(), pixels.data(), img.rgb.size());
+
+        out.resize(header_size + pixels.size());
+        std::memcpy(out.data(), header, header_size);
+        for(int j = 0; j < img.height; j++) // the image is stored bottom row first, PPM wants the top row first
+            std::memcpy(&out[header_size + j * row_bytes], &pixels[(img.height - 1 - j) * row_bytes], row_bytes);
+    }
+};
+
+// portable float map (PF), the linear colour before any gamma correction or clamping, for HDR work further down the
+// pipeline - PFM stores the bottom row first, the same way round as image
+class pfm_encoder : public image_encoder {
+public:
+    void encode(const image &img, std::vector<unsigned char> &out) const override {
+        // the sign of the scale gives the byte order of the floats, negative for little endian
+        const uint16_t probe = 1;
+        const bool little_endian = *reinterpret_cast<const unsigned char *>(&probe) == 1;
+
+        char header[64];
+        int header_size = snprintf(header, sizeof(header), "PF\n%d %d\n%s\n", img.width, img.height,
+                                   little_endian ? "-1.0" : "1.0");
+
+        const size_t data_bytes = img.rgb.size() * sizeof(float);
+        out.resize(header_size + data_bytes);
+        std::memcpy(out.data(), header, header_size);
+        std::memcpy(out.data() + header_size, img.rgb.data(), data_bytes);
+    }
+};
+
+// "ppm" or "pfm", or nullptr for anything else
+inline shared_ptr<image_encoder> make_encoder(const std::string &format){
+    if(format == "ppm") return make_shared<ppm_encoder>();
+    if(format == "pfm") return make_shared<pfm_encoder>();
+    return nullptr;
+}
+
+// the format implied by a file name, ppm unless it ends in .pfm
+inline std::string format_for_path(const std::string &path){
+    const std::string pfm_ext = ".pfm";
+    if(path.size() >= pfm_ext.size() && path.compare(path.size() - pfm_ext.size(), pfm_ext.size(), pfm_ext) == 0)
+        return "pfm";
+    return "ppm";
+}
+
+// encodes the image and writes it in a single write, to stdout if path is "-"
+inline bool write_image(const image &img, const image_encoder &encoder, const std::string &path){
+    std::vector<unsigned char> bytes{};
+    encoder.encode(img, bytes);
+
+    FILE *file = path == "-" ? stdout : std::fopen(path.c_str(), "wb");
+    if(!file) return false;
+
+    bool ok = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    ok = (file == stdout ? std::fflush(file) : std::fclose(file)) == 0 && ok;
+    return ok;
+}
+
+// reads a PFM written by pfm_encoder (or anything else writing colour PFMs in this machine's byte order), say to
+// compare a render against
+inline bool load_pfm(const std::string &path, image &img, std::string &error){
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if(!file){
+        error = "couldn't open " + path;
+        return false;
+    }
+
+    const uint16_t probe = 1;
+    const bool little_endian = *reinterpret_cast<const unsigned char *>(&probe) == 1;
+    char magic[3] = {};
+    float scale = 0;
+    bool ok = std::fscanf(file, "%2s %d %d %f", magic, &img.width, &img.height, &scale) == 4
+              && std::strcmp(magic, "PF") == 0 && img.width > 0 && img.height > 0
+              && std::fgetc(file) != EOF; // a single whitespace ends the header
+    if(!ok) error = path + " isn't a colour PFM";
+    else if((scale < 0) != little_endian){
+        error = path + " is in the other byte order";
+        ok = false;
+    }
+    if(ok){
+        img.rgb.resize(static_cast<size_t>(img.width) * img.height * 3);
+        ok = std::fread(img.rgb.data(), sizeof(float), img.rgb.size(), file) == img.rgb.size();
+        if(!ok) error = path + " is truncated";
+    }
+    std::fclose(file);
+    return ok;
+}
+
+#endif // IMAGE_WRITER_H
@@ -0,0 +1,410 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "helper.h"
+
+#include "framebuffer.h"
+#include "hittable.h"
+#include "light.h"
+#include "material.h"
+#include "medium.h"
+#include "profile.h"
+#include "ray_packet.h"
+
+// hits closer than this to where a ray leaves a surface are that same surface again, which holds in float as well, the
+// rounding error in the root hit_sphere_root finds for the surface a ray leaves is around the sphere's radius times
+// the machine epsilon, so a float build keeps it below this for spheres up to a radius of ~10,000
+const real path_t_min = 0.01;
+
+// the dimensions of a sample each part of its path draws from, so that with a low discrepancy sequence the same part
+// of every sample (say the second bounce's scattering) always takes the same dimensions, however many the parts
+// before it used, the camera takes two (the jitter in the pixel, then the point on the lens, and a third for the time
+// if its shutter is open over an interval) and every bounce three (two for scattering, the most any material uses,
+// then Russian roulette), two more when there are lights to sample (picking a light, then the point on it), and one
+// more when there are media (how far the path gets before it scatters in one)
+const uint32_t camera_dimensions = 2;
+const uint32_t bounce_dimensions = 3;
+const uint32_t light_dimensions = 2;
+const uint32_t medium_dimensions = 1;
+
+// the power heuristic (Veach 1997), the weight multiple importance sampling gives a sample drawn with pdf a, which
+// could have been drawn with pdf b instead, so that adding both ways' weighted samples counts the light once, mostly
+// through whichever was more likely to find it
+inline real power_heuristic(real a, real b){
+    return a * a / (a * a + b * b);
+}
+
+// scratch space for path_integrator::radiance_batch, kept by the caller and reused, so that once it's grown to the
+// size of the batches being traced, tracing one allocates nothing
+struct path_batch {
+    std::vector<ray> rays{}; // the ray each path is currently following
+    std::vector<colour> throughput{};
+    std::vector<colour> radiance{}; // the light each path has picked up so far
+    std::vector<real> scatter_pdf{}; // what each path's ray was scattered with, as path_integrator::radiance_from has
+    std::vector<real> travelled{}; // how far each path has gone
+    std::vector<uint32_t> first_dimension{}; // the dimension each path's first bounce draws from
+    std::vector<hit_record> hits{};
+    std::vector<int> active{}; // the paths still going
+    std::vector<int> binned{}; // the active paths that hit something, grouped by the type of material they hit
+    std::vector<int> next{}; // the paths which survive this bounce
+};
+
+// works out the light arriving back along a camera ray by following its path through the scene, bounce by bounce, in
+// a loop rather than by recursion - the product of the attenuations so far (the throughput) is carried along, and
+// once a path has bounced a few times it's ended at random with Russian roulette, with a chance that grows as the
+// throughput shrinks, so paths which can barely add anything stop early without biasing the result
+//
+// light comes from the background a path escapes to, and from the emissive surfaces it hits, and given the scene's
+// lights, each bounce off a diffuse surface also picks a point on one and sends a shadow ray to it (next event
+// estimation), which finds small lights far more often than scattering does - a light found both ways is weighted
+// by multiple importance sampling, so it's only counted once, and each way counts most where it's the better one
+// (light samples for small lights, scattering for large ones close by)
+//
+// given the scene's media, each ray also samples whether it scatters in one before it gets to what it hit, if it does
+// the path carries on from there as if it had hit a surface of the medium's isotropic material, and shadow rays are
+// weighted by how much light gets through the media on the way
+class path_integrator {
+public:
+    path_integrator() = default;
+    path_integrator(int max_depth, int roulette_depth, const light_list *lights = nullptr,
+                    const medium_list *media = nullptr)
+        : max_depth(max_depth), roulette_depth(roulette_depth), lights(lights && !lights->empty() ? lights : nullptr),
+          media(media && !media->empty() ? media : nullptr) {}
+
+    // features, if it isn't null, is given what the ray first hit
+    colour radiance(const ray &r, const hittable &world, sampler &s, surface_features *features = nullptr) const;
+
+    // the same, for a ray which has already been intersected with the world (say as part of a packet), continuing
+    // the path from what that found
+    colour radiance_from(const ray &r, bool hit, const hit_record &first_rec, const hittable &world, sampler &s,
+                         surface_features *features = nullptr) const;
+
+    // traces count paths a bounce at a time rather than one path at a time (a wavefront), each bounce every path is
+    // intersected, the first bounce's rays in packets (since they're camera rays, which mostly go the same way), then
+    // the hits are binned by material type, and each type is shaded as a batch (so the same scattering code runs over
+    // and over, with no dispatch per hit) - path i starts along rays[i], draws its random numbers from samplers[i],
+    // and its radiance is written to out[i], exactly what radiance would give it (and if features isn't null, what it
+    // first hit to features[i])
+    void radiance_batch(const ray *rays, sampler *samplers, size_t count, const hittable &world, colour *out,
+                        path_batch &batch, surface_features *features = nullptr) const;
+
+    static colour background(const ray &r){
+        vec3 unit_dir = unit_vector(r.direction());
+        double t = 0.5 * (unit_dir.y() + 1.0); // to be in the range 0 < x < 1
+        return (1 - t)*colour(1, 1, 1) + (t)*colour(0.5, 0.7, 1.0);
+    }
+
+    static surface_features features_of(const ray &r, bool hit, const hit_record &rec){
+        surface_features f{};
+        if(!hit){
+            f.albedo = background(r);
+            f.normal = -unit_vector(r.direction());
+            return f;
+        }
+        f.albedo = rec.mat_ptr->base_colour(rec);
+        f.normal = rec.normal;
+        f.depth = rec.t * r.direction().length();
+        return f;
+    }
+public:
+    int max_depth{50}; // bounces before a path is cut off (and returns black)
+    int roulette_depth{3}; // bounces before Russian roulette starts
+    const light_list *lights{}; // owned by the scene, null if it has none, when lights are only found by hitting them
+    const medium_list *media{}; // owned by the scene, null if it has none
+
+    // the angle between neighbouring pixels' camera rays, in radians, for texture filtering, which takes the rays
+    // through a pixel as a cone spreading at this angle over the whole of the path's length (a ray cone, as if every
+    // surface were flat, which underestimates it after a diffuse bounce), 0 to always use the finest texels
+    real pixel_spread{};
+private:
+    // how wide the cone of rays through the pixel is where r, having already gone travelled, hit rec, adding the
+    // distance to the hit to travelled
+    void set_footprint(const ray &r, real &travelled, hit_record &rec) const {
+        if(pixel_spread <= 0) return;
+        travelled += rec.t * r.direction().length();
+        rec.footprint = pixel_spread * travelled;
+    }
+
+    // the first dimension a bounce draws from, where first is the first bounce's, wherever the camera ray left the
+    // sampler (after camera_dimensions, or one more with a shutter interval), without lights a path takes no more than
+    // it ever did, so a scene without any renders exactly as it did before there were lights to sample
+    uint32_t bounce_dimension(uint32_t first, int depth) const {
+        return first + static_cast<uint32_t>(depth) * (bounce_dimensions + (lights ? light_dimensions : 0)
+                                                       + (media ? medium_dimensions : 0));
+    }
+
+    // whether r, which hit rec if hit, scatters in a medium before it gets there (making rec where it does), so
+    // whether it hits anything at all - the medium's tracked from r's origin, path_t_min only keeps a surface from
+    // hitting itself, and skipping that much of a medium would let light through every scattering point for free
+    bool hit_media(const ray &r, bool hit, hit_record &rec, uint32_t first, int depth, sampler &s) const {
+        if(!media) return hit;
+        RT_PROFILE_SCOPE(traversal);
+        s.start_dimension(bounce_dimension(first, depth) + bounce_dimensions + (lights ? light_dimensions : 0));
+        return media->sample_scatter(r, 0, hit ? rec.t : infinity, s, rec) || hit;
+    }
+
+    bool survives_roulette(uint32_t first, int depth, colour &throughput, sampler &s) const;
+
+    // the light given off by the emissive surface r hit, weighted against the chance a light sample would have picked
+    // the same point, where scatter_pdf is the pdf r was scattered with, or 0 if it wasn't scattered over a spread of
+    // directions (a camera ray, or off a mirror or glass), which a light sample couldn't have stood in for
+    colour emitted(const ray &r, const hit_record &rec, real scatter_pdf) const;
+
+    // next event estimation at a hit on a material which samples_lights, the light arriving from a point picked on a
+    // light, if a shadow ray finds nothing in the way, weighted against the chance scattering would have gone there
+    colour sample_lights(const ray &r, const hit_record &rec, const hittable &world, uint32_t first, int depth,
+                         sampler &s) const;
+
+    // shades the paths in [first, last), which all hit a material of this type
+    template<material_type type>
+    void shade(const int *first, const int *last, int depth, const hittable &world, sampler *samplers, colour *out,
+               path_batch &batch) const;
+};
+
+bool path_integrator::survives_roulette(uint32_t first, int depth, colour &throughput, sampler &s) const {
+    if(depth + 1 < roulette_depth) return true;
+    s.start_dimension(bounce_dimension(first, depth) + 2);
+
+    // survive with probability q, and divide by q when it does, so the expected value is unchanged, q is capped below
+    // 1 so that even paths bouncing between white surfaces do end eventually
+    double q = std::min(0.95, static_cast<double>(std::max(throughput[0], std::max(throughput[1], throughput[2]))));
+    if(random_double(s) >= q)
+        return false;
+    throughput /= q;
+    return true;
+}
+
+colour path_integrator::emitted(const ray &r, const hit_record &rec, real scatter_pdf) const {
+    const colour emission = rec.mat_ptr->emitted(rec);
+    if(!lights || scatter_pdf <= 0 || rec.light < 0) return emission;
+    return emission * power_heuristic(scatter_pdf, lights->pdf(r.origin(), rec.light, rec.p));
+}
+
+colour path_integrator::sample_lights(const ray &r, const hit_record &rec, const hittable &world, uint32_t first,
+                                      int depth, sampler &s) const {
+    s.start_dimension(bounce_dimension(first, depth) + bounce_dimensions);
+    light_sample sample{};
+    if(!lights->sample(rec.p, s, sample)) return { 0, 0, 0 };
+
+    const real scatter_pdf = rec.mat_ptr->scatter_pdf(rec, sample.direction);
+    if(scatter_pdf <= 0 || sample.distance <= 2 * path_t_min) return { 0, 0, 0 }; // behind the surface, or touching it
+
+    // the shadow ray stops short of the light, so it isn't the light itself that's found in the way, and is at the
+    // same time as the path (though a moving light isn't sampled, it's only found by hitting it)
+    const ray shadow(rec.p, sample.direction, r.time());
+    bool blocked;
+    real through = 1;
+    {
+        RT_PROFILE_SCOPE(traversal);
+        RT_PROFILE_COUNT(rays, 1);
+        RT_PROFILE_COUNT(shadow_rays, 1);
+        blocked = world.occluded(shadow, path_t_min, sample.distance - path_t_min);
+        if(!blocked && media) through = media->transmittance(shadow, 0, sample.distance, s);
+    }
+    if(blocked || through <= 0) return { 0, 0, 0 };
+
+    return rec.mat_ptr->scattering(rec, sample.direction) * sample.emission
+           * (through * power_heuristic(sample.pdf, scatter_pdf) / sample.pdf);
+}
+
+colour path_integrator::radiance(const ray &r, const hittable &world, sampler &s, surface_features *features) const {
+    hit_record rec;
+    bool hit;
+    {
+        RT_PROFILE_SCOPE(traversal);
+        hit = world.hit(r, path_t_min, infinity, rec);
+    }
+    RT_PROFILE_COUNT(rays, 1);
+    return radiance_from(r, hit, rec, world, s, features);
+}
+
+colour path_integrator::radiance_from(const ray &r, bool hit, const hit_record &first_rec, const hittable &world,
+                                      sampler &s, surface_features *features) const {
+    colour throughput(1, 1, 1);
+    colour gathered(0, 0, 0); // the light picked up so far
+    real scatter_pdf = 0;
+    real travelled = 0;
+    const uint32_t first = s.current_dimension();
+    ray current = r;
+    hit_record rec = first_rec;
+    RT_PROFILE_COUNT(paths, 1);
+
+    for(int depth = 0; depth < max_depth; depth++){
+        if(depth > 0){
+            RT_PROFILE_SCOPE(traversal);
+            RT_PROFILE_COUNT(rays, 1);
+            hit = world.hit(current, path_t_min, infinity, rec);
+        }
+        hit = hit_media(current, hit, rec, first, depth, s);
+        if(hit) set_footprint(current, travelled, rec);
+        if(depth == 0 && features) *features = features_of(current, hit, rec);
+        if(!hit)
+            return gathered + throughput * background(current);
+        if(rec.mat_ptr->type == material_type::emissive)
+            return gathered + throughput * emitted(current, rec, scatter_pdf); // which absorbs whatever arrives at it
+
+        if(lights && rec.mat_ptr->samples_lights())
+            gathered += throughput * sample_lights(current, rec, world, first, depth, s);
+
+        ray scattered{};
+        colour attenuation{};
+        bool scattered_any;
+        {
+            RT_PROFILE_SCOPE(scatter);
+            RT_PROFILE_COUNT(bounces, 1);
+            s.start_dimension(bounce_dimension(first, depth));
+            scattered_any = rec.mat_ptr->scatter(current, rec, attenuation, scattered, s);
+        }
+        if(!scattered_any)
+            return gathered; // absorbed
+
+        throughput = throughput * attenuation;
+        current = scattered;
+        scatter_pdf = rec.mat_ptr->samples_lights()
+                      ? rec.mat_ptr->scatter_pdf(rec, unit_vector(scattered.direction())) : 0;
+
+        if(!survives_roulette(first, depth, throughput, s))
+            return gathered;
+    }
+
+    return gathered; // cut off
+}
+
+void path_integrator::radiance_batch(const ray *rays, sampler *samplers, size_t count, const hittable &world,
+                                     colour *out, path_batch &batch, surface_features *features) const {
+    batch.rays.assign(rays, rays + count);
+    batch.throughput.assign(count, colour(1, 1, 1));
+    batch.radiance.assign(count, colour(0, 0, 0));
+    batch.scatter_pdf.assign(count, 0);
+    batch.travelled.assign(count, 0);
+    batch.first_dimension.resize(count);
+    batch.hits.resize(count);
+    batch.active.resize(count);
+    for(size_t i = 0; i < count; i++){
+        batch.active[i] = static_cast<int>(i);
+        batch.first_dimension[i] = samplers[i].current_dimension();
+    }
+    RT_PROFILE_COUNT(paths, count);
+
+    for(int depth = 0; depth < max_depth && !batch.active.empty(); depth++){
+        // intersect every active path, finishing the ones which escape, and count how many hit each material type
+        int type_counts[material_type_count] = {};
+        size_t hit_count = 0;
+        int packet_hits = 0;
+        for(size_t i = 0; i < batch.active.size(); i++){
+            const int path = batch.active[i];
+            hit_record &rec = batch.hits[path];
+
+            bool hit;
+            if(depth == 0){
+                // at the first bounce every path is active, in order, so the rays are in a row for hit_packet
+                if(i % packet_size == 0){
+                    const int packet_count = static_cast<int>(std::min<size_t>(packet_size, count - i));
+                    RT_PROFILE_SCOPE(traversal);
+                    RT_PROFILE_COUNT(rays, packet_count);
+                    packet_hits = world.hit_packet(&batch.rays[i], packet_count, path_t_min, infinity, &batch.hits[i]);
+                }
+                hit = packet_hits & (1 << (i % packet_size));
+                hit = hit_media(batch.rays[path], hit, rec, batch.first_dimension[path], depth, samplers[path]);
+                if(hit) set_footprint(batch.rays[path], batch.travelled[path], rec);
+                if(features) features[path] = features_of(batch.rays[path], hit, rec);
+            }else{
+                {
+                    RT_PROFILE_SCOPE(traversal);
+                    RT_PROFILE_COUNT(rays, 1);
+                    hit = world.hit(batch.rays[path], path_t_min, infinity, rec);
+                }
+                hit = hit_media(batch.rays[path], hit, rec, batch.first_dimension[path], depth, samplers[path]);
+                if(hit) set_footprint(batch.rays[path], batch.travelled[path], rec);
+            }
+
+            if(!hit){
+                out[path] = batch.radiance[path] + batch.throughput[path] * background(batch.rays[path]);
+                continue;
+            }
+            type_counts[static_cast<int>(rec.mat_ptr->type)]++;
+            batch.active[hit_count++] = path;
+        }
+
+        // a counting sort of the paths which hit something, by material type
+        int type_starts[material_type_count + 1] = {};
+        for(int t = 0; t < material_type_count; t++)
+            type_starts[t + 1] = type_starts[t] + type_counts[t];
+
+        batch.binned.resize(hit_count);
+        int fill[material_type_count];
+        std::copy(type_starts, type_starts + material_type_count, fill);
+        for(size_t i = 0; i < hit_count; i++){
+            int path = batch.active[i];
+            batch.binned[fill[static_cast<int>(batch.hits[path].mat_ptr->type)]++] = path;
+        }
+
+        batch.next.clear();
+        const int *binned = batch.binned.data();
+        shade<material_type::lambertian>(binned + type_starts[0], binned + type_starts[1], depth, world, samplers, out,
+                                         batch);
+        shade<material_type::metal>(binned + type_starts[1], binned + type_starts[2], depth, world, samplers, out,
+                                    batch);
+        shade<material_type::dielectric>(binned + type_starts[2], binned + type_starts[3], depth, world, samplers, out,
+                                         batch);
+        shade<material_type::emissive>(binned + type_starts[3], binned + type_starts[4], depth, world, samplers, out,
+                                       batch);
+        shade<material_type::isotropic>(binned + type_starts[4], binned + type_starts[5], depth, world, samplers, out,
+                                        batch);
+        std::swap(batch.active, batch.next);
+    }
+
+    for(int path : batch.active)
+        out[path] = batch.radiance[path]; // cut off
+}
+
+template<material_type type>
+void path_integrator::shade(const int *first, const int *last, int depth, const hittable &world, sampler *samplers,
+                            colour *out, path_batch &batch) const {
+    // the same steps as radiance_from, in the same order, so each path comes out exactly the same
+    for(const int *it = first; it != last; it++){
+        const int path = *it;
+        const hit_record &rec = batch.hits[path];
+        sampler &s = samplers[path];
+
+        if(type == material_type::emissive){
+            out[path] = batch.radiance[path]
+                        + batch.throughput[path] * emitted(batch.rays[path], rec, batch.scatter_pdf[path]);
+            continue;
+        }
+
+        const uint32_t first = batch.first_dimension[path];
+        if(lights && rec.mat_ptr->samples_lights())
+            batch.radiance[path] += batch.throughput[path]
+                                    * sample_lights(batch.rays[path], rec, world, first, depth, s);
+
+        // scattering, with the roulette and bookkeeping, the light sample above being timed as traversal, as it is
+        // in radiance_from
+        RT_PROFILE_SCOPE(scatter);
+        RT_PROFILE_COUNT(bounces, 1);
+        ray scattered{};
+        colour attenuation{};
+        s.start_dimension(bounce_dimension(first, depth));
+        if(!scatter_as<type>(*rec.mat_ptr, batch.rays[path], rec, attenuation, scattered, s)){
+            out[path] = batch.radiance[path]; // absorbed
+            continue;
+        }
+
+        batch.throughput[path] = batch.throughput[path] * attenuation;
+        batch.rays[path] = scattered;
+        batch.scatter_pdf[path] = rec.mat_ptr->samples_lights()
+                                  ? rec.mat_ptr->scatter_pdf(rec, unit_vector(scattered.direction())) : 0;
+
+        if(!survives_roulette(first, depth, batch.throughput[path], s)){
+            out[path] = batch.radiance[path];
+            continue;
+        }
+        batch.next.push_back(path);
+    }
+}
+
+#endif // INTEGRATOR_H
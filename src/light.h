@@ -0,0 +1,181 @@
+#ifndef LIGHT_H
+#define LIGHT_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "helper.h"
+
+enum class light_shape { sphere, triangle };
+
+// an emissive primitive, copied out of the scene into world space, so sampling a point on it needs nothing else -
+// a mesh instance with an emissive material is a light per triangle
+struct light {
+    light_shape shape{light_shape::sphere};
+    point3 position{}; // the sphere's centre, or the triangle's first corner
+    vec3 edge1{}; // triangle, from the first corner to the second
+    vec3 edge2{}; // triangle, from the first corner to the third
+    vec3 normal{}; // triangle, unit, on the side it emits from (its front)
+    real radius{}; // sphere
+    real area{};
+    colour emission{};
+};
+
+// a direction towards a light, picked by light_list::sample
+struct light_sample {
+    vec3 direction{}; // unit, from the point being lit
+    real distance{}; // along direction, to the point on the light
+    colour emission{};
+    real pdf{}; // over solid angle, including the chance the light was picked
+};
+
+// every light in a scene, for next event estimation, where each bounce off a diffuse surface picks a point on a light
+// and sends a shadow ray to it, rather than waiting for the path to find a light by chance - a light is picked with
+// probability in proportion to its power (its emission times its area), then a direction towards it, for a sphere
+// uniformly over the cone it fills as seen from the point (so every direction hits it), for a triangle uniformly over
+// its area
+class light_list {
+public:
+    void clear();
+    void add_sphere(const point3 &center, real radius, const colour &emission);
+    void add_triangle(const point3 &a, const point3 &b, const point3 &c, const vec3 &normal, const colour &emission);
+
+    // works out the chance of picking each light, once they've all been added, lights which can't add anything
+    // (black, or of no area) are never picked
+    void finish();
+
+    bool empty() const { return lights.empty(); }
+    size_t size() const { return lights.size(); }
+
+    // picks a light and a direction from p towards it, false if the one picked can't be seen from p (p is inside
+    // the sphere, or behind the triangle), draws two dimensions from s, the first to pick the light and the second
+    // for the point on it
+    bool sample(const point3 &p, sampler &s, light_sample &out) const;
+
+    // the pdf over solid angle that sample would have given for the direction from p to on_light, a point on light
+    // light_idx, 0 for a direction sample could never give
+    real pdf(const point3 &p, int light_idx, const point3 &on_light) const;
+public:
+    std::vector<light> lights{};
+    std::vector<real> pick_cdf{}; // the chance of picking any of lights 0 to i, by finish
+private:
+    real pick_pdf(int light_idx) const {
+        return pick_cdf[light_idx] - (light_idx > 0 ? pick_cdf[light_idx - 1] : 0);
+    }
+
+    // 1 minus the cosine of the half angle of the cone sphere l fills from p, 0 if p is inside it, the sine squared
+    // over (1 + cosine), which keeps its precision for small, distant spheres where the cosine is close to 1
+    static real cone_one_minus_cos(const light &l, const point3 &p, real &distance_squared);
+};
+
+void light_list::clear() {
+    lights.clear();
+    pick_cdf.clear();
+}
+
+void light_list::add_sphere(const point3 &center, real radius, const colour &emission) {
+    light l{};
+    l.shape = light_shape::sphere;
+    l.position = center;
+    l.radius = radius;
+    l.area = 4 * pi * radius * radius;
+    l.emission = emission;
+    lights.push_back(l);
+}
+
+void light_list::add_triangle(const point3 &a, const point3 &b, const point3 &c, const vec3 &normal,
+                              const colour &emission) {
+    light l{};
+    l.shape = light_shape::triangle;
+    l.position = a;
+    l.edge1 = b - a;
+    l.edge2 = c - a;
+    l.normal = normal;
+    l.area = cross(l.edge1, l.edge2).length() / 2;
+    l.emission = emission;
+    lights.push_back(l);
+}
+
+void light_list::finish() {
+    pick_cdf.resize(lights.size());
+    double total = 0;
+    for(size_t i = 0; i < lights.size(); i++){
+        const colour &e = lights[i].emission;
+        total += std::max(0.0, static_cast<double>(e[0] + e[1] + e[2])) * lights[i].area;
+        pick_cdf[i] = static_cast<real>(total);
+    }
+    if(total <= 0){
+        clear();
+        return;
+    }
+    for(real &c : pick_cdf) c /= static_cast<real>(total);
+    pick_cdf.back() = 1; // so rounding can't leave a number in [0, 1) past the last light
+}
+
+real light_list::cone_one_minus_cos(const light &l, const point3 &p, real &distance_squared) {
+    distance_squared = (l.position - p).length_squared();
+    const real sin2 = l.radius * l.radius / distance_squared;
+    if(sin2 >= 1) return 0;
+    return sin2 / (1 + std::sqrt(1 - sin2));
+}
+
+bool light_list::sample(const point3 &p, sampler &s, light_sample &out) const {
+    const double pick = s.next_1d();
+    const int idx = std::min(static_cast<int>(std::upper_bound(pick_cdf.begin(), pick_cdf.end(), pick)
+                                              - pick_cdf.begin()), static_cast<int>(lights.size()) - 1);
+    const light &l = lights[idx];
+    const real chance = pick_pdf(idx);
+    double u, v;
+    s.next_2d(u, v);
+
+    if(l.shape == light_shape::sphere){
+        real distance_squared;
+        const real one_minus_cos = cone_one_minus_cos(l, p, distance_squared);
+        if(one_minus_cos <= 0) return false;
+
+        const real distance = std::sqrt(distance_squared);
+        const vec3 axis = (l.position - p) / distance;
+        vec3 b1, b2;
+        orthonormal_basis(axis, b1, b2);
+        const vec3 d = uniform_cone(u, v, one_minus_cos);
+        out.direction = d.x() * b1 + d.y() * b2 + d.z() * axis;
+
+        // where the direction first meets the sphere, from its distance along the axis and how far off it it passes
+        const real sin2 = d.x() * d.x() + d.y() * d.y();
+        out.distance = distance * d.z() - std::sqrt(std::max(real(0), l.radius * l.radius - distance_squared * sin2));
+        out.pdf = chance / (2 * pi * one_minus_cos);
+    }else{
+        double b1, b2;
+        uniform_triangle(u, v, b1, b2);
+        const vec3 to_light = l.position + static_cast<real>(b1) * l.edge1 + static_cast<real>(b2) * l.edge2 - p;
+        const real distance_squared = to_light.length_squared();
+        out.distance = std::sqrt(distance_squared);
+        out.direction = to_light / out.distance;
+
+        const real cosine = -dot(l.normal, out.direction);
+        if(cosine <= 0) return false; // its back is towards p
+        out.pdf = chance * distance_squared / (cosine * l.area);
+    }
+
+    out.emission = l.emission;
+    return out.pdf > 0 && std::isfinite(out.pdf);
+}
+
+real light_list::pdf(const point3 &p, int light_idx, const point3 &on_light) const {
+    const light &l = lights[light_idx];
+    const real chance = pick_pdf(light_idx);
+
+    if(l.shape == light_shape::sphere){
+        real distance_squared;
+        const real one_minus_cos = cone_one_minus_cos(l, p, distance_squared);
+        return one_minus_cos > 0 ? chance / (2 * pi * one_minus_cos) : 0;
+    }
+
+    const vec3 to_light = on_light - p;
+    const real distance_squared = to_light.length_squared();
+    const real cosine = -dot(l.normal, to_light) / std::sqrt(distance_squared);
+    return cosine > 0 ? chance * distance_squared / (cosine * l.area) : 0;
+}
+
+#endif // LIGHT_H
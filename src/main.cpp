@@ -1,100 +1,700 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "helper.h"
 
-#include "material.h"
-
-#include "colour.h"
-#include "sphere.h"
-#include "hittable_list.h"
+#include "scene.h"
+#include "scene_file.h"
 #include "camera.h"
+#include "render.h"
+#include "distributed.h"
+#include "checkpoint.h"
+#include "denoise.h"
+#include "image_writer.h"
+#include "preview_server.h"
+#include "profile.h"
 
-colour ray_col(const ray& r, const hittable &world, int depth){ // world could be a shape, or hittable_list, since abstract class
-    if(depth <= 0)
-        return { 0, 0, 0 };
+static void print_usage(const char *program){
+    std::cerr << "Usage: " << program << " [--scene FILE] [--save-scene FILE] [--threads N] [--tile-size N] [--seed N]"
+                 " [-o image.ppm|image.pfm]"
+                 " [--format ppm|pfm] [--samples N] [--pass-samples N] [--preview image.ppm]"
+                 " [--adaptive THRESHOLD] [--min-samples N] [--roulette-depth N] [--no-light-sampling]"
+                 " [--mode path|packet|wavefront]"
+                 " [--sampler sobol|halton|random] [--profile stats.json]"
+                 " [--tiles BEGIN:END] [--sample-range BEGIN:END] [--partial FILE] [--merge FILE]..."
+                 " [--processes N] [--split-samples N] [--frames BEGIN:END]"
+                 " [--denoise] [--features image.ppm|image.pfm] [--reference image.pfm] [--serve PORT]"
+                 " [--texture-cache MB] [--checkpoint FILE] [--checkpoint-interval SECONDS]\n";
+}
 
-    hit_record rec;
-    if(world.hit(r, 0.01, infinity, rec)){
-        ray scattered{};
-        colour attenuation{};
+// parses BEGIN:END
+static bool parse_range(const char *text, int &begin, int &end){
+    char trailing = 0;
+    return std::sscanf(text, "%d:%d%c", &begin, &end, &trailing) == 2 && begin >= 0 && end >= begin;
+}
 
-        if(rec.mat_ptr->scatter(r, rec, attenuation, scattered))
-            return attenuation * ray_col(scattered, world, depth-1); // attenuates the returning colour
+// path with suffix put before its extension
+static std::string with_suffix(const std::string &path, const std::string &suffix){
+    const size_t dot = path.find_last_of('.');
+    const size_t slash = path.find_last_of('/');
+    if(dot == std::string::npos || (slash != std::string::npos && dot < slash)) return path + suffix;
+    return path.substr(0, dot) + suffix + path.substr(dot);
+}
 
-        return { 0, 0, 0 };
+// where frame's image goes, path is either a printf pattern for it (frames/%04d.ppm), or has the frame number put
+// before its extension (out.ppm becomes out_0007.ppm)
+static std::string frame_path(const std::string &path, int frame){
+    char number[32];
+    if(path.find('%') != std::string::npos){
+        std::vector<char> buffer(path.size() + 32);
+        std::snprintf(buffer.data(), buffer.size(), path.c_str(), frame);
+        return buffer.data();
     }
+    std::snprintf(number, sizeof(number), "_%04d", frame);
+    return with_suffix(path, number);
+}
+
+// writes the frame's features as three images, path with _albedo, _normal and _depth put before its extension - in
+// an 8 bit format, where they're only to be looked at, the normals are mapped from -1-1 to 0-1, and the depths are
+// divided by the furthest, a float format keeps them as they are
+static bool write_features(const framebuffer &fb, const image_encoder &encoder, bool for_display,
+                           const std::string &path){
+    const feature_image features = resolve_features(fb);
+    image albedo{}, normal{}, depth{};
+    albedo.width = normal.width = depth.width = features.width;
+    albedo.height = normal.height = depth.height = features.height;
+    albedo.rgb = features.albedo;
+    normal.rgb = features.normal;
+    depth.rgb.resize(normal.rgb.size());
 
-    vec3 unit_dir = unit_vector(r.direction());
-    double t = 0.5 * (unit_dir.y() + 1.0); // to be in the range 0 < x < 1
-    return (1 - t)*colour(1, 1, 1) + (t)*colour(0.5, 0.7, 1.0);
+    float furthest = 0;
+    for(float d : features.depth) furthest = std::max(furthest, d);
+    const float depth_scale = for_display && furthest > 0 ? 1 / furthest : 1;
+    for(size_t p = 0; p < features.depth.size(); p++)
+        for(int c = 0; c < 3; c++) depth.rgb[3 * p + c] = features.depth[p] * depth_scale;
+    if(for_display)
+        for(float &n : normal.rgb) n = 0.5f * n + 0.5f;
+
+    return write_image(albedo, encoder, with_suffix(path, "_albedo"))
+           && write_image(normal, encoder, with_suffix(path, "_normal"))
+           && write_image(depth, encoder, with_suffix(path, "_depth"));
 }
 
-int main(){
-
-    // setup
-    constexpr int max_depth = 50;
-    constexpr auto aspect_ratio = 16.0 / 9.0;
-    const int width = 1920;
-    const int height = static_cast<int>( width / aspect_ratio);
-
-    // camera
-    const point3 look_from(5,10,10);
-    const point3 look_at(0,0,-1);
-    const vec3 v_up(0,1,0);
-    auto dist_to_focus = (look_from-look_at).length();
-    auto aperture = 0.7;
-    camera cam(look_from, look_at, v_up, aspect_ratio, 20, aperture, dist_to_focus);
-
-    constexpr int samples_per_pixel = 50;
-
-    // materials
-    auto material_world = make_shared<lambertian>(colour{0.15294 * random_double(), 0.68235 * random_double(), 0.37647 * random_double()});
-    auto material_center_sphere = make_shared<dielectric>( 1.5);
-    auto material_left_sphere = make_shared<metal>(colour{0.90588 * random_double(), 0.29804 * random_double(), 0.23529 * random_double()}, 0.5);
-    auto material_right_sphere = make_shared<metal>(colour{0.60784 * random_double(), 0.34902 * random_double(), 0.71373 * random_double()}, 0.2);
-
-    // setup hittable world
-    hittable_list world{}; // when we pass it to ray_col it is cast to its public base - hittable
-    world.add(make_shared<sphere>(point3{ 0, -100.5, -1},100, material_world));
-    world.add(make_shared<sphere>(point3{ 0, 1, -1}, 1.5, material_center_sphere));
-    world.add(make_shared<sphere>(point3{ 0, 1, -1}, -1.4, material_center_sphere));
-    world.add(make_shared<sphere>(point3{ -2, 1, -1}, 0.5, material_left_sphere));
-    world.add(make_shared<sphere>(point3{ 2, 1, -1}, 0.5, material_right_sphere));
-
-    for(int i = -5; i < 5; i++){
-        for(int j = -5; j < 5; j++){
-            auto material_random_sphere = make_shared<metal>(colour{0.60784 * random_double(), 0.34902 * random_double(), 0.71373 * random_double()}, 0.2*random_double());
-            world.add(make_shared<sphere>(
-                    point3{ 1+static_cast<double>(i)* random_double()*0.9+0.1, random_double()*0.9+0.1, -1+static_cast<double>(j)* random_double()*0.9+0.1},
-                    0.1 * random_double()*0.9+0.1,
-                    material_random_sphere)
-            );
+// the finished image of a rendered frame, denoised if denoising isn't null, printing how long that took, and how
+// close the image is to the reference before and after, if there is one
+static image finish_frame(const framebuffer &fb, const denoise_settings *denoising, const image &reference){
+    const image noisy = resolve(fb);
+    const bool compare = !reference.rgb.empty();
+    if(compare && (reference.width != noisy.width || reference.height != noisy.height)){
+        std::cerr << "\nThe reference is " << reference.width << "x" << reference.height << ", not the image's size\n";
+        return denoising ? denoise(fb, *denoising) : noisy;
+    }
+    if(!denoising){
+        if(compare) std::fprintf(stderr, "\nPSNR against the reference %.2f dB", psnr(noisy, reference));
+        return noisy;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    image denoised = denoise(fb, *denoising);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::fprintf(stderr, "\nDenoised in %.1f ms", 1000 * seconds);
+    if(compare)
+        std::fprintf(stderr, ", PSNR against the reference %.2f dB, from %.2f dB", psnr(denoised, reference),
+                     psnr(noisy, reference));
+    return denoised;
+}
+
+// how the texture cache did, if the scene has textures and this process looked any up (forked workers have caches of
+// their own)
+static void report_textures(const scene &world){
+    if(!world.textures) return;
+    const texture_cache_stats stats = world.textures->stats();
+    if(stats.lookups == 0) return;
+    std::fprintf(stderr, "Textures: %llu tile lookups, %.1f%% hit, %llu tiles (%.1f MB) loaded, %llu evicted, "
+                 "%.1f MB held of %.1f MB\n", static_cast<unsigned long long>(stats.lookups), 100 * stats.hit_rate(),
+                 static_cast<unsigned long long>(stats.tiles_loaded), stats.bytes_loaded / 1048576.0,
+                 static_cast<unsigned long long>(stats.evictions), stats.bytes_held / 1048576.0,
+                 world.textures->get_budget() / 1048576.0);
+    if(stats.read_errors > 0)
+        std::fprintf(stderr, "%llu tiles couldn't be read from their files, and were left black\n",
+                     static_cast<unsigned long long>(stats.read_errors));
+}
+
+// set by SIGINT or SIGTERM during a checkpointed render, which stops it once the tiles being rendered are done, so
+// it can be checkpointed before exiting
+static std::atomic<bool> interrupted{false};
+
+static void on_interrupt(int signal_number){
+    interrupted = true;
+    std::signal(signal_number, SIG_DFL); // a second one ends the process straight away
+}
+
+// what a checkpoint of the scene at path is checked against, so it's never carried on with something else, the scene
+// file (though not the meshes or textures it loads) and the settings which change what a sample is
+static bool scene_fingerprint(const std::string &path, int roulette_depth, bool sample_lights, uint64_t &fingerprint,
+                              std::string &error){
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if(!file){
+        error = "couldn't open " + path;
+        return false;
+    }
+    fingerprint = checkpoint_fingerprint(nullptr, 0);
+    std::vector<char> buffer(1 << 16);
+    size_t got;
+    while((got = std::fread(buffer.data(), 1, buffer.size(), file)) > 0)
+        fingerprint = checkpoint_fingerprint(buffer.data(), got, fingerprint);
+    const bool ok = !std::ferror(file);
+    std::fclose(file);
+    if(!ok) error = "couldn't read " + path;
+
+    const int32_t settings[2] = { roulette_depth, sample_lights ? 1 : 0 };
+    fingerprint = checkpoint_fingerprint(settings, sizeof(settings), fingerprint);
+    return ok;
+}
+
+// the angle between neighbouring pixels' camera rays, for the integrator's texture filtering, in a frame height pixels
+// high seen from view - it's worked out again for every view rendered, as animations and the viewer change the fov
+static real pixel_spread(const camera_settings &view, int height){
+    return 2 * std::tan(deg_to_rads(view.vertical_fov) / 2) / height;
+}
+
+// renders frames [frame_begin, frame_end) of an animated scene, the scene is only loaded and built once, then each
+// frame only moves what its keys move, refitting the instances' tree - the next frame's update is worked out, and
+// the last frame's image written, on another thread while each frame renders (unless it's rendered by worker
+// processes), so the time between frames is only applying the update
+static bool render_animation(scene &world, render_settings settings, path_integrator integrator,
+                             const image_encoder &encoder, const std::string &output_path, int frame_begin,
+                             int frame_end, int processes, int sample_splits, const pass_callback &write_preview,
+                             const denoise_settings *denoising){
+    const double aspect_ratio = static_cast<double>(settings.width) / settings.height;
+    const uint64_t seed = settings.seed;
+    settings.report_progress = false; // there's a line per frame instead
+
+    frame_update next = world.motion.prepare(frame_begin, world.view);
+    image last_image{};
+    std::string last_path{};
+    bool written = true;
+    double total_setup = 0, total_render = 0;
+
+    for(int frame = frame_begin; frame < frame_end; frame++){
+        auto setup_start = std::chrono::steady_clock::now();
+        const frame_update update = std::move(next);
+        const tree_update fitted = world.apply(update);
+        const camera cam(update.view, aspect_ratio);
+        integrator.pixel_spread = pixel_spread(update.view, settings.height);
+        settings.seed = seed + frame; // so the noise doesn't sit still on the screen while everything moves under it
+        const double setup = std::chrono::duration<double>(std::chrono::steady_clock::now() - setup_start).count();
+
+        // only reads the scene's keys, which nothing changes, while the frame renders - but render_distributed forks,
+        // and a child only keeps the forking thread, so a lock the other thread held then (in the allocator, or stdio
+        // while writing the image) would stay locked in the child for good, with worker processes it's done first
+        auto background_work = [&](){
+            if(!last_path.empty()) written = write_image(last_image, encoder, last_path) && written;
+            if(frame + 1 < frame_end) next = world.motion.prepare(frame + 1, world.view);
+        };
+        std::thread background{};
+        if(processes > 1) background_work();
+        else background = std::thread(background_work);
+
+        auto render_start = std::chrono::steady_clock::now();
+        framebuffer fb{};
+        std::string error{};
+        bool ok = true;
+        if(processes > 1) ok = render_distributed(cam, world.geometry(), integrator, settings, processes, sample_splits,
+                                                  fb, error);
+        else render(cam, world.geometry(), integrator, settings, fb, write_preview);
+        image frame_image = denoising ? denoise(fb, *denoising) : resolve(fb);
+        const double render_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                                                    - render_start).count();
+        if(background.joinable()) background.join();
+        if(!ok){
+            std::cerr << "Couldn't render frame " << frame << ", " << error << "\n";
+            return false;
         }
+
+        last_image = std::move(frame_image);
+        last_path = frame_path(output_path, frame);
+        total_setup += setup;
+        total_render += render_seconds;
+
+        const char *fitted_name[] = { "unchanged", "refit", "rebuilt" };
+        std::fprintf(stderr, "Frame %d: setup %.3f ms (tree %s), render %.3f s\n", frame, 1000 * setup,
+                     fitted_name[static_cast<int>(fitted)], render_seconds);
     }
 
-    // render
-    std::cout << "P3\n" << width << " " << height << "\n255\n";
+    if(!last_path.empty()) written = write_image(last_image, encoder, last_path) && written;
+    if(!written){
+        std::cerr << "Couldn't write every frame's image to " << output_path << "\n";
+        return false;
+    }
+
+    const int frames = frame_end - frame_begin;
+    std::fprintf(stderr, "Done, %d frames, setup %.3f ms a frame, render %.3f s a frame.\n", frames,
+                 1000 * total_setup / frames, total_render / frames);
+    report_textures(world);
+    return true;
+}
+
+// renders progressively while serving a preview of the image on localhost:port, restarting (from the scene already
+// loaded) whenever the viewer moves the camera, and once it's finished, waiting for the viewer to move it again or
+// stop - the last image is written to output_path once it's stopped, unless that's stdout
+static bool render_served(scene &world, render_settings settings, path_integrator integrator,
+                          const image_encoder &encoder, const std::string &output_path, int port,
+                          const denoise_settings *denoising){
+    preview_frame frame(settings.width, settings.height, settings.tile_size);
+    preview_server server(frame, world.view);
+    std::string error{};
+    if(!server.start(port, error)){
+        std::cerr << "Couldn't start the preview server, " << error << "\n";
+        return false;
+    }
+    std::cerr << "Serving the preview at http://localhost:" << port << "/\n";
+
+    settings.report_progress = false;
+    settings.stop = &server.interrupted();
+    if(settings.samples_per_pass <= 0) settings.samples_per_pass = 1;
+    const int pass_samples = settings.samples_per_pass;
+    const int samples = settings.samples_per_pixel;
+    auto on_pass = [&](const framebuffer &, int pass){ server.set_samples(std::min(samples, pass * pass_samples)); };
+    auto on_tile = [&](const framebuffer &fb, const tile &t){ frame.publish(fb, t); };
 
-    for(int j = height-1; j >= 0; j--){
-        char buff[20];
-        sprintf(buff, "%*d", 4, j);
-        std::cerr << "\rScanlines: " << buff << std::flush;
+    const double aspect_ratio = static_cast<double>(settings.width) / settings.height;
+    camera_settings view = world.view;
+    framebuffer fb{};
+    for(int restarts = 0;; restarts++){
+        auto start = std::chrono::steady_clock::now();
+        integrator.pixel_spread = pixel_spread(view, settings.height);
+        render(camera(view, aspect_ratio), world.geometry(), integrator, settings, fb, on_pass, on_tile);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if(!server.interrupted()) std::fprintf(stderr, "Render %d finished in %.3f s\n", restarts, seconds);
 
-        for(int i = 0; i < width; i++){
-            // get u/v coordinates in the range 0-1
-            colour pix_col{};
+        const preview_request request = server.wait_for_request();
+        if(request.stop) break;
+        view = request.view;
+    }
+
+    std::cerr << "Stopped, " << fb.total_samples() << " samples.\n";
+    report_textures(world);
+    if(output_path == "-") return true;
+    const image finished = denoising ? denoise(fb, *denoising) : resolve(fb);
+    if(!write_image(finished, encoder, output_path)){
+        std::cerr << "Couldn't write the image to " << output_path << "\n";
+        return false;
+    }
+    return true;
+}
 
-            for(int sample = 0; sample < samples_per_pixel; sample++){
-                auto u = static_cast<double>(i + random_double()) / (width-1);
-                auto v = static_cast<double>(j + random_double()) / (height-1);
-                auto r = cam.get_ray(u, v);
+int main(int argc, char **argv){
+    // defaults to one render thread per core, hardware_concurrency can report 0 if it doesn't know
+    int num_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::string scene_path = "scenes/demo.scene";
+    std::string save_scene_path{};
+    int tile_size = 32;
+    uint64_t seed = 0;
+    std::string output_path = "-"; // stdout
+    std::string format{}; // worked out from output_path if not given
+    int samples_per_pixel = 0; // the scene's unless given
+    int samples_per_pass = 0;
+    std::string preview_path{};
+    double noise_threshold = 0;
+    int min_samples = 16;
+    int roulette_depth = 3;
+    bool sample_lights = true;
+    render_mode mode = render_mode::path;
+    sample_sequence sequence = sample_sequence::sobol;
+    std::string profile_path{};
+    int tile_begin = 0, tile_end = -1;
+    int sample_begin = 0, sample_end = -1;
+    std::string partial_path{};
+    std::vector<std::string> merge_paths{};
+    int processes = 1;
+    int sample_splits = 1;
+    int frame_begin = 0, frame_end = -1;
+    bool denoise_image = false;
+    std::string features_path{};
+    std::string reference_path{};
+    int serve_port = 0;
+    double texture_cache_mb = texture_cache::default_budget / 1048576.0;
+    std::string checkpoint_path{};
+    double checkpoint_interval = 60;
 
-                pix_col += ray_col(r, world, max_depth);
+    for(int arg = 1; arg < argc; arg++){
+        if(std::strcmp(argv[arg], "--scene") == 0 && arg + 1 < argc){
+            scene_path = argv[++arg];
+        }else if(std::strcmp(argv[arg], "--save-scene") == 0 && arg + 1 < argc){
+            save_scene_path = argv[++arg];
+        }else if(std::strcmp(argv[arg], "--threads") == 0 && arg + 1 < argc){
+            num_threads = std::atoi(argv[++arg]);
+        }else if(std::strcmp(argv[arg], "--tile-size") == 0 && arg + 1 < argc){
+            tile_size = std::atoi(argv[++arg]);
+        }else if(std::strcmp(argv[arg], "--seed") == 0 && arg + 1 < argc){
+            seed = std::strtoull(argv[++arg], nullptr, 10);
+        }else if((std::strcmp(argv[arg], "-o") == 0 || std::strcmp(argv[arg], "--output") == 0) && arg + 1 < argc){
+            output_path = argv[++arg];
+        }else if(std::strcmp(argv[arg], "--format") == 0 && arg + 1 < argc){
+            format = argv[++arg];
+        }else if(std::strcmp(argv[arg], "--samples") == 0 && arg + 1 < argc){
+            samples_per_pixel = std::atoi(argv[++arg]);
+        }else if(std::strcmp(argv[arg], "--pass-samples") == 0 && arg + 1 < argc){
+            samples_per_pass = std::atoi(argv[++arg]);
+        }else if(std::strcmp(argv[arg], "--preview") == 0 && arg + 1 < argc){
+            preview_path = argv[++arg];
+        }else if(std::strcmp(argv[arg], "--adaptive") == 0 && arg + 1 < argc){
+            noise_threshold = std::atof(argv[++arg]);
+        }else if(std::strcmp(argv[arg], "--min-samples") == 0 && arg + 1 < argc){
+            min_samples = std::atoi(argv[++arg]);
+        }else if(std::strcmp(argv[arg], "--roulette-depth") == 0 && arg + 1 < argc){
+            roulette_depth = std::atoi(argv[++arg]);
+        }else if(std::strcmp(argv[arg], "--no-light-sampling") == 0){
+            sample_lights = false;
+        }else if(std::strcmp(argv[arg], "--mode") == 0 && arg + 1 < argc){
+            const char *name = argv[++arg];
+            if(std::strcmp(name, "path") == 0) mode = render_mode::path;
+            else if(std::strcmp(name, "packet") == 0) mode = render_mode::packet;
+            else if(std::strcmp(name, "wavefront") == 0) mode = render_mode::wavefront;
+            else{
+                std::cerr << "Unknown mode '" << name << "', expected path, packet or wavefront\n";
+                return -1;
+            }
+        }else if(std::strcmp(argv[arg], "--sampler") == 0 && arg + 1 < argc){
+            const char *name = argv[++arg];
+            if(std::strcmp(name, "sobol") == 0) sequence = sample_sequence::sobol;
+            else if(std::strcmp(name, "halton") == 0) sequence = sample_sequence::halton;
+            else if(std::strcmp(name, "random") == 0) sequence = sample_sequence::random;
+            else{
+                std::cerr << "Unknown sampler '" << name << "', expected sobol, halton or random\n";
+                return -1;
+            }
+        }else if(std::strcmp(argv[arg], "--profile") == 0 && arg + 1 < argc){
+            profile_path = argv[++arg];
+        }else if(std::strcmp(argv[arg], "--tiles") == 0 && arg + 1 < argc){
+            if(!parse_range(argv[++arg], tile_begin, tile_end)){
+                std::cerr << "--tiles takes a range of tile indices, BEGIN:END\n";
+                return -1;
+            }
+        }else if(std::strcmp(argv[arg], "--sample-range") == 0 && arg + 1 < argc){
+            if(!parse_range(argv[++arg], sample_begin, sample_end)){
+                std::cerr << "--sample-range takes a range of sample indices, BEGIN:END\n";
+                return -1;
             }
+        }else if(std::strcmp(argv[arg], "--partial") == 0 && arg + 1 < argc){
+            partial_path = argv[++arg];
+        }else if(std::strcmp(argv[arg], "--merge") == 0 && arg + 1 < argc){
+            merge_paths.push_back(argv[++arg]);
+        }else if(std::strcmp(argv[arg], "--processes") == 0 && arg + 1 < argc){
+            processes = std::atoi(argv[++arg]);
+        }else if(std::strcmp(argv[arg], "--split-samples") == 0 && arg + 1 < argc){
+            sample_splits = std::atoi(argv[++arg]);
+        }else if(std::strcmp(argv[arg], "--frames") == 0 && arg + 1 < argc){
+            if(!parse_range(argv[++arg], frame_begin, frame_end)){
+                std::cerr << "--frames takes a range of frame numbers, BEGIN:END\n";
+                return -1;
+            }
+        }else if(std::strcmp(argv[arg], "--denoise") == 0){
+            denoise_image = true;
+        }else if(std::strcmp(argv[arg], "--features") == 0 && arg + 1 < argc){
+            features_path = argv[++arg];
+        }else if(std::strcmp(argv[arg], "--reference") == 0 && arg + 1 < argc){
+            reference_path = argv[++arg];
+        }else if(std::strcmp(argv[arg], "--serve") == 0 && arg + 1 < argc){
+            serve_port = std::atoi(argv[++arg]);
+            if(serve_port < 1 || serve_port > 65535){
+                std::cerr << "--serve takes a port number\n";
+                return -1;
+            }
+        }else if(std::strcmp(argv[arg], "--texture-cache") == 0 && arg + 1 < argc){
+            texture_cache_mb = std::atof(argv[++arg]);
+            if(texture_cache_mb <= 0){
+                std::cerr << "--texture-cache takes the megabytes textures' tiles can take up\n";
+                return -1;
+            }
+        }else if(std::strcmp(argv[arg], "--checkpoint") == 0 && arg + 1 < argc){
+            checkpoint_path = argv[++arg];
+        }else if(std::strcmp(argv[arg], "--checkpoint-interval") == 0 && arg + 1 < argc){
+            checkpoint_interval = std::atof(argv[++arg]);
+            if(checkpoint_interval < 0){
+                std::cerr << "--checkpoint-interval takes the seconds between checkpoints\n";
+                return -1;
+            }
+        }else{
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if(num_threads < 1 || tile_size < 1 || samples_per_pixel < 0 || min_samples < 1 || processes < 1
+       || sample_splits < 1){
+        std::cerr << "Thread and process counts, tile size and sample counts must all be at least 1\n";
+        return -1;
+    }
+
+    // a pixel's samples have to be taken in one go for adaptive sampling to decide when to stop
+    if(noise_threshold > 0 && (sample_begin > 0 || sample_splits > 1)){
+        std::cerr << "Adaptive sampling can't be used with a sample range, or with the samples split up\n";
+        return -1;
+    }
+    if(processes > 1 && (tile_end >= 0 || sample_end >= 0 || !partial_path.empty())){
+        std::cerr << "--processes renders the whole frame, it can't be given a tile or sample range, or a partial\n";
+        return -1;
+    }
+
+    // a checkpoint is of the whole of each pixel's samples, rendered by this process
+    if(!checkpoint_path.empty() && (processes > 1 || sample_end >= 0 || serve_port > 0 || !merge_paths.empty())){
+        std::cerr << "--checkpoint is for a frame rendered in this process, it can't be given --processes, a sample"
+                     " range, --serve or --merge\n";
+        return -1;
+    }
+
+    if(!profile_path.empty() && !profile_enabled){
+        std::cerr << "--profile needs a build with profiling compiled in (meson configure -Dprofiling=true)\n";
+        return -1;
+    }
+
+    if(format.empty()) format = format_for_path(output_path);
+    shared_ptr<image_encoder> encoder = make_encoder(format);
+    if(!encoder){
+        std::cerr << "Unknown image format '" << format << "', expected ppm or pfm\n";
+        return -1;
+    }
+
+    std::string error{};
+
+    image reference{};
+    if(!reference_path.empty() && !load_pfm(reference_path, reference, error)){
+        std::cerr << "Couldn't load the reference, " << error << "\n";
+        return -1;
+    }
+
+    denoise_settings denoising{};
+    denoising.num_threads = num_threads;
+    const denoise_settings *denoise_with = denoise_image ? &denoising : nullptr;
+    shared_ptr<image_encoder> features_encoder = make_encoder(format_for_path(features_path));
+    const bool features_for_display = format_for_path(features_path) == "ppm";
+
+    // merging partials, rendered separately, into the image rather than rendering it
+    if(!merge_paths.empty()){
+        std::vector<render_partial> parts(merge_paths.size());
+        framebuffer fb{};
+        for(size_t p = 0; p < merge_paths.size(); p++){
+            if(!load_partial(merge_paths[p], parts[p], error)){
+                std::cerr << "Couldn't load a partial, " << error << "\n";
+                return -1;
+            }
+        }
+        if(!merge_partials(std::move(parts), fb, error)){
+            std::cerr << "Couldn't merge the partials, " << error << "\n";
+            return -1;
+        }
+        if((denoise_image || !features_path.empty()) && !fb.has_features()){
+            std::cerr << "The partials were rendered without features, so can't be denoised (render them with"
+                         " --denoise or --features)\n";
+            return -1;
+        }
+        if(!features_path.empty() && !write_features(fb, *features_encoder, features_for_display, features_path)){
+            std::cerr << "Couldn't write the features to " << features_path << "\n";
+            return -1;
+        }
+        std::cerr << "Merged " << merge_paths.size() << " partials, " << fb.total_samples() << " samples.";
+        const image finished = finish_frame(fb, denoise_with, reference);
+        std::cerr << "\n";
+        if(!write_image(finished, *encoder, output_path)){
+            std::cerr << "Couldn't write the image to " << output_path << "\n";
+            return -1;
+        }
+        return 0;
+    }
+
+    // the scene, and how it's to be viewed and rendered, come from a scene file
+    scene world{};
+    if(!load_scene(scene_path, world, error)){
+        std::cerr << "Couldn't load the scene, " << error << "\n";
+        return -1;
+    }
+
+    // converting a scene to the binary format, which loads much faster, rather than rendering it
+    if(!save_scene_path.empty()){
+        if(!save_scene_binary(world, save_scene_path, error)){
+            std::cerr << "Couldn't save the scene, " << error << "\n";
+            return -1;
+        }
+        std::cerr << "Saved " << world.spheres.size() << " spheres to " << save_scene_path << "\n";
+        return 0;
+    }
+
+    const int width = world.frame.width;
+    const int height = world.frame.height;
+    if(samples_per_pixel == 0) samples_per_pixel = world.frame.samples_per_pixel;
+    camera cam(world.view, static_cast<double>(width) / height);
+
+    // render
+    render_settings settings{};
+    settings.width = width;
+    settings.height = height;
+    settings.samples_per_pixel = samples_per_pixel;
+    settings.tile_size = tile_size;
+    settings.num_threads = num_threads;
+    settings.seed = seed;
+    settings.samples_per_pass = samples_per_pass;
+    settings.noise_threshold = noise_threshold;
+    settings.min_samples = min_samples;
+    settings.mode = mode;
+    settings.sequence = sequence;
+    settings.tile_begin = tile_begin;
+    settings.tile_end = tile_end;
+    settings.features = denoise_image || !features_path.empty();
+    if(sample_end >= 0){
+        settings.sample_begin = sample_begin;
+        settings.samples_per_pixel = sample_end;
+    }
+
+    // with a preview path, every pass overwrites it with the image so far
+    shared_ptr<image_encoder> preview_encoder = make_encoder(format_for_path(preview_path));
+    pass_callback write_preview = nullptr;
+    if(!preview_path.empty()){
+        write_preview = [&](const framebuffer &pass_fb, int){
+            if(!write_image(resolve(pass_fb), *preview_encoder, preview_path))
+                std::cerr << "\nCouldn't write the preview to " << preview_path << "\n";
+        };
+    }
+
+    if(world.textures) world.textures->set_budget(static_cast<size_t>(texture_cache_mb * 1048576));
+
+    path_integrator integrator(world.frame.max_depth, roulette_depth, sample_lights ? &world.lights : nullptr,
+                               &world.media);
+    integrator.pixel_spread = pixel_spread(world.view, height);
+
+    // an animated scene renders each of its frames (or the range asked for) to an image of its own
+    if(world.motion.animated()){
+        if(frame_end < 0) frame_end = world.motion.frame_count;
+        if(frame_end > world.motion.frame_count || frame_begin >= frame_end){
+            std::cerr << "The scene has " << world.motion.frame_count << " frames, --frames has to be within them\n";
+            return -1;
+        }
+        if(output_path == "-" || tile_end >= 0 || sample_end >= 0 || !partial_path.empty() || !checkpoint_path.empty()){
+            std::cerr << "An animation renders whole frames to files, so it needs -o, and can't be given a tile or"
+                         " sample range, a partial or a checkpoint\n";
+            return -1;
+        }
+        if(!features_path.empty() || !reference_path.empty()){
+            std::cerr << "--features and --reference are for a single frame, an animation can only be --denoise'd\n";
+            return -1;
+        }
+        return render_animation(world, settings, integrator, *encoder, output_path, frame_begin, frame_end, processes,
+                                sample_splits, write_preview, denoise_with) ? 0 : -1;
+    }
+    if(frame_end >= 0){
+        std::cerr << "--frames is only for animated scenes\n";
+        return -1;
+    }
+
+    // a preview of the render in progress, served until the viewer stops it
+    if(serve_port > 0){
+        if(processes > 1 || tile_end >= 0 || sample_end >= 0 || !partial_path.empty() || !features_path.empty()
+           || !reference_path.empty()){
+            std::cerr << "--serve renders the whole frame in this process, it can't be given --processes, a tile or"
+                         " sample range, a partial, --features or --reference\n";
+            return -1;
+        }
+        return render_served(world, settings, integrator, *encoder, output_path, serve_port, denoise_with) ? 0 : -1;
+    }
+
+    framebuffer fb{};
+
+    // a checkpointed render starts from whatever the checkpoint has, and saves each tile to it as it's rendered
+    render_checkpoint checkpoint{};
+    tile_callback save_tile = nullptr;
+    if(!checkpoint_path.empty()){
+        uint64_t fingerprint;
+        if(!scene_fingerprint(scene_path, roulette_depth, sample_lights, fingerprint, error)
+           || !checkpoint.open(checkpoint_path, settings, fingerprint, fb, error)){
+            std::cerr << "Couldn't open the checkpoint, " << error << "\n";
+            return -1;
+        }
+        if(checkpoint.tiles_restored > 0)
+            std::cerr << "Resuming from " << checkpoint_path << ", " << checkpoint.samples_restored << " samples in "
+                      << checkpoint.tiles_restored << " tiles\n";
+        checkpoint.interval = checkpoint_interval;
+        settings.resume = true;
+        settings.stop = &interrupted;
+        std::signal(SIGINT, on_interrupt);
+        std::signal(SIGTERM, on_interrupt);
+        save_tile = [&](const framebuffer &tile_fb, const tile &t){ checkpoint.save_tile(tile_fb, t); };
+    }
+
+    profile_reset();
+    if(processes > 1){
+        if(!render_distributed(cam, world.geometry(), integrator, settings, processes, sample_splits, fb, error)){
+            std::cerr << "\nCouldn't render the frame, " << error << "\n";
+            return -1;
+        }
+    }else{
+        render(cam, world.geometry(), integrator, settings, fb, write_preview, save_tile);
+    }
+
+    if(!checkpoint_path.empty()){
+        if(!checkpoint.checkpoint(error)){
+            std::cerr << "\nCouldn't checkpoint the render, " << error << "\n";
+            return -1;
+        }
+        if(interrupted){
+            std::cerr << "\nStopped, " << fb.total_samples() << " samples checkpointed to " << checkpoint_path
+                      << ", run the same command again to carry on\n";
+            return 1;
+        }
+    }
+
+    // a part of the frame, to be merged with the rest, is written out as a partial rather than an image
+    if(!partial_path.empty()){
+        const render_partial part = make_partial(settings, fb);
+        if(!save_partial(part, partial_path, error)){
+            std::cerr << "\nCouldn't save the partial, " << error << "\n";
+            return -1;
+        }
+        std::cerr << "\nSaved tiles " << part.header.tile_begin << ":" << part.header.tile_end << ", samples "
+                  << part.header.sample_begin << ":" << part.header.sample_end << " to " << partial_path << "\n";
+        return 0;
+    }
+
+    if(!features_path.empty() && !write_features(fb, *features_encoder, features_for_display, features_path)){
+        std::cerr << "\nCouldn't write the features to " << features_path << "\n";
+        return -1;
+    }
+
+    // tiles finish in any order, so the image is only written out once all of them are done
+    const image finished = finish_frame(fb, denoise_with, reference);
+    bool written;
+    {
+        RT_PROFILE_SCOPE(output);
+        written = write_image(finished, *encoder, output_path);
+    }
+    if(!written){
+        std::cerr << "\nCouldn't write the image to " << output_path << "\n";
+        return -1;
+    }
 
-            write_colour(std::cout, pix_col, samples_per_pixel);
+    if(!profile_path.empty()){
+        FILE *file = std::fopen(profile_path.c_str(), "w");
+        if(!file){
+            std::cerr << "\nCouldn't write the profile to " << profile_path << "\n";
+            return -1;
         }
+        std::fprintf(file, "{\n");
+        write_profile_json(file, profile_read(), "  ");
+        std::fprintf(file, "\n}\n");
+        std::fclose(file);
     }
 
-    std::cerr << "\nDone.\n";
+    const long long fixed_samples = static_cast<long long>(samples_per_pixel) * width * height;
+    std::cerr << "\nDone, " << fb.total_samples() << " samples ("
+              << 100.0 * fb.total_samples() / fixed_samples << "% of " << samples_per_pixel << " per pixel).\n";
+    report_textures(world);
 }
\ No newline at end of file
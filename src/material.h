@@ -3,89 +3,207 @@
 
 #include "helper.h"
 #include "hittable.h"
+#include "texture.h"
 
+enum class material_type { lambertian, metal, dielectric, emissive, isotropic };
+const int material_type_count = 5;
+
+// every material is one of a closed set of types, held by value (so a scene's materials sit in one contiguous table)
+// and dispatched on its type with a switch rather than a virtual call - the scattering code can then be inlined into
+// the integrator, and hits can be grouped by type so each type's code runs over a batch at a time
 class material {
 public:
-    virtual bool scatter(const ray &r_incident, const hit_record &rec, colour &attenuation, ray &scattered) const = 0;
-    virtual ~material() = default;
-};
+    bool scatter(const ray &r_incident, const hit_record &rec, colour &attenuation, ray &scattered, sampler &s) const;
 
-class lambertian : public material {
-public:
-    explicit lambertian(const colour &col) : albedo(col) {}
+    // the light given off towards the ray that hit, only from the front of an emissive surface (the outside of a
+    // sphere, the side of a triangle its corners go counter clockwise round)
+    colour emitted(const hit_record &rec) const {
+        return type == material_type::emissive && rec.front_face ? emission : colour(0, 0, 0);
+    }
 
-    bool scatter(const ray &r_incident, const hit_record &rec, colour &attenuation, ray &scattered) const override {
-        auto scatter_dir = rec.normal + random_unit_vector(); // lambertian distribution scattering
+    // whether scatter spreads light out over every direction, as a diffuse surface (or a medium) does, which is where
+    // sampling the lights directly helps - a mirror or glass only sends light one way, which a light sample would
+    // never hit
+    bool samples_lights() const { return type == material_type::lambertian || type == material_type::isotropic; }
+
+    // for a material that samples_lights, the pdf over solid angle that scatter gives the unit direction with, and
+    // the fraction of the light arriving from it that leaves along the ray that hit, times the cosine it arrives at
+    // (which is what scatter's attenuation is, over that pdf) - a medium's phase function has no cosine, there's no
+    // surface for the light to arrive at an angle to
+    real scatter_pdf(const hit_record &rec, const vec3 &direction) const {
+        if(type == material_type::isotropic) return 1 / (4 * pi);
+        return std::max(real(0), dot(rec.normal, direction)) / pi;
+    }
+    colour scattering(const hit_record &rec, const vec3 &direction) const {
+        if(type == material_type::isotropic) return albedo / (4 * pi);
+        return albedo_at(rec) * (std::max(real(0), dot(rec.normal, direction)) / pi);
+    }
 
-        if(scatter_dir.near_zero()) // if near zero then scatter_dir is approaching direction of normal
-            scatter_dir = rec.normal; // if this were to be zero, then normalising for example would produce errors
+    // the colour of the surface itself, which the denoiser divides out of the light it filters (glass lets all of it
+    // through, and a light is its own colour, so both are white)
+    colour base_colour(const hit_record &rec) const {
+        return type == material_type::dielectric || type == material_type::emissive ? colour(1, 1, 1) : albedo_at(rec);
+    }
 
-        scattered = { rec.p, scatter_dir };
-        attenuation = albedo;
-        // attenuation is reduction in intensity of light due to absorption when travelling through a medium
+    // whether hits on it need texture coordinates
+    bool textured() const { return albedo_map != nullptr; }
 
-        return true;
+    // the albedo where rec hit, times the texture there if there is one
+    colour albedo_at(const hit_record &rec) const {
+        return albedo_map ? albedo * albedo_map->sample(rec.u, rec.v, rec.uv_scale * rec.footprint) : albedo;
     }
 public:
-    colour albedo{}; // albedo is the fraction of light that is reflected by a body, so this is the coloured fraction
+    material_type type{material_type::lambertian};
+    colour albedo{}; // lambertian, metal and isotropic, the fraction of light that is reflected (or in a medium,
+                     // scattered rather than absorbed), so the coloured fraction
+    const texture *albedo_map{}; // lambertian and metal, owned by the scene's texture_cache, which albedo multiplies
+    real fuzz{}; // metal, 0 <= fuzz <= 1
+    real ir{}; // dielectric, the index of refraction
+    colour emission{}; // emissive, the radiance it gives off
 };
 
-class metal : public material {
-public:
-    metal(const colour &col, double fuzz) : albedo(col), fuzz(std::min(std::max(0.0, fuzz), 1.0)) {} // 0 <= fuzz <= 1
-
-    bool scatter(const ray &r_incident, const hit_record &rec, colour &attenuation, ray &scattered) const override {
-        vec3 reflected = reflect(unit_vector(r_incident.direction()), rec.normal);
-
-        // where rec.p is the point of intersection of the ray on the object, and reflected is the direction of the
-        // new ray
-        scattered = ray(rec.p, reflected + fuzz*random_in_unit_sphere()); // adds random direction for fuzz
-        attenuation = albedo;
+// the scattering for one type, the switch in material::scatter picks one of these, and batched shading calls them
+// directly for a bucket of hits that all have the same type
+template<material_type type>
+bool scatter_as(const material &m, const ray &r_incident, const hit_record &rec, colour &attenuation, ray &scattered,
+                sampler &s);
+
+template<>
+inline bool scatter_as<material_type::lambertian>(const material &m, const ray &r_incident, const hit_record &rec,
+                                                  colour &attenuation, ray &scattered, sampler &s){
+    // lambertian distribution scattering, cosine weighted about the normal, which is what adding a random unit vector
+    // to the normal gives too, but this way it can't come out near zero (a scattered ray carries on at the same time)
+    scattered = { rec.p, random_cosine_direction(rec.normal, s), r_incident.time() };
+    attenuation = m.albedo_at(rec);
+    // attenuation is reduction in intensity of light due to absorption when travelling through a medium
+
+    return true;
+}
+
+template<>
+inline bool scatter_as<material_type::metal>(const material &m, const ray &r_incident, const hit_record &rec,
+                                             colour &attenuation, ray &scattered, sampler &s){
+    vec3 reflected = reflect(unit_vector(r_incident.direction()), rec.normal);
+
+    // where rec.p is the point of intersection of the ray on the object, and reflected is the direction of the
+    // new ray
+    scattered = ray(rec.p, reflected + m.fuzz*random_in_unit_sphere(s), r_incident.time()); // adds random fuzz
+    attenuation = m.albedo_at(rec);
+
+    return dot(scattered.direction(), rec.normal) > 0; // is scattered ray dir in same dir as normal
+}
+
+inline real schlick_reflectance(real cosine, real ref_idx) {
+    // this returns the reflection coefficient, which describes how much of a wave is reflected,
+    // so we can use it as 'probability of reflection' when rendering,
+    // and it becomes the ratio of the overall light reflected
+    // this is Schlick's approximation for reflectance
+    auto r0 = (1-ref_idx) / (1+ref_idx);
+    r0 *= r0;
+    return r0 + (1-r0)*pow((1-cosine), 5);
+}
+
+template<>
+inline bool scatter_as<material_type::dielectric>(const material &m, const ray &r_incident, const hit_record &rec,
+                                                  colour &attenuation, ray &scattered, sampler &s){
+    attenuation = colour(1.0, 1.0, 1.0);
+    real refraction_ratio = rec.front_face ? (1.0/m.ir) : m.ir; // depending on if coming into/out of material
+
+    vec3 unit_dir = unit_vector(r_incident.direction()); // the refract function requires normalised vectors
+
+    real cos_theta_i = dot(-unit_dir, rec.normal); // gets angle between ray and normal
+    // if n1/n2 * sin(theta_i) > 1 then total internal reflection
+    // or n1/n2 * sqrt(1-cos(theta_i)^2) > 1
+    // or sqrt((n1/n2)^2 * (1-cos(theta_i)^2)) > 1
+    // or (n1/n2)^2 * (1-cos(theta_i)^2) > 1 (which is what I've done below - avoids the square root)
+    bool cannot_refract = refraction_ratio*refraction_ratio*(1-cos_theta_i*cos_theta_i) > 1;
+
+    vec3 direction_out;
+    if(cannot_refract || schlick_reflectance(cos_theta_i, refraction_ratio) > random_double(s))
+        direction_out = reflect(unit_dir, rec.normal);
+    else
+        direction_out = refract(unit_dir, rec.normal, refraction_ratio);
+
+    // scattered ray from the point of intersection, in the refracted direction
+    scattered = ray(rec.p, direction_out, r_incident.time());
+    return true;
+}
+
+template<>
+inline bool scatter_as<material_type::emissive>(const material &, const ray &, const hit_record &, colour &, ray &,
+                                                sampler &){
+    return false; // a light only gives light off, anything arriving at it is absorbed
+}
+
+template<>
+inline bool scatter_as<material_type::isotropic>(const material &m, const ray &r_incident, const hit_record &rec,
+                                                 colour &attenuation, ray &scattered, sampler &s){
+    // the phase function of a medium that scatters light equally every way, whichever way it arrived from
+    scattered = ray(rec.p, random_unit_vector(s), r_incident.time());
+    attenuation = m.albedo;
+    return true;
+}
+
+inline bool material::scatter(const ray &r_incident, const hit_record &rec, colour &attenuation, ray &scattered,
+                              sampler &s) const {
+    switch(type){
+        case material_type::lambertian:
+            return scatter_as<material_type::lambertian>(*this, r_incident, rec, attenuation, scattered, s);
+        case material_type::metal:
+            return scatter_as<material_type::metal>(*this, r_incident, rec, attenuation, scattered, s);
+        case material_type::dielectric:
+            return scatter_as<material_type::dielectric>(*this, r_incident, rec, attenuation, scattered, s);
+        case material_type::emissive:
+            return scatter_as<material_type::emissive>(*this, r_incident, rec, attenuation, scattered, s);
+        case material_type::isotropic:
+            return scatter_as<material_type::isotropic>(*this, r_incident, rec, attenuation, scattered, s);
+    }
+    return false;
+}
 
-        return dot(scattered.direction(), rec.normal) > 0; // is scattered ray dir in same dir as normal
+// constructors for each type, they add no data, so copying one into a material (or a table of them) keeps all of it
+class lambertian : public material {
+public:
+    explicit lambertian(const colour &col, const texture *map = nullptr) {
+        type = material_type::lambertian;
+        albedo = col;
+        albedo_map = map;
     }
+};
+
+class metal : public material {
 public:
-    colour albedo{};
-    double fuzz{};
+    metal(const colour &col, real fuzz, const texture *map = nullptr) {
+        type = material_type::metal;
+        albedo = col;
+        albedo_map = map;
+        this->fuzz = std::min(std::max(real(0), fuzz), real(1)); // 0 <= fuzz <= 1
+    }
 };
 
 class dielectric : public material {
 public:
-    dielectric(double index_of_refraction) : ir(index_of_refraction) {}
-
-    bool scatter(const ray &r_incident, const hit_record &rec, colour &attenuation, ray &scattered) const override {
-        attenuation = colour(1.0, 1.0, 1.0);
-        double refraction_ratio = rec.front_face ? (1.0/ir) : ir; // depending on if coming into/out of material
-
-        vec3 unit_dir = unit_vector(r_incident.direction()); // the refract function requires normalised vectors
-
-        double cos_theta_i = dot(-unit_dir, rec.normal); // gets angle between ray and normal
-        // if n1/n2 * sin(theta_i) > 1 then total internal reflection
-        // or n1/n2 * sqrt(1-cos(theta_i)^2) > 1
-        // or sqrt((n1/n2)^2 * (1-cos(theta_i)^2)) > 1
-        // or (n1/n2)^2 * (1-cos(theta_i)^2) > 1 (which is what I've done below - avoids the square root)
-        bool cannot_refract = refraction_ratio*refraction_ratio*(1-cos_theta_i*cos_theta_i) > 1;
-
-        vec3 direction_out;
-        if(cannot_refract || reflectance(cos_theta_i, refraction_ratio) > random_double())
-            direction_out = reflect(unit_dir, rec.normal);
-        else
-            direction_out = refract(unit_dir, rec.normal, refraction_ratio);
+    dielectric(real index_of_refraction) {
+        type = material_type::dielectric;
+        ir = index_of_refraction;
+    }
+};
 
-        scattered = ray(rec.p, direction_out); // scattered ray from the point of intersection, in the refracted direction
-        return true;
+class emissive : public material {
+public:
+    explicit emissive(const colour &radiance) {
+        type = material_type::emissive;
+        emission = radiance;
     }
+};
+
+// the phase function of a medium (see medium.h), albedo is the fraction of what collides in it that's scattered
+// rather than absorbed
+class isotropic : public material {
 public:
-    double ir{};
-private:
-    static double reflectance(double cosine, double ref_idx) {
-        // this returns the reflection coefficient, which describes how much of a wave is reflected,
-        // so we can use it as 'probability of reflection' when rendering,
-        // and it becomes the ratio of the overall light reflected
-        // this is Schlick's approximation for reflectance
-        auto r0 = (1-ref_idx) / (1+ref_idx);
-        r0 *= r0;
-        return r0 + (1-r0)*pow((1-cosine), 5);
+    explicit isotropic(const colour &col) {
+        type = material_type::isotropic;
+        albedo = col;
     }
 };
 
@@ -0,0 +1,396 @@
+#ifndef MEDIUM_H
+#define MEDIUM_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "helper.h"
+
+#include "aabb.h"
+#include "hittable.h"
+#include "material.h"
+
+// how far a free flight goes, in optical depth (distance times density), for a uniform u in [0, 1), light travelling
+// through a medium is scattered or absorbed at a rate proportional to its density, so the distance it gets before it
+// is has an exponential distribution
+inline real free_path(double u){
+    return static_cast<real>(-std::log(1 - u));
+}
+
+// where a path's free flights draw their random numbers from, the first from the bounce's dimension for media (so
+// with a low discrepancy sequence it's spread out like the rest of the bounce), any after it from the generator, since
+// tracking through a density grid takes however many numbers it takes
+class medium_random {
+public:
+    explicit medium_random(sampler &s, bool from_sequence = true) : s(s), from_sequence(from_sequence) {}
+
+    double operator()() {
+        if(!from_sequence) return s.next_double();
+        from_sequence = false;
+        return s.next_1d();
+    }
+private:
+    sampler &s;
+    bool from_sequence{};
+};
+
+// densities over a box, a voxel's at its centre, interpolated trilinearly between them, with a coarser grid of
+// majorants alongside, each the most density there is anywhere in a block of voxels - tracking through the grid
+// (delta tracking to sample where a path scatters, ratio tracking for how much light gets through) takes steps with
+// the majorant of the block it's in, so it steps straight over the empty blocks, and takes longer steps through thin
+// ones than a single majorant for the whole grid (which the thickest voxel sets) would let it - smaller blocks fit the
+// densities more tightly, but take more steps between them, medium_bench has blocks of 4 to 8 voxels fastest, around
+// ten times faster than marching through the grid, and three to five times faster than one majorant
+class density_grid {
+public:
+    density_grid() = default;
+
+    // nx * ny * nz densities, x fastest then y, over box, with majorants for each block of voxels along each axis
+    density_grid(int nx, int ny, int nz, std::vector<float> densities, const aabb &box, int block = 8);
+
+    // works out the majorants again for blocks of this many voxels along each axis, as many as there are voxels
+    // across the grid gives one majorant for all of it
+    void build_majorants(int block);
+
+    // puts the grid over box instead
+    void place(const aabb &to);
+
+    real density(const point3 &p) const;
+
+    // walks r from t0 to t1 through the blocks, picking tentative collisions at a rate of the block's majorant times
+    // scale, and calls on_collision(t, ratio) for each, where ratio is the density there over the majorant (the chance
+    // it's a real collision rather than a null one), until it returns false or the walk gets to t1 - next gives the
+    // random numbers, as a medium_random does
+    template<typename random_source, typename collision_function>
+    void track(const ray &r, real t0, real t1, real scale, random_source &next, collision_function on_collision) const;
+
+    size_t block_count() const { return majorants.size(); }
+public:
+    int size[3]{};
+    std::vector<float> densities{};
+    aabb box{};
+    vec3 voxel{}; // a voxel's size along each axis
+
+    int block{};
+    int blocks[3]{}; // along each axis
+    std::vector<float> majorants{};
+private:
+    float at(int x, int y, int z) const {
+        return densities[(static_cast<size_t>(z) * size[1] + y) * size[0] + x];
+    }
+};
+
+density_grid::density_grid(int nx, int ny, int nz, std::vector<float> densities, const aabb &box, int block)
+    : densities(std::move(densities)), box(box) {
+    size[0] = nx;
+    size[1] = ny;
+    size[2] = nz;
+    place(box);
+    build_majorants(block);
+}
+
+void density_grid::place(const aabb &to) {
+    box = to;
+    const vec3 extent = box.max() - box.min();
+    voxel = vec3(extent[0] / size[0], extent[1] / size[1], extent[2] / size[2]);
+}
+
+void density_grid::build_majorants(int block_size) {
+    block = std::max(1, block_size);
+    for(int a = 0; a < 3; a++) blocks[a] = (size[a] + block - 1) / block;
+    majorants.assign(static_cast<size_t>(blocks[0]) * blocks[1] * blocks[2], 0);
+
+    // a point in a block is interpolated from the voxels either side of it, so its majorant takes in the voxels a
+    // step beyond the block along each axis too
+    for(int bz = 0; bz < blocks[2]; bz++){
+        for(int by = 0; by < blocks[1]; by++){
+            for(int bx = 0; bx < blocks[0]; bx++){
+                float most = 0;
+                for(int z = std::max(0, bz * block - 1); z <= std::min(size[2] - 1, (bz + 1) * block); z++)
+                    for(int y = std::max(0, by * block - 1); y <= std::min(size[1] - 1, (by + 1) * block); y++)
+                        for(int x = std::max(0, bx * block - 1); x <= std::min(size[0] - 1, (bx + 1) * block); x++)
+                            most = std::max(most, at(x, y, z));
+                majorants[(static_cast<size_t>(bz) * blocks[1] + by) * blocks[0] + bx] = most;
+            }
+        }
+    }
+}
+
+real density_grid::density(const point3 &p) const {
+    int lower[3], upper[3];
+    real fraction[3];
+    for(int a = 0; a < 3; a++){
+        const real x = (p[a] - box.min()[a]) / voxel[a] - real(0.5);
+        const real floored = std::floor(x);
+        const int i = static_cast<int>(floored);
+        fraction[a] = x - floored;
+        lower[a] = std::min(std::max(i, 0), size[a] - 1);
+        upper[a] = std::min(std::max(i + 1, 0), size[a] - 1);
+    }
+
+    real along_z[2];
+    for(int k = 0; k < 2; k++){
+        const int z = k ? upper[2] : lower[2];
+        const real near_y = at(lower[0], lower[1], z) + fraction[0] * (at(upper[0], lower[1], z)
+                                                                       - at(lower[0], lower[1], z));
+        const real far_y = at(lower[0], upper[1], z) + fraction[0] * (at(upper[0], upper[1], z)
+                                                                      - at(lower[0], upper[1], z));
+        along_z[k] = near_y + fraction[1] * (far_y - near_y);
+    }
+    return along_z[0] + fraction[2] * (along_z[1] - along_z[0]);
+}
+
+template<typename random_source, typename collision_function>
+void density_grid::track(const ray &r, real t0, real t1, real scale, random_source &next,
+                         collision_function on_collision) const {
+    // a 3D DDA through the blocks (Amanatides and Woo), from the block t0 is in, to the next boundary along each axis
+    const point3 start = r.at(t0);
+    const vec3 d = r.direction();
+    int cell[3], step[3];
+    real t_next[3], t_delta[3];
+    for(int a = 0; a < 3; a++){
+        const real block_size = voxel[a] * block;
+        const real x = (start[a] - box.min()[a]) / block_size;
+        cell[a] = std::min(std::max(static_cast<int>(std::floor(x)), 0), blocks[a] - 1);
+        if(d[a] == 0){
+            step[a] = 0;
+            t_next[a] = infinity;
+            t_delta[a] = infinity;
+            continue;
+        }
+        step[a] = d[a] > 0 ? 1 : -1;
+        const real boundary = box.min()[a] + (cell[a] + (d[a] > 0 ? 1 : 0)) * block_size;
+        t_next[a] = t0 + (boundary - start[a]) / d[a];
+        t_delta[a] = block_size / std::fabs(d[a]);
+    }
+
+    // the optical depth left until the next tentative collision, carried over from block to block
+    const real length = r.direction().length();
+    real depth_left = free_path(next());
+    real t = t0;
+    while(true){
+        const int axis = t_next[0] < t_next[1] ? (t_next[0] < t_next[2] ? 0 : 2) : (t_next[1] < t_next[2] ? 1 : 2);
+        const real exit = std::min(t_next[axis], t1);
+        const float majorant = majorants[(static_cast<size_t>(cell[2]) * blocks[1] + cell[1]) * blocks[0] + cell[0]];
+        if(majorant > 0 && exit > t){
+            const real rate = majorant * scale * length;
+            while(depth_left < rate * (exit - t)){
+                t += depth_left / rate;
+                if(!on_collision(t, density(r.at(t)) / majorant)) return;
+                depth_left = free_path(next());
+            }
+            depth_left -= rate * (exit - t);
+        }
+
+        if(exit >= t1) return;
+        t = exit;
+        cell[axis] += step[axis];
+        if(cell[axis] < 0 || cell[axis] >= blocks[axis]) return;
+        t_next[axis] += t_delta[axis];
+    }
+}
+
+// a lattice value for value_noise, in [0, 1)
+inline real lattice_value(int x, int y, int z, uint64_t seed){
+    uint64_t h = hash_combine(seed, static_cast<uint32_t>(x));
+    h = hash_combine(h, static_cast<uint32_t>(y));
+    h = hash_combine(h, static_cast<uint32_t>(z));
+    return static_cast<real>((h >> 40) * (1.0 / 16777216.0));
+}
+
+// smoothly interpolated random values at the integer lattice points
+inline real value_noise(real x, real y, real z, uint64_t seed){
+    const int x0 = static_cast<int>(std::floor(x)), y0 = static_cast<int>(std::floor(y));
+    const int z0 = static_cast<int>(std::floor(z));
+    real f[3] = { x - x0, y - y0, z - z0 };
+    for(real &v : f) v = v * v * (3 - 2 * v);
+
+    real along_z[2];
+    for(int k = 0; k < 2; k++){
+        const real a = lattice_value(x0, y0, z0 + k, seed), b = lattice_value(x0 + 1, y0, z0 + k, seed);
+        const real c = lattice_value(x0, y0 + 1, z0 + k, seed), e = lattice_value(x0 + 1, y0 + 1, z0 + k, seed);
+        const real near_y = a + f[0] * (b - a), far_y = c + f[0] * (e - c);
+        along_z[k] = near_y + f[1] * (far_y - near_y);
+    }
+    return along_z[0] + f[2] * (along_z[1] - along_z[0]);
+}
+
+// a puff of smoke filling the ball inside the grid's box (from -1 to 1 along each axis, until it's placed), resolution
+// voxels along each side, from a few octaves of noise that thin out towards the edge, cut off below a threshold so
+// there's empty space between the billows, densities go up to about 1
+inline density_grid smoke_grid(int resolution, uint64_t seed, int block = 8){
+    std::vector<float> densities(static_cast<size_t>(resolution) * resolution * resolution);
+    size_t idx = 0;
+    for(int z = 0; z < resolution; z++){
+        for(int y = 0; y < resolution; y++){
+            for(int x = 0; x < resolution; x++, idx++){
+                // where the voxel's centre is, from -1 to 1 across the box
+                const real px = 2 * (x + real(0.5)) / resolution - 1, py = 2 * (y + real(0.5)) / resolution - 1;
+                const real pz = 2 * (z + real(0.5)) / resolution - 1;
+                real noise = 0, weight = 0, amplitude = 1, frequency = 3;
+                for(int octave = 0; octave < 4; octave++){
+                    noise += amplitude * value_noise(px * frequency, py * frequency, pz * frequency, seed + octave);
+                    weight += amplitude;
+                    amplitude /= 2;
+                    frequency *= 2;
+                }
+                const real falloff = 1 - (px * px + py * py + pz * pz);
+                densities[idx] = static_cast<float>(std::max(real(0), 3 * (noise / weight + falloff / 2 - real(0.75))));
+            }
+        }
+    }
+    return density_grid(resolution, resolution, resolution, std::move(densities),
+                        aabb(point3(-1, -1, -1), point3(1, 1, 1)), block);
+}
+
+// a participating medium filling a sphere, like fog or smoke, where light is scattered at random in its volume rather
+// than at a surface - a homogeneous one has the same density all through, one with a grid has the grid's densities
+// (across the sphere's box) times it
+struct medium {
+    point3 center{};
+    real radius{};
+    real density{}; // the chance of a collision over a unit of distance, or what the grid's densities are scaled by
+    int material_idx{}; // an isotropic material, its phase function, which a collision scatters the path with
+    int grid{-1}; // into the medium_list's grids, -1 for a homogeneous medium
+};
+
+// the scene's media, which aren't hittables - whether a path scatters in a medium is random, so it's the integrator
+// that samples them, with the path's sampler, between the surfaces it hits, there are few enough of them that each is
+// tested on its own
+//
+// a homogeneous medium's free path is sampled exactly, a distance from an exponential distribution, and how much gets
+// through it has a closed form, a grid's are sampled by delta tracking and ratio tracking (Woodcock tracking, and
+// Novák et al., Residual Ratio Tracking, 2014), both unbiased, both stepping through the majorant grid
+class medium_list {
+public:
+    medium_list() = default;
+
+    // a grid is given the box of the sphere it fills
+    void add(const point3 &center, real radius, real density, int material_idx);
+    void add(const point3 &center, real radius, real density, int material_idx, density_grid &&grid);
+
+    bool empty() const { return media.empty(); }
+    size_t size() const { return media.size(); }
+
+    // samples whether r scatters in a medium between t_min and t_max (where it hits a surface, or infinity), and if
+    // it does, rec is made a hit at the point it scatters, on the medium's material, facing back along r
+    bool sample_scatter(const ray &r, real t_min, real t_max, sampler &s, hit_record &rec) const;
+
+    // the fraction of the light that gets through the media along r from t_min to t_max, exactly for homogeneous
+    // media, an unbiased estimate through grids (drawing from the sampler's generator, never its sequence)
+    real transmittance(const ray &r, real t_min, real t_max, sampler &s) const;
+public:
+    std::vector<medium> media{};
+    std::vector<density_grid> grids{};
+    const material *materials{}; // the table material_idx indexes, set by the scene as it builds
+private:
+    // where r is inside the medium's sphere, within [t_min, t_max], false if it isn't at all
+    static bool overlap(const medium &m, const ray &r, real t_min, real t_max, real &t0, real &t1);
+};
+
+void medium_list::add(const point3 &center, real radius, real density, int material_idx) {
+    medium m{};
+    m.center = center;
+    m.radius = radius;
+    m.density = density;
+    m.material_idx = material_idx;
+    media.push_back(m);
+}
+
+void medium_list::add(const point3 &center, real radius, real density, int material_idx, density_grid &&grid) {
+    const vec3 extent(radius, radius, radius);
+    grid.place(aabb(center - extent, center + extent));
+    grids.push_back(std::move(grid));
+    add(center, radius, density, material_idx);
+    media.back().grid = static_cast<int>(grids.size()) - 1;
+}
+
+bool medium_list::overlap(const medium &m, const ray &r, real t_min, real t_max, real &t0, real &t1) {
+    const vec3 oc = r.origin() - m.center;
+    const real a = r.direction().length_squared();
+    const real b_half = dot(r.direction(), oc);
+    const real c = oc.length_squared() - m.radius * m.radius;
+    const real discriminant = b_half * b_half - a * c;
+    if(discriminant <= 0) return false;
+
+    const real root = std::sqrt(discriminant);
+    t0 = std::max(t_min, (-b_half - root) / a);
+    t1 = std::min(t_max, (-b_half + root) / a);
+    return t0 < t1;
+}
+
+bool medium_list::sample_scatter(const ray &r, real t_min, real t_max, sampler &s, hit_record &rec) const {
+    // collisions in each medium are independent, so the first along r is the closest of each one's first, and a
+    // medium only has to be sampled as far as the closest found so far
+    medium_random next(s);
+    const real length = r.direction().length();
+    real closest = t_max;
+    int scattered = -1;
+    for(size_t i = 0; i < media.size(); i++){
+        const medium &m = media[i];
+        real t0, t1;
+        if(!overlap(m, r, t_min, closest, t0, t1)) continue;
+
+        if(m.grid < 0){
+            const real t = t0 + free_path(next()) / (m.density * length);
+            if(t < t1){
+                closest = t;
+                scattered = static_cast<int>(i);
+            }
+            continue;
+        }
+
+        grids[m.grid].track(r, t0, t1, m.density, next, [&](real t, real ratio){
+            if(next() >= ratio) return true; // a null collision, which carries on as if nothing were there
+            closest = t;
+            scattered = static_cast<int>(i);
+            return false;
+        });
+    }
+    if(scattered < 0) return false;
+
+    rec.t = closest;
+    rec.p = r.at(closest);
+    rec.mat_ptr = &materials[media[scattered].material_idx];
+    rec.light = -1;
+    rec.front_face = true;
+    rec.normal = -unit_vector(r.direction());
+    rec.u = rec.v = rec.uv_scale = 0;
+    return true;
+}
+
+real medium_list::transmittance(const ray &r, real t_min, real t_max, sampler &s) const {
+    medium_random next(s, false);
+    const real length = r.direction().length();
+    real through = 1;
+    for(const medium &m : media){
+        real t0, t1;
+        if(!overlap(m, r, t_min, t_max, t0, t1)) continue;
+
+        if(m.grid < 0){
+            through *= std::exp(-m.density * length * (t1 - t0));
+            continue;
+        }
+
+        grids[m.grid].track(r, t0, t1, m.density, next, [&](real, real ratio){
+            through *= 1 - ratio;
+            // once little is getting through, Russian roulette ends the estimate half the time (and doubles it the
+            // other half), so a long way through thick smoke doesn't have to take every step
+            if(through < real(0.1)){
+                if(next() >= 0.5){
+                    through = 0;
+                    return false;
+                }
+                through *= 2;
+            }
+            return true;
+        });
+        if(through <= 0) return 0;
+    }
+    return through;
+}
+
+#endif // MEDIUM_H
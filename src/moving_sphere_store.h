@@ -0,0 +1,166 @@
+#ifndef MOVING_SPHERE_STORE_H
+#define MOVING_SPHERE_STORE_H
+
+#include <algorithm>
+#include <vector>
+
+#include "bvh.h"
+#include "hittable.h"
+#include "material.h"
+#include "sphere.h"
+#include "sphere_store.h"
+
+// how a tree over moving spheres bounds them, swept boxes cover everywhere what's in a node goes over the shutter
+// interval, interpolated ones are worked out at each ray's time (see bvh_tree::refit_motion), which costs more a node
+// but can be far smaller, and automatic picks whichever should be faster for the spheres at hand
+enum class motion_bounds { automatic, swept, interpolated };
+
+// a sphere moving in a straight line over the shutter interval, from center0 at time 0 to center1 at time 1
+struct moving_sphere {
+    point3 center0{};
+    point3 center1{};
+    real radius{};
+    int material_idx{};
+
+    // times outside [0, 1] are clamped to it, so a shutter open for longer sees the sphere stop at either end
+    point3 center(real time) const {
+        time = std::min(real(1), std::max(real(0), time));
+        return center0 + time * (center1 - center0);
+    }
+};
+
+// the scene's moving spheres, kept apart from the sphere_store, which stays as it is for the (far more common) still
+// ones - there are few enough of these that each is tested on its own, with hit_sphere_root at its centre at the
+// ray's time, and once they move far enough for it to pay, the tree over them has a box at each end of the interval
+// for every node, so a ray only tests the spheres near where they are at its time (see bvh_tree::refit_motion)
+class moving_sphere_store : public hittable {
+public:
+    moving_sphere_store() = default;
+
+    // material_idx is into the material table of the scene's sphere_store, which materials points at
+    void add(const point3 &center0, const point3 &center1, real radius, int material_idx);
+
+    // builds the tree, over boxes covering each sphere's whole path, with the nodes bounded as given
+    void build(motion_bounds bounds = motion_bounds::automatic);
+
+    size_t size() const { return spheres.size(); }
+
+    bool hit(const ray &r, real t_min, real t_max, hit_record &rec) const override;
+    bool occluded(const ray &r, real t_min, real t_max) const override;
+    bool bounding_box(aabb &output_box) const override;
+public:
+    std::vector<moving_sphere> spheres{}; // in the tree's leaf order once built
+    const material *materials{}; // the table material_idx indexes, set by the scene as it builds
+    bvh_tree tree{};
+private:
+    static aabb box_at(const moving_sphere &sphere, real time);
+
+    // the closest sphere in [first, first + count) that r hits in [t_min, t_max] at its time, shrinking t_max
+    bool hit_range(const ray &r, real t_min, real &t_max, int first, int count, int &hit_idx) const;
+};
+
+void moving_sphere_store::add(const point3 &center0, const point3 &center1, real radius, int material_idx) {
+    moving_sphere sphere{};
+    sphere.center0 = center0;
+    sphere.center1 = center1;
+    sphere.radius = radius;
+    sphere.material_idx = material_idx;
+    spheres.push_back(sphere);
+    tree = bvh_tree{};
+}
+
+aabb moving_sphere_store::box_at(const moving_sphere &sphere, real time) {
+    const real r = fabs(sphere.radius); // negative radii are hollow spheres
+    const vec3 extent(r, r, r);
+    const point3 center = sphere.center(time);
+    return aabb(center - extent, center + extent);
+}
+
+void moving_sphere_store::build(motion_bounds bounds) {
+    std::vector<aabb> boxes(spheres.size());
+    for(size_t i = 0; i < spheres.size(); i++)
+        boxes[i] = surrounding_box(box_at(spheres[i], 0), box_at(spheres[i], 1));
+    tree.build(boxes); // which leaves every node's box swept
+
+    reorder_by(spheres, tree.indices);
+    if(bounds == motion_bounds::swept || tree.nodes.empty()) return;
+
+    double swept_area = 0;
+    for(const bvh_flat_node &node : tree.nodes) swept_area += node.box.surface_area();
+    tree.refit_motion([&](int i){ return box_at(spheres[i], 0); }, [&](int i){ return box_at(spheres[i], 1); });
+    if(bounds == motion_bounds::interpolated) return;
+
+    // a ray visits nodes in proportion to their area, and interpolating a box costs about half as much again as
+    // testing it, so it's only worth it if the boxes halfway through the interval are smaller by more than that
+    // (motion_bench has the two about even where the swept boxes' areas are half as big again), as they are when
+    // the spheres move far compared to the space between them, and much the same way as their neighbours
+    double interpolated_area = 0;
+    for(size_t n = 0; n < tree.nodes.size(); n++)
+        interpolated_area += tree.box_at(static_cast<int>(n), 0.5).surface_area();
+    if(swept_area < 1.5 * interpolated_area)
+        tree.refit([&](int i){ return surrounding_box(box_at(spheres[i], 0), box_at(spheres[i], 1)); });
+}
+
+bool moving_sphere_store::hit_range(const ray &r, real t_min, real &t_max, int first, int count,
+                                    int &hit_idx) const {
+    bool hit_anything = false;
+    for(int i = first; i < first + count; i++){
+        real root;
+        if(hit_sphere_root(spheres[i].center(r.time()), spheres[i].radius, r, t_min, t_max, root)){
+            t_max = root;
+            hit_idx = i;
+            hit_anything = true;
+        }
+    }
+    return hit_anything;
+}
+
+bool moving_sphere_store::hit(const ray &r, real t_min, real t_max, hit_record &rec) const {
+    int hit_idx = -1;
+    real closest = t_max;
+
+    if(tree.nodes.empty()){
+        hit_range(r, t_min, closest, 0, static_cast<int>(spheres.size()), hit_idx);
+    }else{
+        tree.traverse(r, t_min, t_max, [&](int first, int count, real &closest_so_far){
+            if(!hit_range(r, t_min, closest_so_far, first, count, hit_idx)) return false;
+            closest = closest_so_far;
+            return true;
+        });
+    }
+
+    if(hit_idx < 0) return false;
+
+    const moving_sphere &sphere = spheres[hit_idx];
+    const point3 center = sphere.center(r.time());
+    set_sphere_hit(center, sphere.radius, r, closest, rec);
+    rec.mat_ptr = &materials[sphere.material_idx];
+    if(rec.mat_ptr->textured()) set_sphere_uv(center, sphere.radius, rec);
+    return true;
+}
+
+bool moving_sphere_store::occluded(const ray &r, real t_min, real t_max) const {
+    int hit_idx = -1;
+    if(tree.nodes.empty()){
+        real closest = t_max;
+        return hit_range(r, t_min, closest, 0, static_cast<int>(spheres.size()), hit_idx);
+    }
+    return tree.traverse_any(r, t_min, t_max, [&](int first, int count){
+        real closest = t_max;
+        return hit_range(r, t_min, closest, first, count, hit_idx);
+    });
+}
+
+bool moving_sphere_store::bounding_box(aabb &output_box) const {
+    if(spheres.empty()) return false;
+
+    aabb bounds{};
+    for(const moving_sphere &sphere : spheres){
+        bounds.expand(box_at(sphere, 0));
+        bounds.expand(box_at(sphere, 1));
+    }
+    output_box = bounds;
+    return true;
+}
+
+#endif // MOVING_SPHERE_STORE_H
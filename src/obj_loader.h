@@ -0,0 +1,283 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "helper.h"
+
+#include "triangle_mesh.h"
+
+// reads the geometry of a Wavefront OBJ file, the v (vertex), vn (vertex normal), vt (texture coordinate) and f (face)
+// lines, with faces of more than three corners split into a fan of triangles, and indices either counting from 1 or,
+// if negative, back from the latest vertex - groups, smoothing groups and materials are skipped over
+//
+// the file is mapped rather than read, and parsed where it lies, a line at a time, with pages dropped behind the
+// parser as it goes, so a mesh of millions of triangles loads without the file ever being copied or held in memory as
+// a whole on top of the mesh
+class obj_parser {
+public:
+    obj_parser(const char *begin, const char *end, triangle_mesh &out) : cursor(begin), end(end), out(out) {}
+
+    // parses the next line, false at the end of the file or on an error, which error is then set for
+    bool parse_line(std::string &error);
+
+    const char *position() const { return cursor; }
+    int line() const { return line_number; }
+private:
+    const char *cursor;
+    const char *end;
+    triangle_mesh &out;
+    int line_number{};
+
+    bool at_line_end() const { return cursor == end || *cursor == '\n' || *cursor == '\r' || *cursor == '#'; }
+    void skip_spaces() { while(cursor != end && (*cursor == ' ' || *cursor == '\t')) cursor++; }
+    void skip_line();
+
+    bool next_number(double &value);
+    bool next_index(int count, int &index); // a 1 based or negative index into count things, made 0 based
+    bool parse_vertex(std::string &error);
+    bool parse_normal(std::string &error);
+    bool parse_texcoord(std::string &error);
+    bool parse_face(std::string &error);
+};
+
+void obj_parser::skip_line() {
+    const void *newline = std::memchr(cursor, '\n', static_cast<size_t>(end - cursor));
+    cursor = newline ? static_cast<const char *>(newline) + 1 : end;
+}
+
+bool obj_parser::next_number(double &value) {
+    // the mantissa's digits are gathered into an integer and scaled by a power of 10 at the end, which is exact for
+    // up to 15 significant digits and 22 decimal places, the most an OBJ file has in practice - anything longer goes
+    // through strtod instead
+    static const double powers_of_10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    skip_spaces();
+    const char *start = cursor;
+    const bool negative = cursor != end && *cursor == '-';
+    if(cursor != end && (*cursor == '-' || *cursor == '+')) cursor++;
+
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    for(; cursor != end && *cursor >= '0' && *cursor <= '9'; cursor++, digits++)
+        mantissa = mantissa * 10 + (*cursor - '0');
+    if(cursor != end && *cursor == '.'){
+        for(cursor++; cursor != end && *cursor >= '0' && *cursor <= '9'; cursor++, digits++, exponent--)
+            mantissa = mantissa * 10 + (*cursor - '0');
+    }
+    if(digits == 0) return false;
+
+    bool long_form = digits > 15;
+    if(cursor != end && (*cursor == 'e' || *cursor == 'E')){
+        cursor++;
+        const bool exponent_negative = cursor != end && *cursor == '-';
+        if(cursor != end && (*cursor == '-' || *cursor == '+')) cursor++;
+        int written = 0, exponent_digits = 0;
+        for(; cursor != end && *cursor >= '0' && *cursor <= '9'; cursor++, exponent_digits++)
+            if(written < 10000) written = written * 10 + (*cursor - '0');
+        if(exponent_digits == 0) return false;
+        exponent += exponent_negative ? -written : written;
+    }
+    if(cursor != end && !(*cursor == ' ' || *cursor == '\t' || at_line_end())) return false;
+
+    if(long_form || exponent < -22 || exponent > 22){
+        const std::string text(start, cursor); // strtod needs it null terminated, which the mapping isn't
+        value = std::strtod(text.c_str(), nullptr);
+        return true;
+    }
+    value = exponent < 0 ? mantissa / powers_of_10[-exponent] : mantissa * powers_of_10[exponent];
+    if(negative) value = -value;
+    return true;
+}
+
+bool obj_parser::next_index(int count, int &index) {
+    const bool negative = cursor != end && *cursor == '-';
+    if(negative) cursor++;
+
+    int64_t value = 0;
+    const char *start = cursor;
+    for(; cursor != end && *cursor >= '0' && *cursor <= '9'; cursor++)
+        if(value <= count) value = value * 10 + (*cursor - '0');
+    if(cursor == start) return false;
+
+    // 1 is the first, -1 the latest, and 0 isn't anything
+    if(negative) value = count - value;
+    else value -= 1;
+    if(value < 0 || value >= count) return false;
+    index = static_cast<int>(value);
+    return true;
+}
+
+bool obj_parser::parse_vertex(std::string &error) {
+    double x, y, z;
+    if(!next_number(x) || !next_number(y) || !next_number(z)){
+        error = "expected a vertex's x y z";
+        return false;
+    }
+    out.add_vertex(point3(x, y, z));
+    skip_line(); // an optional w, or colour
+    return true;
+}
+
+bool obj_parser::parse_normal(std::string &error) {
+    double x, y, z;
+    if(!next_number(x) || !next_number(y) || !next_number(z)){
+        error = "expected a normal's x y z";
+        return false;
+    }
+    out.add_normal(vec3(x, y, z));
+    skip_line();
+    return true;
+}
+
+bool obj_parser::parse_texcoord(std::string &error) {
+    double u, v;
+    if(!next_number(u) || !next_number(v)){
+        error = "expected a texture coordinate's u v";
+        return false;
+    }
+    out.add_texcoord(u, v);
+    skip_line(); // an optional w
+    return true;
+}
+
+bool obj_parser::parse_face(std::string &error) {
+    const int vertex_count = static_cast<int>(out.vertices.size());
+    const int normal_count = static_cast<int>(out.normals.size());
+    const int texcoord_count = static_cast<int>(out.texcoords.size() / 2);
+
+    // the first corner and the previous one make a triangle with each corner after the second
+    int first[3] = { -1, -1, -1 }, previous[3] = { -1, -1, -1 };
+    int corners = 0;
+    while(true){
+        skip_spaces();
+        if(at_line_end()) break;
+
+        int corner[3] = { -1, -1, -1 }; // vertex, normal and texture coordinate, as v, v/vt, v//vn or v/vt/vn
+        bool ok = next_index(vertex_count, corner[0]);
+        if(ok && cursor != end && *cursor == '/'){
+            cursor++;
+            if(cursor != end && *cursor != '/') ok = next_index(texcoord_count, corner[2]);
+            if(ok && cursor != end && *cursor == '/'){
+                cursor++;
+                ok = next_index(normal_count, corner[1]);
+            }
+        }
+        if(!ok || !(cursor == end || *cursor == ' ' || *cursor == '\t' || at_line_end())){
+            error = "expected a face's corners as v, v/vt, v//vn or v/vt/vn, with every index in range";
+            return false;
+        }
+
+        if(corners == 0){
+            std::copy(corner, corner + 3, first);
+        }else if(corners >= 2){
+            const bool smooth = first[1] >= 0 && previous[1] >= 0 && corner[1] >= 0;
+            const bool mapped = first[2] >= 0 && previous[2] >= 0 && corner[2] >= 0;
+            out.add_triangle(first[0], previous[0], corner[0], smooth ? first[1] : -1, smooth ? previous[1] : -1,
+                             smooth ? corner[1] : -1, mapped ? first[2] : -1, mapped ? previous[2] : -1,
+                             mapped ? corner[2] : -1);
+        }
+        std::copy(corner, corner + 3, previous);
+        corners++;
+    }
+
+    if(corners < 3){
+        error = "a face needs at least 3 corners";
+        return false;
+    }
+    skip_line();
+    return true;
+}
+
+bool obj_parser::parse_line(std::string &error) {
+    while(cursor != end){
+        line_number++;
+        skip_spaces();
+
+        const char *keyword = cursor;
+        while(cursor != end && *cursor != ' ' && *cursor != '\t' && *cursor != '\n' && *cursor != '\r') cursor++;
+        const size_t length = static_cast<size_t>(cursor - keyword);
+
+        // by far the most lines are vertices and faces, so those are checked for first
+        if(length == 1 && *keyword == 'v') return parse_vertex(error);
+        if(length == 1 && *keyword == 'f') return parse_face(error);
+        if(length == 2 && keyword[0] == 'v' && keyword[1] == 'n') return parse_normal(error);
+        if(length == 2 && keyword[0] == 'v' && keyword[1] == 't') return parse_texcoord(error);
+        skip_line(); // blank, a comment, or something not needed for the geometry
+    }
+    return false;
+}
+
+// loads the file into out, which is left empty if that fails, and unbuilt if it succeeds (the scene builds its meshes)
+inline bool load_obj(const std::string &path, triangle_mesh &out, std::string &error){
+    out = triangle_mesh{};
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+        error = "couldn't open " + path;
+        return false;
+    }
+
+    struct stat file_info{};
+    if(fstat(fd, &file_info) != 0 || file_info.st_size == 0){
+        close(fd);
+        error = path + " is empty";
+        return false;
+    }
+
+    const size_t file_size = static_cast<size_t>(file_info.st_size);
+    void *mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED){
+        error = "couldn't map " + path;
+        return false;
+    }
+    madvise(mapping, file_size, MADV_SEQUENTIAL);
+
+    // a rough guess, from the ~30 bytes a typical vertex or face line takes, so the buffers rarely grow more than once
+    out.vertices.reserve(file_size / 90);
+    out.indices.reserve(file_size / 20);
+
+    const char *bytes = static_cast<const char *>(mapping);
+    const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t release_every = 256 * page_size;
+    size_t released = 0;
+
+    obj_parser parser(bytes, bytes + file_size, out);
+    error.clear();
+    while(parser.parse_line(error)){
+        // the lines behind the parser are never looked at again, so their pages are dropped every so often
+        const size_t parsed = static_cast<size_t>(parser.position() - bytes) / page_size * page_size;
+        if(parsed >= released + release_every){
+            madvise(const_cast<char *>(bytes) + released, parsed - released, MADV_DONTNEED);
+            released = parsed;
+        }
+    }
+    munmap(mapping, file_size);
+
+    if(error.empty() && out.size() == 0) error = "no faces";
+    if(!error.empty()){
+        error = path + ":" + std::to_string(parser.line()) + ": " + error;
+        out = triangle_mesh{};
+        return false;
+    }
+
+    out.vertices.shrink_to_fit();
+    out.indices.shrink_to_fit();
+    out.texcoords.shrink_to_fit();
+    return true;
+}
+
+#endif // OBJ_LOADER_H
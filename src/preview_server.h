@@ -0,0 +1,466 @@
+#ifndef PREVIEW_SERVER_H
+#define PREVIEW_SERVER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "helper.h"
+
+#include "camera.h"
+#include "colour.h"
+#include "framebuffer.h"
+#include "tile_scheduler.h"
+
+// the latest 8 bit image of each tile of a progressive render, render threads hand tiles over as they finish them,
+// and the preview server picks up the ones which changed since it last looked - each tile is triple buffered, the
+// render thread fills a slot of its own then swaps it for the one waiting to be picked up, and the server swaps that
+// for one of its own, each with a single atomic exchange, so neither side ever waits on the other, and the server
+// always gets the newest image of the tile - versions are given out by the server as it picks tiles up, so they only
+// ever go up in the order it sees them, and a tile published late never gets one older than a client's already seen
+class preview_frame {
+public:
+    preview_frame(int width, int height, int tile_size);
+
+    // from the render thread which rendered t (one of make_tiles(width, height, tile_size)), while the others carry on
+    void publish(const framebuffer &fb, const tile &t);
+
+    // from the server, appends every tile picked up after version since to out, as its position and size (top row
+    // first, the way the viewer wants it), then its 8 bit rgb, and returns how many tiles there were, and in newest,
+    // the version to ask for changes since next time
+    uint32_t changed_since(uint32_t since, std::vector<unsigned char> &out, uint32_t &newest);
+
+    // from the server, the whole of the image as it is, as a binary PPM
+    void whole_image(std::vector<unsigned char> &out);
+public:
+    int width{};
+    int height{};
+private:
+    struct tile_slots {
+        std::vector<uint8_t> rgb[3]; // the tile's rows, top row first
+        uint32_t version{}; // of front, 0 until it has something in it
+        int back{0}; // the render thread's
+        std::atomic<int> ready{1}; // waiting to be picked up, with fresh_slot set if it's newer than front
+        int front{2}; // the server's
+    };
+    static const int fresh_slot = 4;
+
+    // picks up every tile that's waiting, giving each the next version
+    void swap_in_fresh();
+
+    std::vector<tile> tiles{};
+    std::vector<std::unique_ptr<tile_slots>> slots{};
+    uint32_t versions{}; // the last given out, only the server touches it
+};
+
+preview_frame::preview_frame(int width, int height, int tile_size) : width(width), height(height) {
+    tiles = make_tiles(width, height, tile_size);
+    for(const tile &t : tiles){
+        slots.emplace_back(new tile_slots{});
+        for(auto &slot : slots.back()->rgb) slot.resize(static_cast<size_t>(t.x1 - t.x0) * (t.y1 - t.y0) * 3);
+    }
+}
+
+void preview_frame::publish(const framebuffer &fb, const tile &t) {
+    tile_slots &tile_slot = *slots[t.index];
+    std::vector<uint8_t> &rgb = tile_slot.rgb[tile_slot.back];
+    const int row_width = t.x1 - t.x0;
+    float linear[3 * 64];
+
+    for(int j = t.y1 - 1, row = 0; j >= t.y0; j--, row++){
+        // a row at a time, in pieces of up to 64 pixels
+        for(int x0 = t.x0; x0 < t.x1; x0 += 64){
+            const int count = std::min(64, t.x1 - x0);
+            for(int i = 0; i < count; i++){
+                const size_t idx = fb.index(x0 + i, j);
+                const double scale = fb.samples(idx) > 0 ? 1.0 / fb.samples(idx) : 0.0;
+                for(int c = 0; c < 3; c++) linear[3 * i + c] = static_cast<float>(fb.pixels[idx][c] * scale);
+            }
+            tonemap_gamma2(linear, &rgb[(static_cast<size_t>(row) * row_width + x0 - t.x0) * 3], 3 * count);
+        }
+    }
+
+    tile_slot.back = tile_slot.ready.exchange(tile_slot.back | fresh_slot, std::memory_order_acq_rel) & ~fresh_slot;
+}
+
+void preview_frame::swap_in_fresh() {
+    for(auto &tile_slot : slots){
+        if(!(tile_slot->ready.load(std::memory_order_relaxed) & fresh_slot)) continue;
+        tile_slot->front = tile_slot->ready.exchange(tile_slot->front, std::memory_order_acq_rel) & ~fresh_slot;
+        tile_slot->version = ++versions;
+    }
+}
+
+// appends a 32 bit value, in this machine's byte order (the viewer reads them as little endian)
+inline void append_u32(std::vector<unsigned char> &out, uint32_t value){
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(value));
+}
+
+uint32_t preview_frame::changed_since(uint32_t since, std::vector<unsigned char> &out, uint32_t &newest) {
+    swap_in_fresh();
+    uint32_t count = 0;
+    newest = since;
+    for(size_t k = 0; k < tiles.size(); k++){
+        const tile_slots &tile_slot = *slots[k];
+        const uint32_t version = tile_slot.version;
+        if(version <= since) continue;
+        const tile &t = tiles[k];
+        append_u32(out, static_cast<uint32_t>(t.x0));
+        append_u32(out, static_cast<uint32_t>(height - t.y1));
+        append_u32(out, static_cast<uint32_t>(t.x1 - t.x0));
+        append_u32(out, static_cast<uint32_t>(t.y1 - t.y0));
+        out.insert(out.end(), tile_slot.rgb[tile_slot.front].begin(), tile_slot.rgb[tile_slot.front].end());
+        newest = std::max(newest, version);
+        count++;
+    }
+    return count;
+}
+
+void preview_frame::whole_image(std::vector<unsigned char> &out) {
+    swap_in_fresh();
+    char header[64];
+    const int header_size = std::snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+    out.assign(header, header + header_size);
+    out.resize(header_size + static_cast<size_t>(width) * height * 3);
+
+    for(size_t k = 0; k < tiles.size(); k++){
+        const tile &t = tiles[k];
+        const std::vector<uint8_t> &rgb = slots[k]->rgb[slots[k]->front];
+        const size_t row_bytes = static_cast<size_t>(t.x1 - t.x0) * 3;
+        for(int row = 0; row < t.y1 - t.y0; row++){
+            const size_t at = header_size + (static_cast<size_t>(height - t.y1 + row) * width + t.x0) * 3;
+            std::memcpy(&out[at], &rgb[row * row_bytes], row_bytes);
+        }
+    }
+}
+
+// the viewer's page, it polls /tiles for the tiles which changed since it last asked and draws them, dragging the
+// image orbits the camera around the point it looks at, and scrolling moves it closer or further
+const char preview_page[] = R"(<!doctype html>
+<html><head><title>ray tracer preview</title>
+<style>body{background:#202020;color:#ddd;font:14px sans-serif}canvas{cursor:move;image-rendering:pixelated}</style>
+</head><body>
+<canvas id="image"></canvas>
+<p><span id="status">connecting</span> &middot; drag to orbit, scroll to zoom &middot;
+<a href="/image.ppm">image so far</a> &middot; <button id="stop">stop rendering</button></p>
+<script>
+const canvas = document.getElementById('image'), context = canvas.getContext('2d');
+const status_line = document.getElementById('status');
+let version = 0, view = null, stopped = false;
+
+async function poll(){
+    try{
+        const data = new DataView(await (await fetch('/tiles?since=' + version)).arrayBuffer());
+        const width = data.getUint32(0, true), height = data.getUint32(4, true), count = data.getUint32(8, true);
+        if(canvas.width != width || canvas.height != height){ canvas.width = width; canvas.height = height; }
+        status_line.textContent = data.getUint32(12, true) + ' samples per pixel' + (stopped ? ', stopped' : '');
+        version = data.getUint32(16, true);
+        let at = 20;
+        for(let t = 0; t < count; t++){
+            const x = data.getUint32(at, true), y = data.getUint32(at + 4, true);
+            const w = data.getUint32(at + 8, true), h = data.getUint32(at + 12, true);
+            at += 16;
+            const tile = context.createImageData(w, h);
+            for(let p = 0; p < w * h; p++, at += 3){
+                tile.data[4 * p] = data.getUint8(at);
+                tile.data[4 * p + 1] = data.getUint8(at + 1);
+                tile.data[4 * p + 2] = data.getUint8(at + 2);
+                tile.data[4 * p + 3] = 255;
+            }
+            context.putImageData(tile, x, y);
+        }
+    }catch(e){
+        status_line.textContent = 'disconnected';
+    }
+    setTimeout(poll, 100);
+}
+
+function send_view(){
+    fetch('/camera?from=' + view.from.join(',') + '&at=' + view.at.join(',') + '&fov=' + view.fov);
+}
+
+// turns the camera about the point it looks at, by yaw about the up axis (y) and pitch above or below it, and scales
+// its distance from it
+function orbit(yaw, pitch, scale){
+    const d = view.from.map((v, i) => v - view.at[i]);
+    const r = Math.hypot(d[0], d[1], d[2]) * scale;
+    const theta = Math.atan2(d[0], d[2]) + yaw;
+    const phi = Math.min(1.55, Math.max(-1.55, Math.asin(d[1] / Math.hypot(d[0], d[1], d[2])) + pitch));
+    view.from = [view.at[0] + r * Math.cos(phi) * Math.sin(theta), view.at[1] + r * Math.sin(phi),
+                 view.at[2] + r * Math.cos(phi) * Math.cos(theta)];
+    send_view();
+}
+
+let dragging = null;
+canvas.onmousedown = e => { dragging = [e.clientX, e.clientY]; };
+window.onmouseup = () => { dragging = null; };
+window.onmousemove = e => {
+    if(!dragging || !view) return;
+    orbit(-(e.clientX - dragging[0]) * 0.01, (e.clientY - dragging[1]) * 0.01, 1);
+    dragging = [e.clientX, e.clientY];
+};
+canvas.onwheel = e => { e.preventDefault(); if(view) orbit(0, 0, e.deltaY > 0 ? 1.1 : 1 / 1.1); };
+document.getElementById('stop').onclick = () => { stopped = true; fetch('/stop'); };
+
+fetch('/camera').then(r => r.json()).then(v => { view = v; });
+poll();
+</script></body></html>
+)";
+
+// what the viewer asked for, for the render loop to act on
+struct preview_request {
+    bool stop{};
+    bool view_changed{};
+    camera_settings view{};
+};
+
+// serves a progressive render's preview_frame over HTTP on localhost, from a thread of its own, to a page which shows
+// the image converging, and can move the camera (which restarts the render, without reloading the scene) or stop it -
+// the render loop passes interrupted() to render as its stop flag, and between renders waits for the next request
+class preview_server {
+public:
+    preview_server(preview_frame &frame, const camera_settings &view) : frame(frame), view(view) {}
+    ~preview_server();
+
+    // listens on port (on localhost only) and starts serving
+    bool start(int port, std::string &error);
+
+    // set whenever there's a request the render should stop for
+    const std::atomic<bool> &interrupted() const { return interrupt; }
+
+    // the samples per pixel the render has reached, to show on the page
+    void set_samples(int samples){ samples_done.store(samples, std::memory_order_relaxed); }
+
+    // waits until there's a request, if there isn't one already, and takes it
+    preview_request wait_for_request();
+private:
+    void serve();
+    void respond(int fd);
+    bool set_view(const std::string &query, std::string &error);
+private:
+    preview_frame &frame;
+    std::atomic<bool> interrupt{false};
+    std::atomic<int> samples_done{0};
+    std::atomic<bool> closing{false};
+
+    std::mutex lock{}; // guards view and request, and is what requested waits on
+    std::condition_variable requested{};
+    camera_settings view{};
+    preview_request request{};
+
+    int listen_fd{-1};
+    std::thread thread{};
+};
+
+preview_server::~preview_server() {
+    closing = true;
+    if(thread.joinable()) thread.join();
+    if(listen_fd >= 0) close(listen_fd);
+}
+
+bool preview_server::start(int port, std::string &error) {
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(listen_fd < 0){
+        error = "couldn't create a socket";
+        return false;
+    }
+    const int reuse = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    if(bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listen_fd, 16) != 0){
+        error = "couldn't listen on port " + std::to_string(port);
+        return false;
+    }
+
+    thread = std::thread(&preview_server::serve, this);
+    return true;
+}
+
+preview_request preview_server::wait_for_request() {
+    std::unique_lock<std::mutex> guard(lock);
+    requested.wait(guard, [&](){ return request.stop || request.view_changed; });
+    preview_request taken = request;
+    request = preview_request{};
+    interrupt = false;
+    samples_done = 0;
+    return taken;
+}
+
+void preview_server::serve() {
+    while(!closing){
+        // wakes up now and then to check whether it's closing
+        pollfd waiting{ listen_fd, POLLIN, 0 };
+        if(poll(&waiting, 1, 200) <= 0) continue;
+        const int fd = accept(listen_fd, nullptr, nullptr);
+        if(fd < 0) continue;
+
+        // so a client which never sends its request can't hold the server up
+        timeval timeout{ 2, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        respond(fd);
+        close(fd);
+    }
+}
+
+// the value of key in a query string of key=value pairs separated by &s, or "" if it isn't there
+inline std::string query_value(const std::string &query, const std::string &key){
+    size_t at = 0;
+    while(at < query.size()){
+        size_t end = query.find('&', at);
+        if(end == std::string::npos) end = query.size();
+        const size_t equals = query.find('=', at);
+        if(equals < end && query.compare(at, equals - at, key) == 0) return query.substr(equals + 1, end - equals - 1);
+        at = end + 1;
+    }
+    return "";
+}
+
+// parses x,y,z
+inline bool parse_point(const std::string &text, point3 &out){
+    double x, y, z;
+    char trailing = 0;
+    if(std::sscanf(text.c_str(), "%lf,%lf,%lf%c", &x, &y, &z, &trailing) != 3) return false;
+    out = point3(x, y, z);
+    return true;
+}
+
+bool preview_server::set_view(const std::string &query, std::string &error) {
+    std::lock_guard<std::mutex> guard(lock);
+    camera_settings changed = view;
+    const std::string from = query_value(query, "from"), at = query_value(query, "at");
+    const std::string fov = query_value(query, "fov"), aperture = query_value(query, "aperture");
+    const std::string focus = query_value(query, "focus");
+    if((!from.empty() && !parse_point(from, changed.look_from)) || (!at.empty() && !parse_point(at, changed.look_at))){
+        error = "from and at are points, x,y,z";
+        return false;
+    }
+    if(!fov.empty()) changed.vertical_fov = std::atof(fov.c_str());
+    if(!aperture.empty()) changed.aperture = std::atof(aperture.c_str());
+    if(!focus.empty()) changed.focus_dist = std::atof(focus.c_str());
+    if(!(changed.vertical_fov > 0 && changed.vertical_fov < 180) || changed.aperture < 0 || changed.focus_dist < 0
+       || (changed.look_from - changed.look_at).length_squared() == 0){
+        error = "the fov has to be between 0 and 180 degrees, and the camera can't be at the point it looks at";
+        return false;
+    }
+
+    view = changed;
+    request.view = changed;
+    request.view_changed = true;
+    interrupt = true;
+    requested.notify_all();
+    return true;
+}
+
+inline bool send_all(int fd, const void *data, size_t bytes){
+    const char *at = static_cast<const char *>(data);
+    while(bytes > 0){
+        ssize_t sent = send(fd, at, bytes, MSG_NOSIGNAL);
+        if(sent <= 0) return false;
+        at += sent;
+        bytes -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+inline void send_response(int fd, const char *status, const char *type, const void *body, size_t bytes){
+    char header[256];
+    const int header_size = std::snprintf(header, sizeof(header), "HTTP/1.1 %s\r\nContent-Type: %s\r\n"
+                                          "Content-Length: %zu\r\nCache-Control: no-store\r\nConnection: close\r\n\r\n",
+                                          status, type, bytes);
+    if(send_all(fd, header, header_size)) send_all(fd, body, bytes);
+}
+
+void preview_server::respond(int fd) {
+    // only the request line matters, so reading stops at the end of the headers (or 8KB of them)
+    std::string received{};
+    char buffer[1024];
+    while(received.find("\r\n\r\n") == std::string::npos && received.size() < 8192){
+        ssize_t got = recv(fd, buffer, sizeof(buffer), 0);
+        if(got <= 0) return;
+        received.append(buffer, static_cast<size_t>(got));
+    }
+
+    char method[8] = {}, target[2048] = {};
+    if(std::sscanf(received.c_str(), "%7s %2047s", method, target) != 2 || std::strcmp(method, "GET") != 0){
+        const char message[] = "only GET requests are served\n";
+        send_response(fd, "405 Method Not Allowed", "text/plain", message, sizeof(message) - 1);
+        return;
+    }
+    std::string path = target, query{};
+    const size_t question = path.find('?');
+    if(question != std::string::npos){
+        query = path.substr(question + 1);
+        path.resize(question);
+    }
+
+    std::vector<unsigned char> body{};
+    if(path == "/"){
+        send_response(fd, "200 OK", "text/html", preview_page, sizeof(preview_page) - 1);
+    }else if(path == "/tiles"){
+        // the frame's size, the tile count, the samples so far and the version to ask for next, then the tiles
+        const uint32_t since = static_cast<uint32_t>(std::strtoul(query_value(query, "since").c_str(), nullptr, 10));
+        append_u32(body, static_cast<uint32_t>(frame.width));
+        append_u32(body, static_cast<uint32_t>(frame.height));
+        body.resize(body.size() + 3 * sizeof(uint32_t));
+        uint32_t newest = since;
+        const uint32_t count = frame.changed_since(since, body, newest);
+        const uint32_t samples = static_cast<uint32_t>(samples_done.load(std::memory_order_relaxed));
+        std::memcpy(&body[8], &count, sizeof(count));
+        std::memcpy(&body[12], &samples, sizeof(samples));
+        std::memcpy(&body[16], &newest, sizeof(newest));
+        send_response(fd, "200 OK", "application/octet-stream", body.data(), body.size());
+    }else if(path == "/camera"){
+        std::string error{};
+        if(!query.empty() && !set_view(query, error)){
+            send_response(fd, "400 Bad Request", "text/plain", error.data(), error.size());
+            return;
+        }
+        camera_settings current{};
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            current = view;
+        }
+        char json[512];
+        const int size = std::snprintf(json, sizeof(json), "{\"from\": [%.9g, %.9g, %.9g], \"at\": [%.9g, %.9g, %.9g], "
+                                       "\"fov\": %.9g, \"aperture\": %.9g, \"focus\": %.9g}",
+                                       current.look_from.x(), current.look_from.y(), current.look_from.z(),
+                                       current.look_at.x(), current.look_at.y(), current.look_at.z(),
+                                       current.vertical_fov, current.aperture, current.focus_dist);
+        send_response(fd, "200 OK", "application/json", json, static_cast<size_t>(size));
+    }else if(path == "/image.ppm"){
+        frame.whole_image(body);
+        send_response(fd, "200 OK", "image/x-portable-pixmap", body.data(), body.size());
+    }else if(path == "/stop"){
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            request.stop = true;
+            interrupt = true;
+        }
+        requested.notify_all();
+        const char message[] = "stopping\n";
+        send_response(fd, "200 OK", "text/plain", message, sizeof(message) - 1);
+    }else{
+        const char message[] = "not found\n";
+        send_response(fd, "404 Not Found", "text/plain", message, sizeof(message) - 1);
+    }
+}
+
+#endif // PREVIEW_SERVER_H
@@ -0,0 +1,173 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#if defined(RT_PROFILE) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
+// counters of what a render does (rays traced, paths, bounces) and of the time it spends in each stage, compiled in
+// with RT_PROFILE (meson configure -Dprofiling=true) - without it RT_PROFILE_COUNT and RT_PROFILE_SCOPE expand to
+// nothing, so the renderer carries no trace of them, and profile_read gives all zeros
+enum class profile_counter {
+    camera_rays, // rays generated by the camera
+    rays, // rays intersected with the scene, camera rays and every bounce after
+    paths, // paths traced (one per sample)
+    bounces, // scattering events, so bounces / paths is the average depth a path reaches
+    shadow_rays // rays sent towards a light to see if it's in view, which are in rays too
+};
+const int profile_counter_count = 5;
+
+enum class profile_stage {
+    camera, // generating camera rays
+    traversal, // intersecting rays with the scene
+    scatter, // scattering off materials
+    output // resolving the framebuffer and writing the image
+};
+const int profile_stage_count = 4;
+
+// the counters and stage times summed over every thread
+struct profile_totals {
+    long long counters[profile_counter_count]{};
+    double stage_seconds[profile_stage_count]{};
+
+    long long count(profile_counter c) const { return counters[static_cast<int>(c)]; }
+    double seconds(profile_stage s) const { return stage_seconds[static_cast<int>(s)]; }
+};
+
+// writes the totals as the members of a JSON object (without the braces, so callers can add their own members)
+inline void write_profile_json(std::FILE *file, const profile_totals &totals, const char *indent){
+    static const char *counter_names[profile_counter_count] = { "camera_rays", "rays", "paths", "bounces",
+                                                                "shadow_rays" };
+    static const char *stage_names[profile_stage_count] = { "camera", "traversal", "scatter", "output" };
+
+    for(int c = 0; c < profile_counter_count; c++)
+        std::fprintf(file, "%s\"%s\": %lld,\n", indent, counter_names[c], totals.counters[c]);
+    std::fprintf(file, "%s\"stage_seconds\": {", indent);
+    for(int s = 0; s < profile_stage_count; s++)
+        std::fprintf(file, "%s\"%s\": %.6f", s > 0 ? ", " : "", stage_names[s], totals.stage_seconds[s]);
+    std::fprintf(file, "}");
+}
+
+#if defined(RT_PROFILE)
+constexpr bool profile_enabled = true;
+
+// a cheap clock for timing stages, which are often only a few hundred nanoseconds long, the time stamp counter where
+// there is one, converted to seconds against the steady clock over the whole profile
+inline uint64_t profile_ticks(){
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// one thread's counts, only ever touched by that thread while it runs, so counting needs no atomics
+struct profile_record {
+    long long counters[profile_counter_count]{};
+    uint64_t stage_ticks[profile_stage_count]{};
+
+    void add(const profile_record &other){
+        for(int c = 0; c < profile_counter_count; c++) counters[c] += other.counters[c];
+        for(int s = 0; s < profile_stage_count; s++) stage_ticks[s] += other.stage_ticks[s];
+    }
+};
+
+// every thread's record, those of threads which have finished are folded into retired as they exit
+struct profile_registry {
+    std::mutex lock{};
+    std::vector<profile_record *> live{};
+    profile_record retired{};
+    uint64_t start_ticks{profile_ticks()};
+    std::chrono::steady_clock::time_point start_time{std::chrono::steady_clock::now()};
+
+    static profile_registry &get(){
+        static profile_registry registry{};
+        return registry;
+    }
+};
+
+struct thread_profile {
+    profile_record record{};
+
+    thread_profile(){
+        profile_registry &registry = profile_registry::get();
+        std::lock_guard<std::mutex> guard(registry.lock);
+        registry.live.push_back(&record);
+    }
+
+    ~thread_profile(){
+        profile_registry &registry = profile_registry::get();
+        std::lock_guard<std::mutex> guard(registry.lock);
+        registry.retired.add(record);
+        for(size_t i = 0; i < registry.live.size(); i++){
+            if(registry.live[i] == &record){
+                registry.live.erase(registry.live.begin() + i);
+                break;
+            }
+        }
+    }
+};
+
+inline profile_record &local_profile(){
+    static thread_local thread_profile profile{};
+    return profile.record;
+}
+
+// adds the time from its construction to its destruction to a stage
+class profile_scope {
+public:
+    explicit profile_scope(profile_stage stage) : stage(stage), start(profile_ticks()) {}
+    ~profile_scope(){ local_profile().stage_ticks[static_cast<int>(stage)] += profile_ticks() - start; }
+private:
+    profile_stage stage;
+    uint64_t start;
+};
+
+// zeroes every thread's counts, call it before rendering, not during
+inline void profile_reset(){
+    profile_registry &registry = profile_registry::get();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    for(profile_record *record : registry.live) *record = profile_record{};
+    registry.retired = profile_record{};
+    registry.start_ticks = profile_ticks();
+    registry.start_time = std::chrono::steady_clock::now();
+}
+
+// the totals since the last reset, call it once rendering has finished, not during
+inline profile_totals profile_read(){
+    profile_registry &registry = profile_registry::get();
+    std::lock_guard<std::mutex> guard(registry.lock);
+
+    profile_record sum = registry.retired;
+    for(const profile_record *record : registry.live) sum.add(*record);
+
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - registry.start_time).count();
+    const uint64_t elapsed_ticks = profile_ticks() - registry.start_ticks;
+    const double seconds_per_tick = elapsed_ticks > 0 ? elapsed / elapsed_ticks : 0;
+
+    profile_totals totals{};
+    for(int c = 0; c < profile_counter_count; c++) totals.counters[c] = sum.counters[c];
+    for(int s = 0; s < profile_stage_count; s++) totals.stage_seconds[s] = sum.stage_ticks[s] * seconds_per_tick;
+    return totals;
+}
+
+#define RT_PROFILE_COUNT(counter, n) (local_profile().counters[static_cast<int>(profile_counter::counter)] += (n))
+#define RT_PROFILE_SCOPE(stage) profile_scope profile_scope_##stage(profile_stage::stage)
+#else
+constexpr bool profile_enabled = false;
+
+inline void profile_reset() {}
+inline profile_totals profile_read(){ return {}; }
+
+#define RT_PROFILE_COUNT(counter, n) ((void)0)
+#define RT_PROFILE_SCOPE(stage) ((void)0)
+#endif
+
+#endif // PROFILE_H
@@ -7,14 +7,16 @@ class ray {
 public:
     vec3 orig{};
     vec3 dir{};
+    real tm{}; // the moment in the shutter interval the ray is at, which is where anything moving is when it's tested
 public:
     ray () = default;
-    ray (const vec3 &orig, const vec3 &dir) : orig(orig), dir(dir) {}
+    ray (const vec3 &orig, const vec3 &dir, real time = 0) : orig(orig), dir(dir), tm(time) {}
 
     point3 origin() const { return orig; }
     vec3 direction() const { return dir; }
+    real time() const { return tm; }
 
-    point3 at(double s) const{
+    point3 at(real s) const{
         return orig + dir * s;
     }
 };
@@ -0,0 +1,38 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "helper.h"
+
+#include "simd.h"
+
+// rays traced together, as neighbouring camera rays are, which mostly go the same way, so testing each box and
+// primitive against all of them at once with SIMD (across the rays) costs little more than testing one ray
+const int packet_size = 8;
+
+struct ray_packet {
+    // structure of arrays, component then lane, unused lanes repeat the first ray, so they're always safe to compute
+    alignas(32) real origin[3][packet_size];
+    alignas(32) real direction[3][packet_size];
+    alignas(32) real inv_direction[3][packet_size];
+    alignas(32) real length_squared[packet_size];
+    int count{};
+
+    ray_packet(const ray *rays, int count);
+
+    int active() const { return (1 << count) - 1; } // the lanes in use, as a bit per lane
+};
+
+ray_packet::ray_packet(const ray *rays, int count) : count(count) {
+    for(int l = 0; l < packet_size; l++){
+        const ray &r = rays[l < count ? l : 0];
+        const vec3 d = r.direction();
+        for(int a = 0; a < 3; a++){
+            origin[a][l] = r.origin()[a];
+            direction[a][l] = d[a];
+            inv_direction[a][l] = 1 / d[a];
+        }
+        length_squared[l] = d.length_squared();
+    }
+}
+
+#endif // RAY_PACKET_H
@@ -0,0 +1,19 @@
+#ifndef REAL_H
+#define REAL_H
+
+#include <limits>
+
+// the type geometry is worked out in (points, directions, distances along rays, colours), picked at compile time,
+// double by default, or float when built with RT_REAL_FLOAT (meson configure -Dprecision=float), which halves the
+// memory every vector, sphere and tree node takes - random numbers and camera and render settings stay double
+#if defined(RT_REAL_FLOAT)
+using real = float;
+#else
+using real = double;
+#endif
+
+// vec3::near_zero treats components smaller than this as zero, it's around the square root of the type's machine
+// epsilon, since below that a sum of unit vectors which (nearly) cancel out is mostly rounding error
+constexpr real near_zero_epsilon = std::numeric_limits<real>::digits > 24 ? real(1e-8) : real(1e-4);
+
+#endif // REAL_H
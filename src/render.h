@@ -0,0 +1,276 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "helper.h"
+
+#include "camera.h"
+#include "framebuffer.h"
+#include "hittable.h"
+#include "integrator.h"
+#include "profile.h"
+#include "tile_scheduler.h"
+
+// how the samples of a tile are traced, every mode gives exactly the same image
+enum class render_mode {
+    path, // one path at a time, start to finish
+    packet, // camera rays in packets of 8, then each path carries on alone
+    wavefront // a stream of the tile's paths traced together a bounce at a time, with the first bounce in packets
+};
+
+struct render_settings {
+    int width{};
+    int height{};
+    int samples_per_pixel{}; // the most samples any pixel gets
+    int tile_size{32};
+    int num_threads{1};
+    uint64_t seed{}; // changes every random number used in the frame, the same seed always gives the same image
+
+    // the frame is rendered in passes of this many samples per pixel (0 for all of them in one pass), with the
+    // framebuffer handed to the pass callback after each, for progressive previews
+    int samples_per_pass{};
+
+    // adaptive sampling, off while noise_threshold is 0, otherwise a pixel stops being sampled once it has at least
+    // min_samples, and the estimated error of its displayed value (0 to 1) is below noise_threshold
+    double noise_threshold{};
+    int min_samples{16};
+
+    render_mode mode{render_mode::path};
+    sample_sequence sequence{sample_sequence::sobol};
+
+    // the part of the frame to render, for splitting it between processes, the tiles [tile_begin, tile_end) (by index
+    // in make_tiles order, tile_end -1 for up to the last), and the samples [sample_begin, samples_per_pixel) of each of
+    // their pixels, every sample is seeded by its pixel and index, so the parts add up to exactly the whole frame
+    int tile_begin{};
+    int tile_end{-1};
+    int sample_begin{};
+
+    bool features{}; // also keeps the features of what each sample first hits (for denoising) in the framebuffer
+
+    // carries on from the samples already in the framebuffer (of this frame, restored from a checkpoint), rather than
+    // starting it empty, each pixel from the sample after its last
+    bool resume{};
+    bool report_progress{true}; // writes the pass and tile count to stderr as tiles finish
+
+    // if it isn't null, setting it stops the render once the tiles being rendered are done, to restart or cancel it
+    const std::atomic<bool> *stop{};
+};
+
+// the tiles the settings cover
+inline std::vector<tile> render_tiles(const render_settings &settings){
+    std::vector<tile> tiles = make_tiles(settings.width, settings.height, settings.tile_size);
+    const int end = settings.tile_end < 0 ? static_cast<int>(tiles.size())
+                                          : std::min(settings.tile_end, static_cast<int>(tiles.size()));
+    const int begin = std::min(std::max(settings.tile_begin, 0), end);
+    return std::vector<tile>(tiles.begin() + begin, tiles.begin() + end);
+}
+
+// the most paths the packet and wavefront modes trace at once, a tile's samples go through in streams this long
+const int stream_size = 4096;
+
+// space the packet and wavefront modes keep between tiles, one per worker thread, so once it's grown to the stream
+// size, rendering a tile allocates nothing
+struct render_scratch {
+    std::vector<size_t> pixels{}; // the pixel each path in the stream is a sample of
+    std::vector<ray> rays{};
+    std::vector<sampler> samplers{};
+    std::vector<hit_record> hits{};
+    std::vector<colour> radiance{};
+    std::vector<surface_features> features{};
+    path_batch batch{};
+};
+
+// called after every pass with the pass number (from 1)
+using pass_callback = std::function<void(const framebuffer &fb, int pass)>;
+
+// called by the worker thread which rendered a tile, as soon as it's done with it (unless every pixel in it had
+// already converged), while the others carry on with theirs, so it can only read that tile's pixels of fb
+using tile_callback = std::function<void(const framebuffer &fb, const tile &t)>;
+
+inline bool render_stopped(const render_settings &settings){
+    return settings.stop && settings.stop->load(std::memory_order_relaxed);
+}
+
+inline bool pixel_converged(const framebuffer &fb, size_t idx, const render_settings &settings){
+    return settings.noise_threshold > 0 && fb.samples(idx) >= settings.min_samples
+           && fb.stats[idx].display_error() < settings.noise_threshold;
+}
+
+// a camera ray through pixel (i, j), jittered within it
+inline ray camera_ray(const camera &cam, const render_settings &settings, int i, int j, sampler &s){
+    // get u/v coordinates in the range 0-1, the jitter is the sample's first dimension, and the lens its second
+    double jitter_u, jitter_v;
+    s.next_2d(jitter_u, jitter_v);
+    auto u = (i + jitter_u) / (settings.width-1);
+    auto v = (j + jitter_v) / (settings.height-1);
+    return cam.get_ray(u, v, s);
+}
+
+// traces the paths queued up in scratch, and adds them to the framebuffer in the order they were queued (which is
+// the order the path mode takes them in, so the pixel statistics come out the same too)
+inline void trace_stream(const hittable &world, const path_integrator &integrator, const render_settings &settings,
+                         render_scratch &scratch, framebuffer &fb){
+    const size_t count = scratch.rays.size();
+    scratch.radiance.resize(count);
+    surface_features *features = nullptr;
+    if(settings.features){
+        scratch.features.resize(count);
+        features = scratch.features.data();
+    }
+
+    if(settings.mode == render_mode::packet){
+        scratch.hits.resize(packet_size);
+        for(size_t first = 0; first < count; first += packet_size){
+            const int packet_count = static_cast<int>(std::min<size_t>(packet_size, count - first));
+            int hits;
+            {
+                RT_PROFILE_SCOPE(traversal);
+                RT_PROFILE_COUNT(rays, packet_count);
+                hits = world.hit_packet(&scratch.rays[first], packet_count, path_t_min, infinity, scratch.hits.data());
+            }
+            for(int l = 0; l < packet_count; l++){
+                scratch.radiance[first + l] = integrator.radiance_from(scratch.rays[first + l], hits & (1 << l),
+                                                                       scratch.hits[l], world,
+                                                                       scratch.samplers[first + l],
+                                                                       features ? features + first + l : nullptr);
+            }
+        }
+    }else{
+        integrator.radiance_batch(scratch.rays.data(), scratch.samplers.data(), count, world, scratch.radiance.data(),
+                                  scratch.batch, features);
+    }
+
+    for(size_t p = 0; p < count; p++){
+        if(features) fb.add_sample(scratch.pixels[p], scratch.radiance[p], features[p]);
+        else fb.add_sample(scratch.pixels[p], scratch.radiance[p]);
+    }
+
+    scratch.pixels.clear();
+    scratch.rays.clear();
+    scratch.samplers.clear();
+}
+
+// takes every pixel of the tile up to sample_end samples (counting from settings.sample_begin), skipping converged
+// ones, and returns how many it sampled
+inline int render_tile(const tile &t, const camera &cam, const hittable &world, const path_integrator &integrator,
+                       const render_settings &settings, int sample_end, framebuffer &fb, render_scratch &scratch){
+    int pixels_sampled = 0;
+
+    for(int j = t.y0; j < t.y1; j++){
+        for(int i = t.x0; i < t.x1; i++){
+            const size_t idx = fb.index(i, j);
+            if(pixel_converged(fb, idx, settings)) continue;
+            pixels_sampled++;
+
+            for(int sample = settings.sample_begin + fb.samples(idx); sample < sample_end; sample++){
+                // every sample gets its own generator, seeded from the pixel and sample index, so the image is the
+                // same whichever thread renders the pixel, however the image is tiled, and however many passes it's
+                // rendered in
+                sampler s = pixel_sampler(settings.seed, idx, sample, settings.sequence);
+                ray r{};
+                {
+                    RT_PROFILE_SCOPE(camera);
+                    RT_PROFILE_COUNT(camera_rays, 1);
+                    r = camera_ray(cam, settings, i, j, s);
+                }
+
+                if(settings.mode == render_mode::path){
+                    if(settings.features){
+                        surface_features first_hit{};
+                        const colour sample = integrator.radiance(r, world, s, &first_hit);
+                        fb.add_sample(idx, sample, first_hit);
+                    }else{
+                        fb.add_sample(idx, integrator.radiance(r, world, s));
+                    }
+                    continue;
+                }
+
+                // the other modes queue the path up, to be traced with the rest of the stream
+                scratch.pixels.push_back(idx);
+                scratch.rays.push_back(r);
+                scratch.samplers.push_back(s);
+                if(scratch.rays.size() == stream_size) trace_stream(world, integrator, settings, scratch, fb);
+            }
+        }
+    }
+
+    if(!scratch.rays.empty()) trace_stream(world, integrator, settings, scratch, fb);
+    return pixels_sampled;
+}
+
+// renders the whole image into fb, pass by pass, and returns once the last pass is done (or every pixel converged),
+// fb holds the summed samples, so resolve it into an image after
+inline void render(const camera &cam, const hittable &world, const path_integrator &integrator,
+                   const render_settings &settings, framebuffer &fb, const pass_callback &on_pass = nullptr,
+                   const tile_callback &on_tile = nullptr){
+    if(!settings.resume) fb = framebuffer(settings.width, settings.height, settings.features);
+
+    const std::vector<tile> tiles = render_tiles(settings);
+    const int num_threads = std::max(1, std::min(settings.num_threads, static_cast<int>(tiles.size())));
+    const int tiles_total = static_cast<int>(tiles.size());
+
+    // adaptive sampling needs passes to check pixels between, so falls back on passes of min_samples
+    int pass_size = settings.samples_per_pass;
+    if(pass_size <= 0) pass_size = settings.noise_threshold > 0 ? settings.min_samples : settings.samples_per_pixel;
+    pass_size = std::max(1, pass_size);
+    const int sample_count = std::max(0, settings.samples_per_pixel - settings.sample_begin);
+    const int pass_count = (sample_count + pass_size - 1) / pass_size;
+
+    std::vector<render_scratch> scratch(num_threads);
+
+    // passes every pixel already has the samples of are skipped
+    int first_pass = 1;
+    if(settings.resume && !tiles.empty()){
+        int fewest = sample_count;
+        for(const tile &t : tiles)
+            for(int j = t.y0; j < t.y1; j++)
+                for(int i = t.x0; i < t.x1; i++) fewest = std::min(fewest, fb.samples(fb.index(i, j)));
+        first_pass = fewest / pass_size + 1;
+    }
+
+    for(int pass = first_pass; pass <= pass_count; pass++){
+        const int sample_end = std::min(settings.samples_per_pixel, settings.sample_begin + pass * pass_size);
+        tile_scheduler scheduler(tiles, num_threads);
+
+        int tiles_done = 0; // guarded by progress_lock, as is pixels_sampled
+        int pixels_sampled = 0;
+        std::mutex progress_lock{};
+
+        auto worker = [&](int worker_idx){
+            tile t{};
+            while(!render_stopped(settings) && scheduler.next(worker_idx, t)){
+                int tile_pixels = render_tile(t, cam, world, integrator, settings, sample_end, fb, scratch[worker_idx]);
+                if(on_tile && tile_pixels > 0) on_tile(fb, t);
+
+                std::lock_guard<std::mutex> guard(progress_lock);
+                pixels_sampled += tile_pixels;
+                ++tiles_done;
+                if(!settings.report_progress) continue;
+                char buff[60];
+                sprintf(buff, "%*d/%d Tiles: %*d/%d", 3, pass, pass_count, 5, tiles_done, tiles_total);
+                std::cerr << "\rPass: " << buff << std::flush;
+            }
+        };
+
+        std::vector<std::thread> threads{};
+        for(int w = 1; w < num_threads; w++)
+            threads.emplace_back(worker, w);
+        worker(0); // the calling thread does its share rather than sitting idle
+
+        for(auto &thread : threads)
+            thread.join();
+
+        if(render_stopped(settings)) break;
+        if(pixels_sampled == 0) break; // everything had already converged, so the pass changed nothing
+        if(on_pass) on_pass(fb, pass);
+    }
+}
+
+#endif // RENDER_H
@@ -0,0 +1,219 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+// mixes the bits of a 64 bit value so that nearby inputs (neighbouring pixels, consecutive samples) give unrelated
+// outputs, this is the finaliser from splitmix64
+inline uint64_t mix_bits(uint64_t v){
+    v ^= v >> 30;
+    v *= 0xbf58476d1ce4e5b9ULL;
+    v ^= v >> 27;
+    v *= 0x94d049bb133111ebULL;
+    v ^= v >> 31;
+    return v;
+}
+
+inline uint64_t hash_combine(uint64_t seed, uint64_t value){
+    return mix_bits(seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2)));
+}
+
+// where a pixel's samples come from, independent random numbers, or a low discrepancy sequence, whose samples fill
+// the space more evenly than random ones do, so an image has less noise for the same number of samples
+enum class sample_sequence {
+    random, // PCG32
+    sobol, // the first two dimensions of Sobol's sequence, Owen scrambled and shuffled per dimension and per pixel
+    halton // Halton's sequence, Owen scrambled per dimension and per pixel
+};
+
+inline uint32_t reverse_bits(uint32_t v){
+    v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+    v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+    v = ((v >> 4) & 0x0f0f0f0fu) | ((v & 0x0f0f0f0fu) << 4);
+    v = ((v >> 8) & 0x00ff00ffu) | ((v & 0x00ff00ffu) << 8);
+    return (v >> 16) | (v << 16);
+}
+
+// a random permutation of a 32 bit value, of the kind Owen scrambling makes, where each bit is flipped depending on
+// the ones above it, done with a hash (Burley, Practical Hash-based Owen Scrambling, 2020), so it needs no tables
+inline uint32_t nested_uniform_scramble(uint32_t v, uint32_t seed){
+    v = reverse_bits(v);
+    // the Laine-Karras permutation, after reversing, each bit only depends on the bits below it
+    v += seed;
+    v ^= v * 0x6c50b47cu;
+    v ^= v * 0xb82f1e52u;
+    v ^= v * 0xc7afe638u;
+    v ^= v * 0x8d22f6e6u;
+    return reverse_bits(v);
+}
+
+// the second dimension of Sobol's sequence, the first is just the index with its bits reversed
+inline uint32_t sobol_second_dimension(uint32_t index){
+    uint32_t result = 0;
+    for(uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1)
+        if(index & 1) result ^= v;
+    return result;
+}
+
+// element i of a random permutation of [0, length), picked by seed, without building the permutation (Kensler,
+// Correlated Multi-Jittered Sampling, 2013), it hashes i within the next power of two up until it lands in range
+inline uint32_t permutation_element(uint32_t i, uint32_t length, uint32_t seed){
+    uint32_t mask = length - 1;
+    mask |= mask >> 1;
+    mask |= mask >> 2;
+    mask |= mask >> 4;
+    mask |= mask >> 8;
+    mask |= mask >> 16;
+    do {
+        i ^= seed; i *= 0xe170893du; i ^= seed >> 16; i ^= (i & mask) >> 4; i ^= seed >> 8; i *= 0x0929eb3fu;
+        i ^= seed >> 23; i ^= (i & mask) >> 1; i *= 1 | seed >> 27; i *= 0x6935fa69u; i ^= (i & mask) >> 11;
+        i *= 0x74dcb303u; i ^= (i & mask) >> 2; i *= 0x9e501cc3u; i ^= (i & mask) >> 2; i *= 0xc860a3dfu;
+        i &= mask; i ^= i >> 5;
+    } while(i >= length);
+    return (i + seed) % length;
+}
+
+// the radical inverse of index in a prime base (its digits mirrored about the point), Owen scrambled, each digit is
+// put through a random permutation picked by the digits before it, which spreads out the first few points of the
+// larger bases, otherwise they all sit close to 0, and in a line across any two dimensions - it carries on past the
+// index's last digit (permuting zeros) until there are 32 bits' worth
+inline double scrambled_radical_inverse(uint32_t base, uint32_t index, uint32_t seed){
+    const double inverse_base = 1.0 / base;
+    double inverse_power = 1;
+    uint64_t reversed_digits = 0;
+    while(inverse_power > 1.0 / 4294967296.0){
+        const uint32_t next = index / base;
+        uint32_t digit = index - next * base;
+        digit = permutation_element(digit, base, static_cast<uint32_t>(mix_bits(seed ^ reversed_digits)));
+        reversed_digits = reversed_digits * base + digit;
+        inverse_power *= inverse_base;
+        index = next;
+    }
+    return reversed_digits * inverse_power;
+}
+
+const uint32_t halton_primes[] = {
+    2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107,
+    109, 113, 127, 131, 137, 139, 149, 151, 157, 163, 167, 173, 179, 181, 191, 193, 197, 199, 211, 223, 227, 229, 233,
+    239, 241, 251, 257, 263, 269, 271, 277, 281, 283, 293, 307, 311
+};
+const uint32_t halton_prime_count = sizeof(halton_primes) / sizeof(halton_primes[0]);
+
+const double one_minus_epsilon = 1 - std::numeric_limits<double>::epsilon() / 2; // the largest double below 1
+
+// source of random numbers for everything that samples, it's a PCG32 generator (https://www.pcg-random.org/), which
+// is 16 bytes of state and a handful of instructions per number, so every pixel sample can cheaply get its own
+// generator, each thread only ever touches its own, and results don't depend on which thread did the work
+//
+// a pixel sample's sampler can instead draw from a low discrepancy sequence, through next_1d and next_2d, which each
+// take the next dimension of it, where the sample's index picks the point, dimensions beyond what the sequence
+// covers (Halton's past its table of primes) fall back on the generator
+class sampler {
+public:
+    sampler() : sampler(0) {}
+    explicit sampler(uint64_t seed, uint64_t stream = 0);
+    sampler(sample_sequence sequence, uint64_t pixel_seed, uint32_t index, uint64_t seed);
+
+    uint32_t next_uint();
+    double next_double(); // uniform in [0, 1), always from the generator
+
+    double next_1d(); // the next dimension of the sequence, uniform in [0, 1)
+    void next_2d(double &u, double &v); // the next dimension, as a 2D point
+
+    // skips to a dimension, so a part of a path (like a bounce's scattering) always uses the same dimensions in every
+    // sample, however many the parts before it used
+    void start_dimension(uint32_t d) { dimension = d; }
+    uint32_t current_dimension() const { return dimension; }
+private:
+    uint32_t dimension_seed(uint32_t salt) const {
+        return static_cast<uint32_t>(hash_combine(pixel_seed, (static_cast<uint64_t>(dimension) << 1) | salt));
+    }
+
+    uint64_t state{};
+    uint64_t inc{}; // must be odd, picks which of the 2^63 sequences this generator walks along
+    uint64_t pixel_seed{}; // scrambles the sequence differently for every pixel, the same for all of its samples
+    uint32_t index{}; // which point of the sequence this sample is
+    uint32_t dimension{};
+    sample_sequence sequence{sample_sequence::random};
+};
+
+sampler::sampler(uint64_t seed, uint64_t stream) {
+    inc = (stream << 1u) | 1u;
+    next_uint();
+    state += seed;
+    next_uint();
+}
+
+sampler::sampler(sample_sequence sequence, uint64_t pixel_seed, uint32_t index, uint64_t seed) : sampler(seed) {
+    this->sequence = sequence;
+    this->pixel_seed = pixel_seed;
+    this->index = index;
+}
+
+uint32_t sampler::next_uint() {
+    uint64_t old_state = state;
+    state = old_state * 6364136223846793005ULL + inc; // the LCG step
+    // then the output permutation, an xorshift followed by a random rotation, hides the weak low bits of the LCG
+    auto xor_shifted = static_cast<uint32_t>(((old_state >> 18u) ^ old_state) >> 27u);
+    auto rot = static_cast<uint32_t>(old_state >> 59u);
+    return (xor_shifted >> rot) | (xor_shifted << ((-rot) & 31u));
+}
+
+double sampler::next_double() {
+    return next_uint() * (1.0 / 4294967296.0); // 32 random bits scaled by 2^-32, so it never reaches 1
+}
+
+double sampler::next_1d() {
+    if(sequence == sample_sequence::sobol){
+        // the index is shuffled, so each dimension goes through the points in a different order, and the two are
+        // uncorrelated, then the point is scrambled
+        const uint32_t shuffled = nested_uniform_scramble(index, dimension_seed(0));
+        const uint32_t x = nested_uniform_scramble(reverse_bits(shuffled), dimension_seed(1));
+        dimension++;
+        return x * (1.0 / 4294967296.0);
+    }
+    if(sequence == sample_sequence::halton && 2 * dimension < halton_prime_count){
+        const double x = scrambled_radical_inverse(halton_primes[2 * dimension], index, dimension_seed(0));
+        dimension++;
+        return std::min(x, one_minus_epsilon);
+    }
+    dimension++;
+    return next_double();
+}
+
+void sampler::next_2d(double &u, double &v) {
+    if(sequence == sample_sequence::sobol){
+        // both coordinates come from the same shuffled index, so the pair keeps the sequence's 2D stratification
+        const uint32_t shuffled = nested_uniform_scramble(index, dimension_seed(0));
+        const uint32_t x = nested_uniform_scramble(reverse_bits(shuffled), dimension_seed(1));
+        const uint32_t y = nested_uniform_scramble(sobol_second_dimension(shuffled),
+                                                   static_cast<uint32_t>(mix_bits(dimension_seed(1))));
+        dimension++;
+        u = x * (1.0 / 4294967296.0);
+        v = y * (1.0 / 4294967296.0);
+        return;
+    }
+    if(sequence == sample_sequence::halton && 2 * dimension + 1 < halton_prime_count){
+        const double x = scrambled_radical_inverse(halton_primes[2 * dimension], index, dimension_seed(0));
+        const double y = scrambled_radical_inverse(halton_primes[2 * dimension + 1], index, dimension_seed(1));
+        dimension++;
+        u = std::min(x, one_minus_epsilon);
+        v = std::min(y, one_minus_epsilon);
+        return;
+    }
+    dimension++;
+    u = next_double();
+    v = next_double();
+}
+
+// the generator for one sample of one pixel, seeding per sample (rather than per tile or thread) means any pixel
+// sample can be reproduced on its own, however the image is split up
+inline sampler pixel_sampler(uint64_t frame_seed, uint64_t pixel_index, uint64_t sample_index,
+                             sample_sequence sequence = sample_sequence::random){
+    const uint64_t pixel_seed = hash_combine(frame_seed, pixel_index);
+    return sampler(sequence, pixel_seed, static_cast<uint32_t>(sample_index), hash_combine(pixel_seed, sample_index));
+}
+
+#endif // SAMPLER_H
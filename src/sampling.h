@@ -0,0 +1,124 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <algorithm>
+#include <cmath>
+
+#include "helper.h"
+
+// maps uniform numbers in [0, 1) onto the shapes paths are sampled over, in closed form, so each point takes a fixed
+// number of dimensions and no retries, and evenly spread (low discrepancy) input points stay evenly spread
+
+// sine and cosine of an angle in [-pi/4, pi/4], from their Taylor series, which that close to 0 are accurate to
+// within 1e-11 by the x^11 and x^12 terms, and are a lot cheaper than std::sin and std::cos, which have to reduce
+// any angle into that range first
+inline void quarter_sin_cos(double x, double &sin_x, double &cos_x){
+    const double x2 = x * x;
+    sin_x = x * (1 + x2 * (-1.0 / 6 + x2 * (1.0 / 120 + x2 * (-1.0 / 5040 + x2 * (1.0 / 362880
+                     + x2 * (-1.0 / 39916800))))));
+    cos_x = 1 + x2 * (-1.0 / 2 + x2 * (1.0 / 24 + x2 * (-1.0 / 720 + x2 * (1.0 / 40320 + x2 * (-1.0 / 3628800
+                     + x2 * (1.0 / 479001600))))));
+}
+
+// Shirley and Chiu's concentric mapping of the square onto the unit disk, at z = 0, which keeps areas in proportion
+// and distorts much less than taking the square root of one coordinate as the radius - each square ring goes to a
+// circle, with the angle along the ring's side (within pi/4 of the middle of the side) as the angle round the circle
+inline vec3 concentric_disk(double u, double v){
+    const double a = 2 * u - 1, b = 2 * v - 1;
+    if(a == 0 && b == 0) return { 0, 0, 0 };
+
+    double sin_t, cos_t;
+    if(std::fabs(a) > std::fabs(b)){
+        quarter_sin_cos((pi / 4) * (b / a), sin_t, cos_t);
+        return { static_cast<real>(a * cos_t), static_cast<real>(a * sin_t), 0 };
+    }
+    // the angle is pi/2 - (pi/4) * (a / b) here, which swaps the sine and cosine
+    quarter_sin_cos((pi / 4) * (a / b), sin_t, cos_t);
+    return { static_cast<real>(b * sin_t), static_cast<real>(b * cos_t), 0 };
+}
+
+// uniform over the unit sphere, from a point on the disk, whose squared distance r^2 from the centre is uniform in
+// [0, 1], so z = 1 - 2r^2 is uniform in [-1, 1], which by Archimedes' hat box theorem makes the point on the sphere
+// uniform, and scaling the disk point by 2 sqrt(1 - r^2) puts it at the sphere's radius at that height
+inline vec3 uniform_sphere(double u, double v){
+    const vec3 d = concentric_disk(u, v);
+    const real r2 = d.x() * d.x() + d.y() * d.y();
+    const real scale = 2 * std::sqrt(std::max(real(0), 1 - r2));
+    return { d.x() * scale, d.y() * scale, 1 - 2 * r2 };
+}
+
+// uniform over the unit ball, a point on the sphere pulled in by the cube root of a third number, since the volume
+// inside radius r goes as r^3
+inline vec3 uniform_ball(double u, double v, double w){
+    return static_cast<real>(std::cbrt(w)) * uniform_sphere(u, v);
+}
+
+// a unit vector about the z axis, with probability proportional to its cosine with it (Malley's method, points
+// spread evenly over the disk, lifted up onto the hemisphere)
+inline vec3 cosine_hemisphere(double u, double v){
+    const vec3 d = concentric_disk(u, v);
+    const real z = std::sqrt(std::max(real(0), 1 - d.x() * d.x() - d.y() * d.y()));
+    return { d.x(), d.y(), z };
+}
+
+// uniform over the directions within a cone about the z axis, whose half angle has a cosine of 1 - one_minus_cos, it's
+// uniform_sphere's mapping with z only going down to that cosine (one_minus_cos of 2 is the whole sphere), and works
+// from one_minus_cos rather than the cosine, so the narrow cones of small or distant lights keep their precision
+inline vec3 uniform_cone(double u, double v, double one_minus_cos){
+    const vec3 d = concentric_disk(u, v);
+    const real r2 = d.x() * d.x() + d.y() * d.y();
+    const real h = static_cast<real>(one_minus_cos) * r2; // 1 - z
+    const real scale = std::sqrt(std::max(real(0), static_cast<real>(one_minus_cos) * (2 - h)));
+    return { d.x() * scale, d.y() * scale, 1 - h };
+}
+
+// uniform over a triangle, as the barycentric weights b1 and b2 of its second and third corners, folding the square
+// in along its diagonal would be cheaper, but this keeps points that are close in the square close on the triangle
+inline void uniform_triangle(double u, double v, double &b1, double &b2){
+    const double su = std::sqrt(u);
+    b1 = 1 - su;
+    b2 = v * su;
+}
+
+// two unit vectors perpendicular to the unit vector n and to each other, without branches (Duff et al., Building an
+// Orthonormal Basis, Revisited, 2017)
+inline void orthonormal_basis(const vec3 &n, vec3 &b1, vec3 &b2){
+    const real sign = std::copysign(real(1), n.z());
+    const real a = -1 / (sign + n.z());
+    const real b = n.x() * n.y() * a;
+    b1 = vec3(1 + sign * n.x() * n.x() * a, sign * b, -sign * n.x());
+    b2 = vec3(b, sign + n.y() * n.y() * a, -n.y());
+}
+
+// the sampler based versions, each takes its numbers from the sampler's next dimensions
+
+inline vec3 random_in_unit_disk(sampler &s){
+    double u, v;
+    s.next_2d(u, v);
+    return concentric_disk(u, v);
+}
+
+inline vec3 random_unit_vector(sampler &s){
+    double u, v;
+    s.next_2d(u, v);
+    return uniform_sphere(u, v);
+}
+
+inline vec3 random_in_unit_sphere(sampler &s){
+    double u, v;
+    s.next_2d(u, v);
+    const double w = s.next_1d();
+    return uniform_ball(u, v, w);
+}
+
+// a cosine weighted direction about the unit normal, the Lambertian distribution
+inline vec3 random_cosine_direction(const vec3 &normal, sampler &s){
+    double u, v;
+    s.next_2d(u, v);
+    const vec3 d = cosine_hemisphere(u, v);
+    vec3 b1, b2;
+    orthonormal_basis(normal, b1, b2);
+    return d.x() * b1 + d.y() * b2 + d.z() * normal;
+}
+
+#endif // SAMPLING_H
@@ -0,0 +1,317 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "helper.h"
+
+#include "animation.h"
+#include "camera.h"
+#include "light.h"
+#include "material.h"
+#include "medium.h"
+#include "moving_sphere_store.h"
+#include "sphere_store.h"
+#include "texture.h"
+#include "transform.h"
+#include "triangle_mesh.h"
+
+// how a scene asks to be rendered, which the command line can override
+struct frame_settings {
+    int width{1920};
+    int height{1080};
+    int samples_per_pixel{50};
+    int max_depth{50};
+};
+
+// what scene::apply did to the tree over the instances
+enum class tree_update { none, refit, rebuild };
+
+// owns everything a frame is rendered from, it's all built up front, then only read while rendering, so the hit
+// path can refer into it with plain pointers and indices - nothing is reference counted (so there are no atomic
+// operations per hit) and nothing is allocated once rendering starts
+//
+// with meshes or moving spheres in it, the scene is itself the top level of the geometry, testing the spheres, then
+// the moving spheres, then the mesh instances through a tree over their world space boxes - it's the scene rather
+// than a separate object so the instances can never be left pointing into a scene that's since been moved
+class scene : public hittable {
+public:
+    scene() = default;
+
+    // adds a material to the scene's material table, returning the index spheres.add takes
+    template<typename type, typename... arg_types>
+    int add_material(arg_types &&...args);
+
+    // opens the image at path as a texture, returning it for materials to use, or null with error set
+    const texture *add_texture(const std::string &path, std::string &error);
+
+    // takes the mesh, returning the index add_instance takes, the mesh is built along with the scene
+    int add_mesh(triangle_mesh &&mesh);
+
+    // places a mesh in the scene, false if to_world can't be inverted (a scale of 0), since rays are taken into the
+    // mesh's space by its inverse
+    bool add_instance(int mesh_idx, const transform &to_world, int material_idx);
+
+    // builds every tree, then the light list
+    void build();
+
+    // gathers every emissive sphere and every triangle of each emissive instance into lights, in world space, which
+    // build does, but a scene whose trees were built some other way (read from a file) needs doing by itself
+    void build_lights();
+
+    // moves the instances update keys to where they are at its frame, then fits the tree over the instances to them,
+    // the spheres and meshes never change, so only the instances' own tree is ever refit or rebuilt (and the lights
+    // gathered again, if an emissive instance moved) - which of the two is up to apply unless forced says
+    tree_update apply(const frame_update &update, tree_update forced = tree_update::none);
+
+    // the spheres alone when there aren't any meshes or moving spheres, so a scene of only still spheres is traced
+    // just as it always was
+    const hittable &geometry() const {
+        return instances.empty() && moving_spheres.size() == 0 ? static_cast<const hittable &>(spheres) : *this;
+    }
+
+    bool hit(const ray &r, real t_min, real t_max, hit_record &rec) const override;
+    int hit_packet(const ray *rays, int count, real t_min, real t_max, hit_record *recs) const override;
+    bool occluded(const ray &r, real t_min, real t_max) const override;
+    bool bounding_box(aabb &output_box) const override;
+public:
+    camera_settings view{};
+    frame_settings frame{};
+    sphere_store spheres{}; // which holds the material table, alongside the spheres that index into it
+    moving_sphere_store moving_spheres{}; // which only light anything by being hit, they're never in lights
+    medium_list media{}; // which aren't geometry, the integrator samples them between the surfaces a path hits
+
+    std::vector<std::unique_ptr<triangle_mesh>> meshes{}; // each on the heap, so instances' pointers survive moves
+    std::vector<mesh_instance> instances{}; // in the order they were added, which animation tracks refer to them by
+    bvh_tree instance_tree{};
+    light_list lights{}; // which the integrator samples, once built
+    std::unique_ptr<texture_cache> textures{}; // null until a texture is added, on the heap since its textures
+                                               // point back at it
+
+    animation motion{}; // keyframes, if the scene is animated
+private:
+    double built_area_sum{}; // the instance tree's node_area_sum when it was last built
+    size_t moves_since_build{}; // instances moved by apply since then, counting each time one moves
+
+    // the closest hit among the instances, for a ray which hits nothing closer than t_max elsewhere, with its material
+    bool hit_instances(const ray &r, real t_min, real t_max, hit_record &rec) const;
+
+    // the instance tree's boxes, built over all of them, or refit to those in moved_to_world (by instance, null for
+    // any that haven't moved), whose new boxes are worked out from their new transform
+    void build_instance_tree(const std::vector<const transform *> &moved_to_world);
+    void refit_instance_tree(const std::vector<const transform *> &moved_to_world);
+    aabb instance_box(size_t idx, const std::vector<const transform *> &moved_to_world) const;
+};
+
+template<typename type, typename... arg_types>
+int scene::add_material(arg_types &&...args) {
+    return spheres.add_material(type(std::forward<arg_types>(args)...));
+}
+
+const texture *scene::add_texture(const std::string &path, std::string &error) {
+    if(!textures) textures.reset(new texture_cache());
+    const int idx = textures->open(path, error);
+    return idx < 0 ? nullptr : &textures->get(idx);
+}
+
+int scene::add_mesh(triangle_mesh &&mesh) {
+    meshes.emplace_back(new triangle_mesh(std::move(mesh)));
+    return static_cast<int>(meshes.size()) - 1;
+}
+
+bool scene::add_instance(int mesh_idx, const transform &to_world, int material_idx) {
+    transform inverse{};
+    if(!to_world.inverse(inverse)) return false;
+    instances.emplace_back(meshes[mesh_idx].get(), to_world, material_idx);
+    instance_tree = bvh_tree{};
+    return true;
+}
+
+void scene::build() {
+    spheres.build();
+    moving_spheres.materials = spheres.materials.data();
+    moving_spheres.build();
+    media.materials = spheres.materials.data();
+    if(instances.empty()){
+        build_lights();
+        return;
+    }
+
+    for(auto &mesh : meshes)
+        if(mesh->tree.nodes.empty()) mesh->build();
+
+    instances.shrink_to_fit(); // they're added one at a time, so it could be holding room for twice as many
+    build_instance_tree(std::vector<const transform *>(instances.size(), nullptr));
+    build_lights();
+}
+
+void scene::build_lights() {
+    lights.clear();
+    spheres.light_idx.clear();
+    for(size_t i = 0; i < spheres.size(); i++){
+        const material &mat = spheres.materials[spheres.material_idx[i]];
+        // a sphere of negative radius is hollow, lit from inside, which sample can't pick points on, so it's only
+        // found by hitting it
+        if(mat.type != material_type::emissive || spheres.radius[i] <= 0) continue;
+        if(spheres.light_idx.empty()) spheres.light_idx.assign(spheres.material_idx.size(), -1);
+        spheres.light_idx[i] = static_cast<int>(lights.size());
+        lights.add_sphere(point3(spheres.center_x[i], spheres.center_y[i], spheres.center_z[i]), spheres.radius[i],
+                          mat.emission);
+    }
+
+    for(mesh_instance &instance : instances){
+        const material &mat = spheres.materials[instance.material_idx];
+        instance.first_light = -1;
+        if(mat.type != material_type::emissive) continue;
+
+        instance.first_light = static_cast<int>(lights.size());
+        const triangle_mesh &mesh = *instance.mesh;
+        const transform to_world = instance.to_world();
+        for(size_t t = 0; t < mesh.size(); t++){
+            const point3 &a = mesh.vertices[mesh.indices[3 * t]];
+            const point3 &b = mesh.vertices[mesh.indices[3 * t + 1]];
+            const point3 &c = mesh.vertices[mesh.indices[3 * t + 2]];
+            // its front is the side hits see as the front face, which comes from the object space normal
+            const vec3 normal = unit_vector(instance.to_object.apply_normal_of_inverse(cross(b - a, c - a)));
+            lights.add_triangle(to_world.apply_point(a), to_world.apply_point(b), to_world.apply_point(c), normal,
+                                mat.emission);
+        }
+    }
+
+    lights.finish();
+    if(lights.empty()){ // nothing that gives off any light, so nothing a hit record can point at either
+        spheres.light_idx.clear();
+        for(mesh_instance &instance : instances) instance.first_light = -1;
+    }
+}
+
+void scene::build_instance_tree(const std::vector<const transform *> &moved_to_world) {
+    std::vector<aabb> boxes(instances.size());
+    for(size_t i = 0; i < instances.size(); i++) boxes[i] = instance_box(i, moved_to_world);
+    instance_tree.build(boxes);
+    built_area_sum = instance_tree.node_area_sum();
+    moves_since_build = 0;
+}
+
+void scene::refit_instance_tree(const std::vector<const transform *> &moved_to_world) {
+    instance_tree.refit_leaves([&](const bvh_flat_node &leaf){
+        bool moved = false;
+        for(int i = leaf.offset; i < leaf.offset + leaf.count; i++)
+            moved |= moved_to_world[instance_tree.indices[i]] != nullptr;
+        if(!moved) return leaf.box;
+
+        aabb bounds{};
+        for(int i = leaf.offset; i < leaf.offset + leaf.count; i++)
+            bounds.expand(instance_box(instance_tree.indices[i], moved_to_world));
+        return bounds;
+    });
+}
+
+aabb scene::instance_box(size_t idx, const std::vector<const transform *> &moved_to_world) const {
+    // a moved instance's box comes from the transform it was moved by, rather than from inverting its to_object
+    const mesh_instance &instance = instances[idx];
+    return moved_to_world[idx] ? mesh_instance::world_box(*instance.mesh, *moved_to_world[idx])
+                               : instance.world_box();
+}
+
+tree_update scene::apply(const frame_update &update, tree_update forced) {
+    std::vector<const transform *> moved_to_world(instances.size(), nullptr);
+    size_t moved = 0;
+    bool moved_light = false;
+    for(size_t k = 0; k < update.instances.size(); k++){
+        mesh_instance &instance = instances[update.instances[k]];
+        if(std::memcmp(&instance.to_object, &update.to_object[k], sizeof(transform)) == 0) continue;
+        instance.to_object = update.to_object[k];
+        moved_to_world[update.instances[k]] = &update.to_world[k];
+        moved++;
+        moved_light |= instance.first_light >= 0;
+    }
+    if(moved == 0) return tree_update::none;
+    if(moved_light) build_lights(); // the same lights in the same order, so hit records' indices still hold
+
+    // refitting keeps the tree's structure, and only grows the boxes of the nodes above what moved, so for a few
+    // instances it's far cheaper than building again - but the boxes of whatever moved stretch over both where it is
+    // and what it shared a leaf with, so each refit leaves the tree a little worse to trace (animation_bench has a
+    // tenth of 10,000 instances moving cost 40% of the rays a second within 60 frames, while the nodes' areas only
+    // grow a few percent), so it's built again once a quarter as many moves as there are instances have been refit
+    // since it was, or once the nodes' areas have grown by half, whichever comes first
+    moves_since_build += moved;
+    if(forced == tree_update::refit
+       || (forced == tree_update::none && 4 * moves_since_build <= instances.size())){
+        refit_instance_tree(moved_to_world);
+        if(forced == tree_update::refit || instance_tree.node_area_sum() <= 1.5 * built_area_sum)
+            return tree_update::refit;
+    }
+
+    build_instance_tree(moved_to_world);
+    return tree_update::rebuild;
+}
+
+bool scene::hit_instances(const ray &r, real t_min, real t_max, hit_record &rec) const {
+    int hit_idx = -1;
+    instance_tree.traverse(r, t_min, t_max, [&](int first, int count, real &closest_so_far){
+        bool hit_leaf = false;
+        for(int i = first; i < first + count; i++){
+            if(instances[instance_tree.indices[i]].hit(r, t_min, closest_so_far, rec)){
+                hit_leaf = true;
+                hit_idx = instance_tree.indices[i];
+                closest_so_far = rec.t;
+            }
+        }
+        return hit_leaf;
+    });
+    if(hit_idx < 0) return false;
+
+    rec.mat_ptr = &spheres.materials[instances[hit_idx].material_idx];
+    return true;
+}
+
+bool scene::hit(const ray &r, real t_min, real t_max, hit_record &rec) const {
+    bool hit_anything = spheres.hit(r, t_min, t_max, rec);
+    if(hit_anything) t_max = rec.t;
+    if(moving_spheres.hit(r, t_min, t_max, rec)){
+        hit_anything = true;
+        t_max = rec.t;
+    }
+    return hit_instances(r, t_min, t_max, rec) || hit_anything;
+}
+
+int scene::hit_packet(const ray *rays, int count, real t_min, real t_max, hit_record *recs) const {
+    // the spheres take the packet together, then each ray goes through the instances on its own
+    int hits = spheres.hit_packet(rays, count, t_min, t_max, recs);
+    for(int i = 0; i < count; i++){
+        real closest = (hits >> i) & 1 ? recs[i].t : t_max;
+        if(moving_spheres.hit(rays[i], t_min, closest, recs[i])){
+            hits |= 1 << i;
+            closest = recs[i].t;
+        }
+        if(hit_instances(rays[i], t_min, closest, recs[i])) hits |= 1 << i;
+    }
+    return hits;
+}
+
+bool scene::occluded(const ray &r, real t_min, real t_max) const {
+    if(spheres.occluded(r, t_min, t_max) || moving_spheres.occluded(r, t_min, t_max)) return true;
+    return instance_tree.traverse_any(r, t_min, t_max, [&](int first, int count){
+        for(int i = first; i < first + count; i++)
+            if(instances[instance_tree.indices[i]].occluded(r, t_min, t_max)) return true;
+        return false;
+    });
+}
+
+bool scene::bounding_box(aabb &output_box) const {
+    aabb box{};
+    if(spheres.size() > 0 && !spheres.bounding_box(box)) return false;
+    aabb moving_box{};
+    if(moving_spheres.bounding_box(moving_box)) box.expand(moving_box);
+    if(!instance_tree.nodes.empty()) box.expand(instance_tree.bounds());
+    if(box.empty()) return false;
+    output_box = box;
+    return true;
+}
+
+#endif // SCENE_H
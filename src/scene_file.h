@@ -0,0 +1,940 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "helper.h"
+
+#include "obj_loader.h"
+#include "scene.h"
+
+// scenes are read from one of two formats, the text format is a line per thing, with # starting a comment:
+//
+//     camera from 5 10 10 at 0 0 -1 up 0 1 0 fov 20 aperture 0.7 focus 15 shutter 0 1
+//     image width 1920 height 1080
+//     render samples 50 depth 50
+//     texture <name> <file.ppm|file.pfm>
+//     material <name> lambertian <r g b> [texture <name>]
+//     material <name> metal <r g b> <fuzz> [texture <name>]
+//     material <name> dielectric <index of refraction>
+//     material <name> emissive <r g b>
+//     material <name> isotropic <r g b>
+//     sphere <x y z> <radius> <material name>
+//     moving_sphere <x y z at time 0> <x y z at time 1> <radius> <material name>
+//     medium <x y z> <radius> <density> <isotropic material name> [smoke <resolution> <seed>]
+//     mesh <name> <file.obj>
+//     instance <mesh name> <material name> [name <name>] [translate <x y z>] [rotate <axis x y z> <degrees>]
+//              [scale <x y z>]
+//     animation frames <count>
+//     key camera <frame> [from <x y z>] [at <x y z>] [up <x y z>] [fov <degrees>] [aperture <a>] [focus <f>]
+//                [shutter <open> <close>]
+//     key <instance name> <frame> [translate <x y z>] [rotate <axis x y z> <degrees>] [scale <x y z>]
+//
+// any of the camera, image and render keys can be left out (focus 0, the default, focuses on the point looked at),
+// and materials have to come before the spheres using them - it's parsed as it's read, a block at a time, so even a
+// file of millions of spheres is never all in memory as text
+//
+// a moving sphere goes in a straight line from its first centre at time 0 to its second at time 1, and with the
+// camera's shutter open over an interval of that time (shutter 0 1 for the whole of it), each ray is at a time in
+// the interval, so whatever moves is blurred along its path - the shutter is closed by default, a still frame at 0
+//
+// a medium is fog or smoke filling a sphere (which isn't a surface itself, put a glass sphere round it for that),
+// light going through it is scattered by its isotropic material at a rate of density collisions a unit of distance
+// (and albedo is the fraction of those that scatter rather than absorb it), with smoke it's a puff of procedural
+// smoke, resolution voxels across, whose densities (up to about 1) the density multiplies, seed picks which puff
+//
+// a texture is an image file (relative to the scene file's directory), a binary PPM or a PFM, which the albedo of the
+// materials using it multiplies - it's read a tile at a time as the render needs it (see texture.h), spheres are
+// mapped with u around them and v from bottom to top, and meshes by their OBJ file's texture coordinates
+//
+// a mesh is loaded from an OBJ file (relative to the scene file's directory) and isn't in the scene until it's placed
+// by an instance, as many times as wanted, an instance's transforms are applied in the order they're written, so
+// "scale 2 2 2 translate 0 1 0" doubles the mesh's size then moves it up by 1
+//
+// an animated scene renders as a sequence of frames, with keys giving where the camera and named instances are at
+// given frames (see animation.h), a camera key starts from the camera line, so it only needs what changes, and an
+// instance key is a scale, then a rotation, then a translation, applied after the instance's own transforms, so a
+// turntable is keys of "rotate 0 1 0 0" at the first frame and "rotate 0 1 0 360" at the last
+//
+// the binary format, written by save_scene_binary, holds the sphere store just as it's laid out in memory once built
+// (each array in leaf order, and the tree), so loading one is mapping the file and copying each array out of it, with
+// nothing to parse and no tree to build, which is what to use for scenes with millions of spheres - it only holds
+// still spheres, scenes with meshes, textures, motion blur, media or animation stay in the text format
+
+// reads the text format a line at a time
+class scene_text_parser {
+public:
+    // directory is where the scene file is, which the paths of meshes are relative to
+    scene_text_parser(scene &out, std::string directory = "") : out(out), directory(std::move(directory)) {}
+
+    // line has to be null terminated, and is changed while it's parsed
+    bool parse_line(char *line, std::string &error);
+private:
+    scene &out;
+    std::string directory{};
+    std::unordered_map<std::string, int> material_names{};
+    std::unordered_map<std::string, int> mesh_names{};
+    std::unordered_map<std::string, const texture *> texture_names{};
+    // each named instance, and where its line put it (which keys move it from, and which it doesn't keep itself)
+    std::unordered_map<std::string, std::pair<int, transform>> instance_names{};
+    std::string name{}; // reused for every name looked up, so that doesn't allocate once it's long enough
+
+    // the words on a line are split up by putting nulls between them
+    char *cursor{};
+
+    const char *next_word();
+    bool next_number(double &value);
+    bool next_int(int &value);
+    bool next_vec3(vec3 &value);
+
+    bool parse_camera_settings(camera_settings &view, std::string &error);
+    bool parse_camera(std::string &error);
+    bool parse_image(std::string &error);
+    bool parse_render(std::string &error);
+    bool parse_texture(std::string &error);
+    bool parse_material(std::string &error);
+    bool parse_sphere(std::string &error);
+    bool parse_moving_sphere(std::string &error);
+    bool parse_medium(std::string &error);
+    bool parse_mesh(std::string &error);
+    bool parse_instance(std::string &error);
+    bool parse_animation(std::string &error);
+    bool parse_key(std::string &error);
+    bool parse_motion_key(const char *instance_name, int frame, std::string &error);
+
+    bool find_material(const char *material_name, int &idx, std::string &error);
+
+    // the path of a file named in the scene, relative to its directory
+    std::string relative_path(const char *file) const {
+        return file[0] == '/' || directory.empty() ? file : directory + "/" + file;
+    }
+};
+
+const char *scene_text_parser::next_word() {
+    while(*cursor && std::isspace(static_cast<unsigned char>(*cursor))) cursor++;
+    if(!*cursor || *cursor == '#') return nullptr;
+
+    const char *word = cursor;
+    while(*cursor && !std::isspace(static_cast<unsigned char>(*cursor))) cursor++;
+    if(*cursor) *cursor++ = '\0';
+    return word;
+}
+
+bool scene_text_parser::next_number(double &value) {
+    const char *word = next_word();
+    if(!word) return false;
+    char *end;
+    value = std::strtod(word, &end);
+    return *end == '\0' && end != word;
+}
+
+bool scene_text_parser::next_int(int &value) {
+    const char *word = next_word();
+    if(!word) return false;
+    char *end;
+    long parsed = std::strtol(word, &end, 10);
+    value = static_cast<int>(parsed);
+    return *end == '\0' && end != word && parsed == value;
+}
+
+bool scene_text_parser::next_vec3(vec3 &value) {
+    double x, y, z;
+    if(!next_number(x) || !next_number(y) || !next_number(z)) return false;
+    value = vec3(x, y, z);
+    return true;
+}
+
+bool scene_text_parser::parse_line(char *line, std::string &error) {
+    cursor = line;
+    const char *keyword = next_word();
+    if(!keyword) return true; // blank, or a comment
+
+    bool ok;
+    if(std::strcmp(keyword, "sphere") == 0) ok = parse_sphere(error); // first, there are by far the most of them
+    else if(std::strcmp(keyword, "material") == 0) ok = parse_material(error);
+    else if(std::strcmp(keyword, "camera") == 0) ok = parse_camera(error);
+    else if(std::strcmp(keyword, "image") == 0) ok = parse_image(error);
+    else if(std::strcmp(keyword, "render") == 0) ok = parse_render(error);
+    else if(std::strcmp(keyword, "instance") == 0) ok = parse_instance(error);
+    else if(std::strcmp(keyword, "moving_sphere") == 0) ok = parse_moving_sphere(error);
+    else if(std::strcmp(keyword, "medium") == 0) ok = parse_medium(error);
+    else if(std::strcmp(keyword, "mesh") == 0) ok = parse_mesh(error);
+    else if(std::strcmp(keyword, "texture") == 0) ok = parse_texture(error);
+    else if(std::strcmp(keyword, "key") == 0) ok = parse_key(error);
+    else if(std::strcmp(keyword, "animation") == 0) ok = parse_animation(error);
+    else{
+        error = std::string("unknown keyword '") + keyword + "'";
+        return false;
+    }
+
+    if(ok && next_word()){
+        error = std::string("too much on the line for '") + keyword + "'";
+        return false;
+    }
+    return ok;
+}
+
+bool scene_text_parser::parse_camera(std::string &error) {
+    return parse_camera_settings(out.view, error);
+}
+
+bool scene_text_parser::parse_camera_settings(camera_settings &view, std::string &error) {
+    while(const char *key = next_word()){
+        bool ok;
+        if(std::strcmp(key, "from") == 0) ok = next_vec3(view.look_from);
+        else if(std::strcmp(key, "at") == 0) ok = next_vec3(view.look_at);
+        else if(std::strcmp(key, "up") == 0) ok = next_vec3(view.up);
+        else if(std::strcmp(key, "fov") == 0) ok = next_number(view.vertical_fov);
+        else if(std::strcmp(key, "aperture") == 0) ok = next_number(view.aperture);
+        else if(std::strcmp(key, "focus") == 0) ok = next_number(view.focus_dist);
+        else if(std::strcmp(key, "shutter") == 0)
+            ok = next_number(view.shutter_open) && next_number(view.shutter_close);
+        else{
+            error = std::string("unknown camera setting '") + key + "'";
+            return false;
+        }
+
+        if(!ok){
+            error = std::string("expected a value for the camera's ") + key;
+            return false;
+        }
+    }
+
+    if(view.vertical_fov <= 0 || view.vertical_fov >= 180){
+        error = "the camera's fov has to be between 0 and 180 degrees";
+        return false;
+    }
+    if(view.shutter_close < view.shutter_open){
+        error = "the camera's shutter has to close after it opens";
+        return false;
+    }
+    return true;
+}
+
+bool scene_text_parser::parse_image(std::string &error) {
+    while(const char *key = next_word()){
+        int *setting;
+        if(std::strcmp(key, "width") == 0) setting = &out.frame.width;
+        else if(std::strcmp(key, "height") == 0) setting = &out.frame.height;
+        else{
+            error = std::string("unknown image setting '") + key + "'";
+            return false;
+        }
+
+        if(!next_int(*setting) || *setting < 1){
+            error = std::string("expected a whole number of at least 1 for the image ") + key;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool scene_text_parser::parse_render(std::string &error) {
+    while(const char *key = next_word()){
+        int *setting;
+        if(std::strcmp(key, "samples") == 0) setting = &out.frame.samples_per_pixel;
+        else if(std::strcmp(key, "depth") == 0) setting = &out.frame.max_depth;
+        else{
+            error = std::string("unknown render setting '") + key + "'";
+            return false;
+        }
+
+        if(!next_int(*setting) || *setting < 1){
+            error = std::string("expected a whole number of at least 1 for the render ") + key;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool scene_text_parser::parse_material(std::string &error) {
+    const char *material_name = next_word();
+    const char *type = next_word();
+    if(!material_name || !type){
+        error = "expected a material name and type";
+        return false;
+    }
+
+    material mat{};
+    colour albedo{};
+    double value;
+    if(std::strcmp(type, "lambertian") == 0 && next_vec3(albedo)){
+        mat = lambertian(albedo);
+    }else if(std::strcmp(type, "metal") == 0 && next_vec3(albedo) && next_number(value)){
+        mat = metal(albedo, value);
+    }else if(std::strcmp(type, "dielectric") == 0 && next_number(value)){
+        mat = dielectric(value);
+    }else if(std::strcmp(type, "emissive") == 0 && next_vec3(albedo)){
+        mat = emissive(albedo);
+    }else if(std::strcmp(type, "isotropic") == 0 && next_vec3(albedo)){
+        mat = isotropic(albedo);
+    }else{
+        error = std::string("expected lambertian r g b, metal r g b fuzz, dielectric ir, emissive r g b, or isotropic ")
+                + "r g b for material '" + material_name + "'";
+        return false;
+    }
+
+    // lambertian and metal can be given a texture after their values, which their albedo multiplies
+    if(mat.type == material_type::lambertian || mat.type == material_type::metal){
+        if(const char *key = next_word()){
+            if(std::strcmp(key, "texture") != 0 || !(key = next_word())){
+                error = std::string("expected texture and a texture's name after material '") + material_name + "'";
+                return false;
+            }
+            name = key;
+            auto found = texture_names.find(name);
+            if(found == texture_names.end()){
+                error = "no texture called '" + name + "' (they have to come before the materials using them)";
+                return false;
+            }
+            mat.albedo_map = found->second;
+        }
+    }
+
+    name = material_name;
+    if(material_names.count(name)){
+        error = "material '" + name + "' is defined twice";
+        return false;
+    }
+    material_names[name] = out.spheres.add_material(mat);
+    return true;
+}
+
+bool scene_text_parser::parse_texture(std::string &error) {
+    const char *texture_name = next_word();
+    const char *file = next_word();
+    if(!texture_name || !file){
+        error = "expected a texture name and image file";
+        return false;
+    }
+
+    name = texture_name;
+    if(texture_names.count(name)){
+        error = "texture '" + name + "' is defined twice";
+        return false;
+    }
+    const texture *opened = out.add_texture(relative_path(file), error);
+    if(!opened) return false;
+    texture_names[texture_name] = opened;
+    return true;
+}
+
+bool scene_text_parser::parse_sphere(std::string &error) {
+    point3 center;
+    double radius;
+    const char *material_name;
+    if(!next_vec3(center) || !next_number(radius) || !(material_name = next_word())){
+        error = "expected a sphere's x y z, radius and material name";
+        return false;
+    }
+
+    int material_idx;
+    if(!find_material(material_name, material_idx, error)) return false;
+    out.spheres.add(center, radius, material_idx);
+    return true;
+}
+
+bool scene_text_parser::parse_moving_sphere(std::string &error) {
+    point3 center0, center1;
+    double radius;
+    const char *material_name;
+    if(!next_vec3(center0) || !next_vec3(center1) || !next_number(radius) || !(material_name = next_word())){
+        error = "expected a moving sphere's x y z at time 0, x y z at time 1, radius and material name";
+        return false;
+    }
+
+    int material_idx;
+    if(!find_material(material_name, material_idx, error)) return false;
+    out.moving_spheres.add(center0, center1, radius, material_idx);
+    return true;
+}
+
+bool scene_text_parser::parse_medium(std::string &error) {
+    point3 center;
+    double radius, density;
+    const char *material_name;
+    if(!next_vec3(center) || !next_number(radius) || !next_number(density) || !(material_name = next_word())){
+        error = "expected a medium's x y z, radius, density and material name";
+        return false;
+    }
+    if(radius <= 0 || density <= 0){
+        error = "a medium's radius and density have to be more than 0";
+        return false;
+    }
+
+    int material_idx;
+    if(!find_material(material_name, material_idx, error)) return false;
+    if(out.spheres.materials[material_idx].type != material_type::isotropic){
+        error = "material '" + name + "' isn't isotropic, which a medium's has to be";
+        return false;
+    }
+
+    const char *key = next_word();
+    if(!key){
+        out.media.add(center, radius, density, material_idx);
+        return true;
+    }
+    int resolution, seed;
+    if(std::strcmp(key, "smoke") != 0 || !next_int(resolution) || !next_int(seed) || resolution < 2
+       || resolution > 512){
+        error = "expected smoke, a resolution from 2 to 512 and a seed after a medium";
+        return false;
+    }
+    out.media.add(center, radius, density, material_idx, smoke_grid(resolution, static_cast<uint64_t>(seed)));
+    return true;
+}
+
+bool scene_text_parser::find_material(const char *material_name, int &idx, std::string &error) {
+    name = material_name;
+    auto found = material_names.find(name);
+    if(found == material_names.end()){
+        error = "no material called '" + name + "' (they have to come before whatever uses them)";
+        return false;
+    }
+    idx = found->second;
+    return true;
+}
+
+bool scene_text_parser::parse_mesh(std::string &error) {
+    const char *mesh_name = next_word();
+    const char *file = next_word();
+    if(!mesh_name || !file){
+        error = "expected a mesh name and OBJ file";
+        return false;
+    }
+
+    name = mesh_name;
+    if(mesh_names.count(name)){
+        error = "mesh '" + name + "' is defined twice";
+        return false;
+    }
+
+    triangle_mesh mesh{};
+    if(!load_obj(relative_path(file), mesh, error)) return false;
+    mesh_names[name] = out.add_mesh(std::move(mesh));
+    return true;
+}
+
+bool scene_text_parser::parse_instance(std::string &error) {
+    const char *mesh_name = next_word();
+    const char *material_name = next_word();
+    if(!mesh_name || !material_name){
+        error = "expected an instance's mesh name and material name";
+        return false;
+    }
+
+    name = mesh_name;
+    auto found = mesh_names.find(name);
+    if(found == mesh_names.end()){
+        error = "no mesh called '" + name + "' (they have to come before the instances of them)";
+        return false;
+    }
+    const int mesh_idx = found->second;
+    int material_idx;
+    if(!find_material(material_name, material_idx, error)) return false;
+
+    transform to_world{};
+    std::string instance_name{};
+    while(const char *key = next_word()){
+        vec3 value;
+        double degrees = 0;
+        transform step{};
+        if(std::strcmp(key, "name") == 0){
+            const char *given = next_word();
+            if(!given || instance_names.count(given)){
+                error = "expected an instance name, which no other instance has";
+                return false;
+            }
+            instance_name = given;
+            continue;
+        }
+        if(std::strcmp(key, "translate") == 0 && next_vec3(value)) step = transform::translate(value);
+        else if(std::strcmp(key, "scale") == 0 && next_vec3(value)) step = transform::scale(value);
+        else if(std::strcmp(key, "rotate") == 0 && next_vec3(value) && next_number(degrees)
+                && value.length_squared() > 0) step = transform::rotate(value, degrees);
+        else{
+            error = std::string("expected translate x y z, rotate x y z degrees (about a non zero axis) or scale x y z, "
+                                "not '") + key + "'";
+            return false;
+        }
+        to_world = step * to_world;
+    }
+
+    if(!out.add_instance(mesh_idx, to_world, material_idx)){
+        error = "an instance of '" + name + "' is scaled to nothing";
+        return false;
+    }
+    if(!instance_name.empty())
+        instance_names[instance_name] = std::make_pair(static_cast<int>(out.instances.size()) - 1, to_world);
+    return true;
+}
+
+bool scene_text_parser::parse_animation(std::string &error) {
+    const char *key = next_word();
+    if(!key || std::strcmp(key, "frames") != 0 || !next_int(out.motion.frame_count) || out.motion.frame_count < 1){
+        error = "expected frames and a whole number of at least 1";
+        return false;
+    }
+    return true;
+}
+
+bool scene_text_parser::parse_key(std::string &error) {
+    const char *target = next_word();
+    int frame;
+    if(!target || !next_int(frame) || frame < 0){
+        error = "expected camera or an instance's name, then a frame number";
+        return false;
+    }
+
+    if(std::strcmp(target, "camera") != 0) return parse_motion_key(target, frame, error);
+
+    camera_key key{};
+    key.frame = frame;
+    key.view = out.view;
+    if(!parse_camera_settings(key.view, error)) return false;
+    out.motion.add_camera_key(key);
+    return true;
+}
+
+bool scene_text_parser::parse_motion_key(const char *instance_name, int frame, std::string &error) {
+    name = instance_name;
+    auto found = instance_names.find(name);
+    if(found == instance_names.end()){
+        error = "no instance named '" + name + "' (keys have to come after the instance they move)";
+        return false;
+    }
+
+    motion_key key{};
+    key.frame = frame;
+    while(const char *step = next_word()){
+        bool ok;
+        if(std::strcmp(step, "translate") == 0) ok = next_vec3(key.translation);
+        else if(std::strcmp(step, "scale") == 0) ok = next_vec3(key.scale);
+        else if(std::strcmp(step, "rotate") == 0) ok = next_vec3(key.axis) && next_number(key.degrees)
+                                                       && key.axis.length_squared() > 0;
+        else ok = false;
+
+        if(!ok){
+            error = std::string("expected translate x y z, rotate x y z degrees (about a non zero axis) or scale x y z, "
+                                "not '") + step + "'";
+            return false;
+        }
+    }
+
+    out.motion.add_motion_key(found->second.first, found->second.second, key);
+    return true;
+}
+
+// reads a text scene file through a fixed size buffer, a line at a time, and builds it
+inline bool load_scene_text(const std::string &path, scene &out, std::string &error){
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if(!file){
+        error = "couldn't open " + path;
+        return false;
+    }
+
+    const size_t slash = path.find_last_of('/');
+    scene_text_parser parser(out, slash == std::string::npos ? "" : path.substr(0, slash));
+    std::vector<char> buffer(1 << 16);
+    size_t filled = 0; // bytes in the buffer, the start of the next line is always at the front
+    int line_number = 0;
+    bool at_end = false;
+    bool ok = true;
+
+    while(ok && (!at_end || filled > 0)){
+        if(!at_end){
+            if(filled == buffer.size()) buffer.resize(buffer.size() * 2); // a line longer than the buffer
+            size_t read = std::fread(buffer.data() + filled, 1, buffer.size() - filled, file);
+            filled += read;
+            at_end = read == 0;
+        }
+
+        size_t line_start = 0;
+        while(ok){
+            char *start = buffer.data() + line_start;
+            char *newline = static_cast<char *>(std::memchr(start, '\n', filled - line_start));
+            if(!newline){
+                if(!at_end || line_start == filled) break;
+                // the last line, without a newline after it
+                if(filled == buffer.size()) buffer.resize(buffer.size() + 1);
+                start = buffer.data() + line_start;
+                newline = buffer.data() + filled;
+            }
+
+            *newline = '\0';
+            line_number++;
+            ok = parser.parse_line(start, error);
+            line_start = std::min<size_t>(newline - buffer.data() + 1, filled);
+        }
+
+        // moves whatever's left of a line to the front, to be finished by the next read
+        std::memmove(buffer.data(), buffer.data() + line_start, filled - line_start);
+        filled -= line_start;
+    }
+
+    if(!ok) error = path + ":" + std::to_string(line_number) + ": " + error;
+    else if(std::ferror(file)){
+        error = "couldn't read " + path;
+        ok = false;
+    }
+    std::fclose(file);
+
+    if(ok) out.build();
+    return ok;
+}
+
+const char scene_binary_magic[8] = { 'R', 'T', 'S', 'C', 'E', 'N', 'E', '\0' };
+const uint32_t scene_binary_version = 1;
+const uint32_t scene_binary_byte_order = 0x01020304; // read back differently on a machine of the other endianness
+
+struct scene_binary_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t material_count;
+    uint64_t sphere_count;
+    uint64_t node_count;
+    double view[12]; // look_from, look_at, up, vertical fov, aperture, focus distance
+    int32_t frame[4]; // width, height, samples per pixel, max depth
+};
+
+struct scene_binary_material {
+    int32_t type;
+    int32_t unused;
+    double albedo[3]; // or emission, for an emissive material
+    double fuzz;
+    double ir;
+};
+
+struct scene_binary_node {
+    double minimum[3];
+    double maximum[3];
+    int32_t offset;
+    int32_t count;
+    int32_t axis;
+    int32_t unused;
+};
+
+// where each section of a binary scene file starts, they follow the header in this order, each on a 64 byte boundary
+struct scene_binary_layout {
+    enum section { materials, center_x, center_y, center_z, radius, material_idx, nodes, section_count };
+
+    uint64_t offsets[section_count];
+    uint64_t size; // of the whole file
+
+    explicit scene_binary_layout(const scene_binary_header &header){
+        const uint64_t sizes[section_count] = {
+            header.material_count * sizeof(scene_binary_material),
+            header.sphere_count * sizeof(double), header.sphere_count * sizeof(double),
+            header.sphere_count * sizeof(double), header.sphere_count * sizeof(double),
+            header.sphere_count * sizeof(int32_t),
+            header.node_count * sizeof(scene_binary_node)
+        };
+
+        uint64_t offset = sizeof(scene_binary_header);
+        for(int s = 0; s < section_count; s++){
+            offset = (offset + 63) / 64 * 64;
+            offsets[s] = offset;
+            offset += sizes[s];
+        }
+        size = offset;
+    }
+};
+
+// writes the scene out in the binary format, building its tree first if it hasn't been
+inline bool save_scene_binary(scene &world, const std::string &path, std::string &error){
+    if(!world.meshes.empty() || world.motion.animated() || !world.motion.camera_keys.empty()
+       || world.moving_spheres.size() > 0 || world.view.shutter_close > world.view.shutter_open || world.textures
+       || !world.media.empty()){
+        error = "the binary format only holds still, untextured spheres, so a scene with meshes, textures, motion blur, "
+                "media or animation can't be saved in it";
+        return false;
+    }
+    if(world.spheres.tree.nodes.empty() && world.spheres.size() > 0) world.build();
+    const sphere_store &spheres = world.spheres;
+
+    scene_binary_header header{};
+    std::memcpy(header.magic, scene_binary_magic, sizeof(header.magic));
+    header.version = scene_binary_version;
+    header.byte_order = scene_binary_byte_order;
+    header.material_count = spheres.materials.size();
+    header.sphere_count = spheres.size();
+    header.node_count = spheres.tree.nodes.size();
+
+    const camera_settings &view = world.view;
+    const double view_values[12] = {
+        view.look_from[0], view.look_from[1], view.look_from[2], view.look_at[0], view.look_at[1], view.look_at[2],
+        view.up[0], view.up[1], view.up[2], view.vertical_fov, view.aperture, view.focus_dist
+    };
+    std::memcpy(header.view, view_values, sizeof(header.view));
+    header.frame[0] = world.frame.width;
+    header.frame[1] = world.frame.height;
+    header.frame[2] = world.frame.samples_per_pixel;
+    header.frame[3] = world.frame.max_depth;
+
+    FILE *file = std::fopen(path.c_str(), "wb");
+    if(!file){
+        error = "couldn't open " + path + " for writing";
+        return false;
+    }
+
+    const scene_binary_layout layout(header);
+    uint64_t written = 0;
+    auto write = [&](const void *data, size_t bytes){
+        if(std::fwrite(data, 1, bytes, file) != bytes) return false;
+        written += bytes;
+        return true;
+    };
+    auto pad_to = [&](uint64_t offset){
+        const char zeros[64] = {};
+        return write(zeros, static_cast<size_t>(offset - written));
+    };
+
+    bool ok = write(&header, sizeof(header));
+
+    ok = ok && pad_to(layout.offsets[scene_binary_layout::materials]);
+    for(const auto &mat : spheres.materials){
+        scene_binary_material record{};
+        record.type = static_cast<int32_t>(mat.type);
+        // an emissive material has no albedo, so its emission goes in its place
+        const colour &rgb = mat.type == material_type::emissive ? mat.emission : mat.albedo;
+        for(int c = 0; c < 3; c++) record.albedo[c] = rgb[c];
+        record.fuzz = mat.fuzz;
+        record.ir = mat.ir;
+        ok = ok && write(&record, sizeof(record));
+    }
+
+    // the file always holds doubles, so a scene saved by a float build loads in a double build and the other way round
+    const size_t count = spheres.size();
+    auto write_reals = [&](const std::vector<real> &values){
+        double chunk[1024];
+        for(size_t first = 0; first < count; first += 1024){
+            const size_t chunk_size = std::min<size_t>(1024, count - first);
+            std::copy(values.begin() + first, values.begin() + first + chunk_size, chunk);
+            if(!write(chunk, chunk_size * sizeof(double))) return false;
+        }
+        return true;
+    };
+    ok = ok && pad_to(layout.offsets[scene_binary_layout::center_x]) && write_reals(spheres.center_x);
+    ok = ok && pad_to(layout.offsets[scene_binary_layout::center_y]) && write_reals(spheres.center_y);
+    ok = ok && pad_to(layout.offsets[scene_binary_layout::center_z]) && write_reals(spheres.center_z);
+    ok = ok && pad_to(layout.offsets[scene_binary_layout::radius]) && write_reals(spheres.radius);
+    ok = ok && pad_to(layout.offsets[scene_binary_layout::material_idx]);
+    static_assert(sizeof(int) == sizeof(int32_t), "material indices are written as they are in memory");
+    ok = ok && write(spheres.material_idx.data(), count * sizeof(int32_t));
+
+    ok = ok && pad_to(layout.offsets[scene_binary_layout::nodes]);
+    for(const auto &node : spheres.tree.nodes){
+        scene_binary_node record{};
+        for(int a = 0; a < 3; a++){
+            record.minimum[a] = node.box.min()[a];
+            record.maximum[a] = node.box.max()[a];
+        }
+        record.offset = node.offset;
+        record.count = node.count;
+        record.axis = node.axis;
+        ok = ok && write(&record, sizeof(record));
+    }
+
+    ok = std::fclose(file) == 0 && ok;
+    if(!ok) error = "couldn't write " + path;
+    return ok;
+}
+
+// true if the file starts like a binary scene file
+inline bool is_scene_binary(const std::string &path){
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if(!file) return false;
+    char magic[sizeof(scene_binary_magic)] = {};
+    bool matches = std::fread(magic, 1, sizeof(magic), file) == sizeof(magic)
+                   && std::memcmp(magic, scene_binary_magic, sizeof(magic)) == 0;
+    std::fclose(file);
+    return matches;
+}
+
+// maps a binary scene file and copies the scene out of it, every count and index is checked against the file before
+// it's used, so a truncated or corrupt file is an error rather than a crash
+inline bool load_scene_binary(const std::string &path, scene &out, std::string &error){
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+        error = "couldn't open " + path;
+        return false;
+    }
+
+    struct stat file_info{};
+    if(fstat(fd, &file_info) != 0 || static_cast<uint64_t>(file_info.st_size) < sizeof(scene_binary_header)){
+        close(fd);
+        error = path + " is too small to be a scene";
+        return false;
+    }
+
+    const size_t file_size = static_cast<size_t>(file_info.st_size);
+    void *mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file open
+    if(mapping == MAP_FAILED){
+        error = "couldn't map " + path;
+        return false;
+    }
+    madvise(mapping, file_size, MADV_SEQUENTIAL); // it's read through once, front to back
+
+    // pages of the file which have been copied out of are dropped as the load goes, so it never holds much more than
+    // the scene itself, rather than the scene and the whole file
+    const char *bytes = static_cast<const char *>(mapping);
+    const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t released = 0;
+    auto release_up_to = [&](const char *end){
+        const size_t up_to = static_cast<size_t>(end - bytes) / page_size * page_size;
+        if(up_to <= released) return;
+        madvise(const_cast<char *>(bytes) + released, up_to - released, MADV_DONTNEED);
+        released = up_to;
+    };
+
+    scene_binary_header header;
+    std::memcpy(&header, bytes, sizeof(header));
+
+    bool ok = false;
+    if(std::memcmp(header.magic, scene_binary_magic, sizeof(header.magic)) != 0){
+        error = path + " isn't a binary scene file";
+    }else if(header.byte_order != scene_binary_byte_order){
+        error = path + " was written on a machine of the other endianness";
+    }else if(header.version != scene_binary_version){
+        error = path + " is version " + std::to_string(header.version) + " of the binary scene format, expected "
+                + std::to_string(scene_binary_version);
+    }else if(header.material_count > (1ull << 31) || header.sphere_count > (1ull << 31)
+             || header.node_count > (1ull << 31)
+             || scene_binary_layout(header).size > file_size){
+        error = path + " is truncated, or its counts are corrupt";
+    }else if(header.frame[0] < 1 || header.frame[1] < 1 || header.frame[2] < 1 || header.frame[3] < 1){
+        error = path + " has an image size or sample count below 1";
+    }else{
+        ok = true;
+    }
+
+    const scene_binary_layout layout(header);
+    const uint64_t material_count = header.material_count;
+    const size_t count = ok ? static_cast<size_t>(header.sphere_count) : 0;
+
+    if(ok){
+        const double *view = header.view;
+        out.view.look_from = point3(view[0], view[1], view[2]);
+        out.view.look_at = point3(view[3], view[4], view[5]);
+        out.view.up = vec3(view[6], view[7], view[8]);
+        out.view.vertical_fov = view[9];
+        out.view.aperture = view[10];
+        out.view.focus_dist = view[11];
+        out.frame.width = header.frame[0];
+        out.frame.height = header.frame[1];
+        out.frame.samples_per_pixel = header.frame[2];
+        out.frame.max_depth = header.frame[3];
+
+        out.spheres = sphere_store{};
+        const char *records = bytes + layout.offsets[scene_binary_layout::materials];
+        for(uint64_t m = 0; ok && m < material_count; m++){
+            scene_binary_material record;
+            std::memcpy(&record, records + m * sizeof(record), sizeof(record));
+
+            material mat{};
+            switch(record.type){
+                case static_cast<int32_t>(material_type::lambertian):
+                    mat = lambertian(colour(record.albedo[0], record.albedo[1], record.albedo[2]));
+                    break;
+                case static_cast<int32_t>(material_type::metal):
+                    mat = metal(colour(record.albedo[0], record.albedo[1], record.albedo[2]), record.fuzz);
+                    break;
+                case static_cast<int32_t>(material_type::dielectric):
+                    mat = dielectric(record.ir);
+                    break;
+                case static_cast<int32_t>(material_type::emissive):
+                    mat = emissive(colour(record.albedo[0], record.albedo[1], record.albedo[2]));
+                    break;
+                case static_cast<int32_t>(material_type::isotropic):
+                    mat = isotropic(colour(record.albedo[0], record.albedo[1], record.albedo[2]));
+                    break;
+                default:
+                    error = path + " has a material of unknown type " + std::to_string(record.type);
+                    ok = false;
+            }
+            out.spheres.add_material(mat);
+        }
+    }
+
+    if(ok){
+        // the sections are 64 byte aligned in the file, and the mapping is page aligned, so these can be read in place
+        auto section = [&](scene_binary_layout::section s){ return bytes + layout.offsets[s]; };
+        const int *material_indices = reinterpret_cast<const int *>(section(scene_binary_layout::material_idx));
+        for(size_t i = 0; ok && i < count; i++){
+            if(material_indices[i] < 0 || static_cast<uint64_t>(material_indices[i]) >= material_count){
+                error = path + " has a sphere with a material index out of range";
+                ok = false;
+            }
+        }
+
+        if(ok){
+            out.spheres.assign(count,
+                               reinterpret_cast<const double *>(section(scene_binary_layout::center_x)),
+                               reinterpret_cast<const double *>(section(scene_binary_layout::center_y)),
+                               reinterpret_cast<const double *>(section(scene_binary_layout::center_z)),
+                               reinterpret_cast<const double *>(section(scene_binary_layout::radius)),
+                               material_indices);
+            release_up_to(section(scene_binary_layout::nodes));
+        }
+    }
+
+    if(ok && header.node_count > 0){
+        const char *records = bytes + layout.offsets[scene_binary_layout::nodes];
+        std::vector<bvh_flat_node> &nodes = out.spheres.tree.nodes;
+        nodes.resize(static_cast<size_t>(header.node_count));
+        for(size_t n = 0; n < nodes.size(); n++){
+            scene_binary_node record;
+            std::memcpy(&record, records + n * sizeof(record), sizeof(record));
+            nodes[n].box = aabb(point3(record.minimum[0], record.minimum[1], record.minimum[2]),
+                                point3(record.maximum[0], record.maximum[1], record.maximum[2]));
+            nodes[n].offset = record.offset;
+            nodes[n].count = record.count;
+            nodes[n].axis = record.axis;
+            if(n % 16384 == 16383) release_up_to(records + (n + 1) * sizeof(record));
+        }
+
+        // the spheres are stored in leaf order already
+        std::vector<int> &indices = out.spheres.tree.indices;
+        indices.resize(count);
+        for(size_t i = 0; i < count; i++)
+            indices[i] = static_cast<int>(i);
+
+        if(!out.spheres.tree.valid(count)){
+            error = path + " has a corrupt tree";
+            ok = false;
+        }else if(sizeof(real) < sizeof(double)){
+            // rounding the spheres to float can leave their surfaces just outside the boxes the file has for them
+            out.spheres.refit();
+        }
+    }
+
+    munmap(mapping, file_size);
+
+    if(ok && header.node_count == 0) out.build(); // written without a tree, it's built now instead
+    else if(ok) out.build_lights();
+    if(!ok) out = scene{};
+    return ok;
+}
+
+// loads either format, telling them apart by the binary format's magic number
+inline bool load_scene(const std::string &path, scene &out, std::string &error){
+    return is_scene_binary(path) ? load_scene_binary(path, out, error) : load_scene_text(path, out, error);
+}
+
+#endif // SCENE_FILE_H
@@ -0,0 +1,196 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cmath>
+
+#include "real.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// a register of reals, as wide as the instruction set the build targets allows (with AVX 4 doubles or 8 floats, with
+// SSE2 2 doubles or 4 floats, without either 1), with just the operations the SIMD kernels need, so those are written
+// once rather than once per instruction set and precision - every operation matches the scalar C++ it stands in for
+// lane by lane, min and max included (simd_min(a, b) is a < b ? a : b, and simd_max(a, b) is a > b ? a : b, so a NaN
+// in a gives b)
+#if defined(__AVX__) && defined(RT_REAL_FLOAT)
+struct simd_real {
+    static constexpr int width = 8;
+    __m256 v;
+};
+
+struct simd_mask {
+    __m256 v;
+};
+
+inline simd_real simd_load(const real *p){ return { _mm256_load_ps(p) }; } // p 32 byte aligned
+inline simd_real simd_loadu(const real *p){ return { _mm256_loadu_ps(p) }; }
+inline simd_real simd_set(real x){ return { _mm256_set1_ps(x) }; }
+inline void simd_store(real *p, simd_real a){ _mm256_store_ps(p, a.v); }
+inline void simd_storeu(real *p, simd_real a){ _mm256_storeu_ps(p, a.v); }
+
+inline simd_real operator+(simd_real a, simd_real b){ return { _mm256_add_ps(a.v, b.v) }; }
+inline simd_real operator-(simd_real a, simd_real b){ return { _mm256_sub_ps(a.v, b.v) }; }
+inline simd_real operator*(simd_real a, simd_real b){ return { _mm256_mul_ps(a.v, b.v) }; }
+inline simd_real operator/(simd_real a, simd_real b){ return { _mm256_div_ps(a.v, b.v) }; }
+inline simd_real operator-(simd_real a){ return { _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)) }; } // flips the sign
+inline simd_real simd_sqrt(simd_real a){ return { _mm256_sqrt_ps(a.v) }; }
+inline simd_real simd_min(simd_real a, simd_real b){ return { _mm256_min_ps(a.v, b.v) }; }
+inline simd_real simd_max(simd_real a, simd_real b){ return { _mm256_max_ps(a.v, b.v) }; }
+
+inline simd_mask simd_lt(simd_real a, simd_real b){ return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+inline simd_mask simd_le(simd_real a, simd_real b){ return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+inline simd_mask simd_ge(simd_real a, simd_real b){ return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+inline simd_mask operator&(simd_mask a, simd_mask b){ return { _mm256_and_ps(a.v, b.v) }; }
+inline simd_mask operator|(simd_mask a, simd_mask b){ return { _mm256_or_ps(a.v, b.v) }; }
+
+inline simd_real simd_select(simd_mask m, simd_real a, simd_real b){
+    return { _mm256_blendv_ps(b.v, a.v, m.v) };
+}
+inline int simd_bits(simd_mask m){ return _mm256_movemask_ps(m.v); } // a bit per lane, lane 0 lowest
+#elif defined(__AVX__)
+struct simd_real {
+    static constexpr int width = 4;
+    __m256d v;
+};
+
+struct simd_mask {
+    __m256d v;
+};
+
+inline simd_real simd_load(const real *p){ return { _mm256_load_pd(p) }; } // p 32 byte aligned
+inline simd_real simd_loadu(const real *p){ return { _mm256_loadu_pd(p) }; }
+inline simd_real simd_set(real x){ return { _mm256_set1_pd(x) }; }
+inline void simd_store(real *p, simd_real a){ _mm256_store_pd(p, a.v); }
+inline void simd_storeu(real *p, simd_real a){ _mm256_storeu_pd(p, a.v); }
+
+inline simd_real operator+(simd_real a, simd_real b){ return { _mm256_add_pd(a.v, b.v) }; }
+inline simd_real operator-(simd_real a, simd_real b){ return { _mm256_sub_pd(a.v, b.v) }; }
+inline simd_real operator*(simd_real a, simd_real b){ return { _mm256_mul_pd(a.v, b.v) }; }
+inline simd_real operator/(simd_real a, simd_real b){ return { _mm256_div_pd(a.v, b.v) }; }
+inline simd_real operator-(simd_real a){ return { _mm256_xor_pd(a.v, _mm256_set1_pd(-0.0)) }; } // flips the sign
+inline simd_real simd_sqrt(simd_real a){ return { _mm256_sqrt_pd(a.v) }; }
+inline simd_real simd_min(simd_real a, simd_real b){ return { _mm256_min_pd(a.v, b.v) }; }
+inline simd_real simd_max(simd_real a, simd_real b){ return { _mm256_max_pd(a.v, b.v) }; }
+
+inline simd_mask simd_lt(simd_real a, simd_real b){ return { _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ) }; }
+inline simd_mask simd_le(simd_real a, simd_real b){ return { _mm256_cmp_pd(a.v, b.v, _CMP_LE_OQ) }; }
+inline simd_mask simd_ge(simd_real a, simd_real b){ return { _mm256_cmp_pd(a.v, b.v, _CMP_GE_OQ) }; }
+inline simd_mask operator&(simd_mask a, simd_mask b){ return { _mm256_and_pd(a.v, b.v) }; }
+inline simd_mask operator|(simd_mask a, simd_mask b){ return { _mm256_or_pd(a.v, b.v) }; }
+
+inline simd_real simd_select(simd_mask m, simd_real a, simd_real b){
+    return { _mm256_blendv_pd(b.v, a.v, m.v) };
+}
+inline int simd_bits(simd_mask m){ return _mm256_movemask_pd(m.v); } // a bit per lane, lane 0 lowest
+#elif defined(__SSE2__) && defined(RT_REAL_FLOAT)
+struct simd_real {
+    static constexpr int width = 4;
+    __m128 v;
+};
+
+struct simd_mask {
+    __m128 v;
+};
+
+inline simd_real simd_load(const real *p){ return { _mm_load_ps(p) }; } // p 16 byte aligned
+inline simd_real simd_loadu(const real *p){ return { _mm_loadu_ps(p) }; }
+inline simd_real simd_set(real x){ return { _mm_set1_ps(x) }; }
+inline void simd_store(real *p, simd_real a){ _mm_store_ps(p, a.v); }
+inline void simd_storeu(real *p, simd_real a){ _mm_storeu_ps(p, a.v); }
+
+inline simd_real operator+(simd_real a, simd_real b){ return { _mm_add_ps(a.v, b.v) }; }
+inline simd_real operator-(simd_real a, simd_real b){ return { _mm_sub_ps(a.v, b.v) }; }
+inline simd_real operator*(simd_real a, simd_real b){ return { _mm_mul_ps(a.v, b.v) }; }
+inline simd_real operator/(simd_real a, simd_real b){ return { _mm_div_ps(a.v, b.v) }; }
+inline simd_real operator-(simd_real a){ return { _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)) }; } // flips the sign
+inline simd_real simd_sqrt(simd_real a){ return { _mm_sqrt_ps(a.v) }; }
+inline simd_real simd_min(simd_real a, simd_real b){ return { _mm_min_ps(a.v, b.v) }; }
+inline simd_real simd_max(simd_real a, simd_real b){ return { _mm_max_ps(a.v, b.v) }; }
+
+inline simd_mask simd_lt(simd_real a, simd_real b){ return { _mm_cmplt_ps(a.v, b.v) }; }
+inline simd_mask simd_le(simd_real a, simd_real b){ return { _mm_cmple_ps(a.v, b.v) }; }
+inline simd_mask simd_ge(simd_real a, simd_real b){ return { _mm_cmpge_ps(a.v, b.v) }; }
+inline simd_mask operator&(simd_mask a, simd_mask b){ return { _mm_and_ps(a.v, b.v) }; }
+inline simd_mask operator|(simd_mask a, simd_mask b){ return { _mm_or_ps(a.v, b.v) }; }
+
+// SSE2 has no blend, so the mask picks between them with and/andnot
+inline simd_real simd_select(simd_mask m, simd_real a, simd_real b){
+    return { _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)) };
+}
+inline int simd_bits(simd_mask m){ return _mm_movemask_ps(m.v); }
+#elif defined(__SSE2__)
+struct simd_real {
+    static constexpr int width = 2;
+    __m128d v;
+};
+
+struct simd_mask {
+    __m128d v;
+};
+
+inline simd_real simd_load(const real *p){ return { _mm_load_pd(p) }; } // p 16 byte aligned
+inline simd_real simd_loadu(const real *p){ return { _mm_loadu_pd(p) }; }
+inline simd_real simd_set(real x){ return { _mm_set1_pd(x) }; }
+inline void simd_store(real *p, simd_real a){ _mm_store_pd(p, a.v); }
+inline void simd_storeu(real *p, simd_real a){ _mm_storeu_pd(p, a.v); }
+
+inline simd_real operator+(simd_real a, simd_real b){ return { _mm_add_pd(a.v, b.v) }; }
+inline simd_real operator-(simd_real a, simd_real b){ return { _mm_sub_pd(a.v, b.v) }; }
+inline simd_real operator*(simd_real a, simd_real b){ return { _mm_mul_pd(a.v, b.v) }; }
+inline simd_real operator/(simd_real a, simd_real b){ return { _mm_div_pd(a.v, b.v) }; }
+inline simd_real operator-(simd_real a){ return { _mm_xor_pd(a.v, _mm_set1_pd(-0.0)) }; } // flips the sign
+inline simd_real simd_sqrt(simd_real a){ return { _mm_sqrt_pd(a.v) }; }
+inline simd_real simd_min(simd_real a, simd_real b){ return { _mm_min_pd(a.v, b.v) }; }
+inline simd_real simd_max(simd_real a, simd_real b){ return { _mm_max_pd(a.v, b.v) }; }
+
+inline simd_mask simd_lt(simd_real a, simd_real b){ return { _mm_cmplt_pd(a.v, b.v) }; }
+inline simd_mask simd_le(simd_real a, simd_real b){ return { _mm_cmple_pd(a.v, b.v) }; }
+inline simd_mask simd_ge(simd_real a, simd_real b){ return { _mm_cmpge_pd(a.v, b.v) }; }
+inline simd_mask operator&(simd_mask a, simd_mask b){ return { _mm_and_pd(a.v, b.v) }; }
+inline simd_mask operator|(simd_mask a, simd_mask b){ return { _mm_or_pd(a.v, b.v) }; }
+
+// SSE2 has no blend, so the mask picks between them with and/andnot
+inline simd_real simd_select(simd_mask m, simd_real a, simd_real b){
+    return { _mm_or_pd(_mm_and_pd(m.v, a.v), _mm_andnot_pd(m.v, b.v)) };
+}
+inline int simd_bits(simd_mask m){ return _mm_movemask_pd(m.v); }
+#else
+struct simd_real {
+    static constexpr int width = 1;
+    real v;
+};
+
+struct simd_mask {
+    bool v;
+};
+
+inline simd_real simd_load(const real *p){ return { *p }; }
+inline simd_real simd_loadu(const real *p){ return { *p }; }
+inline simd_real simd_set(real x){ return { x }; }
+inline void simd_store(real *p, simd_real a){ *p = a.v; }
+inline void simd_storeu(real *p, simd_real a){ *p = a.v; }
+
+inline simd_real operator+(simd_real a, simd_real b){ return { a.v + b.v }; }
+inline simd_real operator-(simd_real a, simd_real b){ return { a.v - b.v }; }
+inline simd_real operator*(simd_real a, simd_real b){ return { a.v * b.v }; }
+inline simd_real operator/(simd_real a, simd_real b){ return { a.v / b.v }; }
+inline simd_real operator-(simd_real a){ return { -a.v }; }
+inline simd_real simd_sqrt(simd_real a){ return { std::sqrt(a.v) }; }
+inline simd_real simd_min(simd_real a, simd_real b){ return { a.v < b.v ? a.v : b.v }; }
+inline simd_real simd_max(simd_real a, simd_real b){ return { a.v > b.v ? a.v : b.v }; }
+
+inline simd_mask simd_lt(simd_real a, simd_real b){ return { a.v < b.v }; }
+inline simd_mask simd_le(simd_real a, simd_real b){ return { a.v <= b.v }; }
+inline simd_mask simd_ge(simd_real a, simd_real b){ return { a.v >= b.v }; }
+inline simd_mask operator&(simd_mask a, simd_mask b){ return { a.v && b.v }; }
+inline simd_mask operator|(simd_mask a, simd_mask b){ return { a.v || b.v }; }
+
+inline simd_real simd_select(simd_mask m, simd_real a, simd_real b){ return { m.v ? a.v : b.v }; }
+inline int simd_bits(simd_mask m){ return m.v ? 1 : 0; }
+#endif
+
+#endif // SIMD_H
@@ -1,51 +1,88 @@
 #ifndef SPHERE_H
 #define SPHERE_H
 
+#include <algorithm>
+#include <cmath>
 #include <utility>
 
 #include "hittable.h"
+#include "material.h"
 
 class sphere : public hittable {
 public:
     sphere() = default;
-    sphere(point3 center, double radius, shared_ptr<material> mat_ptr)
+    sphere(point3 center, real radius, shared_ptr<material> mat_ptr)
         : center(center), radius(radius), mat_ptr(std::move(mat_ptr)) {};
 
-    bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override;
+    bool hit(const ray &r, real t_min, real t_max, hit_record &rec) const override;
+    bool bounding_box(aabb &output_box) const override;
 public:
     point3 center{};
-    double radius{};
+    real radius{};
     shared_ptr<material> mat_ptr{};
 };
 
-bool sphere::hit(const ray &r, double t_min, double t_max, hit_record &rec) const {
+// solves for where r meets the sphere, giving the nearest root in [t_min, t_max], shared by sphere and the packed
+// sphere store so that both find exactly the same hits
+inline bool hit_sphere_root(const point3 &center, real radius, const ray &r, real t_min, real t_max,
+                            real &root){
     vec3 dist_sphere_center_ray_origin = r.origin() - center;
-    double a = r.direction().length_squared();
-    double b_half = dot(r.direction(), dist_sphere_center_ray_origin);
-    double c = dist_sphere_center_ray_origin.length_squared() - radius*radius;
+    real a = r.direction().length_squared();
+    real b_half = dot(r.direction(), dist_sphere_center_ray_origin);
+    real c = dist_sphere_center_ray_origin.length_squared() - radius*radius;
 
-    double discriminant = b_half*b_half - a*c;
+    real discriminant = b_half*b_half - a*c;
     if(discriminant < 0) return false;
 
     auto sqrt_discriminant = sqrt(discriminant);
 
-    auto root = (-b_half - sqrt_discriminant) / a; // try minus root since further in screen
+    root = (-b_half - sqrt_discriminant) / a; // try minus root since further in screen
     if(root < t_min || t_max < root){
         root = (-b_half + sqrt_discriminant) / a; // try plus, not as far in screen but maybe in range
         if(root < t_min || t_max < root)
             return false;
     }
 
+    return true;
+}
+
+inline void set_sphere_hit(const point3 &center, real radius, const ray &r, real root, hit_record &rec){
     rec.t = root;
     rec.p = r.at(root);
+    rec.light = -1;
 
     vec3 outward_normal = (rec.p - center) / radius; // since the magnitude of (rec.p - center) is radius, as lies on surface
     rec.set_face_normal(r, outward_normal);
+}
 
-    rec.mat_ptr = mat_ptr;
+// where on the sphere rec.p is, for textures, u goes round from -x (through -z, then +x), and v up from the bottom,
+// a unit of distance on the surface is at most 1 / (pi * radius) of either
+inline void set_sphere_uv(const point3 &center, real radius, hit_record &rec){
+    const vec3 outward = (rec.p - center) / fabs(radius);
+    const real theta = std::acos(std::max(real(-1), std::min(real(1), -outward.y())));
+    const real phi = std::atan2(-outward.z(), outward.x()) + pi;
+    rec.u = phi / (2 * pi);
+    rec.v = theta / pi;
+    rec.uv_scale = 1 / (pi * fabs(radius));
+}
+
+bool sphere::hit(const ray &r, real t_min, real t_max, hit_record &rec) const {
+    real root;
+    if(!hit_sphere_root(center, radius, r, t_min, t_max, root))
+        return false;
+
+    set_sphere_hit(center, radius, r, root, rec);
+    rec.mat_ptr = mat_ptr.get();
+    if(rec.mat_ptr->textured()) set_sphere_uv(center, radius, rec);
 
     return true;
 }
 
+bool sphere::bounding_box(aabb &output_box) const {
+    // the radius can be negative (for the inside of hollow glass spheres), the box is the same either way
+    vec3 extent(fabs(radius), fabs(radius), fabs(radius));
+    output_box = aabb(center - extent, center + extent);
+    return true;
+}
 
 #endif // SPHERE_H
\ No newline at end of file
@@ -0,0 +1,366 @@
+#ifndef SPHERE_STORE_H
+#define SPHERE_STORE_H
+
+#include <algorithm>
+#include <vector>
+
+#include "bvh.h"
+#include "hittable.h"
+#include "material.h"
+#include "simd.h"
+#include "sphere.h"
+
+// every sphere in a scene packed into flat arrays, one per field (structure of arrays), rather than one heap object
+// each behind a shared_ptr - the spheres are reordered to match the leaves of a bvh_tree over them, so a leaf is a
+// contiguous run of each array, and the spheres in it are tested several at a time with SIMD
+class sphere_store : public hittable {
+public:
+    static constexpr int simd_width = simd_real::width; // spheres tested at once
+
+    sphere_store() = default;
+
+    // copies the material into the table, returning the index to give to add
+    int add_material(const material &mat);
+    void add(const point3 &center, real radius, int material_idx);
+    void reserve(size_t count);
+
+    // replaces every sphere with count copied from the arrays given, in that order, as loading a scene file does (the
+    // file holds doubles whatever real is, so they're rounded to it here)
+    void assign(size_t count, const double *x, const double *y, const double *z, const double *radii,
+                const int *material_indices);
+
+    // builds the tree over everything added so far, hit works without it, but has to test every sphere
+    void build();
+
+    // fits the tree's boxes to the spheres as they are now, which have to be in the tree's leaf order already
+    void refit();
+
+    size_t size() const { return sphere_count; }
+
+    bool hit(const ray &r, real t_min, real t_max, hit_record &rec) const override;
+    int hit_packet(const ray *rays, int count, real t_min, real t_max, hit_record *recs) const override;
+    bool occluded(const ray &r, real t_min, real t_max) const override;
+    bool bounding_box(aabb &output_box) const override;
+public:
+    // each array has simd_width - 1 unused entries on the end, so a full register can always be loaded from a leaf
+    std::vector<real> center_x{};
+    std::vector<real> center_y{};
+    std::vector<real> center_z{};
+    std::vector<real> radius{};
+    std::vector<int> material_idx{};
+
+    std::vector<material> materials{}; // hit records point into this, so it mustn't change while rendering
+    std::vector<int> light_idx{}; // each sphere's light in the scene's light_list (or -1), empty if none are lights
+    bvh_tree tree{};
+private:
+    size_t sphere_count{};
+
+    void resize(size_t count); // keeps the padding on the end of every array
+    point3 center(int idx) const { return { center_x[idx], center_y[idx], center_z[idx] }; }
+    aabb box(int idx) const;
+
+    // finds the closest sphere in [first, first + count) that r hits in [t_min, t_max], shrinking t_max to its root
+    bool hit_range(const ray &r, real t_min, real &t_max, int first, int count, int &hit_idx) const;
+
+    // the same for the rays of a packet in mask, each sphere is tested against all of them at once, t_max and
+    // hit_idx being per ray
+    void hit_range_packet(const ray_packet &packet, const ray *rays, int mask, real t_min, real *t_max,
+                          int first, int count, int *hit_idx) const;
+};
+
+int sphere_store::add_material(const material &mat) {
+    materials.push_back(mat);
+    return static_cast<int>(materials.size()) - 1;
+}
+
+void sphere_store::resize(size_t count) {
+    const size_t padded = count + simd_width - 1;
+    center_x.resize(padded);
+    center_y.resize(padded);
+    center_z.resize(padded);
+    radius.resize(padded);
+    material_idx.resize(padded);
+    sphere_count = count;
+}
+
+void sphere_store::add(const point3 &center, real radius, int material_idx) {
+    const size_t idx = sphere_count;
+    resize(sphere_count + 1);
+
+    center_x[idx] = center[0];
+    center_y[idx] = center[1];
+    center_z[idx] = center[2];
+    this->radius[idx] = radius;
+    this->material_idx[idx] = material_idx;
+    tree = bvh_tree{}; // anything built before no longer covers every sphere
+    light_idx.clear();
+}
+
+void sphere_store::reserve(size_t count) {
+    const size_t padded = count + simd_width - 1;
+    center_x.reserve(padded);
+    center_y.reserve(padded);
+    center_z.reserve(padded);
+    radius.reserve(padded);
+    material_idx.reserve(padded);
+}
+
+void sphere_store::assign(size_t count, const double *x, const double *y, const double *z, const double *radii,
+                          const int *material_indices) {
+    resize(0);
+    resize(count); // so the padding is zeroed too
+    std::copy(x, x + count, center_x.begin());
+    std::copy(y, y + count, center_y.begin());
+    std::copy(z, z + count, center_z.begin());
+    std::copy(radii, radii + count, radius.begin());
+    std::copy(material_indices, material_indices + count, material_idx.begin());
+    tree = bvh_tree{};
+    light_idx.clear();
+}
+
+// puts values in leaf order, one array at a time, so only one array is ever copied at once
+template<typename value_type>
+void reorder_by(std::vector<value_type> &values, const std::vector<int> &order) {
+    std::vector<value_type> old_values(values.begin(), values.begin() + order.size());
+    for(size_t i = 0; i < order.size(); i++)
+        values[i] = old_values[order[i]];
+}
+
+aabb sphere_store::box(int idx) const {
+    vec3 extent(fabs(radius[idx]), fabs(radius[idx]), fabs(radius[idx])); // negative radii are hollow spheres
+    return aabb(center(idx) - extent, center(idx) + extent);
+}
+
+void sphere_store::build() {
+    {
+        std::vector<aabb> boxes(sphere_count);
+        for(size_t i = 0; i < sphere_count; i++)
+            boxes[i] = box(static_cast<int>(i));
+
+        // leaves hold at least a register's worth of spheres, and a couple of registers at most, since testing a few
+        // extra spheres side by side costs less than visiting more nodes
+        tree.build(boxes, 2 * simd_width, simd_width);
+    } // the boxes are freed before the arrays are reordered, which keeps the peak memory use of building down
+
+    // then put the spheres in leaf order
+    reorder_by(center_x, tree.indices);
+    reorder_by(center_y, tree.indices);
+    reorder_by(center_z, tree.indices);
+    reorder_by(radius, tree.indices);
+    reorder_by(material_idx, tree.indices);
+    light_idx.clear(); // which are in a different order now
+}
+
+void sphere_store::refit() {
+    tree.refit([&](int idx){ return box(idx); });
+}
+
+bool sphere_store::hit(const ray &r, real t_min, real t_max, hit_record &rec) const {
+    int hit_idx = -1;
+    real closest = t_max;
+
+    if(tree.nodes.empty()){
+        hit_range(r, t_min, closest, 0, static_cast<int>(sphere_count), hit_idx);
+    }else{
+        tree.traverse(r, t_min, t_max, [&](int first, int count, real &closest_so_far){
+            if(!hit_range(r, t_min, closest_so_far, first, count, hit_idx)) return false;
+            closest = closest_so_far;
+            return true;
+        });
+    }
+
+    if(hit_idx < 0) return false;
+
+    // the hit record is only filled in once, for the sphere that ended up closest
+    set_sphere_hit(center(hit_idx), radius[hit_idx], r, closest, rec);
+    rec.mat_ptr = &materials[material_idx[hit_idx]];
+    if(rec.mat_ptr->textured()) set_sphere_uv(center(hit_idx), radius[hit_idx], rec);
+    if(!light_idx.empty()) rec.light = light_idx[hit_idx];
+    return true;
+}
+
+bool sphere_store::occluded(const ray &r, real t_min, real t_max) const {
+    // the closest hit in a leaf is found as hit finds it, it's only the leaves after the first hit that are skipped
+    int hit_idx = -1;
+    if(tree.nodes.empty()){
+        real closest = t_max;
+        return hit_range(r, t_min, closest, 0, static_cast<int>(sphere_count), hit_idx);
+    }
+    return tree.traverse_any(r, t_min, t_max, [&](int first, int count){
+        real closest = t_max;
+        return hit_range(r, t_min, closest, first, count, hit_idx);
+    });
+}
+
+int sphere_store::hit_packet(const ray *rays, int count, real t_min, real t_max, hit_record *recs) const {
+    const ray_packet packet(rays, count);
+    alignas(32) real closest[packet_size];
+    int hit_idx[packet_size];
+    for(int l = 0; l < packet_size; l++){
+        closest[l] = t_max;
+        hit_idx[l] = -1;
+    }
+
+    if(tree.nodes.empty()){
+        hit_range_packet(packet, rays, packet.active(), t_min, closest, 0, static_cast<int>(sphere_count), hit_idx);
+    }else{
+        tree.traverse_packet(packet, t_min, closest, [&](int first, int leaf_count, int mask){
+            hit_range_packet(packet, rays, mask, t_min, closest, first, leaf_count, hit_idx);
+        });
+    }
+
+    int hits = 0;
+    for(int l = 0; l < count; l++){
+        if(hit_idx[l] < 0) continue;
+        set_sphere_hit(center(hit_idx[l]), radius[hit_idx[l]], rays[l], closest[l], recs[l]);
+        recs[l].mat_ptr = &materials[material_idx[hit_idx[l]]];
+        if(recs[l].mat_ptr->textured()) set_sphere_uv(center(hit_idx[l]), radius[hit_idx[l]], recs[l]);
+        if(!light_idx.empty()) recs[l].light = light_idx[hit_idx[l]];
+        hits |= 1 << l;
+    }
+    return hits;
+}
+
+void sphere_store::hit_range_packet(const ray_packet &packet, const ray *rays, int mask, real t_min, real *t_max,
+                                    int first, int count, int *hit_idx) const {
+    const simd_real t_min_v = simd_set(t_min);
+    const simd_real zero = simd_set(0);
+
+    for(int i = first; i < first + count; i++){
+        const simd_real cx = simd_set(center_x[i]), cy = simd_set(center_y[i]), cz = simd_set(center_z[i]);
+        const simd_real rad = simd_set(radius[i]);
+
+        int candidates = 0;
+        for(int l = 0; l < packet_size; l += simd_real::width){
+            // the same steps as hit_sphere_root, in the same order, for several rays at once
+            const simd_real dx = simd_load(&packet.direction[0][l]);
+            const simd_real dy = simd_load(&packet.direction[1][l]);
+            const simd_real dz = simd_load(&packet.direction[2][l]);
+            const simd_real ocx = simd_load(&packet.origin[0][l]) - cx;
+            const simd_real ocy = simd_load(&packet.origin[1][l]) - cy;
+            const simd_real ocz = simd_load(&packet.origin[2][l]) - cz;
+            const simd_real a = simd_load(&packet.length_squared[l]);
+            const simd_real t_max_v = simd_load(&t_max[l]);
+
+            const simd_real b_half = dx*ocx + dy*ocy + dz*ocz;
+            const simd_real c = (ocx*ocx + ocy*ocy + ocz*ocz) - rad*rad;
+            const simd_real discriminant = b_half*b_half - a*c;
+
+            const simd_real sqrt_discriminant = simd_sqrt(discriminant);
+            const simd_real near_root = (-b_half - sqrt_discriminant) / a;
+            const simd_real far_root = (-b_half + sqrt_discriminant) / a;
+
+            const simd_mask near_ok = simd_ge(near_root, t_min_v) & simd_le(near_root, t_max_v);
+            const simd_mask far_ok = simd_ge(far_root, t_min_v) & simd_le(far_root, t_max_v);
+            candidates |= simd_bits(simd_ge(discriminant, zero) & (near_ok | far_ok)) << l;
+        }
+
+        // then each ray the kernel says hits is tested the scalar way, so the result is exactly what hit gives
+        candidates &= mask;
+        while(candidates){
+            const int l = __builtin_ctz(candidates);
+            candidates &= candidates - 1;
+
+            real root;
+            if(hit_sphere_root(center(i), radius[i], rays[l], t_min, t_max[l], root)){
+                t_max[l] = root;
+                hit_idx[l] = i;
+            }
+        }
+    }
+}
+
+bool sphere_store::hit_range(const ray &r, real t_min, real &t_max, int first, int count, int &hit_idx) const {
+    const int end = first + count;
+    bool hit_anything = false;
+
+    // the SIMD kernel picks out the closest sphere, then its root is worked out again by hit_sphere_root, so the
+    // result is exactly what sphere::hit would give
+    auto confirm = [&](int idx){
+        real root;
+        if(!hit_sphere_root(center(idx), radius[idx], r, t_min, t_max, root)) return false;
+
+        t_max = root;
+        hit_idx = idx;
+        hit_anything = true;
+        return true;
+    };
+
+    if(simd_width == 1){ // builds without SSE2/AVX, where there's nothing to gain from the kernel
+        for(int i = first; i < end; i++)
+            confirm(i);
+        return hit_anything;
+    }
+
+    const point3 o = r.origin();
+    const vec3 d = r.direction();
+    const simd_real ox = simd_set(o[0]), oy = simd_set(o[1]), oz = simd_set(o[2]);
+    const simd_real dx = simd_set(d[0]), dy = simd_set(d[1]), dz = simd_set(d[2]);
+    const simd_real a = simd_set(d.length_squared());
+    const simd_real t_min_v = simd_set(t_min);
+    const simd_real zero = simd_set(0);
+
+    for(int i = first; i < end; i += simd_width){
+        const simd_real t_max_v = simd_set(t_max);
+
+        // the same steps as hit_sphere_root, in the same order, for a register's worth of spheres at once
+        const simd_real ocx = ox - simd_loadu(&center_x[i]);
+        const simd_real ocy = oy - simd_loadu(&center_y[i]);
+        const simd_real ocz = oz - simd_loadu(&center_z[i]);
+        const simd_real rad = simd_loadu(&radius[i]);
+
+        const simd_real b_half = dx*ocx + dy*ocy + dz*ocz;
+        const simd_real c = (ocx*ocx + ocy*ocy + ocz*ocz) - rad*rad;
+        const simd_real discriminant = b_half*b_half - a*c;
+
+        const simd_real sqrt_discriminant = simd_sqrt(discriminant);
+        const simd_real near_root = (-b_half - sqrt_discriminant) / a;
+        const simd_real far_root = (-b_half + sqrt_discriminant) / a;
+
+        const simd_mask near_ok = simd_ge(near_root, t_min_v) & simd_le(near_root, t_max_v);
+        const simd_mask far_ok = simd_ge(far_root, t_min_v) & simd_le(far_root, t_max_v);
+        int mask = simd_bits(simd_ge(discriminant, zero) & (near_ok | far_ok));
+        if(end - i < simd_width) mask &= (1 << (end - i)) - 1; // the lanes past the end of the range
+        if(mask == 0) continue;
+
+        alignas(32) real roots[simd_width];
+        simd_store(roots, simd_select(near_ok, near_root, far_root));
+
+        // ties go to the later sphere, the same as testing them one after another
+        int closest = -1;
+        real closest_root = t_max;
+        for(int l = 0; l < simd_width; l++){
+            if((mask & (1 << l)) && roots[l] <= closest_root){
+                closest = l;
+                closest_root = roots[l];
+            }
+        }
+        if(closest < 0) continue;
+
+        // that can only disagree with the kernel if the compiler fused the scalar maths differently (say, into FMAs)
+        // and the ray only just grazes the sphere, in which case every lane that hit is tested the scalar way instead
+        if(!confirm(i + closest)){
+            for(int l = 0; l < simd_width; l++)
+                if(mask & (1 << l)) confirm(i + l);
+        }
+    }
+
+    return hit_anything;
+}
+
+bool sphere_store::bounding_box(aabb &output_box) const {
+    if(sphere_count == 0) return false;
+
+    if(!tree.nodes.empty()){
+        output_box = tree.bounds();
+        return true;
+    }
+
+    aabb bounds{};
+    for(size_t i = 0; i < sphere_count; i++)
+        bounds.expand(box(static_cast<int>(i)));
+    output_box = bounds;
+    return true;
+}
+
+#endif // SPHERE_STORE_H
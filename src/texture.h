@@ -0,0 +1,604 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "helper.h"
+
+class texture_cache;
+
+// texels along a side of a tile, the unit textures are stored, loaded, kept and evicted in - a tile is 12 KB of 8 bit
+// texels, or 48 KB of float ones
+const int texture_tile_size = 64;
+
+// an 8 bit texel value as linear, the images are gamma 2 like the ones the renderer writes, and back again
+inline float linear_from_byte(unsigned char value){
+    const float v = value / 255.0f;
+    return v * v;
+}
+inline unsigned char byte_from_linear(float value){
+    return static_cast<unsigned char>(std::min(255.0f, std::sqrt(std::max(0.0f, value)) * 255 + 0.5f));
+}
+
+// texels are 3 bytes, or 3 floats in this machine's byte order
+inline void decode_texel(const unsigned char *texel, bool is_float, float rgb[3]){
+    if(is_float){
+        std::memcpy(rgb, texel, 3 * sizeof(float));
+    }else{
+        for(int c = 0; c < 3; c++) rgb[c] = linear_from_byte(texel[c]);
+    }
+}
+inline void encode_texel(const float rgb[3], bool is_float, unsigned char *texel){
+    if(is_float){
+        std::memcpy(texel, rgb, 3 * sizeof(float));
+    }else{
+        for(int c = 0; c < 3; c++) texel[c] = byte_from_linear(rgb[c]);
+    }
+}
+
+// a square of texels from one level of a texture, the top row first, as it is in the tiled file - the tiles along the
+// right and bottom edges of a level are padded out to the full size, and the padding never looked at
+struct texture_tile {
+    bool is_float{};
+    std::vector<unsigned char> data{};
+
+    colour texel(int x, int y) const {
+        const size_t texel_bytes = is_float ? 3 * sizeof(float) : 3;
+        float rgb[3];
+        decode_texel(&data[texel_bytes * (static_cast<size_t>(y) * texture_tile_size + x)], is_float, rgb);
+        return { rgb[0], rgb[1], rgb[2] };
+    }
+    size_t bytes() const { return sizeof(texture_tile) + data.capacity(); }
+};
+
+// an image as a texture_cache reads it, a tile at a time as they're needed - the image is a binary PPM (P6, 8 bit) or
+// a PFM, which is made into a tiled file beside it (the image's name with .tiles on the end) the first time it's
+// opened, or whenever the image has changed since, holding every level of its mip map, each a tile after another in
+// rows, so any tile of any level is one read - no level is ever in memory as a whole, making it or rendering with it
+//
+// textures repeat, u goes left to right and v bottom to top, and lookups filter trilinearly, between the two levels
+// whose texels are closest to the size of the footprint asked for
+class texture {
+public:
+    texture() = default;
+    texture(const texture &) = delete;
+    texture &operator=(const texture &) = delete;
+    ~texture() { if(fd >= 0) close(fd); }
+
+    // the colour at u, v, averaged over a footprint about width wide (in uv units), 0 for the finest level's texels
+    colour sample(real u, real v, real width) const;
+
+    int width() const { return level_width[0]; }
+    int height() const { return level_height[0]; }
+    int levels() const { return static_cast<int>(level_width.size()); }
+
+    int tiles_across(int level) const { return (level_width[level] + texture_tile_size - 1) / texture_tile_size; }
+    int tiles_down(int level) const { return (level_height[level] + texture_tile_size - 1) / texture_tile_size; }
+private:
+    friend class texture_cache;
+
+    const texture_cache *cache{};
+    int id{};
+    int fd{-1}; // the tiled file's
+    bool is_float{}; // from a PFM, rather than a PPM
+    std::vector<int> level_width{}; // each level is half the size of the one before, rounded up, down to 1 by 1
+    std::vector<int> level_height{};
+    std::vector<uint64_t> level_offset{}; // where each level's tiles start in the tiled file
+
+    size_t tile_bytes() const {
+        return (is_float ? 3 * sizeof(float) : 3) * static_cast<size_t>(texture_tile_size) * texture_tile_size;
+    }
+    uint64_t tile_offset(int level, int tx, int ty) const {
+        return level_offset[level] + tile_bytes() * (static_cast<uint64_t>(ty) * tiles_across(level) + tx);
+    }
+
+    // the texel at x, y of level, wrapping round both ways
+    colour texel(int level, int x, int y) const;
+    colour bilinear(int level, real u, real v) const;
+};
+
+// what a texture_cache has done so far, summed over every shard
+struct texture_cache_stats {
+    uint64_t lookups{}; // tiles asked of the shared cache, by threads which didn't have them to hand
+    uint64_t hits{}; // of those, the tiles that were already in it
+    uint64_t tiles_loaded{};
+    uint64_t bytes_loaded{};
+    uint64_t evictions{};
+    uint64_t bytes_held{}; // by the cache now (threads can still be using a few tiles it's since let go of)
+    uint64_t read_errors{}; // tiles that couldn't be read from their file, which are black
+
+    double hit_rate() const { return lookups > 0 ? static_cast<double>(hits) / lookups : 0; }
+};
+
+// every texture of a scene, and the tiles of them loaded so far, kept within a memory budget by evicting whichever
+// tiles were used least recently - render threads look tiles up concurrently, so the tiles are spread over shards by
+// a hash of their key, each with its own lock, list in order of use and share of the budget, and each thread keeps
+// the last few tiles it used to hand (which most lookups find, neighbouring texels sharing tiles), only going to the
+// shared cache, and taking a shard's lock, for one it doesn't have
+//
+// a tile is loaded without holding any lock, so a slow read never holds up other threads, and if two threads load
+// the same tile at once, the first to finish is kept - a tile's texels only ever depend on its file, so an image is
+// the same whatever the budget, and whatever's been evicted along the way
+class texture_cache {
+public:
+    static constexpr size_t default_budget = size_t(256) << 20;
+    static const int shard_count = 16;
+
+    explicit texture_cache(size_t budget_bytes = default_budget);
+    texture_cache(const texture_cache &) = delete;
+    texture_cache &operator=(const texture_cache &) = delete;
+
+    // opens the image at path, making its tiled file first if it's missing or older than the image, returning the
+    // index to give get, or -1 with error set
+    int open(const std::string &path, std::string &error);
+
+    const texture &get(int idx) const { return *textures[idx]; }
+    size_t size() const { return textures.size(); }
+
+    // the most the tiles held can take (though each shard always keeps the tile it last loaded), shrinking it evicts
+    // tiles as they're next loaded, rather than straight away
+    void set_budget(size_t bytes) { budget = bytes; }
+    size_t get_budget() const { return budget; }
+
+    texture_cache_stats stats() const;
+
+    // the tile at tx, ty of level of tex, from this thread's last few tiles if it's one of them
+    const texture_tile &tile(const texture &tex, int level, int tx, int ty) const;
+private:
+    struct entry {
+        std::shared_ptr<const texture_tile> tile{};
+        std::list<uint64_t>::iterator position{}; // in the shard's list, the most recently used at the front
+    };
+
+    // the last few tiles a thread used, replaced in turn, holding on to them keeps them alive if the shared cache
+    // evicts them, so each thread can have up to this many tiles on top of the budget
+    struct recent_tiles {
+        static const int count = 8;
+        uint64_t cache_id[count]{};
+        uint64_t key[count]{};
+        std::shared_ptr<const texture_tile> tile[count]{};
+        int next{};
+    };
+
+    struct shard {
+        std::mutex lock{};
+        std::unordered_map<uint64_t, entry> tiles{};
+        std::list<uint64_t> recency{};
+        size_t bytes{};
+        texture_cache_stats counts{};
+    };
+
+    // the start of a tiled file, in this machine's byte order (it's only ever a copy of the image made here), the
+    // image's size and modification time being what it was made from, so it's made again if the image changes
+    struct tiled_header {
+        char magic[8];
+        uint64_t image_size;
+        int64_t image_time;
+        int32_t width;
+        int32_t height;
+        int32_t is_float;
+        int32_t tile_size;
+    };
+    static const int tiled_data_offset = 64; // where the first tile starts, after the header
+    static_assert(sizeof(tiled_header) <= tiled_data_offset, "the tiled file's header has to fit before the tiles");
+
+    // the texels of a PPM or PFM, and how to find them
+    struct source_image {
+        int fd{-1};
+        bool is_float{};
+        uint64_t data_offset{};
+        int width{};
+        int height{};
+        ~source_image() { if(fd >= 0) close(fd); }
+    };
+
+    std::vector<std::unique_ptr<texture>> textures{};
+    std::unique_ptr<shard[]> shards;
+    std::atomic<size_t> budget;
+    uint64_t id; // unique among every cache there's been, so a thread's tiles from one are never taken for another's
+
+    static uint64_t key(int texture_id, int level, int tx, int ty){
+        return static_cast<uint64_t>(texture_id) << 48 | static_cast<uint64_t>(level) << 42
+               | static_cast<uint64_t>(ty) << 21 | static_cast<uint64_t>(tx);
+    }
+    shard &shard_for(uint64_t tile_key) const {
+        return shards[(tile_key * 0x9e3779b97f4a7c15ull) >> 60]; // the top 4 bits, for 16 shards
+    }
+
+    static bool read_image_header(const std::string &path, source_image &image, std::string &error);
+
+    // writes every level of tex's mip map to its tiled file, a row of tiles at a time, the finest level from the
+    // image and each after that from the two rows of tiles under each of its rows, read back out of the file
+    static bool make_tiles(const source_image &image, const texture &tex, const std::string &tiled_path,
+                           const tiled_header &header, std::string &error);
+
+    // the tile from the shared cache, loading it if it isn't there
+    std::shared_ptr<const texture_tile> fetch(const texture &tex, int level, int tx, int ty) const;
+    std::shared_ptr<const texture_tile> load(const texture &tex, int level, int tx, int ty, bool &read_error) const;
+};
+
+texture_cache::texture_cache(size_t budget_bytes)
+    : shards(new shard[shard_count]), budget(budget_bytes) {
+    static std::atomic<uint64_t> next_id{1};
+    id = next_id++;
+}
+
+// pread and pwrite until all of size is done, which they needn't do in one go
+inline bool read_fully(int fd, void *out, size_t size, uint64_t offset){
+    char *to = static_cast<char *>(out);
+    while(size > 0){
+        const ssize_t done = pread(fd, to, size, static_cast<off_t>(offset));
+        if(done <= 0) return false;
+        to += done;
+        size -= done;
+        offset += done;
+    }
+    return true;
+}
+inline bool write_fully(int fd, const void *in, size_t size, uint64_t offset){
+    const char *from = static_cast<const char *>(in);
+    while(size > 0){
+        const ssize_t done = pwrite(fd, from, size, static_cast<off_t>(offset));
+        if(done <= 0) return false;
+        from += done;
+        size -= done;
+        offset += done;
+    }
+    return true;
+}
+
+// reads a whitespace separated word of a PPM or PFM header, skipping comments, pos is left on the character after it
+inline bool read_header_word(const char *header, size_t size, size_t &pos, std::string &word){
+    while(pos < size){
+        if(header[pos] == '#'){
+            while(pos < size && header[pos] != '\n') pos++;
+        }else if(header[pos] == ' ' || header[pos] == '\t' || header[pos] == '\n' || header[pos] == '\r'){
+            pos++;
+        }else{
+            break;
+        }
+    }
+    const size_t start = pos;
+    while(pos < size && !(header[pos] == ' ' || header[pos] == '\t' || header[pos] == '\n' || header[pos] == '\r'))
+        pos++;
+    word.assign(header + start, pos - start);
+    return pos < size && pos > start;
+}
+
+bool texture_cache::read_image_header(const std::string &path, source_image &image, std::string &error) {
+    image.fd = ::open(path.c_str(), O_RDONLY);
+    if(image.fd < 0){
+        error = "couldn't open " + path;
+        return false;
+    }
+
+    char header[512];
+    const ssize_t read_bytes = pread(image.fd, header, sizeof(header), 0);
+    size_t pos = 0;
+    std::string magic{}, width_word{}, height_word{}, scale_word{};
+    if(read_bytes <= 0 || !read_header_word(header, read_bytes, pos, magic) || (magic != "P6" && magic != "PF")
+       || !read_header_word(header, read_bytes, pos, width_word)
+       || !read_header_word(header, read_bytes, pos, height_word)
+       || !read_header_word(header, read_bytes, pos, scale_word)){
+        error = path + " isn't a binary PPM (P6) or colour PFM";
+        return false;
+    }
+    image.is_float = magic == "PF";
+    image.data_offset = pos + 1; // a single whitespace ends the header
+
+    const long width = std::strtol(width_word.c_str(), nullptr, 10);
+    const long height = std::strtol(height_word.c_str(), nullptr, 10);
+    const double scale = std::strtod(scale_word.c_str(), nullptr);
+    const uint16_t probe = 1;
+    const bool little_endian = *reinterpret_cast<const unsigned char *>(&probe) == 1;
+    if(width < 1 || height < 1 || width > (1 << 24) || height > (1 << 24)){
+        error = path + " has a size out of range";
+        return false;
+    }
+    if(!image.is_float && scale != 255){
+        error = path + " isn't an 8 bit PPM (its maximum value has to be 255)";
+        return false;
+    }
+    if(image.is_float && (scale < 0) != little_endian){
+        error = path + " is in the other byte order";
+        return false;
+    }
+    image.width = static_cast<int>(width);
+    image.height = static_cast<int>(height);
+
+    struct stat file_info{};
+    const uint64_t texel_bytes = image.is_float ? 3 * sizeof(float) : 3;
+    if(fstat(image.fd, &file_info) != 0
+       || static_cast<uint64_t>(file_info.st_size) < image.data_offset + texel_bytes * width * height){
+        error = path + " is truncated";
+        return false;
+    }
+    return true;
+}
+
+int texture_cache::open(const std::string &path, std::string &error) {
+    if(textures.size() >= (1 << 15)){
+        error = "there can't be more than 32768 textures";
+        return -1;
+    }
+    source_image image{};
+    if(!read_image_header(path, image, error)) return -1;
+
+    std::unique_ptr<texture> tex(new texture());
+    tex->is_float = image.is_float;
+    int w = image.width, h = image.height;
+    uint64_t offset = tiled_data_offset;
+    while(true){
+        tex->level_width.push_back(w);
+        tex->level_height.push_back(h);
+        tex->level_offset.push_back(offset);
+        const int level = tex->levels() - 1;
+        offset += tex->tile_bytes() * tex->tiles_across(level) * tex->tiles_down(level);
+        if(w == 1 && h == 1) break;
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+
+    struct stat image_info{};
+    fstat(image.fd, &image_info);
+    tiled_header expected{};
+    std::memcpy(expected.magic, "RTTILES1", sizeof(expected.magic));
+    expected.image_size = static_cast<uint64_t>(image_info.st_size);
+    expected.image_time = static_cast<int64_t>(image_info.st_mtime);
+    expected.width = image.width;
+    expected.height = image.height;
+    expected.is_float = image.is_float;
+    expected.tile_size = texture_tile_size;
+
+    // the tiled file's used if it's whole, and was made from the image as it is now
+    const std::string tiled_path = path + ".tiles";
+    tex->fd = ::open(tiled_path.c_str(), O_RDONLY);
+    tiled_header found{};
+    struct stat tiled_info{};
+    if(tex->fd >= 0 && (!read_fully(tex->fd, &found, sizeof(found), 0) || std::memcmp(&found, &expected, sizeof(found))
+                        || fstat(tex->fd, &tiled_info) != 0 || static_cast<uint64_t>(tiled_info.st_size) != offset)){
+        close(tex->fd);
+        tex->fd = -1;
+    }
+    if(tex->fd < 0){
+        if(!make_tiles(image, *tex, tiled_path, expected, error)) return -1;
+        tex->fd = ::open(tiled_path.c_str(), O_RDONLY);
+        if(tex->fd < 0){
+            error = "couldn't open " + tiled_path;
+            return -1;
+        }
+    }
+
+    tex->cache = this;
+    tex->id = static_cast<int>(textures.size());
+    textures.push_back(std::move(tex));
+    return static_cast<int>(textures.size()) - 1;
+}
+
+bool texture_cache::make_tiles(const source_image &image, const texture &tex, const std::string &tiled_path,
+                               const tiled_header &header, std::string &error) {
+    // written under a name of its own, and renamed once it's whole, so a reader never sees half of one
+    const std::string partial_path = tiled_path + "." + std::to_string(static_cast<long>(getpid())) + ".partial";
+    const int out = ::open(partial_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(out < 0){
+        error = "couldn't write " + partial_path + " (textures are tiled into a file beside their image)";
+        return false;
+    }
+    const size_t texel_bytes = image.is_float ? 3 * sizeof(float) : 3;
+    const size_t tile_bytes = tex.tile_bytes();
+    std::vector<unsigned char> tile(tile_bytes);
+    bool ok = true;
+
+    // the finest level, each row of tiles from that many rows of the image, PPMs have the top row first and PFMs the
+    // bottom
+    const int width = image.width, height = image.height;
+    std::vector<unsigned char> band(texel_bytes * width * texture_tile_size);
+    for(int ty = 0; ok && ty < tex.tiles_down(0); ty++){
+        const int rows = std::min(texture_tile_size, height - ty * texture_tile_size);
+        for(int y = 0; ok && y < rows; y++){
+            const int row = ty * texture_tile_size + y;
+            const int file_row = image.is_float ? height - 1 - row : row;
+            ok = read_fully(image.fd, &band[texel_bytes * width * y], texel_bytes * width,
+                            image.data_offset + texel_bytes * static_cast<uint64_t>(file_row) * width);
+        }
+        for(int tx = 0; ok && tx < tex.tiles_across(0); tx++){
+            std::fill(tile.begin(), tile.end(), 0);
+            const int columns = std::min(texture_tile_size, width - tx * texture_tile_size);
+            for(int y = 0; y < rows; y++)
+                std::memcpy(&tile[texel_bytes * texture_tile_size * y],
+                            &band[texel_bytes * (static_cast<size_t>(width) * y + tx * texture_tile_size)],
+                            texel_bytes * columns);
+            ok = write_fully(out, tile.data(), tile_bytes, tex.tile_offset(0, tx, ty));
+        }
+    }
+
+    // every coarser level, each texel the average of the 2 by 2 under it (in linear), the texel past the edge of a
+    // level of odd size being the one on the edge again
+    for(int level = 1; ok && level < tex.levels(); level++){
+        const int below_width = tex.level_width[level - 1], below_height = tex.level_height[level - 1];
+        const int below_across = tex.tiles_across(level - 1);
+        std::vector<unsigned char> below(2 * tile_bytes * below_across);
+        for(int ty = 0; ok && ty < tex.tiles_down(level); ty++){
+            // a level's tiles are in rows, so the two rows under this one are together in the file
+            const int below_rows = std::min(2, tex.tiles_down(level - 1) - 2 * ty);
+            ok = read_fully(out, below.data(), tile_bytes * below_across * below_rows,
+                            tex.tile_offset(level - 1, 0, 2 * ty));
+            auto add_below = [&](int x, int y, float sum[3]){
+                x = std::min(x, below_width - 1);
+                y = std::min(y, below_height - 1);
+                const size_t t = static_cast<size_t>(y / texture_tile_size - 2 * ty) * below_across
+                                 + x / texture_tile_size;
+                const size_t i = static_cast<size_t>(y % texture_tile_size) * texture_tile_size + x % texture_tile_size;
+                float rgb[3];
+                decode_texel(&below[t * tile_bytes + i * texel_bytes], image.is_float, rgb);
+                for(int c = 0; c < 3; c++) sum[c] += rgb[c];
+            };
+            for(int tx = 0; ok && tx < tex.tiles_across(level); tx++){
+                std::fill(tile.begin(), tile.end(), 0);
+                const int columns = std::min(texture_tile_size, tex.level_width[level] - tx * texture_tile_size);
+                const int rows = std::min(texture_tile_size, tex.level_height[level] - ty * texture_tile_size);
+                for(int y = 0; y < rows; y++){
+                    for(int x = 0; x < columns; x++){
+                        const int bx = 2 * (tx * texture_tile_size + x), by = 2 * (ty * texture_tile_size + y);
+                        float sum[3] = { 0, 0, 0 };
+                        add_below(bx, by, sum);
+                        add_below(bx + 1, by, sum);
+                        add_below(bx, by + 1, sum);
+                        add_below(bx + 1, by + 1, sum);
+                        for(int c = 0; c < 3; c++) sum[c] /= 4;
+                        encode_texel(sum, image.is_float,
+                                     &tile[texel_bytes * (static_cast<size_t>(y) * texture_tile_size + x)]);
+                    }
+                }
+                ok = write_fully(out, tile.data(), tile_bytes, tex.tile_offset(level, tx, ty));
+            }
+        }
+    }
+
+    // the header last, so a file that was never finished doesn't match
+    ok = ok && write_fully(out, &header, sizeof(header), 0);
+    ok = close(out) == 0 && ok;
+    if(!ok || std::rename(partial_path.c_str(), tiled_path.c_str()) != 0){
+        std::remove(partial_path.c_str());
+        error = "couldn't make " + tiled_path;
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const texture_tile> texture_cache::load(const texture &tex, int level, int tx, int ty,
+                                                        bool &read_error) const {
+    std::shared_ptr<texture_tile> out(new texture_tile());
+    out->is_float = tex.is_float;
+    out->data.resize(tex.tile_bytes());
+    read_error = !read_fully(tex.fd, out->data.data(), out->data.size(), tex.tile_offset(level, tx, ty));
+    if(read_error) std::fill(out->data.begin(), out->data.end(), 0); // left black
+    return out;
+}
+
+std::shared_ptr<const texture_tile> texture_cache::fetch(const texture &tex, int level, int tx, int ty) const {
+    const uint64_t tile_key = key(tex.id, level, tx, ty);
+    shard &s = shard_for(tile_key);
+    {
+        std::lock_guard<std::mutex> guard(s.lock);
+        s.counts.lookups++;
+        auto found = s.tiles.find(tile_key);
+        if(found != s.tiles.end()){
+            s.counts.hits++;
+            s.recency.splice(s.recency.begin(), s.recency, found->second.position);
+            return found->second.tile;
+        }
+    }
+
+    bool read_error;
+    std::shared_ptr<const texture_tile> loaded = load(tex, level, tx, ty, read_error);
+
+    std::lock_guard<std::mutex> guard(s.lock);
+    auto found = s.tiles.find(tile_key);
+    if(found != s.tiles.end()) return found->second.tile; // another thread loaded it first
+
+    s.counts.tiles_loaded++;
+    s.counts.bytes_loaded += loaded->bytes();
+    s.counts.read_errors += read_error;
+    s.recency.push_front(tile_key);
+    entry &added = s.tiles[tile_key];
+    added.tile = loaded;
+    added.position = s.recency.begin();
+    s.bytes += loaded->bytes();
+
+    // the least recently used go until the shard's within its share of the budget, apart from the tile just loaded
+    const size_t share = budget / shard_count;
+    while(s.bytes > share && s.recency.size() > 1){
+        auto oldest = s.tiles.find(s.recency.back());
+        s.bytes -= oldest->second.tile->bytes();
+        s.tiles.erase(oldest);
+        s.recency.pop_back();
+        s.counts.evictions++;
+    }
+    return loaded;
+}
+
+const texture_tile &texture_cache::tile(const texture &tex, int level, int tx, int ty) const {
+    static thread_local recent_tiles recent{};
+
+    const uint64_t tile_key = key(tex.id, level, tx, ty);
+    for(int i = 0; i < recent_tiles::count; i++)
+        if(recent.key[i] == tile_key && recent.cache_id[i] == id) return *recent.tile[i];
+
+    const int slot = recent.next;
+    recent.next = (recent.next + 1) % recent_tiles::count;
+    recent.tile[slot] = fetch(tex, level, tx, ty);
+    recent.cache_id[slot] = id;
+    recent.key[slot] = tile_key;
+    return *recent.tile[slot];
+}
+
+texture_cache_stats texture_cache::stats() const {
+    texture_cache_stats total{};
+    for(int i = 0; i < shard_count; i++){
+        std::lock_guard<std::mutex> guard(shards[i].lock);
+        const texture_cache_stats &counts = shards[i].counts;
+        total.lookups += counts.lookups;
+        total.hits += counts.hits;
+        total.tiles_loaded += counts.tiles_loaded;
+        total.bytes_loaded += counts.bytes_loaded;
+        total.evictions += counts.evictions;
+        total.read_errors += counts.read_errors;
+        total.bytes_held += shards[i].bytes;
+    }
+    return total;
+}
+
+colour texture::texel(int level, int x, int y) const {
+    const int w = level_width[level], h = level_height[level];
+    x %= w;
+    y %= h;
+    if(x < 0) x += w;
+    if(y < 0) y += h;
+    const texture_tile &t = cache->tile(*this, level, x / texture_tile_size, y / texture_tile_size);
+    return t.texel(x % texture_tile_size, y % texture_tile_size);
+}
+
+colour texture::bilinear(int level, real u, real v) const {
+    // texel centres are at half integers, so the four around the point are weighted by how close it is to each
+    const real x = u * level_width[level] - real(0.5);
+    const real y = (1 - v) * level_height[level] - real(0.5);
+    const real fx = std::floor(x), fy = std::floor(y);
+    const int x0 = static_cast<int>(fx), y0 = static_cast<int>(fy);
+    const real wx = x - fx, wy = y - fy;
+    return (1 - wy) * ((1 - wx) * texel(level, x0, y0) + wx * texel(level, x0 + 1, y0))
+           + wy * ((1 - wx) * texel(level, x0, y0 + 1) + wx * texel(level, x0 + 1, y0 + 1));
+}
+
+colour texture::sample(real u, real v, real width) const {
+    u -= std::floor(u);
+    v -= std::floor(v);
+
+    // the level whose texels are as wide as the footprint, the finest for a footprint narrower than a texel there
+    const int last = levels() - 1;
+    const real texels = width * std::max(level_width[0], level_height[0]);
+    if(!(texels > 1)) return bilinear(0, u, v); // written so a NaN goes this way too
+    const real lod = std::min(static_cast<real>(last), std::log2(texels));
+    const int level = static_cast<int>(lod);
+    const real blend = lod - level;
+    if(level == last || blend <= 0) return bilinear(level, u, v);
+    return (1 - blend) * bilinear(level, u, v) + blend * bilinear(level + 1, u, v);
+}
+
+#endif // TEXTURE_H
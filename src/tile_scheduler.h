@@ -0,0 +1,91 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct tile {
+    int x0{}, y0{}; // inclusive top left corner of the tile (in image rows, so y0 is the lower row)
+    int x1{}, y1{}; // exclusive bottom right corner
+    int index{}; // position of the tile in scanline order, used to seed/identify the tile independent of threads
+};
+
+inline std::vector<tile> make_tiles(int width, int height, int tile_size){
+    std::vector<tile> tiles{};
+
+    int index = 0;
+    for(int y = 0; y < height; y += tile_size){
+        for(int x = 0; x < width; x += tile_size){
+            tile t{};
+            t.x0 = x;
+            t.y0 = y;
+            t.x1 = std::min(x + tile_size, width);
+            t.y1 = std::min(y + tile_size, height);
+            t.index = index++;
+            tiles.push_back(t);
+        }
+    }
+
+    return tiles;
+}
+
+// hands tiles out to worker threads, each worker gets a contiguous run of tiles in its own queue (so neighbouring
+// tiles, which usually cost about the same, stay on the same thread), and once a worker runs dry it steals from the
+// back of another worker's queue, so expensive regions of the image get spread over every thread
+class tile_scheduler {
+public:
+    tile_scheduler(const std::vector<tile> &tiles, int num_workers);
+
+    bool next(int worker, tile &out); // false once every queue is empty
+private:
+    struct worker_queue {
+        std::mutex lock{};
+        std::deque<tile> tiles{};
+    };
+
+    std::vector<std::unique_ptr<worker_queue>> queues{};
+};
+
+tile_scheduler::tile_scheduler(const std::vector<tile> &tiles, int num_workers) {
+    num_workers = std::max(num_workers, 1);
+    for(int w = 0; w < num_workers; w++)
+        queues.emplace_back(new worker_queue{});
+
+    const size_t count = tiles.size();
+    for(int w = 0; w < num_workers; w++){
+        size_t begin = count * w / num_workers;
+        size_t end = count * (w + 1) / num_workers;
+        queues[w]->tiles.assign(tiles.begin() + begin, tiles.begin() + end);
+    }
+}
+
+bool tile_scheduler::next(int worker, tile &out) {
+    { // own queue first, taken from the front
+        worker_queue &own = *queues[worker];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if(!own.tiles.empty()){
+            out = own.tiles.front();
+            own.tiles.pop_front();
+            return true;
+        }
+    }
+
+    // then steal from the back of everyone else's, which is the work the owner would get to last
+    const int num_workers = static_cast<int>(queues.size());
+    for(int offset = 1; offset < num_workers; offset++){
+        worker_queue &victim = *queues[(worker + offset) % num_workers];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if(!victim.tiles.empty()){
+            out = victim.tiles.back();
+            victim.tiles.pop_back();
+            return true;
+        }
+    }
+
+    return false; // nothing is ever added once rendering starts, so empty everywhere means done
+}
+
+#endif // TILE_SCHEDULER_H
@@ -0,0 +1,133 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <cmath>
+
+#include "helper.h"
+
+#include "aabb.h"
+
+// an affine transform, a 3x3 linear part (rotation, scale, shear) then a translation, stored as the top 3 rows of the
+// 4x4 matrix (the last row is always 0 0 0 1)
+struct transform {
+    real m[3][4]{ { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 } };
+
+    static transform translate(const vec3 &offset);
+    static transform scale(const vec3 &factors);
+    static transform rotate(const vec3 &axis, double degrees); // right handed, about an axis through the origin
+
+    point3 apply_point(const point3 &p) const {
+        return {
+            m[0][0] * p[0] + m[0][1] * p[1] + m[0][2] * p[2] + m[0][3],
+            m[1][0] * p[0] + m[1][1] * p[1] + m[1][2] * p[2] + m[1][3],
+            m[2][0] * p[0] + m[2][1] * p[1] + m[2][2] * p[2] + m[2][3]
+        };
+    }
+
+    vec3 apply_vector(const vec3 &v) const {
+        return {
+            m[0][0] * v[0] + m[0][1] * v[1] + m[0][2] * v[2],
+            m[1][0] * v[0] + m[1][1] * v[1] + m[1][2] * v[2],
+            m[2][0] * v[0] + m[2][1] * v[1] + m[2][2] * v[2]
+        };
+    }
+
+    // normals go through the inverse transpose, so called on the inverse transform, this multiplies by its transpose
+    vec3 apply_normal_of_inverse(const vec3 &n) const {
+        return {
+            m[0][0] * n[0] + m[1][0] * n[1] + m[2][0] * n[2],
+            m[0][1] * n[0] + m[1][1] * n[1] + m[2][1] * n[2],
+            m[0][2] * n[0] + m[1][2] * n[1] + m[2][2] * n[2]
+        };
+    }
+
+    aabb apply_box(const aabb &box) const;
+
+    // false (leaving out as it was) if the linear part is singular, say a scale of 0
+    bool inverse(transform &out) const;
+};
+
+// a then b, so (b * a).apply_point(p) is b.apply_point(a.apply_point(p))
+inline transform operator*(const transform &b, const transform &a){
+    transform out{};
+    for(int r = 0; r < 3; r++){
+        for(int c = 0; c < 4; c++){
+            real value = c == 3 ? b.m[r][3] : 0;
+            for(int k = 0; k < 3; k++) value += b.m[r][k] * a.m[k][c];
+            out.m[r][c] = value;
+        }
+    }
+    return out;
+}
+
+transform transform::translate(const vec3 &offset) {
+    transform t{};
+    for(int r = 0; r < 3; r++) t.m[r][3] = offset[r];
+    return t;
+}
+
+transform transform::scale(const vec3 &factors) {
+    transform t{};
+    for(int r = 0; r < 3; r++) t.m[r][r] = factors[r];
+    return t;
+}
+
+transform transform::rotate(const vec3 &axis, double degrees) {
+    // Rodrigues' rotation formula, as a matrix
+    const vec3 a = unit_vector(axis);
+    const real c = std::cos(deg_to_rads(degrees)), s = std::sin(deg_to_rads(degrees));
+    const real k = 1 - c;
+
+    transform t{};
+    t.m[0][0] = a[0] * a[0] * k + c;        t.m[0][1] = a[0] * a[1] * k - a[2] * s; t.m[0][2] = a[0] * a[2] * k + a[1] * s;
+    t.m[1][0] = a[1] * a[0] * k + a[2] * s; t.m[1][1] = a[1] * a[1] * k + c;        t.m[1][2] = a[1] * a[2] * k - a[0] * s;
+    t.m[2][0] = a[2] * a[0] * k - a[1] * s; t.m[2][1] = a[2] * a[1] * k + a[0] * s; t.m[2][2] = a[2] * a[2] * k + c;
+    return t;
+}
+
+aabb transform::apply_box(const aabb &box) const {
+    // Arvo's method, each row of the linear part stretches the box along that axis by whichever end of each of the
+    // box's extents makes it smallest or largest, which is the box around all 8 transformed corners
+    aabb out{};
+    for(int r = 0; r < 3; r++){
+        real low = m[r][3], high = m[r][3];
+        for(int c = 0; c < 3; c++){
+            const real a = m[r][c] * box.minimum[c];
+            const real b = m[r][c] * box.maximum[c];
+            low += std::min(a, b);
+            high += std::max(a, b);
+        }
+        out.minimum[r] = low;
+        out.maximum[r] = high;
+    }
+    return out;
+}
+
+bool transform::inverse(transform &out) const {
+    // the linear part's inverse is its adjugate over its determinant, then the translation is undone by the inverse
+    const real (&a)[3][4] = m;
+    const real c00 = a[1][1] * a[2][2] - a[1][2] * a[2][1];
+    const real c01 = a[1][2] * a[2][0] - a[1][0] * a[2][2];
+    const real c02 = a[1][0] * a[2][1] - a[1][1] * a[2][0];
+    const real determinant = a[0][0] * c00 + a[0][1] * c01 + a[0][2] * c02;
+    if(determinant == 0 || !std::isfinite(determinant)) return false;
+
+    const real inv = 1 / determinant;
+    transform t{};
+    t.m[0][0] = c00 * inv;
+    t.m[0][1] = (a[0][2] * a[2][1] - a[0][1] * a[2][2]) * inv;
+    t.m[0][2] = (a[0][1] * a[1][2] - a[0][2] * a[1][1]) * inv;
+    t.m[1][0] = c01 * inv;
+    t.m[1][1] = (a[0][0] * a[2][2] - a[0][2] * a[2][0]) * inv;
+    t.m[1][2] = (a[0][2] * a[1][0] - a[0][0] * a[1][2]) * inv;
+    t.m[2][0] = c02 * inv;
+    t.m[2][1] = (a[0][1] * a[2][0] - a[0][0] * a[2][1]) * inv;
+    t.m[2][2] = (a[0][0] * a[1][1] - a[0][1] * a[1][0]) * inv;
+    for(int r = 0; r < 3; r++)
+        t.m[r][3] = -(t.m[r][0] * a[0][3] + t.m[r][1] * a[1][3] + t.m[r][2] * a[2][3]);
+
+    out = t;
+    return true;
+}
+
+#endif // TRANSFORM_H
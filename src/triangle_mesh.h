@@ -0,0 +1,305 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include <cmath>
+#include <vector>
+
+#include "bvh.h"
+#include "hittable.h"
+#include "material.h"
+#include "transform.h"
+
+// a mesh of triangles sharing one vertex buffer, each triangle is just three indices into it (and three more into each
+// of the normals and texture coordinates, if the mesh has them), so a vertex shared by six triangles is stored once
+// rather than six times - like the sphere store, the triangles are reordered to match the leaves of a bvh_tree over
+// them once it's built, so a leaf is a contiguous run of the index buffer
+//
+// a mesh is in its own object space, with no material, it's placed in a scene (as many times as wanted) by
+// mesh_instances, which give it a transform and a material
+class triangle_mesh : public hittable {
+public:
+    triangle_mesh() = default;
+
+    int add_vertex(const point3 &p);
+    int add_normal(const vec3 &n);
+    int add_texcoord(real u, real v);
+
+    // vertex indices a, b, c counter clockwise seen from the front, and optionally the normal at each (which are
+    // interpolated across it, for a smooth surface), or -1 for a flat triangle, and the texture coordinates at each,
+    // or -1 for the hit's barycentric coordinates instead
+    void add_triangle(int a, int b, int c, int na = -1, int nb = -1, int nc = -1, int ta = -1, int tb = -1,
+                      int tc = -1);
+
+    // builds the tree over every triangle, which hit needs
+    void build();
+
+    size_t size() const { return indices.size() / 3; }
+    size_t memory_bytes() const; // of the buffers and tree, as built
+
+    // leaves mat_ptr null, for the instance that was hit to fill in, and light the index of the triangle hit
+    bool hit(const ray &r, real t_min, real t_max, hit_record &rec) const override;
+    bool occluded(const ray &r, real t_min, real t_max) const override;
+    bool bounding_box(aabb &output_box) const override;
+public:
+    std::vector<point3> vertices{};
+    std::vector<vec3> normals{};
+    std::vector<int> indices{}; // 3 vertex indices per triangle
+    std::vector<int> normal_indices{}; // 3 per triangle (-1 for none), or empty if no triangle has normals
+    std::vector<real> texcoords{}; // u then v, 2 per texture coordinate
+    std::vector<int> texcoord_indices{}; // 3 per triangle (-1 for none), or empty if no triangle has them
+    bvh_tree tree{};
+private:
+    aabb box(size_t triangle) const;
+
+    // the closest of the triangles [first, first + count) that r hits in [t_min, t_max], shrinking t_max to its t
+    bool hit_range(const ray &r, real t_min, real &t_max, int first, int count, int &hit_idx, real &hit_u,
+                   real &hit_v) const;
+};
+
+// Moller-Trumbore, where r meets the triangle v0 v1 v2, with u and v the barycentric weights of v1 and v2 there,
+// solving for t, u and v together with Cramer's rule, with nothing precomputed per triangle
+inline bool hit_triangle(const point3 &v0, const point3 &v1, const point3 &v2, const ray &r, real t_min,
+                         real t_max, real &t, real &u, real &v){
+    const vec3 edge1 = v1 - v0;
+    const vec3 edge2 = v2 - v0;
+    const vec3 p = cross(r.direction(), edge2);
+    const real inv_determinant = 1 / dot(edge1, p); // infinite for a ray in the triangle's plane, caught below
+
+    const vec3 s = r.origin() - v0;
+    u = dot(s, p) * inv_determinant;
+    if(!(u >= 0 && u <= 1)) return false; // written so a NaN fails too
+
+    const vec3 q = cross(s, edge1);
+    v = dot(r.direction(), q) * inv_determinant;
+    if(!(v >= 0 && u + v <= 1)) return false;
+
+    t = dot(edge2, q) * inv_determinant;
+    return t >= t_min && t <= t_max;
+}
+
+int triangle_mesh::add_vertex(const point3 &p) {
+    vertices.push_back(p);
+    return static_cast<int>(vertices.size()) - 1;
+}
+
+int triangle_mesh::add_normal(const vec3 &n) {
+    normals.push_back(n);
+    return static_cast<int>(normals.size()) - 1;
+}
+
+int triangle_mesh::add_texcoord(real u, real v) {
+    texcoords.push_back(u);
+    texcoords.push_back(v);
+    return static_cast<int>(texcoords.size() / 2) - 1;
+}
+
+void triangle_mesh::add_triangle(int a, int b, int c, int na, int nb, int nc, int ta, int tb, int tc) {
+    if(na >= 0 && normal_indices.empty()) normal_indices.assign(indices.size(), -1); // the first with normals
+    if(ta >= 0 && texcoord_indices.empty()) texcoord_indices.assign(indices.size(), -1);
+    indices.push_back(a);
+    indices.push_back(b);
+    indices.push_back(c);
+    if(!normal_indices.empty()){
+        normal_indices.push_back(na);
+        normal_indices.push_back(nb);
+        normal_indices.push_back(nc);
+    }
+    if(!texcoord_indices.empty()){
+        texcoord_indices.push_back(ta);
+        texcoord_indices.push_back(tb);
+        texcoord_indices.push_back(tc);
+    }
+    tree = bvh_tree{};
+}
+
+aabb triangle_mesh::box(size_t triangle) const {
+    aabb b{};
+    for(int corner = 0; corner < 3; corner++)
+        b.expand(vertices[indices[3 * triangle + corner]]);
+    return b;
+}
+
+void triangle_mesh::build() {
+    const size_t count = size();
+    {
+        std::vector<aabb> boxes(count);
+        for(size_t i = 0; i < count; i++)
+            boxes[i] = box(i);
+
+        // leaves of 4 to 8 triangles, a leaf's triangles are contiguous, and testing a few more of them costs less
+        // than visiting (and keeping) the extra nodes smaller leaves would need - about half the memory and a little
+        // faster than leaves of 1 or 2
+        tree.build(boxes, 8, 4);
+    }
+
+    // the triangles are put in leaf order three indices at a time, after which the tree's own indices aren't needed
+    auto reorder_triangles = [&](std::vector<int> &values){
+        if(values.empty()) return;
+        std::vector<int> old_values(values);
+        for(size_t i = 0; i < count; i++)
+            for(int corner = 0; corner < 3; corner++)
+                values[3 * i + corner] = old_values[3 * tree.indices[i] + corner];
+    };
+    reorder_triangles(indices);
+    reorder_triangles(normal_indices);
+    reorder_triangles(texcoord_indices);
+    std::vector<int>().swap(tree.indices);
+    tree.nodes.shrink_to_fit(); // build reserves for the smallest leaves possible
+}
+
+size_t triangle_mesh::memory_bytes() const {
+    return vertices.capacity() * sizeof(point3) + normals.capacity() * sizeof(vec3)
+           + texcoords.capacity() * sizeof(real)
+           + (indices.capacity() + normal_indices.capacity() + texcoord_indices.capacity() + tree.indices.capacity())
+             * sizeof(int)
+           + tree.nodes.capacity() * sizeof(bvh_flat_node);
+}
+
+bool triangle_mesh::hit_range(const ray &r, real t_min, real &t_max, int first, int count, int &hit_idx,
+                              real &hit_u, real &hit_v) const {
+    bool hit_anything = false;
+    for(int i = first; i < first + count; i++){
+        const int *corners = &indices[3 * i];
+        real t, u, v;
+        if(hit_triangle(vertices[corners[0]], vertices[corners[1]], vertices[corners[2]], r, t_min, t_max, t, u, v)){
+            hit_anything = true;
+            t_max = t;
+            hit_idx = i;
+            hit_u = u;
+            hit_v = v;
+        }
+    }
+    return hit_anything;
+}
+
+bool triangle_mesh::hit(const ray &r, real t_min, real t_max, hit_record &rec) const {
+    int hit_idx = -1;
+    real closest = t_max, u = 0, v = 0;
+    tree.traverse(r, t_min, t_max, [&](int first, int count, real &closest_so_far){
+        if(!hit_range(r, t_min, closest_so_far, first, count, hit_idx, u, v)) return false;
+        closest = closest_so_far;
+        return true;
+    });
+    if(hit_idx < 0) return false;
+
+    // as with spheres, the hit record is only filled in for the triangle that ended up closest
+    const int *corners = &indices[3 * hit_idx];
+    const point3 &v0 = vertices[corners[0]];
+    const vec3 face_normal = cross(vertices[corners[1]] - v0, vertices[corners[2]] - v0);
+    rec.t = closest;
+    rec.p = r.at(closest);
+    rec.mat_ptr = nullptr;
+    rec.light = hit_idx;
+    rec.set_face_normal(r, unit_vector(face_normal));
+
+    // the texture coordinates are interpolated the same way, and how far they go over the triangle's width is the
+    // square root of its area in them over its area in space (twice each, which cancels)
+    const int *texcoord_corners = texcoord_indices.empty() ? nullptr : &texcoord_indices[3 * hit_idx];
+    if(texcoord_corners && texcoord_corners[0] >= 0 && texcoord_corners[1] >= 0 && texcoord_corners[2] >= 0){
+        const real *t0 = &texcoords[2 * texcoord_corners[0]];
+        const real *t1 = &texcoords[2 * texcoord_corners[1]];
+        const real *t2 = &texcoords[2 * texcoord_corners[2]];
+        rec.u = (1 - u - v) * t0[0] + u * t1[0] + v * t2[0];
+        rec.v = (1 - u - v) * t0[1] + u * t1[1] + v * t2[1];
+        const real uv_area = std::fabs((t1[0] - t0[0]) * (t2[1] - t0[1]) - (t2[0] - t0[0]) * (t1[1] - t0[1]));
+        rec.uv_scale = std::sqrt(uv_area / face_normal.length());
+    }else{
+        rec.u = u;
+        rec.v = v;
+        rec.uv_scale = 1 / std::sqrt(face_normal.length());
+    }
+
+    // which side was hit comes from the triangle's own normal, the interpolated one only changes the shading
+    if(!normal_indices.empty()){
+        const int *normal_corners = &normal_indices[3 * hit_idx];
+        if(normal_corners[0] >= 0 && normal_corners[1] >= 0 && normal_corners[2] >= 0){
+            const vec3 shading = unit_vector((1 - u - v) * normals[normal_corners[0]] + u * normals[normal_corners[1]]
+                                             + v * normals[normal_corners[2]]);
+            rec.normal = rec.front_face ? shading : -shading;
+        }
+    }
+    return true;
+}
+
+bool triangle_mesh::occluded(const ray &r, real t_min, real t_max) const {
+    return tree.traverse_any(r, t_min, t_max, [&](int first, int count){
+        real closest = t_max, u, v;
+        int hit_idx;
+        return hit_range(r, t_min, closest, first, count, hit_idx, u, v);
+    });
+}
+
+bool triangle_mesh::bounding_box(aabb &output_box) const {
+    if(tree.nodes.empty()) return false;
+    output_box = tree.bounds();
+    return true;
+}
+
+// a mesh placed in a scene, the ray is taken into the mesh's object space rather than the mesh into world space, so
+// any number of instances share one mesh and its tree - the direction isn't normalised after transforming, so t means
+// the same distance along the ray in both spaces and hits from different instances compare directly
+//
+// it holds no more than a ray needs to reach the mesh, since a scene can have a great many of them, the transform into
+// the mesh's space, the mesh, and indices into the scene's tables - the transform back out to the world and the box
+// around it there are worked out from that when they're wanted, which is only while building
+class mesh_instance {
+public:
+    mesh_instance() = default;
+    mesh_instance(const triangle_mesh *mesh, const transform &to_world, int material_idx);
+
+    // the inverse of to_object
+    transform to_world() const;
+
+    // the box around it in world space, from the mesh's tree, which has to have been built
+    aabb world_box() const;
+    static aabb world_box(const triangle_mesh &mesh, const transform &to_world);
+
+    // the hit record's material is left for the scene to fill in, from material_idx, once it's found the closest hit
+    bool hit(const ray &r, real t_min, real t_max, hit_record &rec) const;
+    bool occluded(const ray &r, real t_min, real t_max) const;
+public:
+    transform to_object{};
+    const triangle_mesh *mesh{}; // owned by the scene
+    int material_idx{}; // in the scene's material table
+    int first_light{-1}; // with an emissive material, the light its first triangle is in the scene's light_list
+};
+
+mesh_instance::mesh_instance(const triangle_mesh *mesh, const transform &to_world, int material_idx)
+    : mesh(mesh), material_idx(material_idx) {
+    to_world.inverse(to_object); // the scene checks it's invertible first
+}
+
+transform mesh_instance::to_world() const {
+    transform out{};
+    to_object.inverse(out);
+    return out;
+}
+
+aabb mesh_instance::world_box(const triangle_mesh &mesh, const transform &to_world) {
+    aabb object_box{};
+    return mesh.bounding_box(object_box) ? to_world.apply_box(object_box) : aabb{};
+}
+
+aabb mesh_instance::world_box() const {
+    return world_box(*mesh, to_world());
+}
+
+bool mesh_instance::hit(const ray &r, real t_min, real t_max, hit_record &rec) const {
+    const ray object_ray(to_object.apply_point(r.origin()), to_object.apply_vector(r.direction()), r.time());
+    if(!mesh->hit(object_ray, t_min, t_max, rec)) return false;
+
+    // an affine transform keeps the sign of dot(direction, normal), so front_face holds in world space too
+    rec.p = r.at(rec.t);
+    rec.normal = unit_vector(to_object.apply_normal_of_inverse(rec.normal));
+    // a unit of distance along the ray in object space is this much in world space
+    rec.uv_scale *= std::sqrt(object_ray.direction().length_squared() / r.direction().length_squared());
+    rec.light = first_light < 0 ? -1 : first_light + rec.light;
+    return true;
+}
+
+bool mesh_instance::occluded(const ray &r, real t_min, real t_max) const {
+    const ray object_ray(to_object.apply_point(r.origin()), to_object.apply_vector(r.direction()), r.time());
+    return mesh->occluded(object_ray, t_min, t_max);
+}
+
+#endif // TRIANGLE_MESH_H
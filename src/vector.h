@@ -2,68 +2,126 @@
 #define VECTOR_H
 
 #include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include "real.h"
 
 class vec3;
 using point3 = vec3;
 using colour = vec3;
 
+#if defined(RT_VEC3_SIMD)
+// padded doubles are 32 bytes, which without AVX GCC passes differently, it notes that at every function returning
+// one, but these are all inline, so there's no ABI to keep
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+// with RT_VEC3_SIMD (meson configure -Dvec3_simd=true) a vec3 is padded to 4 components, the last always 0, which
+// are worked on together as a GCC vector type, the compiler turns that into SSE, AVX or NEON instructions, whichever
+// the build targets, or into plain scalar code where there are none
+typedef real vec3_lanes __attribute__((vector_size(4 * sizeof(real))));
+#endif
+
 class vec3 {
 public:
-    double vec[3]{};
+#if defined(RT_VEC3_SIMD)
+    alignas(16) real vec[4]{}; // only 16 byte aligned, since that's all operator new promises before C++17
+#else
+    real vec[3]{};
+#endif
 public:
     vec3() {}
-    vec3(double i, double j, double k){
+    vec3(real i, real j, real k){
         vec[0] = i;
         vec[1] = j;
         vec[2] = k;
     }
 
-    double operator[](int idx) const { return vec[idx]; }
-    double &operator[](int idx) { return vec[idx]; }
-    vec3 operator-() const { return { -vec[0], -vec[1], -vec[2] }; }
+    real operator[](int idx) const { return vec[idx]; }
+    real &operator[](int idx) { return vec[idx]; }
+    vec3 operator-() const {
+#if defined(RT_VEC3_SIMD)
+        return from_lanes(-lanes());
+#else
+        return { -vec[0], -vec[1], -vec[2] };
+#endif
+    }
 
-    double x() { return vec[0]; }
-    double y() { return vec[1]; }
-    double z() { return vec[2]; }
+    real x() const { return vec[0]; }
+    real y() const { return vec[1]; }
+    real z() const { return vec[2]; }
 
     vec3 &operator+=(const vec3 &v){
+#if defined(RT_VEC3_SIMD)
+        *this = from_lanes(lanes() + v.lanes());
+#else
         vec[0] += v.vec[0];
         vec[1] += v.vec[1];
         vec[2] += v.vec[2];
+#endif
         return *this;
     }
 
-    vec3 &operator*=(const double s){
+    vec3 &operator*=(const real s){
+#if defined(RT_VEC3_SIMD)
+        *this = from_lanes(lanes() * s);
+#else
         vec[0] *= s;
         vec[1] *= s;
         vec[2] *= s;
+#endif
         return *this;
     }
 
-    vec3 &operator/=(const double s){
+    vec3 &operator/=(const real s){
         return *this *= (1/s);
     }
 
-    double length_squared() const {
+    real length_squared() const {
+#if defined(RT_VEC3_SIMD)
+        const vec3_lanes squares = lanes() * lanes();
+        return squares[0] + squares[1] + squares[2];
+#else
         return vec[0]*vec[0] + vec[1]*vec[1] + vec[2]*vec[2];
+#endif
     }
 
-    double length() const {
-        return sqrt(length_squared());
+    real length() const {
+        return std::sqrt(length_squared());
     }
 
-    inline static vec3 random(){
-        return { random_double(), random_double(), random_double() };
+    // the components are drawn into locals first, since unlike a braced list, a call's arguments can be evaluated in
+    // any order
+    inline static vec3 random(sampler &s){
+        const double x = random_double(s), y = random_double(s), z = random_double(s);
+        return vec3(x, y, z);
     }
 
-    inline static vec3 random(double min, double max){
-        return { random_double(min, max), random_double(min, max), random_double(min, max) };
+    inline static vec3 random(sampler &s, double min, double max){
+        const double x = random_double(s, min, max), y = random_double(s, min, max), z = random_double(s, min, max);
+        return vec3(x, y, z);
     }
 
     bool near_zero() const{
-        const auto s = 1e-8; // threshold to be considered near zero
-        return (fabs(vec[0]) < s) && (fabs(vec[1]) < s) && (fabs(vec[2]) < s); // return true if close to zero
+        const real s = near_zero_epsilon; // threshold to be considered near zero
+        return (std::fabs(vec[0]) < s) && (std::fabs(vec[1]) < s) && (std::fabs(vec[2]) < s); // return true if close to zero
+    }
+
+#if defined(RT_VEC3_SIMD)
+    // copied in and out with memcpy, which compiles down to a single load or store
+    vec3_lanes lanes() const {
+        vec3_lanes l;
+        std::memcpy(&l, vec, sizeof(l));
+        return l;
+    }
+
+    static vec3 from_lanes(const vec3_lanes &l){
+        vec3 v;
+        std::memcpy(v.vec, &l, sizeof(l));
+        return v;
     }
+#endif
 };
 
 inline std::ostream &operator<<(std::ostream &out, const vec3 &u){
@@ -71,27 +129,48 @@ inline std::ostream &operator<<(std::ostream &out, const vec3 &u){
 }
 
 inline vec3 operator-(const vec3 &u, const vec3 &v){
+#if defined(RT_VEC3_SIMD)
+    return vec3::from_lanes(u.lanes() - v.lanes());
+#else
     return { u[0]-v[0], u[1]-v[1], u[2]-v[2] };
+#endif
 }
 
 inline vec3 operator+(const vec3 &u, const vec3 &v){
+#if defined(RT_VEC3_SIMD)
+    return vec3::from_lanes(u.lanes() + v.lanes());
+#else
     return { u[0]+v[0], u[1]+v[1], u[2]+v[2] };
+#endif
 }
 
-inline vec3 operator*(const vec3 &u, double scalar){
+inline vec3 operator*(const vec3 &u, real scalar){
+#if defined(RT_VEC3_SIMD)
+    return vec3::from_lanes(u.lanes() * scalar);
+#else
     return { u[0]*scalar, u[1]*scalar, u[2]*scalar };
+#endif
 }
 
-inline vec3 operator*(double scalar, const vec3 &u){
-    return { u[0]*scalar, u[1]*scalar, u[2]*scalar };
+inline vec3 operator*(real scalar, const vec3 &u){
+    return u * scalar;
 }
 
-inline vec3 operator/(const vec3 &u, double scalar){
+inline vec3 operator/(const vec3 &u, real scalar){
+#if defined(RT_VEC3_SIMD)
+    return vec3::from_lanes(u.lanes() / scalar); // the padding lane becomes 0/0, which nothing reads
+#else
     return { u[0]/scalar, u[1]/scalar, u[2]/scalar };
+#endif
 }
 
-inline double dot(const vec3 &u, const vec3 &v){
+inline real dot(const vec3 &u, const vec3 &v){
+#if defined(RT_VEC3_SIMD)
+    const vec3_lanes products = u.lanes() * v.lanes();
+    return products[0] + products[1] + products[2]; // summed in the same order as the scalar version
+#else
     return u[0]*v[0] + u[1]*v[1] + u[2]*v[2];
+#endif
 }
 
 inline vec3 cross(const vec3 &u, const vec3 &v){
@@ -103,7 +182,11 @@ inline vec3 cross(const vec3 &u, const vec3 &v){
 }
 
 inline vec3 operator*(const vec3 &u, const vec3 &v){
+#if defined(RT_VEC3_SIMD)
+    return vec3::from_lanes(u.lanes() * v.lanes());
+#else
     return { u.vec[0]*v.vec[0], u.vec[1]*v.vec[1], u.vec[2]*v.vec[2] };
+#endif
     // Hadamard product - element wise multiplication
 }
 
@@ -111,38 +194,13 @@ inline vec3 unit_vector(const vec3 &u){
     return u/u.length();
 }
 
-inline vec3 random_in_unit_sphere(){
-    // this has a distribution scaled by cos^3(phi), not Lambertian reflectance
-    while(true){
-        auto point = vec3::random(-1, 1);
-        if(point.length_squared() >= 1) continue;
-        return point;
-    }
-}
-
-inline vec3 random_unit_vector(){
-    return unit_vector(vec3::random(-1, 1));
-    // normalising, rather than picking points over and over until you pick a point in a unit sphere
-    // yields Lambertian reflection, using the Lambertian distribution (random distribution scaled by cos(phi),
-    // rather than by cos^3(phi) )
-}
-
-inline vec3 random_in_hemisphere(const vec3 &normal){
-    vec3 point_in_unit_sphere = random_in_unit_sphere();
-    if(dot(normal, point_in_unit_sphere) > 0){
-        return point_in_unit_sphere;
-    }else{
-        return -point_in_unit_sphere;
-    }
-}
-
 inline vec3 reflect(const vec3 &v, const vec3 &normal){
     return v + 2 * dot(-v, normal) * normal;
     // add 2x the projection of -v onto the normal to get the reflected ray
     // equivalent to rotating however 2x incidence angle clockwise about point of intersection of ray
 }
 
-inline vec3 refract(const vec3 &uv, const vec3 &n, double eta_i_over_eta_t){
+inline vec3 refract(const vec3 &uv, const vec3 &n, real eta_i_over_eta_t){
     // https://graphics.stanford.edu/courses/cs148-10-summer/docs/2006--degreve--reflection_refraction.pdf
     // perp/parallel to the normal, magnitude of all vectors is 1
     // diagram used for the derivation is the same as in the pdf linked above
@@ -154,7 +212,7 @@ inline vec3 refract(const vec3 &uv, const vec3 &n, double eta_i_over_eta_t){
     // r_incident_perp = r_incident - dot(-r_incident, normal) * ( -normal ) - to get the bit perpendicular to the normal
     // so r_incident_perp = r_incident + cos(theta_i)*normal
     // so r_out_perp = n1/n2*(r_incident + cos(theta_i)*normal)
-    auto cos_theta_i = fmin(dot(-uv, n), 1.0); // uv and normal are in opposite directions, so incident angle is with -uv
+    auto cos_theta_i = std::fmin(dot(-uv, n), real(1)); // uv and normal are in opposite directions, so incident angle is with -uv
     vec3 r_out_perp = eta_i_over_eta_t * (uv + cos_theta_i*n); // perpendicular component of refracted ray
     // |r_out|^2 = |r_out_perp|^2 + |r_out_parallel|^2
     // 1 = |r_out_perp|^2 + |r_out_parallel|^2
@@ -164,16 +222,12 @@ inline vec3 refract(const vec3 &uv, const vec3 &n, double eta_i_over_eta_t){
     // r_out_parallel = -sqrt(1 - |r_out_perp|^2)*normal
     // --> since the normal was of magnitude 1 and parallel to r_out_parallel, multiplying the magnitude of
     //     r_out_parallel by it, simply made it into the r_out_parallel vector
-    vec3 r_out_parallel = -sqrt(fabs(1.0 - r_out_perp.length_squared())) * n;
+    vec3 r_out_parallel = -std::sqrt(std::fabs(1 - r_out_perp.length_squared())) * n;
     return r_out_perp + r_out_parallel; // the final refracted ray
 }
 
-inline vec3 random_in_unit_disk() {
-    while(true) {
-        auto p = vec3(random_double(-1, 1), random_double(-1, 1), 0); // disk at z = 0
-        if(p.length_squared() >= 1) continue; // must be in the unit sphere
-        return p;
-    }
-}
+#if defined(RT_VEC3_SIMD)
+#pragma GCC diagnostic pop
+#endif
 
 #endif //VECTOR_H